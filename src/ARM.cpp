@@ -17,11 +17,13 @@
 */
 
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 #include <algorithm>
 #include "NDS.h"
 #include "DSi.h"
 #include "ARM.h"
+#include "ARM_InstrInfo.h"
 #include "ARMInterpreter.h"
 #include "AREngine.h"
 #include "ARMJIT.h"
@@ -116,7 +118,7 @@ ARM::ARM(u32 num, bool jit, std::optional<GDBArgs> gdb, melonDS::NDS& nds) :
 {
 #ifdef GDBSTUB_ENABLED
     if (gdb
-#ifdef JIT_ENABLED
+#ifdef CACHED_INTERPRETER_ENABLED
             && !jit // TODO: Should we support toggling the GdbStub without destroying the ARM?
 #endif
     )
@@ -179,7 +181,7 @@ void ARM::Reset()
 
     CodeMem.Mem = NULL;
 
-#ifdef JIT_ENABLED
+#ifdef CACHED_INTERPRETER_ENABLED
     FastBlockLookup = NULL;
     FastBlockLookupStart = 0;
     FastBlockLookupSize = 0;
@@ -222,7 +224,7 @@ void ARM::DoSavestate(Savestate* file)
     file->VarArray(R_IRQ, 3*sizeof(u32));
     file->VarArray(R_UND, 3*sizeof(u32));
     file->Var32(&CurInstr);
-#ifdef JIT_ENABLED
+#ifdef CACHED_INTERPRETER_ENABLED
     if (file->Saving && NDS.IsJITEnabled())
     {
         // hack, the JIT doesn't really pipeline
@@ -670,7 +672,7 @@ void ARMv5::Execute()
         Halted = 0;
 }
 
-#ifdef JIT_ENABLED
+#ifdef CACHED_INTERPRETER_ENABLED
 void ARMv5::ExecuteJIT()
 {
     if (Halted)
@@ -706,8 +708,12 @@ void ARMv5::ExecuteJIT()
 
         JitBlockEntry block = NDS.JIT.LookUpBlock(0, FastBlockLookup,
             instrAddr - FastBlockLookupStart, instrAddr);
-        if (block)
+        if (block && NDS.JIT.CachedInterpreterEnabled())
+            NDS.JIT.RunCachedBlock(this, block);
+#ifdef JIT_ENABLED
+        else if (block)
             ARM_Dispatch(this, block);
+#endif
         else
             NDS.JIT.CompileBlock(this);
 
@@ -763,12 +769,14 @@ void ARMv4::Execute()
 
     while (NDS.ARM7Timestamp < NDS.ARM7Target)
     {
+        u32 pc;
         if (CPSR & 0x20) // THUMB
         {
             GdbCheckC();
 
             // prefetch
             R[15] += 2;
+            pc = R[15];
             CurInstr = NextInstr[0];
             NextInstr[0] = NextInstr[1];
             NextInstr[1] = CodeRead16(R[15]);
@@ -783,6 +791,7 @@ void ARMv4::Execute()
 
             // prefetch
             R[15] += 4;
+            pc = R[15];
             CurInstr = NextInstr[0];
             NextInstr[0] = NextInstr[1];
             NextInstr[1] = CodeRead32(R[15]);
@@ -812,6 +821,17 @@ void ARMv4::Execute()
                 TriggerIRQ();
         }*/
         if (IRQ) TriggerIRQ();
+        else if (R[15] < pc && IdleLoopSkip)
+        {
+            // nothing is going to change until the next event
+            u32 step = (CPSR & 0x20) ? 2 : 4;
+            if (IsIdleLoop(pc - 2*step, R[15] - step))
+            {
+                Cycles = 0;
+                NDS.ARM7Timestamp = NDS.ARM7Target;
+                break;
+            }
+        }
 
         NDS.ARM7Timestamp += Cycles;
         Cycles = 0;
@@ -829,7 +849,56 @@ void ARMv4::Execute()
     }
 }
 
-#ifdef JIT_ENABLED
+bool ARMv4::IsIdleLoop(u32 branchaddr, u32 target)
+{
+    bool thumb = CPSR & 0x20;
+    u32 size = branchaddr - target + (thumb ? 2 : 4);
+    if (target > branchaddr || size > sizeof(IdleLoopEntry::Code))
+        return false;
+
+    // only loops in memory which can be compared to what was checked before
+    const u8* code;
+    if (branchaddr < ARM7BIOSSize)
+        code = &NDS.GetARM7BIOS()[target];
+    else if (branchaddr < MemPages::End && !((target ^ branchaddr) >> MemPages::Shift)
+        && NDS.ARM7Pages.Read[target >> MemPages::Shift])
+        code = &NDS.ARM7Pages.Read[target >> MemPages::Shift][target & (MemPages::Size - 1)];
+    else
+        return false;
+
+    IdleLoopEntry& entry = IdleLoops[(branchaddr >> 1) & (IdleLoopCacheSize - 1)];
+    if (entry.Addr == (branchaddr | thumb) && entry.Size == size && !memcmp(entry.Code, code, size))
+        return entry.Idle;
+
+    entry.Addr = branchaddr | thumb;
+    entry.Size = size;
+    memcpy(entry.Code, code, size);
+
+    // the loop has to be closed by a plain branch to its start,
+    // otherwise the branch taken might have been something else
+    u32 count = size / (thumb ? 2 : 4);
+    u32 branch = thumb ? *(u16*)&code[size - 2] : *(u32*)&code[size - 4];
+    ARMInstrInfo::Info instrs[sizeof(IdleLoopEntry::Code) / 2] {};
+    for (u32 i = 0; i < count; i++)
+    {
+        u32 instr = thumb ? *(u16*)&code[i * 2] : *(u32*)&code[i * 4];
+        instrs[i] = ARMInstrInfo::Decode(thumb, 1, instr, false);
+    }
+
+    u32 kind = instrs[count - 1].Kind;
+    u32 branchtarget = ~0U;
+    if (!thumb && kind == ARMInstrInfo::ak_B)
+        branchtarget = branchaddr + 8 + ((s32)(branch << 8) >> 6);
+    else if (thumb && kind == ARMInstrInfo::tk_BCOND)
+        branchtarget = branchaddr + 4 + ((s32)(branch << 24) >> 23);
+    else if (thumb && kind == ARMInstrInfo::tk_B)
+        branchtarget = branchaddr + 4 + ((s32)(branch << 21) >> 20);
+
+    entry.Idle = branchtarget == target && ARMInstrInfo::IsIdleLoop(thumb, instrs, count);
+    return entry.Idle;
+}
+
+#ifdef CACHED_INTERPRETER_ENABLED
 void ARMv4::ExecuteJIT()
 {
     if (Halted)
@@ -865,8 +934,12 @@ void ARMv4::ExecuteJIT()
 
         JitBlockEntry block = NDS.JIT.LookUpBlock(1, FastBlockLookup,
             instrAddr - FastBlockLookupStart, instrAddr);
-        if (block)
+        if (block && NDS.JIT.CachedInterpreterEnabled())
+            NDS.JIT.RunCachedBlock(this, block);
+#ifdef JIT_ENABLED
+        else if (block)
             ARM_Dispatch(this, block);
+#endif
         else
             NDS.JIT.CompileBlock(this);
 
@@ -1283,62 +1356,62 @@ void ARMv4::AddCycles_CD()
 
 u8 ARMv5::BusRead8(u32 addr)
 {
-    return NDS.ARM9Read8(addr);
+    return NDS.ARM9Read<u8>(addr);
 }
 
 u16 ARMv5::BusRead16(u32 addr)
 {
-    return NDS.ARM9Read16(addr);
+    return NDS.ARM9Read<u16>(addr);
 }
 
 u32 ARMv5::BusRead32(u32 addr)
 {
-    return NDS.ARM9Read32(addr);
+    return NDS.ARM9Read<u32>(addr);
 }
 
 void ARMv5::BusWrite8(u32 addr, u8 val)
 {
-    NDS.ARM9Write8(addr, val);
+    NDS.ARM9Write<u8>(addr, val);
 }
 
 void ARMv5::BusWrite16(u32 addr, u16 val)
 {
-    NDS.ARM9Write16(addr, val);
+    NDS.ARM9Write<u16>(addr, val);
 }
 
 void ARMv5::BusWrite32(u32 addr, u32 val)
 {
-    NDS.ARM9Write32(addr, val);
+    NDS.ARM9Write<u32>(addr, val);
 }
 
 u8 ARMv4::BusRead8(u32 addr)
 {
-    return NDS.ARM7Read8(addr);
+    return NDS.ARM7Read<u8>(addr);
 }
 
 u16 ARMv4::BusRead16(u32 addr)
 {
-    return NDS.ARM7Read16(addr);
+    return NDS.ARM7Read<u16>(addr);
 }
 
 u32 ARMv4::BusRead32(u32 addr)
 {
-    return NDS.ARM7Read32(addr);
+    return NDS.ARM7Read<u32>(addr);
 }
 
 void ARMv4::BusWrite8(u32 addr, u8 val)
 {
-    NDS.ARM7Write8(addr, val);
+    NDS.ARM7Write<u8>(addr, val);
 }
 
 void ARMv4::BusWrite16(u32 addr, u16 val)
 {
-    NDS.ARM7Write16(addr, val);
+    NDS.ARM7Write<u16>(addr, val);
 }
 
 void ARMv4::BusWrite32(u32 addr, u32 val)
 {
-    NDS.ARM7Write32(addr, val);
+    NDS.ARM7Write<u32>(addr, val);
 }
 }
 
@@ -76,7 +76,7 @@ public:
 
     void NocashPrint(u32 addr) noexcept;
     virtual void Execute() = 0;
-#ifdef JIT_ENABLED
+#ifdef CACHED_INTERPRETER_ENABLED
     virtual void ExecuteJIT() = 0;
 #endif
 
@@ -178,7 +178,7 @@ public:
 
     MemRegion CodeMem;
 
-#ifdef JIT_ENABLED
+#ifdef CACHED_INTERPRETER_ENABLED
     u32 FastBlockLookupStart, FastBlockLookupSize;
     u64* FastBlockLookup;
 #endif
@@ -242,12 +242,15 @@ public:
     void DataAbort();
 
     void Execute() override;
-#ifdef JIT_ENABLED
+#ifdef CACHED_INTERPRETER_ENABLED
     void ExecuteJIT() override;
 #endif
 
     // all code accesses are forced nonseq 32bit
     u32 CodeRead32(u32 addr, bool branch);
+    // the CodeCycles a CodeRead32 from a region with the given timing would take,
+    // without doing the read
+    u32 CodeFetchCycles(u32 addr, bool branch, u32 regionCodeCycles) const;
 
     void DataRead8(u32 addr, u32* val) override;
     void DataRead16(u32 addr, u32* val) override;
@@ -384,7 +387,7 @@ public:
     void JumpTo(u32 addr, bool restorecpsr = false) override;
 
     void Execute() override;
-#ifdef JIT_ENABLED
+#ifdef CACHED_INTERPRETER_ENABLED
     void ExecuteJIT() override;
 #endif
 
@@ -410,6 +413,13 @@ public:
     void AddCycles_CI(s32 num) override;
     void AddCycles_CDI() override;
     void AddCycles_CD() override;
+
+    /// Whether the interpreter skips ahead to the next event when the ARM7
+    /// branches back into a loop which can only be left once something
+    /// else happens, like the JIT does with branch optimizations.
+    /// Enabled by default, can be disabled for testing timing accuracy.
+    void SetIdleLoopSkip(bool enable) noexcept { IdleLoopSkip = enable; }
+    [[nodiscard]] bool GetIdleLoopSkip() const noexcept { return IdleLoopSkip; }
 protected:
     u8 BusRead8(u32 addr) override;
     u16 BusRead16(u32 addr) override;
@@ -417,6 +427,21 @@ protected:
     void BusWrite8(u32 addr, u8 val) override;
     void BusWrite16(u32 addr, u16 val) override;
     void BusWrite32(u32 addr, u32 val) override;
+private:
+    bool IsIdleLoop(u32 branchaddr, u32 target);
+
+    // the loops checked most recently, together with their code
+    // so that they're checked again once it changed
+    struct IdleLoopEntry
+    {
+        u32 Addr; // with bit 0 set for THUMB
+        u32 Size;
+        u8 Code[32];
+        bool Idle;
+    };
+    static constexpr u32 IdleLoopCacheSize = 64;
+    IdleLoopEntry IdleLoops[IdleLoopCacheSize] {};
+    bool IdleLoopSkip = true;
 };
 
 namespace ARMInterpreter
@@ -43,16 +43,21 @@
 #include "Wifi.h"
 #include "NDSCart.h"
 #include "Platform.h"
+#include "Savestate.h"
+#ifdef JIT_ENABLED
 #include "ARMJIT_x64/ARMJIT_Offsets.h"
+#endif
 
 namespace melonDS
 {
 using Platform::Log;
 using Platform::LogLevel;
 
+#ifdef JIT_ENABLED
 static_assert(offsetof(ARM, CPSR) == ARM_CPSR_offset, "");
 static_assert(offsetof(ARM, Cycles) == ARM_Cycles_offset, "");
 static_assert(offsetof(ARM, StopExecution) == ARM_StopExecution_offset, "");
+#endif
 
 
 #define JIT_DEBUGPRINT(msg, ...)
@@ -91,6 +96,7 @@ u32 ARMJIT::LocaliseCodeAddress(u32 num, u32 addr) const noexcept
     return 0;
 }
 
+#ifdef JIT_ENABLED
 template <typename T, int ConsoleType>
 T SlowRead9(u32 addr, ARMv5* cpu)
 {
@@ -102,12 +108,8 @@ T SlowRead9(u32 addr, ARMv5* cpu)
         val = *(T*)&cpu->ITCM[addr & 0x7FFF];
     else if ((addr & cpu->DTCMMask) == cpu->DTCMBase)
         val = *(T*)&cpu->DTCM[addr & 0x3FFF];
-    else if (std::is_same<T, u32>::value)
-        val = NDS::Current->ARM9Read32(addr);
-    else if (std::is_same<T, u16>::value)
-        val = NDS::Current->ARM9Read16(addr);
     else
-        val = NDS::Current->ARM9Read8(addr);
+        val = cpu->NDS.ARM9Read<T>(addr);
 
     if (std::is_same<T, u32>::value)
         return ROR(val, offset << 3);
@@ -116,18 +118,12 @@ T SlowRead9(u32 addr, ARMv5* cpu)
 }
 
 template <typename T, int ConsoleType>
-T SlowRead7(u32 addr)
+T SlowRead7(u32 addr, ARMv4* cpu)
 {
     u32 offset = addr & 0x3;
     addr &= ~(sizeof(T) - 1);
 
-    T val;
-    if (std::is_same<T, u32>::value)
-        val = NDS::Current->ARM7Read32(addr);
-    else if (std::is_same<T, u16>::value)
-        val = NDS::Current->ARM7Read16(addr);
-    else
-        val = NDS::Current->ARM7Read8(addr);
+    T val = cpu->NDS.ARM7Read<T>(addr);
 
     if (std::is_same<T, u32>::value)
         return ROR(val, offset << 3);
@@ -149,31 +145,18 @@ void SlowWrite9(u32 addr, ARMv5* cpu, u32 val)
     {
         *(T*)&cpu->DTCM[addr & 0x3FFF] = val;
     }
-    else if (std::is_same<T, u32>::value)
-    {
-        NDS::Current->ARM9Write32(addr, val);
-    }
-    else if (std::is_same<T, u16>::value)
-    {
-        NDS::Current->ARM9Write16(addr, val);
-    }
     else
     {
-        NDS::Current->ARM9Write8(addr, val);
+        cpu->NDS.ARM9Write<T>(addr, val);
     }
 }
 
 template <typename T, int ConsoleType>
-void SlowWrite7(u32 addr, u32 val)
+void SlowWrite7(u32 addr, ARMv4* cpu, u32 val)
 {
     addr &= ~(sizeof(T) - 1);
 
-    if (std::is_same<T, u32>::value)
-        NDS::Current->ARM7Write32(addr, val);
-    else if (std::is_same<T, u16>::value)
-        NDS::Current->ARM7Write16(addr, val);
-    else
-        NDS::Current->ARM7Write8(addr, val);
+    cpu->NDS.ARM7Write<T>(addr, val);
 }
 
 template <bool Write, int ConsoleType>
@@ -191,15 +174,15 @@ void SlowBlockTransfer9(u32 addr, u64* data, u32 num, ARMv5* cpu)
 }
 
 template <bool Write, int ConsoleType>
-void SlowBlockTransfer7(u32 addr, u64* data, u32 num)
+void SlowBlockTransfer7(u32 addr, u64* data, u32 num, ARMv4* cpu)
 {
     addr &= ~0x3;
     for (u32 i = 0; i < num; i++)
     {
         if (Write)
-            SlowWrite7<u32, ConsoleType>(addr, data[i]);
+            SlowWrite7<u32, ConsoleType>(addr, cpu, data[i]);
         else
-            data[i] = SlowRead7<u32, ConsoleType>(addr);
+            data[i] = SlowRead7<u32, ConsoleType>(addr, cpu);
         addr += 4;
     }
 }
@@ -213,24 +196,28 @@ void SlowBlockTransfer7(u32 addr, u64* data, u32 num)
     template u16 SlowRead9<u16, consoleType>(u32, ARMv5*); \
     template u8 SlowRead9<u8, consoleType>(u32, ARMv5*); \
     \
-    template void SlowWrite7<u32, consoleType>(u32, u32); \
-    template void SlowWrite7<u16, consoleType>(u32, u32); \
-    template void SlowWrite7<u8, consoleType>(u32, u32); \
+    template void SlowWrite7<u32, consoleType>(u32, ARMv4*, u32); \
+    template void SlowWrite7<u16, consoleType>(u32, ARMv4*, u32); \
+    template void SlowWrite7<u8, consoleType>(u32, ARMv4*, u32); \
     \
-    template u32 SlowRead7<u32, consoleType>(u32); \
-    template u16 SlowRead7<u16, consoleType>(u32); \
-    template u8 SlowRead7<u8, consoleType>(u32); \
+    template u32 SlowRead7<u32, consoleType>(u32, ARMv4*); \
+    template u16 SlowRead7<u16, consoleType>(u32, ARMv4*); \
+    template u8 SlowRead7<u8, consoleType>(u32, ARMv4*); \
     \
     template void SlowBlockTransfer9<false, consoleType>(u32, u64*, u32, ARMv5*); \
     template void SlowBlockTransfer9<true, consoleType>(u32, u64*, u32, ARMv5*); \
-    template void SlowBlockTransfer7<false, consoleType>(u32 addr, u64* data, u32 num); \
-    template void SlowBlockTransfer7<true, consoleType>(u32 addr, u64* data, u32 num); \
+    template void SlowBlockTransfer7<false, consoleType>(u32, u64*, u32, ARMv4*); \
+    template void SlowBlockTransfer7<true, consoleType>(u32, u64*, u32, ARMv4*); \
 
 INSTANTIATE_SLOWMEM(0)
 INSTANTIATE_SLOWMEM(1)
+#endif
 
 ARMJIT::~ARMJIT() noexcept
 {
+#ifdef JIT_ENABLED
+    StopCompileThread();
+#endif
     JitEnableWrite();
     ResetBlockCache();
 }
@@ -349,37 +336,231 @@ bool DecodeBranch(bool thumb, const FetchedInstr& instr, u32& cond, bool hasLink
     return false;
 }
 
-bool IsIdleLoop(bool thumb, FetchedInstr* instrs, int instrsCount)
+#ifdef JIT_ENABLED
+// only instructions which take a single cycle and don't do
+// anything besides writing their destination register and flags
+bool IsSimpleALUOp(bool thumb, const FetchedInstr& instr)
 {
-    // see https://github.com/dolphin-emu/dolphin/blob/master/Source/Core/Core/PowerPC/PPCAnalyst.cpp#L678
-    // it basically checks if one iteration of a loop depends on another
-    // the rules are quite simple
-
-    JIT_DEBUGPRINT("checking potential idle loop\n");
-    u16 regsWrittenTo = 0;
-    u16 regsDisallowedToWrite = 0;
-    for (int i = 0; i < instrsCount; i++)
+    if (thumb)
     {
-        JIT_DEBUGPRINT("instr %d %08x regs(%x %x) %x %x\n", i, instrs[i].Instr, instrs[i].Info.DstRegs, instrs[i].Info.SrcRegs, regsWrittenTo, regsDisallowedToWrite);
-        if (instrs[i].Info.SpecialKind == ARMInstrInfo::special_WriteMem)
+        switch (instr.Info.Kind)
+        {
+        case ARMInstrInfo::tk_LSL_IMM: case ARMInstrInfo::tk_LSR_IMM: case ARMInstrInfo::tk_ASR_IMM:
+        case ARMInstrInfo::tk_ADD_REG_: case ARMInstrInfo::tk_SUB_REG_:
+        case ARMInstrInfo::tk_ADD_IMM_: case ARMInstrInfo::tk_SUB_IMM_:
+        case ARMInstrInfo::tk_MOV_IMM: case ARMInstrInfo::tk_ADD_IMM: case ARMInstrInfo::tk_SUB_IMM:
+        case ARMInstrInfo::tk_AND_REG: case ARMInstrInfo::tk_EOR_REG: case ARMInstrInfo::tk_ADC_REG:
+        case ARMInstrInfo::tk_SBC_REG: case ARMInstrInfo::tk_NEG_REG: case ARMInstrInfo::tk_ORR_REG:
+        case ARMInstrInfo::tk_BIC_REG: case ARMInstrInfo::tk_MVN_REG:
+        case ARMInstrInfo::tk_ADD_HIREG: case ARMInstrInfo::tk_MOV_HIREG:
+        case ARMInstrInfo::tk_ADD_PCREL: case ARMInstrInfo::tk_ADD_SPREL: case ARMInstrInfo::tk_ADD_SP:
+            return true;
+        default:
             return false;
-        if (!thumb && instrs[i].Info.Kind >= ARMInstrInfo::ak_MSR_IMM && instrs[i].Info.Kind <= ARMInstrInfo::ak_MRC)
+        }
+    }
+
+    // shifts by a register take another cycle
+    return instr.Info.Kind <= ARMInstrInfo::ak_MVN_IMM_S
+        && ((instr.Instr & (1 << 25)) || !(instr.Instr & (1 << 4)));
+}
+
+// the value a simple instruction puts into its destination register,
+// if everything it reads from is known
+bool EvaluateConstant(bool thumb, const FetchedInstr& instr, u16 known, const u32 values[16], u32& result)
+{
+    auto readReg = [&](u32 reg, u32& value)
+    {
+        value = reg == 15 ? instr.Addr + (thumb ? 4 : 8) : values[reg];
+        return reg == 15 || (known & (1 << reg));
+    };
+
+    u32 value;
+    if (thumb)
+    {
+        u32 imm8 = instr.Instr & 0xFF;
+        switch (instr.Info.Kind)
+        {
+        case ARMInstrInfo::tk_MOV_IMM:
+            result = imm8;
+            return true;
+        case ARMInstrInfo::tk_ADD_IMM:
+        case ARMInstrInfo::tk_SUB_IMM:
+            if (!readReg(instr.T_Reg(8), value))
+                return false;
+            result = instr.Info.Kind == ARMInstrInfo::tk_ADD_IMM ? value + imm8 : value - imm8;
+            return true;
+        case ARMInstrInfo::tk_ADD_IMM_:
+        case ARMInstrInfo::tk_SUB_IMM_:
+            if (!readReg(instr.T_Reg(3), value))
+                return false;
+            result = instr.Info.Kind == ARMInstrInfo::tk_ADD_IMM_
+                ? value + instr.T_Reg(6)
+                : value - instr.T_Reg(6);
+            return true;
+        case ARMInstrInfo::tk_LSL_IMM:
+            if (!readReg(instr.T_Reg(3), value))
+                return false;
+            result = value << ((instr.Instr >> 6) & 0x1F);
+            return true;
+        case ARMInstrInfo::tk_ADD_PCREL:
+            result = ((instr.Addr + 4) & ~0x2) + (imm8 << 2);
+            return true;
+        case ARMInstrInfo::tk_MOV_HIREG:
+            return readReg((instr.Instr >> 3) & 0xF, result);
+        default:
             return false;
-        if (i < instrsCount - 1 && instrs[i].Info.Branches())
+        }
+    }
+
+    u32 op = (instr.Instr >> 21) & 0xF;
+    if (!(instr.Instr & (1 << 25)))
+    {
+        // besides immediates only plain moves and shifts to the left
+        if (op != 0xD || ((instr.Instr >> 5) & 0x3) != 0 || !readReg(instr.A_Reg(0), value))
             return false;
+        result = value << ((instr.Instr >> 7) & 0x1F);
+        return true;
+    }
 
-        u16 srcRegs = instrs[i].Info.SrcRegs & ~(1 << 15);
-        u16 dstRegs = instrs[i].Info.DstRegs & ~(1 << 15);
+    u32 imm = ROR(instr.Instr & 0xFF, (instr.Instr >> 7) & 0x1E);
+    if (op == 0xD) // MOV
+    {
+        result = imm;
+        return true;
+    }
+    if (op == 0xF) // MVN
+    {
+        result = ~imm;
+        return true;
+    }
+    if (!readReg(instr.A_Reg(16), value))
+        return false;
+    switch (op)
+    {
+    case 0x0: result = value & imm; return true;
+    case 0x1: result = value ^ imm; return true;
+    case 0x2: result = value - imm; return true;
+    case 0x3: result = imm - value; return true;
+    case 0x4: result = value + imm; return true;
+    case 0xC: result = value | imm; return true;
+    case 0xE: result = value & ~imm; return true;
+    default: return false; // the others need the carry flag
+    }
+}
 
-        regsDisallowedToWrite |= srcRegs & ~regsWrittenTo;
+// instructions which leave the block or after which the same register number
+// might refer to another register, everything written before them is kept
+bool IsRegisterBarrier(bool thumb, const FetchedInstr& instr, const Compiler& compiler)
+{
+    if (instr.Info.Branches() || instr.Info.EndBlock
+        || instr.Info.SpecialKind == ARMInstrInfo::special_WaitForInterrupt
+        || !compiler.CanCompile(thumb, instr.Info.Kind))
+        return true;
+    if (thumb)
+        return instr.Info.Kind == ARMInstrInfo::tk_SVC;
 
-        if (dstRegs & regsDisallowedToWrite)
-            return false;
-        regsWrittenTo |= dstRegs;
+    switch (instr.Info.Kind)
+    {
+    case ARMInstrInfo::ak_MSR_IMM:
+    case ARMInstrInfo::ak_MSR_REG:
+    case ARMInstrInfo::ak_SVC:
+        return true;
+    case ARMInstrInfo::ak_LDM:
+    case ARMInstrInfo::ak_STM:
+        // user mode registers
+        return instr.Instr & (1 << 22);
+    default:
+        return false;
     }
-    return true;
 }
 
+// A few things both compilers can leave out, working on a whole block:
+// instructions whose result is known when compiling only need to put it
+// into their destination register, instructions whose result is overwritten
+// before it's read don't need to be compiled at all, and CPSR doesn't need to be
+// loaded in between two interpreted instructions.
+void SimplifyBlock(bool thumb, FetchedInstr instrs[], int count, const Compiler& compiler, bool constantPropagation)
+{
+    for (int i = 0; i < count; i++)
+        instrs[i].Simplify = 0;
+
+    if (constantPropagation)
+    {
+        u16 known = 0;
+        u32 values[16];
+        for (int i = 0; i < count; i++)
+        {
+            FetchedInstr& instr = instrs[i];
+            u16 dstRegs = instr.Info.DstRegs;
+            bool conditional = !thumb && instr.Cond() < 0xE;
+
+            u32 result, literalAddr;
+            if (!conditional && instr.SetFlags == 0 && dstRegs && !(dstRegs & (dstRegs - 1)) && !instr.Info.Branches()
+                && IsSimpleALUOp(thumb, instr) && EvaluateConstant(thumb, instr, known, values, result))
+            {
+                int reg = __builtin_ctz(dstRegs);
+                known |= dstRegs;
+                values[reg] = result;
+
+                instr.Simplify |= simplify_ConstantResult;
+                instr.ConstantResult = result;
+                instr.Info.SrcRegs = 0;
+            }
+            else if (!conditional && instr.HasLiteral
+                && (instr.Info.Kind == (thumb ? ARMInstrInfo::tk_LDR_PCREL : ARMInstrInfo::ak_LDR_IMM))
+                && DecodeLiteral(thumb, instr, literalAddr))
+            {
+                int reg = thumb ? instr.T_Reg(8) : instr.A_Reg(12);
+                known |= 1 << reg;
+                values[reg] = ROR(instr.Literal, (literalAddr & 0x3) << 3);
+            }
+            else
+            {
+                known &= ~dstRegs;
+            }
+
+            if (IsRegisterBarrier(thumb, instr, compiler))
+                known = 0;
+        }
+    }
+
+    // everything is needed once the block is left
+    u16 live = 0xFFFF;
+    for (int i = count - 1; i >= 0; i--)
+    {
+        FetchedInstr& instr = instrs[i];
+        bool conditional = !thumb && instr.Cond() < 0xE;
+
+        if (IsRegisterBarrier(thumb, instr, compiler))
+        {
+            live = 0xFFFF;
+        }
+        else if (!conditional && instr.SetFlags == 0 && instr.Info.DstRegs && !(instr.Info.DstRegs & live)
+            && IsSimpleALUOp(thumb, instr))
+        {
+            instr.Simplify = simplify_DeadResult;
+            instr.Info.SrcRegs = 0;
+            instr.Info.DstRegs = 0;
+        }
+        else
+        {
+            if (!conditional)
+                live &= ~instr.Info.DstRegs;
+            live |= instr.Info.SrcRegs;
+        }
+    }
+
+    for (int i = 0; i + 1 < count; i++)
+    {
+        if (!compiler.CanCompile(thumb, instrs[i].Info.Kind) && !instrs[i].Info.Branches()
+            && !compiler.CanCompile(thumb, instrs[i + 1].Info.Kind)
+            && (thumb || instrs[i + 1].Cond() >= 0xE))
+            instrs[i].Simplify |= simplify_KeepCPSR;
+    }
+}
+#endif
+
 typedef void (*InterpreterFunc)(ARM* cpu);
 
 void NOP(ARM* cpu) {}
@@ -443,6 +624,7 @@ void T_BL_LONG(ARM* cpu)
 {
     ARMInterpreter::T_BL_LONG_1(cpu);
     cpu->R[15] += 2;
+    cpu->CurInstr >>= 16;
     ARMInterpreter::T_BL_LONG_2(cpu);
 }
 
@@ -467,9 +649,27 @@ InterpreterFunc InterpretTHUMB[ARMInstrInfo::tk_Count] =
 };
 #undef F
 
+// a block can only be restored at the address it was compiled for,
+// so identical blocks at different addresses shouldn't replace each other
+static u32 RestoreCandidateKey(u32 startAddr, u32 instrHash)
+{
+    return instrHash ^ startAddr;
+}
+
 void ARMJIT::RetireJitBlock(JitBlock* block) noexcept
 {
-    auto it = RestoreCandidates.find(block->InstrHash);
+#ifdef JIT_ENABLED
+    if (!block->EntryPoint)
+    {
+        // still waiting to be compiled, there's nothing to restore
+        PendingBlocks.erase(block);
+        delete block;
+        return;
+    }
+#endif
+
+    u32 key = RestoreCandidateKey(block->StartAddr, block->InstrHash);
+    auto it = RestoreCandidates.find(key);
     if (it != RestoreCandidates.end())
     {
         delete it->second;
@@ -477,24 +677,48 @@ void ARMJIT::RetireJitBlock(JitBlock* block) noexcept
     }
     else
     {
-        RestoreCandidates[block->InstrHash] = block;
+        RestoreCandidates[key] = block;
     }
 }
 
 void ARMJIT::SetJITArgs(JITArgs args) noexcept
 {
     args.MaxBlockSize = std::clamp(args.MaxBlockSize, 1u, 32u);
+#ifndef JIT_ENABLED
+    args.CachedInterpreter = true;
+#endif
+    if (args.CachedInterpreter)
+    {
+        args.LiteralOptimizations = false;
+        args.FastMemory = false;
+        args.AsyncCompile = false;
+    }
 
     if (MaxBlockSize != args.MaxBlockSize
         || LiteralOptimizations != args.LiteralOptimizations
         || BranchOptimizations != args.BranchOptimizations
-        || FastMemory != args.FastMemory)
+        || FastMemory != args.FastMemory
+        || CachedInterpreter != args.CachedInterpreter)
         ResetBlockCache();
 
     MaxBlockSize = args.MaxBlockSize;
     LiteralOptimizations = args.LiteralOptimizations;
     BranchOptimizations = args.BranchOptimizations;
     FastMemory = args.FastMemory;
+    CachedInterpreter = args.CachedInterpreter;
+
+#ifdef JIT_ENABLED
+    if (!CachedInterpreter && !JITCompiler)
+        JITCompiler = std::make_unique<Compiler>(NDS);
+
+    SetAsyncCompile(args.AsyncCompile);
+
+    // the compile thread is stopped by now if it was using the compiler
+    if (CachedInterpreter)
+        JITCompiler = nullptr;
+    else
+        CachedCode = nullptr;
+#endif
 }
 
 void ARMJIT::SetMaxBlockSize(int size) noexcept
@@ -531,8 +755,198 @@ void ARMJIT::SetFastMemory(bool enabled) noexcept
     FastMemory = enabled;
 }
 
+#ifdef JIT_ENABLED
+void ARMJIT::SetAsyncCompile(bool enabled) noexcept
+{
+    if (!Compiler::SupportsAsyncCompile || CachedInterpreter)
+        enabled = false;
+
+    if (enabled == (CompileThread != nullptr))
+        return;
+
+    if (!enabled)
+    {
+        StopCompileThread();
+        return;
+    }
+
+    Sema_CompileJobs = Platform::Semaphore_Create();
+    CompileQueueMutex = Platform::Mutex_Create();
+    CompilerMutex = Platform::Mutex_Create();
+    CompileThreadRunning = true;
+    CompileThread = Platform::Thread_Create([this]() { CompileThreadFunc(); });
+}
+
+void ARMJIT::StopCompileThread() noexcept
+{
+    if (!CompileThread)
+        return;
+
+    CompileThreadRunning = false;
+    Platform::Semaphore_Post(Sema_CompileJobs);
+    Platform::Thread_Wait(CompileThread);
+    Platform::Thread_Free(CompileThread);
+    CompileThread = nullptr;
+
+    // whatever is done can still be used, the rest has to be compiled again
+    PublishCompiledBlocks();
+    CancelCompileJobs();
+
+    Platform::Semaphore_Free(Sema_CompileJobs);
+    Platform::Mutex_Free(CompileQueueMutex);
+    Platform::Mutex_Free(CompilerMutex);
+    Sema_CompileJobs = nullptr;
+    CompileQueueMutex = nullptr;
+    CompilerMutex = nullptr;
+}
+
+void ARMJIT::CompileThreadFunc() noexcept
+{
+    for (;;)
+    {
+        Platform::Semaphore_Wait(Sema_CompileJobs);
+        if (!CompileThreadRunning)
+            return;
+
+        Platform::Mutex_Lock(CompilerMutex);
+
+        Platform::Mutex_Lock(CompileQueueMutex);
+        if (CompileQueue.empty())
+        {
+            // the jobs were cancelled
+            Platform::Mutex_Unlock(CompileQueueMutex);
+            Platform::Mutex_Unlock(CompilerMutex);
+            continue;
+        }
+        CompileJob job = CompileQueue.front();
+        CompileQueue.pop_front();
+        Platform::Mutex_Unlock(CompileQueueMutex);
+
+        // switching to the next code segment evicts blocks,
+        // so that's left to the emulation thread
+        JitBlockEntry entryPoint = nullptr;
+        if (!JITCompiler->CodeSpaceLow())
+        {
+            JitEnableWrite();
+            JITCompiler->Async = true;
+            entryPoint = JITCompiler->CompileBlock(job.CPU, job.Thumb, job.Instrs, job.NumInstrs, job.HasMemoryInstr,
+                job.HotCounter, job.LookupEntry);
+            JITCompiler->Async = false;
+            JitEnableExecute();
+        }
+
+        Platform::Mutex_Lock(CompileQueueMutex);
+        CompiledBlocks.push_back({job.Block, job.ID, entryPoint, JITCompiler->BlockExits});
+        Platform::Mutex_Unlock(CompileQueueMutex);
+
+        Platform::Mutex_Unlock(CompilerMutex);
+
+        BlocksCompiled = true;
+    }
+}
+
+void ARMJIT::PublishCompiledBlocks() noexcept
+{
+    if (!BlocksCompiled.exchange(false))
+        return;
+
+    bool outOfSpace = false;
+
+    Platform::Mutex_Lock(CompileQueueMutex);
+    for (const CompiledBlock& compiled : CompiledBlocks)
+    {
+        // the block might have been invalidated in the meantime
+        auto it = PendingBlocks.find(compiled.Block);
+        if (it == PendingBlocks.end() || it->second != compiled.ID)
+            continue;
+        PendingBlocks.erase(it);
+
+        JitBlock* block = compiled.Block;
+        if (!compiled.EntryPoint)
+        {
+            outOfSpace = true;
+
+            UnindexJitBlock(block);
+            if (block->Num == 0)
+                JitBlocks9.erase(block->StartAddr);
+            else
+                JitBlocks7.erase(block->StartAddr);
+            delete block;
+            continue;
+        }
+
+        block->EntryPoint = compiled.EntryPoint;
+        block->Exits.SetLength(compiled.Exits.size());
+        for (size_t j = 0; j < compiled.Exits.size(); j++)
+            block->Exits[j] = compiled.Exits[j];
+
+        u64* entry = &FastBlockLookupRegions[(block->StartAddrLocal >> 27)][(block->StartAddrLocal & 0x7FFFFFF) / 2];
+        *entry = ((u64)block->StartAddr | block->Num) << 32;
+        *entry |= SubEntryOffset(block->EntryPoint);
+        LinkJitBlock(block);
+        PROFILE_COUNT(NDS.Profiler, JITBlocksCompiled, 1);
+    }
+    CompiledBlocks.clear();
+    Platform::Mutex_Unlock(CompileQueueMutex);
+
+    if (outOfSpace)
+    {
+        Platform::Mutex_Lock(CompilerMutex);
+        JitEnableWrite();
+        if (JITCompiler->CodeSpaceLow())
+            JITCompiler->NextCodeSegment();
+        JitEnableExecute();
+        Platform::Mutex_Unlock(CompilerMutex);
+    }
+}
+
+void ARMJIT::CancelCompileJobs() noexcept
+{
+    if (CompilerMutex)
+    {
+        // wait for the block which is being compiled right now
+        Platform::Mutex_Lock(CompilerMutex);
+        Platform::Mutex_Lock(CompileQueueMutex);
+        CompileQueue.clear();
+        CompiledBlocks.clear();
+        BlocksCompiled = false;
+        Platform::Mutex_Unlock(CompileQueueMutex);
+        Platform::Mutex_Unlock(CompilerMutex);
+    }
+
+    for (auto it : PendingBlocks)
+    {
+        JitBlock* block = it.first;
+        UnindexJitBlock(block);
+        if (block->Num == 0)
+            JitBlocks9.erase(block->StartAddr);
+        else
+            JitBlocks7.erase(block->StartAddr);
+        delete block;
+    }
+    PendingBlocks.clear();
+}
+#else
+void ARMJIT::SetAsyncCompile(bool) noexcept
+{
+}
+#endif
+
 void ARMJIT::CompileBlock(ARM* cpu) noexcept
 {
+#ifdef JIT_ENABLED
+    if (CompileThread)
+        PublishCompiledBlocks();
+#endif
+
+    if (CachedInterpreter)
+    {
+        if (!CachedCode)
+            CachedCode = std::make_unique<CachedInstr[]>(CachedCodeSize);
+        else if (CachedCodeSize - CachedCodeUsed < (u32)MaxBlockSize)
+            ResetBlockCache();
+    }
+
     bool thumb = cpu->CPSR & 0x20;
 
     u32 blockAddr = cpu->R[15] - (thumb ? 2 : 4);
@@ -543,55 +957,74 @@ void ARMJIT::CompileBlock(ARM* cpu) noexcept
         Log(LogLevel::Warn, "trying to compile non executable code? %x\n", blockAddr);
     }
 
+    // the block is being compiled on the compile thread, until then it's interpreted
+    bool pending = false;
+    bool trace = false;
+
     auto& map = cpu->Num == 0 ? JitBlocks9 : JitBlocks7;
     auto existingBlockIt = map.find(blockAddr);
-    if (existingBlockIt != map.end())
+    if (existingBlockIt != map.end() && !existingBlockIt->second->EntryPoint
+        && existingBlockIt->second->StartAddrLocal == localAddr)
+    {
+        pending = true;
+    }
+    else if (existingBlockIt != map.end())
     {
         // there's already a block, though it's not inside the fast map
         // could be that there are two blocks at the same physical addr
         // but different mirrors
         u32 otherLocalAddr = existingBlockIt->second->StartAddrLocal;
 
-        if (localAddr == otherLocalAddr)
+        // a block which became hot took itself out of the fast map
+        trace = localAddr == otherLocalAddr && BranchOptimizations && !CachedInterpreter
+            && !existingBlockIt->second->Trace && HotCounter(localAddr) == 0;
+
+        if (localAddr == otherLocalAddr && !trace)
         {
             JIT_DEBUGPRINT("switching out block %x %x %x\n", localAddr, blockAddr, existingBlockIt->second->StartAddr);
 
             u64* entry = &FastBlockLookupRegions[localAddr >> 27][(localAddr & 0x7FFFFFF) / 2];
             *entry = ((u64)blockAddr | cpu->Num) << 32;
-            *entry |= JITCompiler.SubEntryOffset(existingBlockIt->second->EntryPoint);
+            *entry |= SubEntryOffset(existingBlockIt->second->EntryPoint);
             return;
         }
 
-        // some memory has been remapped
+        // either some memory has been remapped or the block is replaced by a trace
+        if (trace)
+            UnindexJitBlock(existingBlockIt->second);
+        else
+            UnlinkJitBlock(existingBlockIt->second);
         RetireJitBlock(existingBlockIt->second);
         map.erase(existingBlockIt);
     }
 
-    FetchedInstr instrs[MaxBlockSize];
+    int maxBlockSize = trace ? MaxBlockSize * TraceSizeFactor : MaxBlockSize;
+
+    FetchedInstr instrs[maxBlockSize];
     int i = 0;
     u32 r15 = cpu->R[15];
 
-    u32 addressRanges[MaxBlockSize];
-    u32 addressMasks[MaxBlockSize];
-    memset(addressMasks, 0, MaxBlockSize * sizeof(u32));
+    u32 addressRanges[maxBlockSize];
+    u32 addressMasks[maxBlockSize];
+    memset(addressMasks, 0, maxBlockSize * sizeof(u32));
     u32 numAddressRanges = 0;
 
     u32 numLiterals = 0;
-    u32 literalLoadAddrs[MaxBlockSize];
+    u32 literalLoadAddrs[maxBlockSize];
     // they are going to be hashed
-    u32 literalValues[MaxBlockSize];
-    u32 instrValues[MaxBlockSize];
+    u32 literalValues[maxBlockSize];
+    u32 instrValues[maxBlockSize];
     // due to instruction merging i might not reflect the amount of actual instructions
     u32 numInstrs = 0;
 
-    u32 writeAddrs[MaxBlockSize];
+    u32 writeAddrs[maxBlockSize];
     u32 numWriteAddrs = 0, writeAddrsTranslated = 0;
 
     cpu->FillPipeline();
     u32 nextInstr[2] = {cpu->NextInstr[0], cpu->NextInstr[1]};
     u32 nextInstrAddr[2] = {blockAddr, r15};
 
-    JIT_DEBUGPRINT("start block %x %08x (%x)\n", blockAddr, cpu->CPSR, localAddr);
+    JIT_DEBUGPRINT("start %s %x %08x (%x)\n", trace ? "trace" : "block", blockAddr, cpu->CPSR, localAddr);
 
     u32 lastSegmentStart = blockAddr;
     u32 lr;
@@ -701,6 +1134,7 @@ void ARMJIT::CompileBlock(ARM* cpu) noexcept
 
         instrs[i].DataCycles = cpu->DataCycles;
         instrs[i].DataRegion = cpu->DataRegion;
+        instrs[i].HasLiteral = false;
 
         u32 literalAddr;
         if (LiteralOptimizations
@@ -725,6 +1159,8 @@ void ARMJIT::CompileBlock(ARM* cpu) noexcept
                 addressMasks[j] |= 1 << ((translatedAddr & 0x1FF) / 16);
                 JIT_DEBUGPRINT("literal loading %08x %08x %08x %08x\n", literalAddr, translatedAddr, addressMasks[j], addressRanges[j]);
                 cpu->DataRead32(literalAddr, &literalValues[numLiterals]);
+                instrs[i].HasLiteral = true;
+                instrs[i].Literal = literalValues[numLiterals];
                 literalLoadAddrs[numLiterals++] = translatedAddr;
             }
         }
@@ -773,13 +1209,16 @@ void ARMJIT::CompileBlock(ARM* cpu) noexcept
                 {
                     // we might have an idle loop
                     u32 backwardsOffset = (instrs[i].Addr - target) / (thumb ? 2 : 4);
-                    if (IsIdleLoop(thumb, &instrs[i - backwardsOffset], backwardsOffset + 1))
+                    ARMInstrInfo::Info loop[MaxTraceSize];
+                    for (u32 j = 0; j <= backwardsOffset; j++)
+                        loop[j] = instrs[i - backwardsOffset + j].Info;
+                    if (ARMInstrInfo::IsIdleLoop(thumb, loop, backwardsOffset + 1))
                     {
                         instrs[i].BranchFlags |= branch_IdleBranch;
                         JIT_DEBUGPRINT("found %s idle loop %d in block %08x\n", thumb ? "thumb" : "arm", cpu->Num, blockAddr);
                     }
                 }
-                else if (hasBranched && !isBackJump && i + 1 < MaxBlockSize)
+                else if (hasBranched && !isBackJump && i + 1 < maxBlockSize)
                 {
                     if (link)
                     {
@@ -807,7 +1246,7 @@ void ARMJIT::CompileBlock(ARM* cpu) noexcept
                 }
             }
 
-            if (!hasBranched && cond < 0xE && i + 1 < MaxBlockSize)
+            if (!hasBranched && cond < 0xE && i + 1 < maxBlockSize)
             {
                 JIT_DEBUGPRINT("block lengthened by untaken branch\n");
                 instrs[i].Info.EndBlock = false;
@@ -816,12 +1255,7 @@ void ARMJIT::CompileBlock(ARM* cpu) noexcept
         }
 
         i++;
-
-        bool canCompile = JITCompiler.CanCompile(thumb, instrs[i - 1].Info.Kind);
-        bool secondaryFlagReadCond = !canCompile || (instrs[i - 1].BranchFlags & (branch_FollowCondTaken | branch_FollowCondNotTaken));
-        if (instrs[i - 1].Info.ReadFlags != 0 || secondaryFlagReadCond)
-            FloodFillSetFlags(instrs, i - 2, !secondaryFlagReadCond ? instrs[i - 1].Info.ReadFlags : 0xF);
-    } while(!instrs[i - 1].Info.EndBlock && i < MaxBlockSize && !cpu->Halted && (!cpu->IRQ || (cpu->CPSR & 0x80)));
+    } while(!instrs[i - 1].Info.EndBlock && i < maxBlockSize && !cpu->Halted && (!cpu->IRQ || (cpu->CPSR & 0x80)));
 
     if (numLiterals)
     {
@@ -843,10 +1277,13 @@ void ARMJIT::CompileBlock(ARM* cpu) noexcept
         }
     }
 
+    if (pending)
+        return;
+
     u32 literalHash = (u32)XXH3_64bits(literalValues, numLiterals * 4);
     u32 instrHash = (u32)XXH3_64bits(instrValues, numInstrs * 4);
 
-    auto prevBlockIt = RestoreCandidates.find(instrHash);
+    auto prevBlockIt = RestoreCandidates.find(RestoreCandidateKey(blockAddr, instrHash));
     JitBlock* prevBlock = NULL;
     bool mayRestore = true;
     if (prevBlockIt != RestoreCandidates.end())
@@ -854,7 +1291,11 @@ void ARMJIT::CompileBlock(ARM* cpu) noexcept
         prevBlock = prevBlockIt->second;
         RestoreCandidates.erase(prevBlockIt);
 
-        mayRestore = prevBlock->StartAddr == blockAddr && prevBlock->LiteralHash == literalHash;
+        mayRestore = prevBlock->Num == cpu->Num
+            && prevBlock->Trace == trace
+            && prevBlock->StartAddr == blockAddr
+            && prevBlock->InstrHash == instrHash
+            && prevBlock->LiteralHash == literalHash;
 
         if (mayRestore && prevBlock->NumAddresses == numAddressRanges)
         {
@@ -894,14 +1335,88 @@ void ARMJIT::CompileBlock(ARM* cpu) noexcept
 
         block->StartAddr = blockAddr;
         block->StartAddrLocal = localAddr;
+        block->Trace = trace;
 
-        FloodFillSetFlags(instrs, i - 1, 0xF);
+        if (CachedInterpreter)
+        {
+            CachedInstr* cached = &CachedCode[CachedCodeUsed];
+            for (int j = 0; j < i; j++)
+            {
+                cached[j].Instr = instrs[j].Instr;
+                cached[j].Addr = instrs[j].Addr;
+                cached[j].CodeCycles = instrs[j].CodeCycles;
+                cached[j].Cond = 0xE;
+                cached[j].Flags = thumb ? cached_Thumb : 0;
+                if (instrs[j].BranchFlags & branch_IdleBranch)
+                    cached[j].Flags |= cached_IdleBranch;
+
+                if (thumb)
+                    cached[j].Handler = InterpretTHUMB[instrs[j].Info.Kind];
+                else if (cpu->Num == 0 && instrs[j].Info.Kind == ARMInstrInfo::ak_BLX_IMM)
+                    cached[j].Handler = ARMInterpreter::A_BLX_IMM;
+                else
+                {
+                    cached[j].Handler = InterpretARM[instrs[j].Info.Kind];
+                    cached[j].Cond = instrs[j].Cond();
+                }
+            }
+            cached[i - 1].Flags |= cached_Last;
+            CachedCodeUsed += i;
 
-        JitEnableWrite();
-        block->EntryPoint = JITCompiler.CompileBlock(cpu, thumb, instrs, i, hasMemoryInstr);
-        JitEnableExecute();
+            block->EntryPoint = (JitBlockEntry)cached;
+            PROFILE_COUNT(NDS.Profiler, JITBlocksCompiled, 1);
+        }
+#ifdef JIT_ENABLED
+        else
+        {
+            // only compiled code needs to know which flags are read later on
+            for (int j = 0; j < i; j++)
+            {
+                bool canCompile = JITCompiler->CanCompile(thumb, instrs[j].Info.Kind);
+                bool secondaryFlagReadCond = !canCompile || (instrs[j].BranchFlags & (branch_FollowCondTaken | branch_FollowCondNotTaken));
+                if (instrs[j].Info.ReadFlags != 0 || secondaryFlagReadCond)
+                    FloodFillSetFlags(instrs, j - 1, !secondaryFlagReadCond ? instrs[j].Info.ReadFlags : 0xF);
+            }
+            FloodFillSetFlags(instrs, i - 1, 0xF);
+            SimplifyBlock(thumb, instrs, i, *JITCompiler, LiteralOptimizations);
+
+            u64* entry = &FastBlockLookupRegions[(localAddr >> 27)][(localAddr & 0x7FFFFFF) / 2];
+            u16* hotCounter = BranchOptimizations && !trace ? &HotCounter(localAddr) : nullptr;
 
-        JIT_DEBUGPRINT("block start %p\n", block->EntryPoint);
+            if (CompileThread)
+            {
+                block->EntryPoint = nullptr;
+
+                Platform::Mutex_Lock(CompileQueueMutex);
+                CompileJob& job = CompileQueue.emplace_back();
+                job.Block = block;
+                job.ID = NextCompileJobID++;
+                job.CPU = cpu;
+                job.Thumb = thumb;
+                job.HasMemoryInstr = hasMemoryInstr;
+                job.NumInstrs = i;
+                job.HotCounter = hotCounter;
+                job.LookupEntry = entry;
+                std::copy(instrs, instrs + i, job.Instrs);
+                PendingBlocks[block] = job.ID;
+                Platform::Mutex_Unlock(CompileQueueMutex);
+
+                Platform::Semaphore_Post(Sema_CompileJobs);
+            }
+            else
+            {
+                JitEnableWrite();
+                block->EntryPoint = JITCompiler->CompileBlock(cpu, thumb, instrs, i, hasMemoryInstr, hotCounter, entry);
+                JitEnableExecute();
+                block->Exits.SetLength(JITCompiler->BlockExits.size());
+                for (size_t j = 0; j < JITCompiler->BlockExits.size(); j++)
+                    block->Exits[j] = JITCompiler->BlockExits[j];
+                PROFILE_COUNT(NDS.Profiler, JITBlocksCompiled, 1);
+
+                JIT_DEBUGPRINT("block start %p\n", block->EntryPoint);
+            }
+        }
+#endif
     }
     else
     {
@@ -931,9 +1446,21 @@ void ARMJIT::CompileBlock(ARM* cpu) noexcept
     else
         JitBlocks7[blockAddr] = block;
 
+    // a trace doesn't use the counter anymore, though
+    // other blocks might still share it with this one
+    HotCounter(localAddr) = TraceThreshold;
+
     u64* entry = &FastBlockLookupRegions[(localAddr >> 27)][(localAddr & 0x7FFFFFF) / 2];
+    if (!block->EntryPoint)
+    {
+        // it's entered once it's compiled
+        *entry = (u64)UINT32_MAX << 32;
+        return;
+    }
     *entry = ((u64)blockAddr | cpu->Num) << 32;
-    *entry |= JITCompiler.SubEntryOffset(block->EntryPoint);
+    *entry |= SubEntryOffset(block->EntryPoint);
+
+    LinkJitBlock(block);
 }
 
 void ARMJIT::InvalidateByAddr(u32 localAddr) noexcept
@@ -969,6 +1496,7 @@ void ARMJIT::InvalidateByAddr(u32 localAddr) noexcept
             continue;
         }
         range->Blocks.Remove(i);
+        PROFILE_COUNT(NDS.Profiler, JITBlocksInvalidated, 1);
 
         if (range->Blocks.Length == 0
             && !PageContainsCode(&region[(localAddr & 0x7FFF000) / 512]))
@@ -1014,6 +1542,7 @@ void ARMJIT::InvalidateByAddr(u32 localAddr) noexcept
         }
 
         FastBlockLookupRegions[block->StartAddrLocal >> 27][(block->StartAddrLocal & 0x7FFFFFF) / 2] = (u64)UINT32_MAX << 32;
+        UnlinkJitBlock(block);
         if (block->Num == 0)
             JitBlocks9.erase(block->StartAddr);
         else
@@ -1025,6 +1554,9 @@ void ARMJIT::InvalidateByAddr(u32 localAddr) noexcept
         }
         else
         {
+#ifdef JIT_ENABLED
+            PendingBlocks.erase(block);
+#endif
             delete block;
         }
     }
@@ -1068,14 +1600,45 @@ JitBlockEntry ARMJIT::LookUpBlock(u32 num, u64* entries, u32 offset, u32 addr) n
 {
     u64* entry = &entries[offset / 2];
     if (*entry >> 32 == (addr | num))
-        return JITCompiler.AddEntryOffset((u32)*entry);
+        return AddEntryOffset((u32)*entry);
     return NULL;
 }
 
+void ARMJIT::RunCachedBlock(ARM* cpu, JitBlockEntry entry) noexcept
+{
+    // every instruction is executed like the interpreter does, except that it's
+    // already fetched and decoded. Execution continues with the next one
+    // as long as it's where the block went while it was fetched.
+    const CachedInstr* instr = (const CachedInstr*)entry;
+    while (true)
+    {
+        u32 step = instr->Flags & cached_Thumb ? 2 : 4;
+
+        cpu->R[15] += step;
+        cpu->CurInstr = instr->Instr;
+        cpu->CodeCycles = instr->CodeCycles;
+
+        if (cpu->CheckCondition(instr->Cond))
+            instr->Handler(cpu);
+        else
+            cpu->AddCycles_C();
+
+        if (instr->Flags & cached_IdleBranch && cpu->R[15] != instr->Addr + step * 2)
+            cpu->IdleLoop |= 0x1;
+
+        if (instr->Flags & cached_Last || cpu->StopExecution)
+            return;
+
+        instr++;
+        if (cpu->R[15] != instr->Addr + step)
+            return;
+    }
+}
+
 void ARMJIT::blockSanityCheck(u32 num, u32 blockAddr, JitBlockEntry entry) noexcept
 {
     u32 localAddr = LocaliseCodeAddress(num, blockAddr);
-    assert(JITCompiler.AddEntryOffset((u32)FastBlockLookupRegions[localAddr >> 27][(localAddr & 0x7FFFFFF) / 2]) == entry);
+    assert(AddEntryOffset((u32)FastBlockLookupRegions[localAddr >> 27][(localAddr & 0x7FFFFFF) / 2]) == entry);
 }
 
 bool ARMJIT::SetupExecutableRegion(u32 num, u32 blockAddr, u64*& entry, u32& start, u32& size) noexcept
@@ -1111,10 +1674,171 @@ template void ARMJIT::CheckAndInvalidate<1, ARMJIT_Memory::memregion_NewSharedWR
 template void ARMJIT::CheckAndInvalidate<0, ARMJIT_Memory::memregion_NewSharedWRAM_C>(u32) noexcept;
 template void ARMJIT::CheckAndInvalidate<1, ARMJIT_Memory::memregion_NewSharedWRAM_C>(u32) noexcept;
 
+void ARMJIT::UnindexJitBlock(JitBlock* block) noexcept
+{
+    UnlinkJitBlock(block);
+
+    for (int j = 0; j < block->NumAddresses; j++)
+    {
+        u32 addr = block->AddressRanges()[j];
+        AddressRange* region = CodeMemRegions[addr >> 27];
+        AddressRange* range = &region[(addr & 0x7FFFFFF) / 512];
+
+        if (!range->Blocks.RemoveByValue(block))
+            continue;
+
+        // the remaining blocks might share some of the code with this one
+        range->Code = 0;
+        for (int k = 0; k < range->Blocks.Length; k++)
+        {
+            JitBlock* other = range->Blocks[k];
+            for (int l = 0; l < other->NumAddresses; l++)
+            {
+                if (other->AddressRanges()[l] == addr)
+                    range->Code |= other->AddressMasks()[l];
+            }
+        }
+
+        if (range->Blocks.Length == 0
+            && !PageContainsCode(&region[(addr & 0x7FFF000) / 512]))
+        {
+            Memory.SetCodeProtection(addr >> 27, addr & 0x7FFFFFF, false);
+        }
+    }
+
+    u64* entry = &FastBlockLookupRegions[block->StartAddrLocal >> 27][(block->StartAddrLocal & 0x7FFFFFF) / 2];
+    u64 blockEntry = ((u64)(block->StartAddr | block->Num) << 32) | SubEntryOffset(block->EntryPoint);
+    if (*entry == blockEntry)
+        *entry = (u64)UINT32_MAX << 32;
+}
+
+#ifdef JIT_ENABLED
+JitBlock* ARMJIT::LinkableBlock(u32 num, u32 addr) const noexcept
+{
+    auto& map = num == 0 ? JitBlocks9 : JitBlocks7;
+    auto it = map.find(addr);
+    if (it == map.end() || !it->second->EntryPoint)
+        return nullptr;
+
+    // only memory whose mapping rarely changes, see the calls to UnlinkAllBlocks.
+    // On the DSi the BIOS can be swapped out in too many ways to keep track of.
+    int region = num == 0 ? Memory.ClassifyAddress9(addr) : Memory.ClassifyAddress7(addr);
+    bool linkable = region == ARMJIT_Memory::memregion_MainRAM
+        || region == ARMJIT_Memory::memregion_ITCM
+        || (region == ARMJIT_Memory::memregion_WRAM7 && addr >= 0x03800000)
+        || (NDS.ConsoleType == 0
+            && (region == ARMJIT_Memory::memregion_BIOS9 || region == ARMJIT_Memory::memregion_BIOS7));
+    if (!linkable)
+        return nullptr;
+
+    // the dispatcher would look in another place for it
+    if (Memory.LocaliseAddress(region, num, addr) != it->second->StartAddrLocal)
+        return nullptr;
+
+    return it->second;
+}
+
+void ARMJIT::LinkJitBlock(JitBlock* block) noexcept
+{
+    for (int i = 0; i < block->Exits.Length; i++)
+    {
+        const BlockExit& exit = block->Exits[i];
+        JitBlock* target = LinkableBlock(block->Num, exit.Target);
+        JITCompiler->LinkBlockExit(exit, target ? target->EntryPoint : nullptr);
+        BlockLinks.insert({exit.Target | block->Num, {block, exit, target}});
+    }
+
+    if (LinkableBlock(block->Num, block->StartAddr) != block)
+        return;
+
+    auto range = BlockLinks.equal_range(block->StartAddr | block->Num);
+    for (auto it = range.first; it != range.second; it++)
+    {
+        JITCompiler->LinkBlockExit(it->second.Exit, block->EntryPoint);
+        it->second.Target = block;
+    }
+}
+
+void ARMJIT::UnlinkJitBlock(JitBlock* block) noexcept
+{
+    // the block might still be running, if it just invalidated itself
+    for (int i = 0; i < block->Exits.Length; i++)
+    {
+        JITCompiler->LinkBlockExit(block->Exits[i], nullptr);
+
+        auto range = BlockLinks.equal_range(block->Exits[i].Target | block->Num);
+        for (auto it = range.first; it != range.second;)
+        {
+            if (it->second.Source == block)
+                it = BlockLinks.erase(it);
+            else
+                it++;
+        }
+    }
+
+    auto range = BlockLinks.equal_range(block->StartAddr | block->Num);
+    for (auto it = range.first; it != range.second; it++)
+    {
+        if (it->second.Target == block)
+        {
+            JITCompiler->LinkBlockExit(it->second.Exit, nullptr);
+            it->second.Target = nullptr;
+        }
+    }
+}
+
+void ARMJIT::UnlinkAllBlocks() noexcept
+{
+    for (auto& it : BlockLinks)
+    {
+        if (it.second.Target)
+        {
+            JITCompiler->LinkBlockExit(it.second.Exit, nullptr);
+            it.second.Target = nullptr;
+        }
+    }
+}
+
+void ARMJIT::EvictCode(const u8* start, const u8* end) noexcept
+{
+    auto inRange = [=](const JitBlock* block)
+    {
+        const u8* entry = (const u8*)block->EntryPoint;
+        return entry >= start && entry < end;
+    };
+
+    u32 evicted = 0;
+    for (auto* map : {&JitBlocks9, &JitBlocks7, &RestoreCandidates})
+    {
+        for (auto it = map->begin(); it != map->end();)
+        {
+            JitBlock* block = it->second;
+            if (!inRange(block))
+            {
+                it++;
+                continue;
+            }
+
+            UnindexJitBlock(block);
+            delete block;
+            it = map->erase(it);
+            evicted++;
+        }
+    }
+
+    JIT_DEBUGPRINT("evicted %d blocks\n", evicted);
+    PROFILE_COUNT(NDS.Profiler, JITBlocksInvalidated, evicted);
+}
+#endif
+
 void ARMJIT::ResetBlockCache() noexcept
 {
     Log(LogLevel::Debug, "Resetting JIT block cache...\n");
 
+#ifdef JIT_ENABLED
+    CancelCompileJobs();
+#endif
+
     // could be replace through a function which only resets
     // the permissions but we're too lazy
     Memory.Reset();
@@ -1128,6 +1852,10 @@ void ARMJIT::ResetBlockCache() noexcept
     for (auto it = RestoreCandidates.begin(); it != RestoreCandidates.end(); it++)
         delete it->second;
     RestoreCandidates.clear();
+#ifdef JIT_ENABLED
+    BlockLinks.clear();
+#endif
+    PROFILE_COUNT(NDS.Profiler, JITBlocksInvalidated, JitBlocks9.size() + JitBlocks7.size());
     for (auto it : JitBlocks9)
     {
         JitBlock* block = it.second;
@@ -1154,9 +1882,135 @@ void ARMJIT::ResetBlockCache() noexcept
     }
     JitBlocks9.clear();
     JitBlocks7.clear();
+    CachedCodeUsed = 0;
+
+#ifdef JIT_ENABLED
+    if (JITCompiler)
+        JITCompiler->Reset();
+#endif
+}
+
+#ifdef JIT_ENABLED
+bool ARMJIT::DoCodeCache(Savestate* file) noexcept
+{
+    // there's no code to save, the blocks are cheap to decode again
+    if (CachedInterpreter || !JITCompiler)
+        return false;
 
-    JITCompiler.Reset();
+    if (file->Saving && CompileThread)
+    {
+        // only blocks which have their code can be saved
+        PublishCompiledBlocks();
+        CancelCompileJobs();
+    }
+
+    file->Section("JITC");
+
+    u32 consoleType = NDS.ConsoleType;
+    bool literalOptimizations = LiteralOptimizations;
+    bool branchOptimizations = BranchOptimizations;
+    bool fastMemory = FastMemory;
+    file->Var32(&consoleType);
+    file->Bool32(&literalOptimizations);
+    file->Bool32(&branchOptimizations);
+    file->Bool32(&fastMemory);
+
+    if (!file->Saving)
+    {
+        ResetBlockCache();
+
+        if (file->Error
+            || consoleType != (u32)NDS.ConsoleType
+            || literalOptimizations != LiteralOptimizations
+            || branchOptimizations != BranchOptimizations
+            || fastMemory != FastMemory)
+        {
+            Log(LogLevel::Info, "JIT code cache was made with different settings\n");
+            return false;
+        }
+    }
+
+    JitEnableWrite();
+    bool compatible = JITCompiler->DoCodeCache(file);
+    JitEnableExecute();
+
+    if (compatible)
+    {
+        file->Section("JITB");
+
+        u32 numBlocks = JitBlocks9.size() + JitBlocks7.size() + RestoreCandidates.size();
+        file->Var32(&numBlocks);
+
+        auto doBlock = [file, this](JitBlock* block)
+        {
+            u32 entry = SubEntryOffset(block->EntryPoint);
+            file->Var32(&block->StartAddr);
+            file->Var32(&block->StartAddrLocal);
+            file->Var32(&block->InstrHash);
+            file->Var32(&block->LiteralHash);
+            file->Bool32(&block->Trace);
+            file->Var32(&entry);
+            file->VarArray(block->AddressRanges(), block->NumAddresses * sizeof(u32));
+            file->VarArray(block->AddressMasks(), block->NumAddresses * sizeof(u32));
+            file->VarArray(block->Literals(), block->NumLiterals * sizeof(u32));
+            block->EntryPoint = AddEntryOffset(entry);
+
+            u16 numExits = block->Exits.Length;
+            file->Var16(&numExits);
+            if (!file->Saving)
+                block->Exits.SetLength(numExits);
+            file->VarArray(block->Exits.Data, numExits * sizeof(BlockExit));
+        };
+
+        if (file->Saving)
+        {
+            for (auto* map : {&JitBlocks9, &JitBlocks7, &RestoreCandidates})
+            {
+                for (auto it : *map)
+                {
+                    JitBlock* block = it.second;
+                    file->Var8(&block->Num);
+                    file->Var16(&block->NumAddresses);
+                    file->Var16(&block->NumLiterals);
+                    doBlock(block);
+                }
+            }
+        }
+        else
+        {
+            // everything goes into the restore candidates, the blocks
+            // are then picked up by CompileBlock once they are needed
+            // and still match the code in memory
+            for (u32 i = 0; i < numBlocks && !file->Error; i++)
+            {
+                u8 num;
+                u16 numAddresses, numLiterals;
+                file->Var8(&num);
+                file->Var16(&numAddresses);
+                file->Var16(&numLiterals);
+                if (num > 1 || numAddresses < 1 || numAddresses > MaxTraceSize || numLiterals > MaxTraceSize)
+                {
+                    compatible = false;
+                    break;
+                }
+
+                JitBlock* block = new JitBlock(num, 0, numAddresses, numLiterals);
+                doBlock(block);
+                RetireJitBlock(block);
+            }
+        }
+    }
+
+    if (file->Error || !compatible)
+    {
+        if (!file->Saving)
+            ResetBlockCache();
+        return false;
+    }
+
+    return true;
 }
+#endif
 
 void ARMJIT::JitEnableWrite() noexcept
 {
@@ -20,25 +20,40 @@
 #define ARMJIT_H
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
 #include <optional>
 #include <memory>
+#include <vector>
 #include "types.h"
 #include "MemConstants.h"
 #include "Args.h"
 #include "ARMJIT_Memory.h"
 
-#ifdef JIT_ENABLED
+#ifdef CACHED_INTERPRETER_ENABLED
+#include <unordered_map>
 #include "JitBlock.h"
+#include "ARMJIT_Internal.h"
 
 #if defined(__APPLE__) && defined(__aarch64__)
     #include <pthread.h>
 #endif
 
+// the compiler only exists with JIT_ENABLED, everything else
+// (fetching, decoding, indexing and invalidating blocks) is
+// shared with the cached interpreter, which builds without it
 #include "ARMJIT_Compiler.h"
 
 namespace melonDS
 {
+namespace Platform
+{
+struct Thread;
+struct Semaphore;
+struct Mutex;
+}
 class ARM;
+class Savestate;
 
 class JitBlock;
 class ARMJIT
@@ -47,12 +62,29 @@ public:
     ARMJIT(melonDS::NDS& nds, std::optional<JITArgs> jit) noexcept :
         NDS(nds),
         Memory(nds),
-        JITCompiler(nds),
         MaxBlockSize(jit.has_value() ? std::clamp(jit->MaxBlockSize, 1u, 32u) : 32),
         LiteralOptimizations(jit.has_value() ? jit->LiteralOptimizations : false),
         BranchOptimizations(jit.has_value() ? jit->BranchOptimizations : false),
-        FastMemory(jit.has_value() ? jit->FastMemory : false)
-    {}
+        FastMemory(jit.has_value() ? jit->FastMemory : false),
+#ifdef JIT_ENABLED
+        CachedInterpreter(jit.has_value() ? jit->CachedInterpreter : false)
+#else
+        CachedInterpreter(true)
+#endif
+    {
+        if (CachedInterpreter)
+        {
+            LiteralOptimizations = false;
+            FastMemory = false;
+        }
+#ifdef JIT_ENABLED
+        else if (jit.has_value())
+            JITCompiler = std::make_unique<Compiler>(nds);
+
+        if (jit.has_value())
+            SetAsyncCompile(jit->AsyncCompile);
+#endif
+    }
     ~ARMJIT() noexcept;
     void InvalidateByAddr(u32) noexcept;
     void CheckAndInvalidateWVRAM(int) noexcept;
@@ -62,43 +94,194 @@ public:
     void JitEnableExecute() noexcept;
     void CompileBlock(ARM* cpu) noexcept;
     void ResetBlockCache() noexcept;
+#ifdef JIT_ENABLED
+    /// Drops every block whose entry point lies within [start, end),
+    /// so that the compiler can reuse that part of its code memory.
+    void EvictCode(const u8* start, const u8* end) noexcept;
+    /// Makes all blocks return to the dispatcher again, to be called
+    /// when an address might not lead to the same memory anymore.
+    void UnlinkAllBlocks() noexcept;
+    /// Has to be called before anything which blocks are compiled against changes:
+    /// the memory map, the TCM settings, the memory timings, EXMEMCNT or
+    /// SCFG_BIOS. The compile thread reads those while the console runs, so
+    /// it's waited for and the blocks left for it are dropped, to be compiled
+    /// again with the new state once they're run.
+    void MemoryStateChanging() noexcept
+    {
+        if (CompileThread)
+            CancelCompileJobs();
+    }
+    /// Saves all compiled blocks or replaces the block cache with ones saved before.
+    /// Loaded blocks are only used once they are looked up and the code
+    /// and literals they were compiled from still hash to the same values,
+    /// so a code cache of another game only costs some memory.
+    /// @return false if the code cache isn't supported, or was made by a different build
+    /// or with different settings. A failed load leaves the block cache empty.
+    bool DoCodeCache(Savestate* file) noexcept;
+#else
+    // decoded blocks have no exits to link, and nothing is decoded in the background
+    void UnlinkAllBlocks() noexcept {}
+    void MemoryStateChanging() noexcept {}
+    bool DoCodeCache(Savestate*) noexcept { return false; }
+#endif
 
-    template <u32 num, int region>
-    void CheckAndInvalidate(u32 addr) noexcept
+    void CheckAndInvalidate(u32 num, int region, u32 addr) noexcept
     {
         u32 localAddr = Memory.LocaliseAddress(region, num, addr);
         if (CodeMemRegions[region][(localAddr & 0x7FFFFFF) / 512].Code & (1 << ((localAddr & 0x1FF) / 16)))
             InvalidateByAddr(localAddr);
     }
+    template <u32 num, int region>
+    void CheckAndInvalidate(u32 addr) noexcept
+    {
+        CheckAndInvalidate(num, region, addr);
+    }
     JitBlockEntry LookUpBlock(u32 num, u64* entries, u32 offset, u32 addr) noexcept;
+    /// Runs a block looked up while the cached interpreter is used,
+    /// until it's left or the CPU has to stop executing.
+    void RunCachedBlock(ARM* cpu, JitBlockEntry entry) noexcept;
     bool SetupExecutableRegion(u32 num, u32 blockAddr, u64*& entry, u32& start, u32& size) noexcept;
     u32 LocaliseCodeAddress(u32 num, u32 addr) const noexcept;
 
     ARMJIT_Memory Memory;
 private:
     int MaxBlockSize {};
+    // With branch optimizations, blocks count how often they're entered.
+    // Once one of them becomes hot it's fetched and compiled again as a trace,
+    // which may be this many times longer and follows the path the code took
+    // over conditional branches and calls, with side exits wherever it left it.
+    static constexpr int TraceSizeFactor = 4;
+    static constexpr int MaxTraceSize = 32 * TraceSizeFactor;
+    static constexpr u16 TraceThreshold = 500;
     bool LiteralOptimizations = false;
     bool BranchOptimizations = false;
     bool FastMemory = false;
+    bool CachedInterpreter = false;
+
+    // the cached interpreter's counterpart to the code memory, the blocks' entry points
+    // point into it. Once it's full the block cache is reset.
+    static constexpr u32 CachedCodeSize = 0x40000;
+    std::unique_ptr<CachedInstr[]> CachedCode {};
+    u32 CachedCodeUsed = 0;
+
+#ifdef JIT_ENABLED
+    JitBlockEntry AddEntryOffset(u32 offset) noexcept
+    {
+        return CachedInterpreter ? (JitBlockEntry)&CachedCode[offset] : JITCompiler->AddEntryOffset(offset);
+    }
+    u32 SubEntryOffset(JitBlockEntry entry) noexcept
+    {
+        return CachedInterpreter ? (const CachedInstr*)entry - CachedCode.get() : JITCompiler->SubEntryOffset(entry);
+    }
+#else
+    JitBlockEntry AddEntryOffset(u32 offset) noexcept { return (JitBlockEntry)&CachedCode[offset]; }
+    u32 SubEntryOffset(JitBlockEntry entry) noexcept { return (const CachedInstr*)entry - CachedCode.get(); }
+#endif
+
+#ifdef JIT_ENABLED
+    // with asynchronous compilation, CompileBlock only fetches and interprets a new block
+    // and indexes it like any other, but without an entry point. It's then compiled on
+    // the compile thread and published the next time CompileBlock is called.
+    struct CompileJob
+    {
+        JitBlock* Block;
+        u32 ID;
+        ARM* CPU;
+        bool Thumb;
+        bool HasMemoryInstr;
+        int NumInstrs;
+        u16* HotCounter;
+        u64* LookupEntry;
+        FetchedInstr Instrs[MaxTraceSize];
+    };
+    struct CompiledBlock
+    {
+        JitBlock* Block;
+        u32 ID;
+        // null if the compiler needs a new code segment first
+        JitBlockEntry EntryPoint;
+        std::vector<BlockExit> Exits;
+    };
+
+    // blocks which are waiting to be compiled, with the ID of their job.
+    // Blocks which are invalidated in the meantime are removed here,
+    // so that the code compiled for them is thrown away.
+    std::unordered_map<JitBlock*, u32> PendingBlocks {};
+    u32 NextCompileJobID = 0;
+
+    Platform::Thread* CompileThread = nullptr;
+    std::atomic_bool CompileThreadRunning = false;
+    Platform::Semaphore* Sema_CompileJobs = nullptr;
+    // protects the two queues
+    Platform::Mutex* CompileQueueMutex = nullptr;
+    // held by the compile thread while it uses JITCompiler,
+    // which is otherwise only used by the emulation thread
+    Platform::Mutex* CompilerMutex = nullptr;
+    std::deque<CompileJob> CompileQueue {};
+    std::vector<CompiledBlock> CompiledBlocks {};
+    std::atomic_bool BlocksCompiled = false;
+
+    void CompileThreadFunc() noexcept;
+    void StopCompileThread() noexcept;
+    void CancelCompileJobs() noexcept;
+    void PublishCompiledBlocks() noexcept;
+
+    // Blocks which are in use jump directly into the block which follows them
+    // if it's known when compiling. An exit is linked once both blocks are
+    // in use and unlinked again once its target isn't anymore.
+    struct BlockLink
+    {
+        JitBlock* Source;
+        BlockExit Exit;
+        // null while the exit returns to the dispatcher
+        JitBlock* Target;
+    };
+    // the exits of all blocks in use, by the address they lead to (with the CPU in bit 0)
+    std::unordered_multimap<u32, BlockLink> BlockLinks {};
+
+    JitBlock* LinkableBlock(u32 num, u32 addr) const noexcept;
+    void LinkJitBlock(JitBlock* block) noexcept;
+    void UnlinkJitBlock(JitBlock* block) noexcept;
+#else
+    void LinkJitBlock(JitBlock*) noexcept {}
+    void UnlinkJitBlock(JitBlock*) noexcept {}
+#endif
+
+    // counted down by blocks which aren't traces, shared by blocks
+    // which start at the same address modulo its size
+    u16 HotCounters[0x4000] {};
+    u16& HotCounter(u32 localAddr) noexcept { return HotCounters[(localAddr / 2) % std::size(HotCounters)]; }
 public:
     melonDS::NDS& NDS;
     TinyVector<u32> InvalidLiterals {};
     friend class ARMJIT_Memory;
     void blockSanityCheck(u32 num, u32 blockAddr, JitBlockEntry entry) noexcept;
     void RetireJitBlock(JitBlock* block) noexcept;
+    void UnindexJitBlock(JitBlock* block) noexcept;
 
     int GetMaxBlockSize() const noexcept { return MaxBlockSize; }
     bool LiteralOptimizationsEnabled() const noexcept { return LiteralOptimizations; }
     bool BranchOptimizationsEnabled() const noexcept { return BranchOptimizations; }
     bool FastMemoryEnabled() const noexcept { return FastMemory; }
+#ifdef JIT_ENABLED
+    bool AsyncCompileEnabled() const noexcept { return CompileThread != nullptr; }
+#else
+    bool AsyncCompileEnabled() const noexcept { return false; }
+#endif
+    bool CachedInterpreterEnabled() const noexcept { return CachedInterpreter; }
 
     void SetJITArgs(JITArgs args) noexcept;
     void SetMaxBlockSize(int size) noexcept;
     void SetLiteralOptimizations(bool enabled) noexcept;
     void SetBranchOptimizations(bool enabled) noexcept;
     void SetFastMemory(bool enabled) noexcept;
+    void SetAsyncCompile(bool enabled) noexcept;
 
-    Compiler JITCompiler;
+#ifdef JIT_ENABLED
+    // only created while blocks are compiled rather than decoded
+    // for the cached interpreter, as it allocates executable memory
+    std::unique_ptr<Compiler> JITCompiler {};
+#endif
     std::unordered_map<u32, JitBlock*> JitBlocks9 {};
     std::unordered_map<u32, JitBlock*> JitBlocks7 {};
 
@@ -179,12 +362,15 @@ public:
 };
 }
 
+#ifdef JIT_ENABLED
 // Defined in assembly
 extern "C" void ARM_Dispatch(melonDS::ARM* cpu, melonDS::JitBlockEntry entry);
+#endif
 #else
 namespace melonDS
 {
 class ARM;
+class Savestate;
 
 // This version is a stub; the methods all do nothing,
 // but there's still a Memory member.
@@ -201,13 +387,17 @@ public:
     void JitEnableExecute() noexcept {}
     void CompileBlock(ARM*) noexcept {}
     void ResetBlockCache() noexcept {}
+    void UnlinkAllBlocks() noexcept {}
+    void MemoryStateChanging() noexcept {}
+    bool DoCodeCache(Savestate*) noexcept { return false; }
+    void CheckAndInvalidate(u32, int, u32) noexcept {}
     template <u32, int>
     void CheckAndInvalidate(u32 addr) noexcept {}
 
     ARMJIT_Memory Memory;
 };
 }
-#endif // JIT_ENABLED
+#endif // CACHED_INTERPRETER_ENABLED
 
 #endif // ARMJIT_H
 
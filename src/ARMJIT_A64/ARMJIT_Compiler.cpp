@@ -35,6 +35,7 @@ extern char __start__;
 #endif
 
 #include <stdlib.h>
+#include <atomic>
 
 using namespace Arm64Gen;
 
@@ -68,7 +69,9 @@ const BitSet32 CallerSavedPushRegs({W8, W9, W10, W11, W12, W13, W14, W15});
 
 const int JitMemSize = 16 * 1024 * 1024;
 #ifndef __SWITCH__
+// only the first compiler gets this, every other one allocates its own
 u8 JitMem[JitMemSize];
+static std::atomic_flag JitMemInUse = ATOMIC_FLAG_INIT;
 #endif
 
 void Compiler::MovePC()
@@ -268,8 +271,12 @@ Compiler::Compiler(melonDS::NDS& nds) : Arm64Gen::ARM64XEmitter(), NDS(nds)
     #else
         u64 pageSize = sysconf(_SC_PAGE_SIZE);
     #endif
-    u8* pageAligned = (u8*)(((u64)JitMem & ~(pageSize - 1)) + pageSize);
-    u64 alignedSize = (((u64)JitMem + sizeof(JitMem)) & ~(pageSize - 1)) - (u64)pageAligned;
+    u8* pageAligned;
+    u64 alignedSize;
+    if (!JitMemInUse.test_and_set())
+    {
+        pageAligned = (u8*)(((u64)JitMem & ~(pageSize - 1)) + pageSize);
+        alignedSize = (((u64)JitMem + sizeof(JitMem)) & ~(pageSize - 1)) - (u64)pageAligned;
 
     #if defined(_WIN32)
         DWORD dummy;
@@ -280,6 +287,22 @@ Compiler::Compiler(melonDS::NDS& nds) : Arm64Gen::ARM64XEmitter(), NDS(nds)
     #else
         mprotect(pageAligned, alignedSize, PROT_EXEC | PROT_READ | PROT_WRITE);
     #endif
+    }
+    else
+    {
+        // everything outside of the generated code is called through QuickCallFunction,
+        // so unlike on x64 this can be placed anywhere
+        alignedSize = JitMemSize;
+    #if defined(_WIN32)
+        pageAligned = (u8*)VirtualAlloc(NULL, alignedSize, MEM_RESERVE | MEM_COMMIT, PAGE_EXECUTE_READWRITE);
+    #elif defined(__APPLE__)
+        pageAligned = (u8*)mmap(NULL, alignedSize, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS | MAP_JIT,-1, 0);
+        nds.JIT.JitEnableWrite();
+    #else
+        pageAligned = (u8*)mmap(NULL, alignedSize, PROT_EXEC | PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    #endif
+        OwnedJitMem = pageAligned;
+    }
 
     SetCodeBase(pageAligned, pageAligned);
     JitMemMainSize = alignedSize;
@@ -389,15 +412,8 @@ Compiler::Compiler(melonDS::NDS& nds) : Arm64Gen::ARM64XEmitter(), NDS(nds)
                         continue;
                     ARM64Reg rdMapped = (ARM64Reg)reg;
                     PatchedStoreFuncs[consoleType][num][size][reg] = GetRXPtr();
-                    if (num == 0)
-                    {
-                        MOV(X1, RCPU);
-                        MOV(W2, rdMapped);
-                    }
-                    else
-                    {
-                        MOV(W1, rdMapped);
-                    }
+                    MOV(X1, RCPU);
+                    MOV(W2, rdMapped);
                     ABI_PushRegisters(BitSet32({30}) | CallerSavedPushRegs);
                     if (consoleType == 0)
                     {
@@ -430,8 +446,7 @@ Compiler::Compiler(melonDS::NDS& nds) : Arm64Gen::ARM64XEmitter(), NDS(nds)
                     for (int signextend = 0; signextend < 2; signextend++)
                     {
                         PatchedLoadFuncs[consoleType][num][size][signextend][reg] = GetRXPtr();
-                        if (num == 0)
-                            MOV(X1, RCPU);
+                        MOV(X1, RCPU);
                         ABI_PushRegisters(BitSet32({30}) | CallerSavedPushRegs);
                         if (consoleType == 0)
                         {
@@ -492,6 +507,19 @@ Compiler::~Compiler()
         assert(succeded);
         free(JitRWBase);
     }
+#else
+    if (OwnedJitMem)
+    {
+    #ifdef _WIN32
+        VirtualFree(OwnedJitMem, 0, MEM_RELEASE);
+    #else
+        munmap(OwnedJitMem, JitMemSize);
+    #endif
+    }
+    else
+    {
+        JitMemInUse.clear();
+    }
 #endif
 }
 
@@ -701,7 +729,8 @@ void Compiler::Comp_BranchSpecialBehaviour(bool taken)
     }
 }
 
-JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemInstr)
+JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemInstr,
+    u16* hotCounter, u64* lookupEntry)
 {
     if (JitMemMainSize - GetCodeOffset() < 1024 * 16)
     {
@@ -735,6 +764,8 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
         CompileFunc comp = Thumb
             ? T_Comp[CurInstr.Info.Kind]
             : A_Comp[CurInstr.Info.Kind];
+        if (CurInstr.Simplify & (simplify_ConstantResult | simplify_DeadResult))
+            comp = &Compiler::Comp_SimplifiedInstr;
 
         Exit = i == (instrsCount - 1) || (CurInstr.BranchFlags & branch_FollowCondNotTaken);
 
@@ -841,7 +872,8 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
         if (comp == NULL)
         {
             LoadCycles();
-            LoadCPSR();
+            if (!(CurInstr.Simplify & simplify_KeepCPSR))
+                LoadCPSR();
         }
     }
 
@@ -869,6 +901,18 @@ void Compiler::Reset()
         *(((u32*)GetRWPtr()) + i) = brk_0;
 }
 
+void Compiler::Comp_SimplifiedInstr()
+{
+    Comp_AddCycles_C();
+
+    if (CurInstr.Simplify & simplify_ConstantResult)
+    {
+        int rd = __builtin_ctz(CurInstr.Info.DstRegs);
+        MOVI2R(MapReg(rd), CurInstr.ConstantResult);
+        RegCache.PutLiteral(rd, CurInstr.ConstantResult);
+    }
+}
+
 void Compiler::Comp_AddCycles_C(bool forceNonConstant)
 {
     s32 cycles = Num ?
@@ -29,10 +29,12 @@
 #include "../ARMJIT_RegisterCache.h"
 
 #include <unordered_map>
+#include <vector>
 
 namespace melonDS
 {
 class ARMJIT;
+class Savestate;
 const Arm64Gen::ARM64Reg RMemBase = Arm64Gen::X26;
 const Arm64Gen::ARM64Reg RCPSR = Arm64Gen::W27;
 const Arm64Gen::ARM64Reg RCycles = Arm64Gen::W28;
@@ -110,7 +112,9 @@ public:
         return RegCache.Mapping[reg];
     }
 
-    JitBlockEntry CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemInstr);
+    // blocks aren't profiled here, so they never become traces
+    JitBlockEntry CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemInstr,
+        u16* hotCounter, u64* lookupEntry);
 
     bool CanCompile(bool thumb, u16 kind);
 
@@ -121,6 +125,20 @@ public:
 
     void Reset();
 
+    // the code cache isn't supported here yet, the generated
+    // code isn't tracked closely enough to be relocated
+    bool DoCodeCache(Savestate* file) { return false; }
+
+    // the generated code depends on the state of the CPU
+    // in too many places to be compiled on another thread
+    static constexpr bool SupportsAsyncCompile = false;
+    bool Async = false;
+    bool CodeSpaceLow() const { return false; }
+
+    // blocks aren't linked here, they always return to the dispatcher
+    std::vector<BlockExit> BlockExits {};
+    void LinkBlockExit(const BlockExit& exit, JitBlockEntry target) {}
+
     void Comp_AddCycles_C(bool forceNonConstant = false);
     void Comp_AddCycles_CI(u32 numI);
     void Comp_AddCycles_CI(u32 c, Arm64Gen::ARM64Reg numI, Arm64Gen::ArithOption shift);
@@ -223,6 +241,8 @@ public:
     void* Gen_JumpTo7(int kind);
 
     void Comp_BranchSpecialBehaviour(bool taken);
+    // for instructions which were simplified before compiling, see SimplifyBlock
+    void Comp_SimplifiedInstr();
 
     JitBlockEntry AddEntryOffset(u32 offset)
     {
@@ -261,6 +281,10 @@ public:
 
     u32 JitMemSecondarySize;
     u32 JitMemMainSize;
+#ifndef __SWITCH__
+    // only set if this compiler doesn't use the static code memory
+    u8* OwnedJitMem = nullptr;
+#endif
 
     std::unordered_map<ptrdiff_t, LoadStorePatch> LoadStorePatches; 
 
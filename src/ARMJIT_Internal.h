@@ -32,6 +32,7 @@ namespace melonDS
 {
 class ARM;
 class ARMv5;
+class ARMv4;
 
 // here lands everything which doesn't fit into ARMJIT.h
 // where it would be included by pretty much everything
@@ -44,6 +45,18 @@ enum
     branch_StaticTarget = 1 << 3,
 };
 
+// set by SimplifyBlock, so that both compilers can make use of it
+enum
+{
+    // the instruction only needs to put ConstantResult into its destination register
+    simplify_ConstantResult = 1 << 0,
+    // the result is overwritten before it's used, only the cycles remain
+    simplify_DeadResult = 1 << 1,
+    // the following instruction is interpreted as well,
+    // so CPSR doesn't need to be loaded back after this one
+    simplify_KeepCPSR = 1 << 2,
+};
+
 struct FetchedInstr
 {
     u32 A_Reg(int pos) const
@@ -63,6 +76,7 @@ struct FetchedInstr
 
     u8 BranchFlags;
     u8 SetFlags;
+    u8 Simplify;
     u32 Instr;
     u32 Addr;
 
@@ -70,6 +84,13 @@ struct FetchedInstr
     u16 CodeCycles;
     u32 DataRegion;
 
+    // the aligned word a literal load reads, taken while fetching the block
+    // so that it can be compiled without accessing the memory
+    bool HasLiteral;
+    u32 Literal;
+
+    u32 ConstantResult;
+
     ARMInstrInfo::Info Info;
 };
 
@@ -85,6 +106,28 @@ typedef void (*InterpreterFunc)(ARM* cpu);
 extern InterpreterFunc InterpretARM[];
 extern InterpreterFunc InterpretTHUMB[];
 
+enum
+{
+    cached_Thumb = 1 << 0,
+    cached_IdleBranch = 1 << 1,
+    // the block ends after this instruction
+    cached_Last = 1 << 2,
+};
+
+// what the cached interpreter runs in place of compiled code,
+// an instruction of a block with its interpreter function already looked up.
+// The handlers are the interpreter's, so they still take their operands
+// from CurInstr, and RunCachedBlock calls one after the other in a loop
+struct CachedInstr
+{
+    InterpreterFunc Handler;
+    u32 Instr;
+    u32 Addr;
+    u16 CodeCycles;
+    u8 Cond;
+    u8 Flags;
+};
+
 inline bool PageContainsCode(const AddressRange* range)
 {
     for (int i = 0; i < 8; i++)
@@ -97,11 +140,11 @@ inline bool PageContainsCode(const AddressRange* range)
 
 template <typename T, int ConsoleType> T SlowRead9(u32 addr, ARMv5* cpu);
 template <typename T, int ConsoleType> void SlowWrite9(u32 addr, ARMv5* cpu, u32 val);
-template <typename T, int ConsoleType> T SlowRead7(u32 addr);
-template <typename T, int ConsoleType> void SlowWrite7(u32 addr, u32 val);
+template <typename T, int ConsoleType> T SlowRead7(u32 addr, ARMv4* cpu);
+template <typename T, int ConsoleType> void SlowWrite7(u32 addr, ARMv4* cpu, u32 val);
 
 template <bool Write, int ConsoleType> void SlowBlockTransfer9(u32 addr, u64* data, u32 num, ARMv5* cpu);
-template <bool Write, int ConsoleType> void SlowBlockTransfer7(u32 addr, u64* data, u32 num);
+template <bool Write, int ConsoleType> void SlowBlockTransfer7(u32 addr, u64* data, u32 num, ARMv4* cpu);
 
 }
 
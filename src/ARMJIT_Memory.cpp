@@ -16,6 +16,7 @@
     with melonDS. If not, see http://www.gnu.org/licenses/.
 */
 
+#ifdef JIT_ENABLED
 #if defined(__SWITCH__)
 #include <switch.h>
 #elif defined(_WIN32)
@@ -33,6 +34,7 @@
 #include <linux/ashmem.h>
 #include <sys/ioctl.h>
 #endif
+#endif
 
 #include "ARMJIT.h"
 #include "ARMJIT_Memory.h"
@@ -48,6 +50,13 @@
 #include "SPU.h"
 
 #include <stdlib.h>
+#include <atomic>
+#include <mutex>
+
+#ifdef JIT_ENABLED
+#if !defined(__SWITCH__) && !defined(_WIN32) && !defined(MAP_NORESERVE)
+#define MAP_NORESERVE 0
+#endif
 
 /*
     We're handling fastmem here.
@@ -96,6 +105,7 @@
         #define CONTEXT_PC uc_mcontext.__gregs[_REG_PC]
     #endif
 #endif
+#endif
 
 namespace melonDS
 {
@@ -103,6 +113,7 @@ namespace melonDS
 using Platform::Log;
 using Platform::LogLevel;
 
+#ifdef JIT_ENABLED
 #if defined(__ANDROID__)
 #define ASHMEM_DEVICE "/dev/ashmem"
 #endif
@@ -159,12 +170,17 @@ LONG ARMJIT_Memory::ExceptionHandler(EXCEPTION_POINTERS* exceptionInfo)
         return EXCEPTION_CONTINUE_SEARCH;
     }
 
-    u8* curArea = (u8*)(NDS::Current->CurCPU == 0 ? NDS::Current->JIT.Memory.FastMem9Start : NDS::Current->JIT.Memory.FastMem7Start);
+    u8* faultAddr = (u8*)exceptionInfo->ExceptionRecord->ExceptionInformation[1];
+    ARMJIT_Memory* memory = FindFaultingInstance(faultAddr);
+    if (!memory)
+        return EXCEPTION_CONTINUE_SEARCH;
+
+    u8* curArea = (u8*)(memory->NDS.CurCPU == 0 ? memory->FastMem9Start : memory->FastMem7Start);
     FaultDescription desc {};
-    desc.EmulatedFaultAddr = (u8*)exceptionInfo->ExceptionRecord->ExceptionInformation[1] - curArea;
+    desc.EmulatedFaultAddr = faultAddr - curArea;
     desc.FaultPC = (u8*)exceptionInfo->ContextRecord->CONTEXT_PC;
 
-    if (FaultHandler(desc, *NDS::Current))
+    if (FaultHandler(desc, memory->NDS))
     {
         exceptionInfo->ContextRecord->CONTEXT_PC = (u64)desc.FaultPC;
         return EXCEPTION_CONTINUE_EXECUTION;
@@ -193,16 +209,20 @@ void ARMJIT_Memory::SigsegvHandler(int sig, siginfo_t* info, void* rawContext)
 
     ucontext_t* context = (ucontext_t*)rawContext;
 
-    FaultDescription desc {};
-    u8* curArea = (u8*)(NDS::Current->CurCPU == 0 ? NDS::Current->JIT.Memory.FastMem9Start : NDS::Current->JIT.Memory.FastMem7Start);
+    ARMJIT_Memory* memory = FindFaultingInstance((u8*)info->si_addr);
+    if (memory)
+    {
+        FaultDescription desc {};
+        u8* curArea = (u8*)(memory->NDS.CurCPU == 0 ? memory->FastMem9Start : memory->FastMem7Start);
 
-    desc.EmulatedFaultAddr = (u8*)info->si_addr - curArea;
-    desc.FaultPC = (u8*)context->CONTEXT_PC;
+        desc.EmulatedFaultAddr = (u8*)info->si_addr - curArea;
+        desc.FaultPC = (u8*)context->CONTEXT_PC;
 
-    if (FaultHandler(desc, *NDS::Current))
-    {
-        context->CONTEXT_PC = (u64)desc.FaultPC;
-        return;
+        if (FaultHandler(desc, memory->NDS))
+        {
+            context->CONTEXT_PC = (u64)desc.FaultPC;
+            return;
+        }
     }
 
     struct sigaction* oldSa;
@@ -288,7 +308,8 @@ bool ARMJIT_Memory::UnmapFromRange(u32 addr, u32 num, u32 offset, u32 size) noex
 #elif defined(_WIN32)
     return UnmapViewOfFile(dst);
 #else
-    return munmap(dst, size) == 0;
+    // put the reservation back in place instead of leaving a hole
+    return mmap(dst, size, PROT_NONE, MAP_ANON | MAP_PRIVATE | MAP_FIXED | MAP_NORESERVE, -1, 0) != MAP_FAILED;
 #endif
 }
 
@@ -425,6 +446,8 @@ void ARMJIT_Memory::SetCodeProtection(int region, u32 offset, bool protect) noex
 
 void ARMJIT_Memory::RemapDTCM(u32 newBase, u32 newSize) noexcept
 {
+    NDS.JIT.MemoryStateChanging();
+
     // this first part could be made more efficient
     // by unmapping DTCM first and then map the holes
     u32 oldDTCMBase = NDS.ARM9.DTCMBase;
@@ -469,6 +492,8 @@ void ARMJIT_Memory::RemapDTCM(u32 newBase, u32 newSize) noexcept
         Mappings[memregion_DTCM][i].Unmap(memregion_DTCM, NDS);
     }
     Mappings[memregion_DTCM].Clear();
+
+    NDS.JIT.UnlinkAllBlocks();
 }
 
 void ARMJIT_Memory::RemapNWRAM(int num) noexcept
@@ -476,6 +501,8 @@ void ARMJIT_Memory::RemapNWRAM(int num) noexcept
     if (NDS.ConsoleType == 0)
         return;
 
+    NDS.JIT.MemoryStateChanging();
+
     auto* dsi = static_cast<DSi*>(&NDS);
     for (int i = 0; i < Mappings[memregion_SharedWRAM].Length;)
     {
@@ -496,10 +523,14 @@ void ARMJIT_Memory::RemapNWRAM(int num) noexcept
         Mappings[memregion_NewSharedWRAM_A + num][i].Unmap(memregion_NewSharedWRAM_A + num, NDS);
     }
     Mappings[memregion_NewSharedWRAM_A + num].Clear();
+
+    NDS.JIT.UnlinkAllBlocks();
 }
 
 void ARMJIT_Memory::RemapSWRAM() noexcept
 {
+    NDS.JIT.MemoryStateChanging();
+
     Log(LogLevel::Debug, "remapping SWRAM\n");
     for (int i = 0; i < Mappings[memregion_WRAM7].Length;)
     {
@@ -626,8 +657,10 @@ bool ARMJIT_Memory::MapAtAddress(u32 addr) noexcept
 
 bool ARMJIT_Memory::FaultHandler(FaultDescription& faultDesc, melonDS::NDS& nds)
 {
-    if (nds.JIT.JITCompiler.IsJITFault(faultDesc.FaultPC))
+    if (nds.JIT.JITCompiler && nds.JIT.JITCompiler->IsJITFault(faultDesc.FaultPC))
     {
+        PROFILE_COUNT(nds.Profiler, FastmemFaults, 1);
+
         bool rewriteToSlowPath = true;
 
         u8* memStatus = nds.CurCPU == 0 ? nds.JIT.Memory.MappingStatus9 : nds.JIT.Memory.MappingStatus7;
@@ -636,7 +669,14 @@ bool ARMJIT_Memory::FaultHandler(FaultDescription& faultDesc, melonDS::NDS& nds)
             rewriteToSlowPath = !nds.JIT.Memory.MapAtAddress(faultDesc.EmulatedFaultAddr);
 
         if (rewriteToSlowPath)
-            faultDesc.FaultPC = nds.JIT.JITCompiler.RewriteMemAccess(faultDesc.FaultPC);
+        {
+            // the compile thread might be emitting code (and patch info) right now
+            if (nds.JIT.CompilerMutex)
+                Platform::Mutex_Lock(nds.JIT.CompilerMutex);
+            faultDesc.FaultPC = nds.JIT.JITCompiler->RewriteMemAccess(faultDesc.FaultPC);
+            if (nds.JIT.CompilerMutex)
+                Platform::Mutex_Unlock(nds.JIT.CompilerMutex);
+        }
 
         return true;
     }
@@ -645,6 +685,117 @@ bool ARMJIT_Memory::FaultHandler(FaultDescription& faultDesc, melonDS::NDS& nds)
 
 const u64 AddrSpaceSize = 0x100000000;
 
+#ifndef __SWITCH__
+/*
+    Every console has its own fastmem arena, but there's only
+    one fault handler per process. So all instances are registered
+    here and the handler looks up the one whose arena contains
+    the faulting address.
+
+    The table is read from within the fault handler, that's why
+    it's a fixed size array of atomics instead of a container
+    behind a lock. The lock only serialises the writers.
+*/
+const int MaxFastMemInstances = 256;
+static std::atomic<ARMJIT_Memory*> FastMemInstances[MaxFastMemInstances];
+static std::mutex FastMemInstancesLock;
+static int NumFastMemInstances = 0;
+#ifdef _WIN32
+static LPVOID ExceptionHandlerHandle = nullptr;
+#endif
+
+ARMJIT_Memory* ARMJIT_Memory::FindFaultingInstance(u8* addr) noexcept
+{
+    for (int i = 0; i < MaxFastMemInstances; i++)
+    {
+        ARMJIT_Memory* memory = FastMemInstances[i].load(std::memory_order_acquire);
+        // the ARM7 address space directly follows the ARM9 one
+        if (memory && addr >= (u8*)memory->FastMem9Start && addr < (u8*)memory->FastMem9Start + AddrSpaceSize*2)
+            return memory;
+    }
+    return nullptr;
+}
+
+#ifdef _WIN32
+bool ARMJIT_Memory::OverlapsInstance(u8* start, u64 size) noexcept
+{
+    for (int i = 0; i < MaxFastMemInstances; i++)
+    {
+        ARMJIT_Memory* memory = FastMemInstances[i].load(std::memory_order_relaxed);
+        if (!memory)
+            continue;
+
+        u8* otherStart = (u8*)memory->FastMem9Start - AddrSpaceSize;
+        if (start < otherStart + AddrSpaceSize*4 && otherStart < start + size)
+            return true;
+    }
+    return false;
+}
+#endif
+
+// must be called with FastMemInstancesLock held
+void ARMJIT_Memory::RegisterInstance() noexcept
+{
+    int slot = 0;
+    while (slot < MaxFastMemInstances && FastMemInstances[slot].load(std::memory_order_relaxed))
+        slot++;
+
+    if (slot == MaxFastMemInstances)
+    {
+        Log(LogLevel::Error, "Too many JIT instances, fastmem faults of this one won't be handled!\n");
+        return;
+    }
+
+    FastMemInstances[slot].store(this, std::memory_order_release);
+
+    if (NumFastMemInstances++ > 0)
+        return;
+
+#if defined(_WIN32)
+    ExceptionHandlerHandle = AddVectoredExceptionHandler(1, ExceptionHandler);
+#else
+    struct sigaction sa;
+    sa.sa_handler = nullptr;
+    sa.sa_sigaction = &SigsegvHandler;
+    sa.sa_flags = SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGSEGV, &sa, &OldSaSegv);
+#ifdef __APPLE__
+    sigaction(SIGBUS, &sa, &OldSaBus);
+#endif
+#endif
+}
+
+// must be called with FastMemInstancesLock held
+void ARMJIT_Memory::UnregisterInstance() noexcept
+{
+    for (int i = 0; i < MaxFastMemInstances; i++)
+    {
+        if (FastMemInstances[i].load(std::memory_order_relaxed) == this)
+        {
+            FastMemInstances[i].store(nullptr, std::memory_order_release);
+            break;
+        }
+    }
+
+    if (--NumFastMemInstances > 0)
+        return;
+
+#if defined(_WIN32)
+    if (ExceptionHandlerHandle)
+    {
+        RemoveVectoredExceptionHandler(ExceptionHandlerHandle);
+        ExceptionHandlerHandle = nullptr;
+    }
+#else
+    sigaction(SIGSEGV, &OldSaSegv, nullptr);
+#ifdef __APPLE__
+    sigaction(SIGBUS, &OldSaBus, nullptr);
+#endif
+#endif
+}
+#endif
+
 ARMJIT_Memory::ARMJIT_Memory(melonDS::NDS& nds) : NDS(nds)
 {
 #if defined(__SWITCH__)
@@ -671,12 +822,24 @@ ARMJIT_Memory::ARMJIT_Memory(melonDS::NDS& nds) : NDS(nds)
 
     u8* basePtr = MemoryBaseCodeMem;
 #elif defined(_WIN32)
-    ExceptionHandlerHandle = AddVectoredExceptionHandler(1, ExceptionHandler);
-
     MemoryFile = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, MemoryTotalSize, NULL);
 
+    std::lock_guard<std::mutex> lock(FastMemInstancesLock);
+
+    // other consoles only map their views once they're needed, so Windows
+    // might hand out their address space again. Keep any such range reserved
+    // while looking for another one, so we don't get it twice.
+    LPVOID takenRanges[16];
+    int numTakenRanges = 0;
     MemoryBase = (u8*)VirtualAlloc(NULL, AddrSpaceSize*4, MEM_RESERVE, PAGE_READWRITE);
+    while (MemoryBase && OverlapsInstance(MemoryBase, AddrSpaceSize*4) && numTakenRanges < 16)
+    {
+        takenRanges[numTakenRanges++] = MemoryBase;
+        MemoryBase = (u8*)VirtualAlloc(NULL, AddrSpaceSize*4, MEM_RESERVE, PAGE_READWRITE);
+    }
     VirtualFree(MemoryBase, 0, MEM_RELEASE);
+    for (int i = 0; i < numTakenRanges; i++)
+        VirtualFree(takenRanges[i], 0, MEM_RELEASE);
     // this is incredible hacky
     // but someone else is trying to go into our address space!
     // Windows will very likely give them virtual memory starting at the same address
@@ -688,13 +851,16 @@ ARMJIT_Memory::ARMJIT_Memory(melonDS::NDS& nds) : NDS(nds)
     MemoryBase = MemoryBase + AddrSpaceSize*3;
 
     MapViewOfFileEx(MemoryFile, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, MemoryTotalSize, MemoryBase);
+
+    RegisterInstance();
 #else
     // this used to be allocated with three different mmaps
     // The idea was to give the OS more freedom where to position the buffers,
     // but something was bad about this so instead we take this vmem eating monster
     // which seems to work better.
-    MemoryBase = (u8*)mmap(NULL, AddrSpaceSize*4, PROT_NONE, MAP_ANON | MAP_PRIVATE, -1, 0);
-    munmap(MemoryBase, AddrSpaceSize*4);
+    // It stays reserved for as long as we live, so no other console
+    // can end up in the same address space.
+    MemoryBase = (u8*)mmap(NULL, AddrSpaceSize*4, PROT_NONE, MAP_ANON | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
     FastMem9Start = MemoryBase;
     FastMem7Start = MemoryBase + AddrSpaceSize;
     MemoryBase = MemoryBase + AddrSpaceSize*2;
@@ -716,8 +882,11 @@ ARMJIT_Memory::ARMJIT_Memory(melonDS::NDS& nds) : NDS(nds)
         MemoryFile = fd;
     }
 #else
-    char fastmemPidName[snprintf(NULL, 0, "/melondsfastmem%d", getpid()) + 1];
-    sprintf(fastmemPidName, "/melondsfastmem%d", getpid());
+    // several consoles might be created at the same time
+    static std::atomic<u32> fastmemCounter = 0;
+    u32 fastmemID = fastmemCounter++;
+    char fastmemPidName[snprintf(NULL, 0, "/melondsfastmem%d-%u", getpid(), fastmemID) + 1];
+    sprintf(fastmemPidName, "/melondsfastmem%d-%u", getpid(), fastmemID);
     MemoryFile = shm_open(fastmemPidName, O_RDWR | O_CREAT | O_EXCL, 0600);
     if (MemoryFile == -1)
     {
@@ -730,18 +899,13 @@ ARMJIT_Memory::ARMJIT_Memory(melonDS::NDS& nds) : NDS(nds)
         Log(LogLevel::Error, "Failed to allocate memory using ftruncate! (%s)", strerror(errno));
     }
 
-    struct sigaction sa;
-    sa.sa_handler = nullptr;
-    sa.sa_sigaction = &SigsegvHandler;
-    sa.sa_flags = SA_SIGINFO;
-    sigemptyset(&sa.sa_mask);
-    sigaction(SIGSEGV, &sa, &OldSaSegv);
-#ifdef __APPLE__
-    sigaction(SIGBUS, &sa, &OldSaBus);
-#endif
-
     mmap(MemoryBase, MemoryTotalSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, MemoryFile, 0);
 
+    {
+        std::lock_guard<std::mutex> lock(FastMemInstancesLock);
+        RegisterInstance();
+    }
+
     u8* basePtr = MemoryBase;
 #endif
 }
@@ -764,6 +928,11 @@ ARMJIT_Memory::~ARMJIT_Memory() noexcept
     free(MemoryBase);
     MemoryBase = nullptr;
 #elif defined(_WIN32)
+    {
+        std::lock_guard<std::mutex> lock(FastMemInstancesLock);
+        UnregisterInstance();
+    }
+
     if (MemoryBase)
     {
         bool viewUnmapped = UnmapViewOfFile(MemoryBase);
@@ -778,20 +947,16 @@ ARMJIT_Memory::~ARMJIT_Memory() noexcept
         CloseHandle(MemoryFile);
         MemoryFile = INVALID_HANDLE_VALUE;
     }
-
-    if (ExceptionHandlerHandle)
+#else
     {
-        RemoveVectoredExceptionHandler(ExceptionHandlerHandle);
-        ExceptionHandlerHandle = nullptr;
+        std::lock_guard<std::mutex> lock(FastMemInstancesLock);
+        UnregisterInstance();
     }
-#else
-    sigaction(SIGSEGV, &OldSaSegv, nullptr);
-#ifdef __APPLE__
-    sigaction(SIGBUS, &OldSaBus, nullptr);
-#endif
+
     if (MemoryBase)
     {
-        munmap(MemoryBase, MemoryTotalSize);
+        // this takes everything still mapped into the fastmem areas with it
+        munmap(FastMem9Start, AddrSpaceSize*4);
         MemoryBase = nullptr;
         FastMem9Start = nullptr;
         FastMem7Start = nullptr;
@@ -847,6 +1012,10 @@ bool ARMJIT_Memory::IsFastmemCompatible(int region) const noexcept
 #endif
     return OffsetsPerRegion[region] != UINT32_MAX;
 }
+#endif
+
+// the cached interpreter needs to know where code lies as well,
+// so these are also part of builds without fast memory
 
 bool ARMJIT_Memory::GetMirrorLocation(int region, u32 num, u32 addr, u32& memoryOffset, u32& mirrorStart, u32& mirrorSize) const noexcept
 {
@@ -1179,6 +1348,7 @@ int ARMJIT_Memory::ClassifyAddress7(u32 addr) const noexcept
     }
 }
 
+#ifdef JIT_ENABLED
 /*void WifiWrite32(u32 addr, u32 val)
 {
     Wifi::Write(addr, val & 0xFFFF);
@@ -1191,135 +1361,135 @@ u32 WifiRead32(u32 addr)
 }*/
 
 template <typename T>
-void VRAMWrite(u32 addr, T val)
+void VRAMWrite(u32 addr, ARM* cpu, T val)
 {
     switch (addr & 0x00E00000)
     {
-    case 0x00000000: NDS::Current->GPU.WriteVRAM_ABG<T>(addr, val); return;
-    case 0x00200000: NDS::Current->GPU.WriteVRAM_BBG<T>(addr, val); return;
-    case 0x00400000: NDS::Current->GPU.WriteVRAM_AOBJ<T>(addr, val); return;
-    case 0x00600000: NDS::Current->GPU.WriteVRAM_BOBJ<T>(addr, val); return;
-    default: NDS::Current->GPU.WriteVRAM_LCDC<T>(addr, val); return;
+    case 0x00000000: cpu->NDS.GPU.WriteVRAM_ABG<T>(addr, val); return;
+    case 0x00200000: cpu->NDS.GPU.WriteVRAM_BBG<T>(addr, val); return;
+    case 0x00400000: cpu->NDS.GPU.WriteVRAM_AOBJ<T>(addr, val); return;
+    case 0x00600000: cpu->NDS.GPU.WriteVRAM_BOBJ<T>(addr, val); return;
+    default: cpu->NDS.GPU.WriteVRAM_LCDC<T>(addr, val); return;
     }
 }
 template <typename T>
-T VRAMRead(u32 addr)
+T VRAMRead(u32 addr, ARM* cpu)
 {
     switch (addr & 0x00E00000)
     {
-    case 0x00000000: return NDS::Current->GPU.ReadVRAM_ABG<T>(addr);
-    case 0x00200000: return NDS::Current->GPU.ReadVRAM_BBG<T>(addr);
-    case 0x00400000: return NDS::Current->GPU.ReadVRAM_AOBJ<T>(addr);
-    case 0x00600000: return NDS::Current->GPU.ReadVRAM_BOBJ<T>(addr);
-    default: return NDS::Current->GPU.ReadVRAM_LCDC<T>(addr);
+    case 0x00000000: return cpu->NDS.GPU.ReadVRAM_ABG<T>(addr);
+    case 0x00200000: return cpu->NDS.GPU.ReadVRAM_BBG<T>(addr);
+    case 0x00400000: return cpu->NDS.GPU.ReadVRAM_AOBJ<T>(addr);
+    case 0x00600000: return cpu->NDS.GPU.ReadVRAM_BOBJ<T>(addr);
+    default: return cpu->NDS.GPU.ReadVRAM_LCDC<T>(addr);
     }
 }
 
-static u8 GPU3D_Read8(u32 addr) noexcept
+static u8 GPU3D_Read8(u32 addr, ARM* cpu) noexcept
 {
-    return NDS::Current->GPU.GPU3D.Read8(addr);
+    return cpu->NDS.GPU.GPU3D.Read8(addr);
 }
 
-static u16 GPU3D_Read16(u32 addr) noexcept
+static u16 GPU3D_Read16(u32 addr, ARM* cpu) noexcept
 {
-    return NDS::Current->GPU.GPU3D.Read16(addr);
+    return cpu->NDS.GPU.GPU3D.Read16(addr);
 }
 
-static u32 GPU3D_Read32(u32 addr) noexcept
+static u32 GPU3D_Read32(u32 addr, ARM* cpu) noexcept
 {
-    return NDS::Current->GPU.GPU3D.Read32(addr);
+    return cpu->NDS.GPU.GPU3D.Read32(addr);
 }
 
-static void GPU3D_Write8(u32 addr, u8 val) noexcept
+static void GPU3D_Write8(u32 addr, ARM* cpu, u8 val) noexcept
 {
-    NDS::Current->GPU.GPU3D.Write8(addr, val);
+    cpu->NDS.GPU.GPU3D.Write8(addr, val);
 }
 
-static void GPU3D_Write16(u32 addr, u16 val) noexcept
+static void GPU3D_Write16(u32 addr, ARM* cpu, u16 val) noexcept
 {
-    NDS::Current->GPU.GPU3D.Write16(addr, val);
+    cpu->NDS.GPU.GPU3D.Write16(addr, val);
 }
 
-static void GPU3D_Write32(u32 addr, u32 val) noexcept
+static void GPU3D_Write32(u32 addr, ARM* cpu, u32 val) noexcept
 {
-    NDS::Current->GPU.GPU3D.Write32(addr, val);
+    cpu->NDS.GPU.GPU3D.Write32(addr, val);
 }
 
 template<class T>
-static T GPU_ReadVRAM_ARM7(u32 addr) noexcept
+static T GPU_ReadVRAM_ARM7(u32 addr, ARM* cpu) noexcept
 {
-    return NDS::Current->GPU.ReadVRAM_ARM7<T>(addr);
+    return cpu->NDS.GPU.ReadVRAM_ARM7<T>(addr);
 }
 
 template<class T>
-static void GPU_WriteVRAM_ARM7(u32 addr, T val) noexcept
+static void GPU_WriteVRAM_ARM7(u32 addr, ARM* cpu, T val) noexcept
 {
-    NDS::Current->GPU.WriteVRAM_ARM7<T>(addr, val);
+    cpu->NDS.GPU.WriteVRAM_ARM7<T>(addr, val);
 }
 
-u32 NDSCartSlot_ReadROMData()
-{ // TODO: Add a NDS* parameter, when NDS* is eventually implemented
-    return NDS::Current->NDSCartSlot.ReadROMData();
+u32 NDSCartSlot_ReadROMData(u32 addr, ARM* cpu)
+{
+    return cpu->NDS.NDSCartSlot.ReadROMData();
 }
 
-static u8 NDS_ARM9IORead8(u32 addr)
+static u8 NDS_ARM9IORead8(u32 addr, ARM* cpu)
 {
-    return NDS::Current->ARM9IORead8(addr);
+    return cpu->NDS.ARM9IORead8(addr);
 }
 
-static u16 NDS_ARM9IORead16(u32 addr)
+static u16 NDS_ARM9IORead16(u32 addr, ARM* cpu)
 {
-    return NDS::Current->ARM9IORead16(addr);
+    return cpu->NDS.ARM9IORead16(addr);
 }
 
-static u32 NDS_ARM9IORead32(u32 addr)
+static u32 NDS_ARM9IORead32(u32 addr, ARM* cpu)
 {
-    return NDS::Current->ARM9IORead32(addr);
+    return cpu->NDS.ARM9IORead32(addr);
 }
 
-static void NDS_ARM9IOWrite8(u32 addr, u8 val)
+static void NDS_ARM9IOWrite8(u32 addr, ARM* cpu, u8 val)
 {
-    NDS::Current->ARM9IOWrite8(addr, val);
+    cpu->NDS.ARM9IOWrite8(addr, val);
 }
 
-static void NDS_ARM9IOWrite16(u32 addr, u16 val)
+static void NDS_ARM9IOWrite16(u32 addr, ARM* cpu, u16 val)
 {
-    NDS::Current->ARM9IOWrite16(addr, val);
+    cpu->NDS.ARM9IOWrite16(addr, val);
 }
 
-static void NDS_ARM9IOWrite32(u32 addr, u32 val)
+static void NDS_ARM9IOWrite32(u32 addr, ARM* cpu, u32 val)
 {
-    NDS::Current->ARM9IOWrite32(addr, val);
+    cpu->NDS.ARM9IOWrite32(addr, val);
 }
 
-static u8 NDS_ARM7IORead8(u32 addr)
+static u8 NDS_ARM7IORead8(u32 addr, ARM* cpu)
 {
-    return NDS::Current->ARM7IORead8(addr);
+    return cpu->NDS.ARM7IORead8(addr);
 }
 
-static u16 NDS_ARM7IORead16(u32 addr)
+static u16 NDS_ARM7IORead16(u32 addr, ARM* cpu)
 {
-    return NDS::Current->ARM7IORead16(addr);
+    return cpu->NDS.ARM7IORead16(addr);
 }
 
-static u32 NDS_ARM7IORead32(u32 addr)
+static u32 NDS_ARM7IORead32(u32 addr, ARM* cpu)
 {
-    return NDS::Current->ARM7IORead32(addr);
+    return cpu->NDS.ARM7IORead32(addr);
 }
 
-static void NDS_ARM7IOWrite8(u32 addr, u8 val)
+static void NDS_ARM7IOWrite8(u32 addr, ARM* cpu, u8 val)
 {
-    NDS::Current->ARM7IOWrite8(addr, val);
+    cpu->NDS.ARM7IOWrite8(addr, val);
 }
 
-static void NDS_ARM7IOWrite16(u32 addr, u16 val)
+static void NDS_ARM7IOWrite16(u32 addr, ARM* cpu, u16 val)
 {
-    NDS::Current->ARM7IOWrite16(addr, val);
+    cpu->NDS.ARM7IOWrite16(addr, val);
 }
 
-static void NDS_ARM7IOWrite32(u32 addr, u32 val)
+static void NDS_ARM7IOWrite32(u32 addr, ARM* cpu, u32 val)
 {
-    NDS::Current->ARM7IOWrite32(addr, val);
+    cpu->NDS.ARM7IOWrite32(addr, val);
 }
 
 void* ARMJIT_Memory::GetFuncForAddr(ARM* cpu, u32 addr, bool store, int size) const noexcept
@@ -1360,7 +1530,7 @@ void* ARMJIT_Memory::GetFuncForAddr(ARM* cpu, u32 addr, bool store, int size) co
             case 32: return (void*)NDS_ARM9IORead32;
             case 33: return (void*)NDS_ARM9IOWrite32;
             }
-            // NDS::Current will delegate to the DSi versions of these methods
+            // the NDS object will delegate to the DSi versions of these methods
             // if it's really a DSi
             break;
         case 0x06000000:
@@ -1432,4 +1602,5 @@ void* ARMJIT_Memory::GetFuncForAddr(ARM* cpu, u32 addr, bool store, int size) co
     }
     return NULL;
 }
+#endif
 }
\ No newline at end of file
@@ -154,6 +154,11 @@ private:
         u8* FaultPC;
     };
     static bool FaultHandler(FaultDescription& faultDesc, melonDS::NDS& nds);
+#ifndef __SWITCH__
+    static ARMJIT_Memory* FindFaultingInstance(u8* addr) noexcept;
+    void RegisterInstance() noexcept;
+    void UnregisterInstance() noexcept;
+#endif
     bool MapIntoRange(u32 addr, u32 num, u32 offset, u32 size) noexcept;
     bool UnmapFromRange(u32 addr, u32 num, u32 offset, u32 size) noexcept;
     void SetCodeProtectionRange(u32 addr, u32 size, u32 num, int protection) noexcept;
@@ -167,8 +172,8 @@ private:
     u8* MemoryBaseCodeMem;
 #elif defined(_WIN32)
     static LONG ExceptionHandler(EXCEPTION_POINTERS* exceptionInfo);
+    static bool OverlapsInstance(u8* start, u64 size) noexcept;
     HANDLE MemoryFile = INVALID_HANDLE_VALUE;
-    LPVOID ExceptionHandlerHandle = nullptr;
 #else
     static void SigsegvHandler(int sig, siginfo_t* info, void* rawContext);
     int MemoryFile = -1;
@@ -181,7 +186,11 @@ private:
     TinyVector<Mapping> Mappings[memregions_Count] {};
 #else
 public:
+#ifdef CACHED_INTERPRETER_ENABLED
+    explicit ARMJIT_Memory(melonDS::NDS& nds) : NDS(nds) {};
+#else
     explicit ARMJIT_Memory(melonDS::NDS&) {};
+#endif
     ~ARMJIT_Memory() = default;
     ARMJIT_Memory(const ARMJIT_Memory&) = delete;
     ARMJIT_Memory(ARMJIT_Memory&&) = delete;
@@ -214,7 +223,17 @@ public:
 
     [[nodiscard]] u8* GetNWRAM_C() noexcept { return NWRAM_C.data(); }
     [[nodiscard]] const u8* GetNWRAM_C() const noexcept { return NWRAM_C.data(); }
+
+#ifdef CACHED_INTERPRETER_ENABLED
+    int ClassifyAddress9(u32 addr) const noexcept;
+    int ClassifyAddress7(u32 addr) const noexcept;
+    bool GetMirrorLocation(int region, u32 num, u32 addr, u32& memoryOffset, u32& mirrorStart, u32& mirrorSize) const noexcept;
+    u32 LocaliseAddress(int region, u32 num, u32 addr) const noexcept;
+#endif
 private:
+#ifdef CACHED_INTERPRETER_ENABLED
+    melonDS::NDS& NDS;
+#endif
     std::array<u8, MainRAMMaxSize> MainRAM {};
     std::array<u8, ARM7WRAMSize> ARM7WRAM {};
     std::array<u8, SharedWRAMSize> SharedWRAM {};
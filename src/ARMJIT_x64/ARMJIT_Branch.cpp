@@ -56,9 +56,22 @@ void Compiler::Comp_JumpTo(u32 addr, bool forceNonConstantCycles)
     {
         ARMv5* cpu9 = (ARMv5*)CurCPU;
 
+        // MemTimings only changes once compiling in the background
+        // has been stopped, see ARMJIT::MemoryStateChanging()
         u32 regionCodeCycles = cpu9->MemTimings[addr >> 12][0];
-        u32 compileTimeCodeCycles = cpu9->RegionCodeCycles;
-        cpu9->RegionCodeCycles = regionCodeCycles;
+
+        // when compiling in the background the CPU is running at the same time
+        auto fetch = [&](u32 fetchAddr, bool branch) -> u32
+        {
+            if (Async)
+                return cpu9->CodeFetchCycles(fetchAddr, branch, regionCodeCycles);
+
+            u32 compileTimeCodeCycles = cpu9->RegionCodeCycles;
+            cpu9->RegionCodeCycles = regionCodeCycles;
+            cpu9->CodeRead32(fetchAddr, branch);
+            cpu9->RegionCodeCycles = compileTimeCodeCycles;
+            return cpu9->CodeCycles;
+        };
 
         if (Exit)
             MOV(32, MDisp(RCPU, offsetof(ARMv5, RegionCodeCycles)), Imm32(regionCodeCycles));
@@ -72,15 +85,12 @@ void Compiler::Comp_JumpTo(u32 addr, bool forceNonConstantCycles)
             // doesn't matter if we put garbage in the MSbs there
             if (addr & 0x2)
             {
-                cpu9->CodeRead32(addr-2, true);
-                cycles += cpu9->CodeCycles;
-                cpu9->CodeRead32(addr+2, false);
-                cycles += CurCPU->CodeCycles;
+                cycles += fetch(addr-2, true);
+                cycles += fetch(addr+2, false);
             }
             else
             {
-                cpu9->CodeRead32(addr, true);
-                cycles += cpu9->CodeCycles;
+                cycles += fetch(addr, true);
             }
         }
         else
@@ -88,13 +98,9 @@ void Compiler::Comp_JumpTo(u32 addr, bool forceNonConstantCycles)
             addr &= ~0x3;
             newPC = addr+4;
 
-            cpu9->CodeRead32(addr, true);
-            cycles += cpu9->CodeCycles;
-            cpu9->CodeRead32(addr+4, false);
-            cycles += cpu9->CodeCycles;
+            cycles += fetch(addr, true);
+            cycles += fetch(addr+4, false);
         }
-
-        cpu9->RegionCodeCycles = compileTimeCodeCycles;
     }
     else
     {
@@ -103,8 +109,11 @@ void Compiler::Comp_JumpTo(u32 addr, bool forceNonConstantCycles)
         u32 codeRegion = addr >> 24;
         u32 codeCycles = addr >> 15; // cheato
 
-        cpu7->CodeRegion = codeRegion;
-        cpu7->CodeCycles = codeCycles;
+        if (!Async)
+        {
+            cpu7->CodeRegion = codeRegion;
+            cpu7->CodeCycles = codeCycles;
+        }
 
         if (Exit)
         {
@@ -117,33 +126,29 @@ void Compiler::Comp_JumpTo(u32 addr, bool forceNonConstantCycles)
             addr &= ~0x1;
             newPC = addr+2;
 
-            // this is necessary because ARM7 bios protection
-            u32 compileTimePC = CurCPU->R[15];
-            CurCPU->R[15] = newPC;
-
             cycles += NDS.ARM7MemTimings[codeCycles][0] + NDS.ARM7MemTimings[codeCycles][1];
-
-            CurCPU->R[15] = compileTimePC;
         }
         else
         {
             addr &= ~0x3;
             newPC = addr+4;
 
-            u32 compileTimePC = CurCPU->R[15];
-            CurCPU->R[15] = newPC;
-
             cycles += NDS.ARM7MemTimings[codeCycles][2] + NDS.ARM7MemTimings[codeCycles][3];
-
-            CurCPU->R[15] = compileTimePC;
         }
 
-        cpu7->CodeRegion = R15 >> 24;
-        cpu7->CodeCycles = addr >> 15;
+        if (!Async)
+        {
+            cpu7->CodeRegion = R15 >> 24;
+            cpu7->CodeCycles = addr >> 15;
+        }
     }
 
     if (Exit)
+    {
         MOV(32, MDisp(RCPU, offsetof(ARM, R[15])), Imm32(newPC));
+        ExitTargetKnown = true;
+        ExitTarget = addr;
+    }
     if ((Thumb || CurInstr.Cond() >= 0xE) && !forceNonConstantCycles)
         ConstantCycles += cycles;
     else
@@ -21,9 +21,14 @@
 #include "../ARMJIT.h"
 #include "../ARMInterpreter.h"
 #include "../NDS.h"
+#include "../Savestate.h"
 
 #include <assert.h>
 #include <stdarg.h>
+#include <atomic>
+
+#define XXH_STATIC_LINKING_ONLY
+#include "../xxhash/xxhash.h"
 
 #include "../dolphin/CommonFuncs.h"
 
@@ -232,8 +237,45 @@ void Compiler::A_Comp_MSR()
 /*
     We'll repurpose this .bss memory
 
+    It's only enough for one compiler though, every other
+    one gets its own allocation (see AllocCodeMemoryNear).
  */
 u8 CodeMemory[1024 * 1024 * 32];
+static std::atomic_flag CodeMemoryInUse = ATOMIC_FLAG_INIT;
+
+/*
+    The generated code calls into the rest of the emulator
+    with rel32 calls, so it has to be placed within 2 GB of it.
+    We can only give the OS hints, so just try a couple of them.
+ */
+static u8* AllocCodeMemoryNear(u8* target, u64 size, u64 pageSize)
+{
+    const s64 maxDistance = 0x40000000;
+    const s64 step = 0x1000000;
+
+    for (s64 distance = step; distance < maxDistance; distance += step)
+    {
+        for (int dir = 0; dir < 2; dir++)
+        {
+            u8* hint = (u8*)(((u64)target + (dir ? distance : -distance)) & ~(pageSize - 1));
+        #ifdef _WIN32
+            u8* mem = (u8*)VirtualAlloc(hint, size, MEM_RESERVE | MEM_COMMIT, PAGE_EXECUTE_READWRITE);
+            if (mem)
+                return mem;
+        #else
+            u8* mem = (u8*)mmap(hint, size, PROT_EXEC | PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mem == MAP_FAILED)
+                continue;
+            s64 offset = mem - target;
+            if (offset > -maxDistance && offset < maxDistance)
+                return mem;
+            munmap(mem, size);
+        #endif
+        }
+    }
+
+    return nullptr;
+}
 
 Compiler::Compiler(melonDS::NDS& nds) : XEmitter(), NDS(nds)
 {
@@ -247,17 +289,32 @@ Compiler::Compiler(melonDS::NDS& nds) : XEmitter(), NDS(nds)
         u64 pageSize = sysconf(_SC_PAGE_SIZE);
     #endif
 
-        u8* pageAligned = (u8*)(((u64)CodeMemory & ~(pageSize - 1)) + pageSize);
-        u64 alignedSize = (((u64)CodeMemory + sizeof(CodeMemory)) & ~(pageSize - 1)) - (u64)pageAligned;
+        u8* pageAligned;
+        u64 alignedSize;
 
-    #ifdef _WIN32
-        DWORD dummy;
-        VirtualProtect(pageAligned, alignedSize, PAGE_EXECUTE_READWRITE, &dummy);
-    #elif defined(__APPLE__)
-        pageAligned = (u8*)mmap(NULL, 1024*1024*32, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS ,-1, 0);
-    #else
-        mprotect(pageAligned, alignedSize, PROT_EXEC | PROT_READ | PROT_WRITE);
-    #endif
+        if (!CodeMemoryInUse.test_and_set())
+        {
+            pageAligned = (u8*)(((u64)CodeMemory & ~(pageSize - 1)) + pageSize);
+            alignedSize = (((u64)CodeMemory + sizeof(CodeMemory)) & ~(pageSize - 1)) - (u64)pageAligned;
+
+        #ifdef _WIN32
+            DWORD dummy;
+            VirtualProtect(pageAligned, alignedSize, PAGE_EXECUTE_READWRITE, &dummy);
+        #elif defined(__APPLE__)
+            pageAligned = (u8*)mmap(NULL, 1024*1024*32, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS ,-1, 0);
+        #else
+            mprotect(pageAligned, alignedSize, PROT_EXEC | PROT_READ | PROT_WRITE);
+        #endif
+        }
+        else
+        {
+            alignedSize = sizeof(CodeMemory);
+            pageAligned = AllocCodeMemoryNear(CodeMemory, alignedSize, pageSize);
+            if (!pageAligned)
+                Log(LogLevel::Error, "Couldn't allocate JIT code memory close enough to the emulator!\n");
+            assert(pageAligned);
+            OwnedCodeMemory = pageAligned;
+        }
 
         ResetStart = pageAligned;
         CodeMemSize = alignedSize;
@@ -374,16 +431,9 @@ Compiler::Compiler(melonDS::NDS& nds) : XEmitter(), NDS(nds)
                     PatchedStoreFuncs[consoleType][num][size][reg] = GetWritableCodePtr();
                     if (RSCRATCH3 != ABI_PARAM1)
                         MOV(32, R(ABI_PARAM1), R(RSCRATCH3));
-                    if (num == 0)
-                    {
-                        MOV(64, R(ABI_PARAM2), R(RCPU));
-                        if (rdMapped != ABI_PARAM3)
-                            MOV(32, R(ABI_PARAM3), R(rdMapped));
-                    }
-                    else
-                    {
-                        MOV(32, R(ABI_PARAM2), R(rdMapped));
-                    }
+                    MOV(64, R(ABI_PARAM2), R(RCPU));
+                    if (rdMapped != ABI_PARAM3)
+                        MOV(32, R(ABI_PARAM3), R(rdMapped));
                     ABI_PushRegistersAndAdjustStack(CallerSavedPushRegs, 8);
                     if (consoleType == 0)
                     {
@@ -421,8 +471,7 @@ Compiler::Compiler(melonDS::NDS& nds) : XEmitter(), NDS(nds)
                         PatchedLoadFuncs[consoleType][num][size][signextend][reg] = GetWritableCodePtr();
                         if (RSCRATCH3 != ABI_PARAM1)
                             MOV(32, R(ABI_PARAM1), R(RSCRATCH3));
-                        if (num == 0)
-                            MOV(64, R(ABI_PARAM2), R(RCPU));
+                        MOV(64, R(ABI_PARAM2), R(RCPU));
                         ABI_PushRegistersAndAdjustStack(CallerSavedPushRegs, 8);
                         if (consoleType == 0)
                         {
@@ -473,6 +522,25 @@ Compiler::Compiler(melonDS::NDS& nds) : XEmitter(), NDS(nds)
 
     NearSize = FarStart - ResetStart;
     FarSize = (ResetStart + CodeMemSize) - FarStart;
+
+    NearSegmentSize = NearSize / NumCodeSegments;
+    FarSegmentSize = FarSize / NumCodeSegments;
+}
+
+Compiler::~Compiler()
+{
+    if (OwnedCodeMemory)
+    {
+    #ifdef _WIN32
+        VirtualFree(OwnedCodeMemory, 0, MEM_RELEASE);
+    #else
+        munmap(OwnedCodeMemory, sizeof(CodeMemory));
+    #endif
+    }
+    else
+    {
+        CodeMemoryInUse.clear();
+    }
 }
 
 void Compiler::LoadCPSR()
@@ -663,8 +731,187 @@ void Compiler::Reset()
 
     NearCode = NearStart;
     FarCode = FarStart;
+    CurSegment = 0;
+    Wrapped = false;
 
     LoadStorePatches.clear();
+    FastMemBaseRelocs.clear();
+}
+
+void Compiler::NextCodeSegment()
+{
+    CurSegment = (CurSegment + 1) % NumCodeSegments;
+    if (CurSegment == 0)
+        Wrapped = true;
+    Log(LogLevel::Debug, "reusing code segment %d\n", CurSegment);
+
+    u8* nearStart = NearStart + CurSegment * NearSegmentSize;
+    u8* farStart = FarStart + CurSegment * FarSegmentSize;
+
+    // a block's far code is always in the same segment as its entry point
+    NDS.JIT.EvictCode(nearStart, nearStart + NearSegmentSize);
+
+    for (auto it = LoadStorePatches.begin(); it != LoadStorePatches.end();)
+    {
+        u8* addr = it->first;
+        if ((addr >= nearStart && addr < nearStart + NearSegmentSize)
+            || (addr >= farStart && addr < farStart + FarSegmentSize))
+            it = LoadStorePatches.erase(it);
+        else
+            it++;
+    }
+    for (auto it = FastMemBaseRelocs.begin(); it != FastMemBaseRelocs.end();)
+    {
+        if (it->first >= nearStart && it->first < nearStart + NearSegmentSize)
+            it = FastMemBaseRelocs.erase(it);
+        else
+            it++;
+    }
+
+    memset(nearStart, 0xcc, NearSegmentSize);
+    memset(farStart, 0xcc, FarSegmentSize);
+
+    NearCode = nearStart;
+    FarCode = farStart;
+    SetCodePtr(nearStart);
+}
+
+void Compiler::MOV_FastMemBase(X64Reg reg)
+{
+    // always a full movabs, the emitter would shorten
+    // it if the pointer happened to fit into 32 bits
+    Write8(0x48 | (reg >> 3));
+    Write8(0xB8 | (reg & 7));
+    FastMemBaseRelocs[GetWritableCodePtr()] = Num;
+    Write64((u64)(Num == 0 ? NDS.JIT.Memory.FastMem9Start : NDS.JIT.Memory.FastMem7Start));
+}
+
+u64 Compiler::CodeLayoutHash() const
+{
+    // the functions generated in the constructor call the slow memory
+    // handlers with rel32 calls, so they change along with the position
+    // of the rest of the emulator relative to the code memory
+    struct
+    {
+        s64 RetOffset;
+        u32 NearSize, FarSize;
+        char Build[sizeof(__DATE__ __TIME__)];
+    } layout {};
+    layout.RetOffset = (u8*)&ARM_Ret - CodeMemory;
+    layout.NearSize = NearSize;
+    layout.FarSize = FarSize;
+    memcpy(layout.Build, __DATE__ __TIME__, sizeof(layout.Build));
+
+    return XXH3_64bits_withSeed(CodeMemory, ResetStart - CodeMemory, XXH3_64bits(&layout, sizeof(layout)));
+}
+
+bool Compiler::DoCodeCache(Savestate* file)
+{
+    file->Section("JITX");
+
+    // the code is only position independent relative to the binary
+    // if it's placed into the static code memory
+    if (ResetStart < CodeMemory || ResetStart >= CodeMemory + sizeof(CodeMemory))
+        return false;
+
+    u64 layout = CodeLayoutHash();
+    u64 fileLayout = layout;
+    file->Var64(&fileLayout);
+    if (file->Error || fileLayout != layout)
+    {
+        Log(LogLevel::Info, "JIT code cache was made by a different build\n");
+        return false;
+    }
+
+    u32 nearPos = GetWritableCodePtr() - NearStart;
+    u32 farPos = FarCode - FarStart;
+    u32 segment = CurSegment;
+    bool wrapped = Wrapped;
+    file->Var32(&nearPos);
+    file->Var32(&farPos);
+    file->Var32(&segment);
+    file->Bool32(&wrapped);
+    if (file->Error || nearPos > NearSize || farPos > FarSize || segment >= NumCodeSegments)
+        return false;
+
+    file->VarArray(NearStart, wrapped ? NearSize : nearPos);
+    file->VarArray(FarStart, wrapped ? FarSize : farPos);
+
+    if (!file->Saving)
+    {
+        LoadStorePatches.clear();
+        FastMemBaseRelocs.clear();
+
+        SetCodePtr(NearStart + nearPos);
+        NearCode = NearStart + nearPos;
+        FarCode = FarStart + farPos;
+        CurSegment = segment;
+        Wrapped = wrapped;
+    }
+
+    // all pointers are stored relative to the start of the code memory
+    u32 numPatches = LoadStorePatches.size();
+    file->Var32(&numPatches);
+    if (file->Saving)
+    {
+        for (auto& it : LoadStorePatches)
+        {
+            u32 pc = it.first - ResetStart;
+            u64 func = (u8*)it.second.PatchFunc - ResetStart;
+            file->Var32(&pc);
+            file->Var64(&func);
+            file->Var16((u16*)&it.second.Offset);
+            file->Var16(&it.second.Size);
+        }
+    }
+    else
+    {
+        for (u32 i = 0; i < numPatches && !file->Error; i++)
+        {
+            u32 pc;
+            u64 func;
+            LoadStorePatch patch;
+            file->Var32(&pc);
+            file->Var64(&func);
+            file->Var16((u16*)&patch.Offset);
+            file->Var16(&patch.Size);
+            if (pc >= CodeMemSize)
+                return false;
+
+            patch.PatchFunc = ResetStart + (s64)func;
+            LoadStorePatches[ResetStart + pc] = patch;
+        }
+    }
+
+    u32 numRelocs = FastMemBaseRelocs.size();
+    file->Var32(&numRelocs);
+    if (file->Saving)
+    {
+        for (auto& it : FastMemBaseRelocs)
+        {
+            u32 pos = it.first - ResetStart;
+            file->Var32(&pos);
+            file->Var8(&it.second);
+        }
+    }
+    else
+    {
+        for (u32 i = 0; i < numRelocs && !file->Error; i++)
+        {
+            u32 pos;
+            u8 num;
+            file->Var32(&pos);
+            file->Var8(&num);
+            if (pos + 8 > CodeMemSize)
+                return false;
+
+            void* base = num == 0 ? NDS.JIT.Memory.FastMem9Start : NDS.JIT.Memory.FastMem7Start;
+            memcpy(ResetStart + pos, &base, sizeof(base));
+            FastMemBaseRelocs[ResetStart + pos] = num;
+        }
+    }
+
+    return !file->Error;
 }
 
 bool Compiler::IsJITFault(const u8* addr)
@@ -684,7 +931,84 @@ void Compiler::Comp_SpecialBranchBehaviour(bool taken)
 
         if (ConstantCycles)
             ADD(32, MDisp(RCPU, offsetof(ARM, Cycles)), Imm32(ConstantCycles));
-        JMP((u8*)&ARM_Ret, true);
+
+        // if the branch isn't taken, execution continues after it
+        if (taken)
+            Comp_BlockExit(ExitTargetKnown, ExitTarget);
+        else
+            Comp_BlockExit(true, R15 - (Thumb ? 2 : 4));
+    }
+}
+
+void Compiler::Comp_SimplifiedInstr()
+{
+    Comp_AddCycles_C();
+
+    if (CurInstr.Simplify & simplify_ConstantResult)
+    {
+        int rd = __builtin_ctz(CurInstr.Info.DstRegs);
+        MOV(32, MapReg(rd), Imm32(CurInstr.ConstantResult));
+        RegCache.PutLiteral(rd, CurInstr.ConstantResult);
+    }
+}
+
+void Compiler::Comp_BlockExit(bool targetKnown, u32 target)
+{
+    // goes straight to the dispatcher as long as the exit isn't linked
+    u8* exitJump = GetWritableCodePtr();
+    JMP((u8*)&ARM_Ret, true);
+
+    if (!targetKnown || !NDS.JIT.BranchOptimizationsEnabled())
+        return;
+
+    // otherwise it's patched to continue here, to do the same
+    // the dispatcher does between two blocks
+    s64 timestampOffset = Num == 0
+        ? (u8*)&NDS.ARM9Timestamp - (u8*)&NDS.ARM9
+        : (u8*)&NDS.ARM7Timestamp - (u8*)&NDS.ARM7;
+    s64 targetOffset = Num == 0
+        ? (u8*)&NDS.ARM9Target - (u8*)&NDS.ARM9
+        : (u8*)&NDS.ARM7Target - (u8*)&NDS.ARM7;
+    assert(timestampOffset == (s32)timestampOffset && targetOffset == (s32)targetOffset);
+
+    CMP(32, MDisp(RCPU, offsetof(ARM, StopExecution)), Imm8(0));
+    FixupBranch stopExecution = J_CC(CC_NZ);
+    MOVSX(64, 32, RSCRATCH, MDisp(RCPU, offsetof(ARM, Cycles)));
+    ADD(64, R(RSCRATCH), MDisp(RCPU, timestampOffset));
+    CMP(64, R(RSCRATCH), MDisp(RCPU, targetOffset));
+    FixupBranch targetReached = J_CC(CC_AE);
+    MOV(64, MDisp(RCPU, timestampOffset), R(RSCRATCH));
+    MOV(32, MDisp(RCPU, offsetof(ARM, Cycles)), Imm32(0));
+
+    u8* linkJump = GetWritableCodePtr();
+    JMP((u8*)&ARM_Ret, true);
+
+    SetJumpTarget(stopExecution);
+    SetJumpTarget(targetReached);
+    JMP((u8*)&ARM_Ret, true);
+
+    BlockExits.push_back({target, (u32)(exitJump - ResetStart), (u32)(linkJump - ResetStart)});
+}
+
+static void PatchJump(u8* jump, const u8* dest)
+{
+    s64 distance = dest - (jump + 5);
+    assert(jump[0] == 0xE9 && distance == (s32)distance);
+    s32 rel = (s32)distance;
+    memcpy(jump + 1, &rel, sizeof(rel));
+}
+
+void Compiler::LinkBlockExit(const BlockExit& exit, JitBlockEntry target)
+{
+    u8* exitJump = ResetStart + exit.ExitJumpOffset;
+    if (target)
+    {
+        PatchJump(ResetStart + exit.LinkJumpOffset, (u8*)target);
+        PatchJump(exitJump, exitJump + 5);
+    }
+    else
+    {
+        PatchJump(exitJump, (u8*)&ARM_Ret);
     }
 }
 
@@ -710,18 +1034,18 @@ void Compiler::CreateMethod(const char* namefmt, void* start, ...)
 }
 #endif
 
-JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemoryInstr)
+bool Compiler::CodeSpaceLow() const
 {
-    if (NearSize - (GetCodePtr() - NearStart) < 1024 * 32) // guess...
-    {
-        Log(LogLevel::Debug, "near reset\n");
-        NDS.JIT.ResetBlockCache();
-    }
-    if (FarSize - (FarCode - FarStart) < 1024 * 32) // guess...
-    {
-        Log(LogLevel::Debug, "far reset\n");
-        NDS.JIT.ResetBlockCache();
-    }
+    u8* nearEnd = NearStart + (CurSegment + 1) * NearSegmentSize;
+    u8* farEnd = FarStart + (CurSegment + 1) * FarSegmentSize;
+    return nearEnd - GetCodePtr() < 1024 * 128 || farEnd - FarCode < 1024 * 128; // guess...
+}
+
+JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemoryInstr,
+    u16* hotCounter, u64* lookupEntry)
+{
+    if (CodeSpaceLow())
+        NextCodeSegment();
 
     ConstantCycles = 0;
     Thumb = thumb;
@@ -733,19 +1057,45 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
 
     JitBlockEntry res = (JitBlockEntry)GetWritableCodePtr();
 
+    // both live inside of the NDS object just like the CPU
+    s64 counterOffset = (u8*)hotCounter - (u8*)cpu;
+    s64 entryOffset = (u8*)lookupEntry - (u8*)cpu;
+    if (hotCounter && counterOffset == (s32)counterOffset && entryOffset == (s32)entryOffset)
+    {
+        // nothing has been done yet, so the dispatcher can simply run the block
+        // again once it's replaced. The counter stays at zero until then,
+        // as linked blocks still enter this one.
+        SUB(16, MDisp(RCPU, counterOffset), Imm8(1));
+        FixupBranch hot = J_CC(CC_C, true);
+
+        SwitchToFarCode();
+        SetJumpTarget(hot);
+        MOV(16, MDisp(RCPU, counterOffset), Imm16(0));
+        // the fast lookup entry is emptied like everywhere else, an entry of 0
+        // would still match address 0
+        MOV(64, R(RSCRATCH), Imm64((u64)UINT32_MAX << 32));
+        MOV(64, MDisp(RCPU, entryOffset), R(RSCRATCH));
+        JMP((u8*)&ARM_Ret, true);
+        SwitchToNearCode();
+    }
+
     RegCache = RegisterCache<Compiler, X64Reg>(this, instrs, instrsCount);
+    BlockExits.clear();
 
     for (int i = 0; i < instrsCount; i++)
     {
         CurInstr = instrs[i];
         R15 = CurInstr.Addr + (Thumb ? 4 : 8);
         CodeRegion = R15 >> 24;
+        ExitTargetKnown = false;
 
         Exit = i == instrsCount - 1 || (CurInstr.BranchFlags & branch_FollowCondNotTaken);
 
         CompileFunc comp = Thumb
             ? T_Comp[CurInstr.Info.Kind]
             : A_Comp[CurInstr.Info.Kind];
+        if (CurInstr.Simplify & (simplify_ConstantResult | simplify_DeadResult))
+            comp = &Compiler::Comp_SimplifiedInstr;
 
         bool isConditional = Thumb ? CurInstr.Info.Kind == ARMInstrInfo::tk_BCOND : CurInstr.Cond() < 0xE;
         if (comp == NULL || (CurInstr.BranchFlags & branch_FollowCondTaken) || (i == instrsCount - 1 && (!CurInstr.Info.Branches() || isConditional)))
@@ -838,7 +1188,7 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
             }
         }
 
-        if (comp == NULL)
+        if (comp == NULL && !(CurInstr.Simplify & simplify_KeepCPSR))
             LoadCPSR();
     }
 
@@ -846,7 +1196,15 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
 
     if (ConstantCycles)
         ADD(32, MDisp(RCPU, offsetof(ARM, Cycles)), Imm32(ConstantCycles));
-    JMP((u8*)ARM_Ret, true);
+
+    // the block either ends with an instruction which doesn't branch, with a branch
+    // to a known address or after the untaken path of the last conditional branch
+    const FetchedInstr& last = instrs[instrsCount - 1];
+    bool lastConditional = Thumb ? last.Info.Kind == ARMInstrInfo::tk_BCOND : last.Cond() < 0xE;
+    if (!last.Info.Branches() || (last.BranchFlags & branch_FollowCondNotTaken))
+        Comp_BlockExit(true, R15 - (Thumb ? 2 : 4));
+    else
+        Comp_BlockExit(ExitTargetKnown && !lastConditional, ExitTarget);
 
 #ifdef JIT_PROFILING_ENABLED
     CreateMethod("JIT_Block_%d_%d_%08X", (void*)res, Num, Thumb, instrs[0].Addr);
@@ -31,6 +31,7 @@
 #endif
 
 #include <unordered_map>
+#include <vector>
 
 
 namespace melonDS
@@ -38,6 +39,7 @@ namespace melonDS
 class ARMJIT;
 class ARMJIT_Memory;
 class NDS;
+class Savestate;
 const Gen::X64Reg RCPU = Gen::RBP;
 const Gen::X64Reg RCPSR = Gen::R15;
 
@@ -84,10 +86,31 @@ class Compiler : public Gen::XEmitter
 {
 public:
     explicit Compiler(melonDS::NDS& nds);
+    ~Compiler();
 
     void Reset();
 
-    JitBlockEntry CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemoryInstr);
+    // saves or loads the generated code, see ARMJIT::DoCodeCache
+    bool DoCodeCache(Savestate* file);
+
+    static constexpr bool SupportsAsyncCompile = true;
+    // set while compiling on the compile thread (see ARMJIT::SetAsyncCompile).
+    // The CPU is running at the same time then, so the state of the emulator
+    // may only be read where it doesn't matter if it's stale, and not modified at all.
+    bool Async = false;
+
+    // if so, a new code segment has to be started before compiling another block
+    bool CodeSpaceLow() const;
+
+    // if hotCounter isn't null the block counts it down each time it's entered,
+    // once it's used up the block clears its lookup entry and returns to the dispatcher
+    JitBlockEntry CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemoryInstr,
+        u16* hotCounter, u64* lookupEntry);
+
+    // the exits of the block compiled last which can be linked
+    std::vector<BlockExit> BlockExits {};
+    // makes an exit jump to the given block, or back to the dispatcher if it's null
+    void LinkBlockExit(const BlockExit& exit, JitBlockEntry target);
 
     void LoadReg(int reg, Gen::X64Reg nativeReg);
     void SaveReg(int reg, Gen::X64Reg nativeReg);
@@ -185,6 +208,9 @@ public:
     void Comp_RetriveFlags(bool sign, bool retriveCV, bool carryUsed);
 
     void Comp_SpecialBranchBehaviour(bool taken);
+    void Comp_BlockExit(bool targetKnown, u32 target);
+    // for instructions which were simplified before compiling, see SimplifyBlock
+    void Comp_SimplifiedInstr();
 
 
     Gen::OpArg Comp_RegShiftImm(int op, int amount, Gen::OpArg rm, bool S, bool& carryUsed);
@@ -251,6 +277,29 @@ public:
     u8* NearStart {};
     u8* FarStart {};
 
+    // near and far code are both split into segments, which are filled one
+    // after another. Once the last one is full, the oldest one is emptied,
+    // so that running out of code memory only costs recompiling the blocks
+    // compiled the longest time ago instead of all of them.
+    static constexpr int NumCodeSegments = 8;
+    u32 NearSegmentSize {};
+    u32 FarSegmentSize {};
+    int CurSegment {};
+
+    // set once the segments were used all the way through, so that
+    // there might be code behind the current position of every segment
+    bool Wrapped {};
+
+    void NextCodeSegment();
+
+    // the fastmem base pointers are the only absolute addresses in
+    // the generated code, this is where they are written to (and for which CPU)
+    // so that they can be relocated when the code is loaded again
+    std::unordered_map<u8*, u8> FastMemBaseRelocs {};
+
+    void MOV_FastMemBase(Gen::X64Reg reg);
+    u64 CodeLayoutHash() const;
+
     void* PatchedStoreFuncs[2][2][3][16] {};
     void* PatchedLoadFuncs[2][2][3][2][16] {};
 
@@ -258,10 +307,17 @@ public:
 
     u8* ResetStart {};
     u32 CodeMemSize {};
+    // only set if this compiler doesn't use the static code memory
+    u8* OwnedCodeMemory {};
 
     bool Exit {};
     bool IrregularCycles {};
 
+    // set by Comp_JumpTo if the current instruction leaves the block
+    // for an address which is known at compile time
+    bool ExitTargetKnown {};
+    u32 ExitTarget {};
+
     void* ReadBanked {};
     void* WriteBanked {};
 
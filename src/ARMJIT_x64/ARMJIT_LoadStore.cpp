@@ -43,6 +43,9 @@ u8* Compiler::RewriteMemAccess(u8* pc)
 
         //printf("rewriting memory access %p %d %d\n", (u8*)pc-ResetStart, patch.Offset, patch.Size);
 
+        for (u8* reloc = pc + (ptrdiff_t)patch.Offset; reloc < pc + (ptrdiff_t)patch.Offset + patch.Size; reloc++)
+            FastMemBaseRelocs.erase(reloc);
+
         XEmitter emitter(pc + (ptrdiff_t)patch.Offset);
         emitter.CALL(patch.PatchFunc);
         ptrdiff_t remainingSize = (ptrdiff_t)patch.Size - 5;
@@ -69,38 +72,67 @@ u8* Compiler::RewriteMemAccess(u8* pc)
 
 bool Compiler::Comp_MemLoadLiteral(int size, bool signExtend, int rd, u32 addr)
 {
-    u32 localAddr = NDS.JIT.LocaliseCodeAddress(Num, addr);
-
-    int invalidLiteralIdx = NDS.JIT.InvalidLiterals.Find(localAddr);
-    if (invalidLiteralIdx != -1)
+    u32 val;
+    if (Async)
     {
-        return false;
-    }
+        // neither the memory nor the list of invalid literals
+        // can be accessed while the emulation is running
+        if (!CurInstr.HasLiteral)
+            return false;
 
-    Comp_AddCycles_CDI();
+        Comp_AddCycles_CDI();
 
-    u32 val;
-    // make sure arm7 bios is accessible
-    u32 tmpR15 = CurCPU->R[15];
-    CurCPU->R[15] = R15;
-    if (size == 32)
-    {
-        CurCPU->DataRead32(addr & ~0x3, &val);
-        val = melonDS::ROR(val, (addr & 0x3) << 3);
-    }
-    else if (size == 16)
-    {
-        CurCPU->DataRead16(addr & ~0x1, &val);
-        if (signExtend)
-            val = ((s32)val << 16) >> 16;
+        if (size == 32)
+        {
+            val = melonDS::ROR(CurInstr.Literal, (addr & 0x3) << 3);
+        }
+        else if (size == 16)
+        {
+            val = (u16)(CurInstr.Literal >> ((addr & 0x2) << 3));
+            if (signExtend)
+                val = ((s32)val << 16) >> 16;
+        }
+        else
+        {
+            val = (u8)(CurInstr.Literal >> ((addr & 0x3) << 3));
+            if (signExtend)
+                val = ((s32)val << 24) >> 24;
+        }
     }
     else
     {
-        CurCPU->DataRead8(addr, &val);
-        if (signExtend)
-            val = ((s32)val << 24) >> 24;
+        u32 localAddr = NDS.JIT.LocaliseCodeAddress(Num, addr);
+
+        int invalidLiteralIdx = NDS.JIT.InvalidLiterals.Find(localAddr);
+        if (invalidLiteralIdx != -1)
+        {
+            return false;
+        }
+
+        Comp_AddCycles_CDI();
+
+        // make sure arm7 bios is accessible
+        u32 tmpR15 = CurCPU->R[15];
+        CurCPU->R[15] = R15;
+        if (size == 32)
+        {
+            CurCPU->DataRead32(addr & ~0x3, &val);
+            val = melonDS::ROR(val, (addr & 0x3) << 3);
+        }
+        else if (size == 16)
+        {
+            CurCPU->DataRead16(addr & ~0x1, &val);
+            if (signExtend)
+                val = ((s32)val << 16) >> 16;
+        }
+        else
+        {
+            CurCPU->DataRead8(addr, &val);
+            if (signExtend)
+                val = ((s32)val << 24) >> 24;
+        }
+        CurCPU->R[15] = tmpR15;
     }
-    CurCPU->R[15] = tmpR15;
 
     MOV(32, MapReg(rd), Imm32(val));
 
@@ -218,7 +250,7 @@ void Compiler::Comp_MemAccess(int rd, int rn, const Op2& op2, int size, int flag
 
         assert(patch.PatchFunc != NULL);
 
-        MOV(64, R(RSCRATCH), ImmPtr(Num == 0 ? NDS.JIT.Memory.FastMem9Start : NDS.JIT.Memory.FastMem7Start));
+        MOV_FastMemBase(RSCRATCH);
 
         X64Reg maskedAddr = RSCRATCH3;
         if (size > 8)
@@ -275,10 +307,13 @@ void Compiler::Comp_MemAccess(int rd, int rn, const Op2& op2, int size, int flag
         {
             AND(32, R(RSCRATCH3), Imm8(addressMask));
 
+            // on Windows param 3 is R8 which is also scratch 4 which can be used for rd
+            if (flags & memop_Store)
+                MOV(32, R(ABI_PARAM3), rdMapped);
+
+            MOV(64, R(ABI_PARAM2), R(RCPU));
             if (ABI_PARAM1 != RSCRATCH3)
                 MOV(32, R(ABI_PARAM1), R(RSCRATCH3));
-            if (flags & memop_Store)
-                MOV(32, R(ABI_PARAM2), rdMapped);
 
             ABI_CallFunction((void (*)())func);
 
@@ -303,15 +338,16 @@ void Compiler::Comp_MemAccess(int rd, int rn, const Op2& op2, int size, int flag
         }
         else
         {
+            // on Windows param 3 is R8 which is also scratch 4 which can be used for rd
+            if (flags & memop_Store)
+                MOV(32, R(ABI_PARAM3), rdMapped);
+
+            MOV(64, R(ABI_PARAM2), R(RCPU));
+            if (ABI_PARAM1 != RSCRATCH3)
+                MOV(32, R(ABI_PARAM1), R(RSCRATCH3));
+
             if (Num == 0)
             {
-                // on Windows param 3 is R8 which is also scratch 4 which can be used for rd
-                if (flags & memop_Store)
-                    MOV(32, R(ABI_PARAM3), rdMapped);
-
-                MOV(64, R(ABI_PARAM2), R(RCPU));
-                if (ABI_PARAM1 != RSCRATCH3)
-                    MOV(32, R(ABI_PARAM1), R(RSCRATCH3));
                 if (flags & memop_Store)
                 {
                     switch (size | NDS.ConsoleType)
@@ -339,12 +375,8 @@ void Compiler::Comp_MemAccess(int rd, int rn, const Op2& op2, int size, int flag
             }
             else
             {
-                if (ABI_PARAM1 != RSCRATCH3)
-                    MOV(32, R(ABI_PARAM1), R(RSCRATCH3));
                 if (flags & memop_Store)
                 {
-                    MOV(32, R(ABI_PARAM2), rdMapped);
-
                     switch (size | NDS.ConsoleType)
                     {
                     case 32: CALL((void*)&SlowWrite7<u32, 0>); break;
@@ -455,7 +487,7 @@ s32 Compiler::Comp_MemAccessBlock(int rn, BitSet16 regs, bool store, bool preinc
         u8* fastPathStart = GetWritableCodePtr();
         u8* loadStoreAddr[16];
 
-        MOV(64, R(RSCRATCH2), ImmPtr(Num == 0 ? NDS.JIT.Memory.FastMem9Start : NDS.JIT.Memory.FastMem7Start));
+        MOV_FastMemBase(RSCRATCH2);
         ADD(64, R(RSCRATCH2), R(RSCRATCH4));
 
         u32 offset = 0;
@@ -521,8 +553,7 @@ s32 Compiler::Comp_MemAccessBlock(int rn, BitSet16 regs, bool store, bool preinc
         else
             LEA(64, ABI_PARAM2, MDisp(RSP, allocOffset));
 
-        if (Num == 0)
-            MOV(64, R(ABI_PARAM4), R(RCPU));
+        MOV(64, R(ABI_PARAM4), R(RCPU));
 
         switch (Num * 2 | NDS.ConsoleType)
         {
@@ -625,8 +656,7 @@ s32 Compiler::Comp_MemAccessBlock(int rn, BitSet16 regs, bool store, bool preinc
             MOV(64, R(ABI_PARAM2), R(RSP));
 
         MOV(32, R(ABI_PARAM3), Imm32(regsCount));
-        if (Num == 0)
-            MOV(64, R(ABI_PARAM4), R(RCPU));
+        MOV(64, R(ABI_PARAM4), R(RCPU));
 
         switch (Num * 2 | NDS.ConsoleType)
         {
@@ -20,8 +20,6 @@
 
 #include <stdio.h>
 
-#include "ARMJIT.h"
-
 namespace melonDS::ARMInstrInfo
 {
 
@@ -562,4 +560,33 @@ Info Decode(bool thumb, u32 num, u32 instr, bool literaloptimizations)
     }
 }
 
+bool IsIdleLoop(bool thumb, const Info* instrs, int count)
+{
+    // see https://github.com/dolphin-emu/dolphin/blob/master/Source/Core/Core/PowerPC/PPCAnalyst.cpp#L678
+    // it basically checks if one iteration of a loop depends on another
+    // the rules are quite simple
+
+    u16 regsWrittenTo = 0;
+    u16 regsDisallowedToWrite = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (instrs[i].SpecialKind == special_WriteMem)
+            return false;
+        if (!thumb && instrs[i].Kind >= ak_MSR_IMM && instrs[i].Kind <= ak_MRC)
+            return false;
+        if (i < count - 1 && instrs[i].Branches())
+            return false;
+
+        u16 srcRegs = instrs[i].SrcRegs & ~(1 << 15);
+        u16 dstRegs = instrs[i].DstRegs & ~(1 << 15);
+
+        regsDisallowedToWrite |= srcRegs & ~regsWrittenTo;
+
+        if (dstRegs & regsDisallowedToWrite)
+            return false;
+        regsWrittenTo |= dstRegs;
+    }
+    return true;
+}
+
 }
@@ -276,6 +276,10 @@ struct Info
 
 Info Decode(bool thumb, u32 num, u32 instr, bool literaloptimizations);
 
+// whether a loop made of these instructions (the last one being the branch back)
+// can only be left once something outside of it changes, e.g. memory it reads
+bool IsIdleLoop(bool thumb, const Info* instrs, int count);
+
 }
 
 #endif
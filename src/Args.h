@@ -55,7 +55,8 @@ constexpr std::array<u8, N> BrokenBIOS = []() constexpr {
 }();
 
 /// Arguments that configure the JIT.
-/// Ignored in builds that don't have the JIT included.
+/// Builds that don't have the JIT included only use them
+/// if CachedInterpreter is set, and ignore them otherwise.
 struct JITArgs
 {
     unsigned MaxBlockSize = 32;
@@ -67,6 +68,20 @@ struct JITArgs
     /// Enabled by default, but frontends should disable this when debugging
     /// so the constants segfaults don't hinder debugging.
     bool FastMemory = true;
+
+    /// Compile blocks on a separate thread and interpret them until they're done,
+    /// instead of stopping the emulation whenever a lot of new code is run.
+    /// Which blocks are interpreted then depends on the timing of the host,
+    /// so the emulation isn't deterministic anymore.
+    /// Ignored if the JIT backend doesn't support it (only the x64 one does).
+    bool AsyncCompile = false;
+
+    /// Instead of compiling blocks to host code, only decode them once
+    /// and run them through the interpreter, for hosts which don't allow
+    /// generating code at runtime. Literal optimizations, fast memory
+    /// and asynchronous compilation don't apply to it and are ignored.
+    /// Also available in builds without the JIT, unless they exclude it as well.
+    bool CachedInterpreter = false;
 };
 
 using ARM9BIOSImage = std::array<u8, ARM9BIOSSize>;
@@ -113,7 +128,8 @@ struct NDSArgs
     /// How the JIT should be configured when initializing.
     /// Defaults to enabled, with default settings.
     /// To disable the JIT, set this to std::nullopt.
-    /// Ignored in builds that don't have the JIT included.
+    /// Ignored in builds that don't have the JIT included,
+    /// unless the cached interpreter is requested.
     std::optional<JITArgs> JIT = JITArgs();
 
     AudioBitDepth BitDepth = AudioBitDepth::Auto;
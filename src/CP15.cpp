@@ -81,8 +81,8 @@ void ARMv5::CP15DoSavestate(Savestate* file)
     file->Var32(&DTCMSetting);
     file->Var32(&ITCMSetting);
 
-    file->VarArray(ITCM, ITCMPhysicalSize);
-    file->VarArray(DTCM, DTCMPhysicalSize);
+    file->VarPages(ITCM, ITCMPhysicalSize);
+    file->VarPages(DTCM, DTCMPhysicalSize);
 
     file->Var32(&PU_CodeCacheable);
     file->Var32(&PU_DataCacheable);
@@ -132,10 +132,12 @@ void ARMv5::UpdateDTCMSetting()
 
 void ARMv5::UpdateITCMSetting()
 {
+    NDS.JIT.MemoryStateChanging();
+
     if (CP15Control & (1<<18))
     {
         ITCMSize = 0x200 << ((ITCMSetting >> 1) & 0x1F);
-#ifdef JIT_ENABLED
+#ifdef CACHED_INTERPRETER_ENABLED
         FastBlockLookupSize = 0;
 #endif
     }
@@ -143,6 +145,8 @@ void ARMv5::UpdateITCMSetting()
     {
         ITCMSize = 0;
     }
+
+    NDS.JIT.UnlinkAllBlocks();
 }
 
 
@@ -292,6 +296,8 @@ void ARMv5::UpdatePURegions(bool update_all)
 
 void ARMv5::UpdateRegionTimings(u32 addrstart, u32 addrend)
 {
+    NDS.JIT.MemoryStateChanging();
+
     for (u32 i = addrstart; i < addrend; i++)
     {
         u8 pu = PU_Map[i];
@@ -780,26 +786,33 @@ u32 ARMv5::CodeRead32(u32 addr, bool branch)
         }
     }*/
 
+    CodeCycles = CodeFetchCycles(addr, branch, RegionCodeCycles);
+
     if (addr < ITCMSize)
-    {
-        CodeCycles = 1;
         return *(u32*)&ITCM[addr & (ITCMPhysicalSize - 1)];
-    }
 
-    CodeCycles = RegionCodeCycles;
-    if (CodeCycles == 0xFF) // cached memory. hax
+    //if (RegionCodeCycles == 0xFF)
+    //    return *(u32*)&CurICacheLine[addr & 0x1C];
+
+    if (CodeMem.Mem) return *(u32*)&CodeMem.Mem[addr & CodeMem.Mask];
+
+    return BusRead32(addr);
+}
+
+u32 ARMv5::CodeFetchCycles(u32 addr, bool branch, u32 regionCodeCycles) const
+{
+    if (addr < ITCMSize)
+        return 1;
+
+    if (regionCodeCycles == 0xFF) // cached memory. hax
     {
         if (branch || !(addr & 0x1F))
-            CodeCycles = kCodeCacheTiming;//ICacheLookup(addr);
+            return kCodeCacheTiming;//ICacheLookup(addr);
         else
-            CodeCycles = 1;
-
-        //return *(u32*)&CurICacheLine[addr & 0x1C];
+            return 1;
     }
 
-    if (CodeMem.Mem) return *(u32*)&CodeMem.Mem[addr & CodeMem.Mask];
-
-    return BusRead32(addr);
+    return regionCodeCycles;
 }
 
 
@@ -1005,7 +1018,7 @@ void ARMv5::DataWrite32S(u32 addr, u32 val)
     {
         DataCycles += 1;
         *(u32*)&ITCM[addr & (ITCMPhysicalSize - 1)] = val;
-#ifdef JIT_ENABLED
+#ifdef CACHED_INTERPRETER_ENABLED
         NDS.JIT.CheckAndInvalidate<0, ARMJIT_Memory::memregion_ITCM>(addr);
 #endif
         return;
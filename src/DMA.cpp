@@ -17,6 +17,8 @@
 */
 
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
 #include "NDS.h"
 #include "DSi.h"
 #include "DMA.h"
@@ -549,6 +551,83 @@ u32 DMA::UnitTimings7_32(bool burststart)
     }
 }
 
+// copies as many units as possible in one go, if both the source and
+// the destination are memory the page tables point to and are counted up.
+// only the timings still have to be added up unit by unit, as the burst
+// tables depend on what came before. stops at the end of a page or
+// once the CPU's time is up, the same as the unit by unit loop.
+template <u32 num, typename T>
+bool DMA::CopyBulk(bool& burststart)
+{
+    if (SrcAddrInc != 1 || DstAddrInc != 1)
+        return false;
+    if ((CurSrcAddr | CurDstAddr) & (sizeof(T) - 1))
+        return false;
+    if (CurSrcAddr >= MemPages::End || CurDstAddr >= MemPages::End)
+        return false;
+
+    MemPages& pages = num == 0 ? NDS.ARM9Pages : NDS.ARM7Pages;
+    u8* src = pages.Read[CurSrcAddr >> MemPages::Shift];
+    u8* dst = pages.Write[CurDstAddr >> MemPages::Shift];
+    int dstregion = pages.WriteRegion[CurDstAddr >> MemPages::Shift];
+    bool vram = false;
+    if (num == 0 && !dst && (CurDstAddr >> 24) == 0x06)
+    {
+        // the VRAM pages are only there for reading, but all
+        // that's missing for writing them is marking them as dirty
+        dst = pages.Read[CurDstAddr >> MemPages::Shift];
+        dstregion = ARMJIT_Memory::memregion_VRAM;
+        vram = true;
+    }
+    if (!src || !dst)
+        return false;
+
+    src += CurSrcAddr & (MemPages::Size - 1);
+    dst += CurDstAddr & (MemPages::Size - 1);
+
+    u32 maxunits = std::min(MemPages::Size - (CurSrcAddr & (MemPages::Size - 1)),
+                            MemPages::Size - (CurDstAddr & (MemPages::Size - 1))) / sizeof(T);
+    maxunits = std::min(maxunits, IterCount);
+
+    // copying unit by unit repeats the data if the destination
+    // lies a bit after the source, memcpy wouldn't do that
+    if (src < dst + maxunits*sizeof(T) && dst < src + maxunits*sizeof(T))
+        return false;
+
+    u32 units = 0;
+    while (units < maxunits)
+    {
+        units++;
+        if constexpr (num == 0)
+        {
+            NDS.ARM9Timestamp += ((sizeof(T) == 4 ? UnitTimings9_32(burststart) : UnitTimings9_16(burststart)) << NDS.ARM9ClockShift);
+            burststart = false;
+            if (NDS.ARM9Timestamp >= NDS.ARM9Target) break;
+        }
+        else
+        {
+            NDS.ARM7Timestamp += (sizeof(T) == 4 ? UnitTimings7_32(burststart) : UnitTimings7_16(burststart));
+            burststart = false;
+            if (NDS.ARM7Timestamp >= NDS.ARM7Target) break;
+        }
+    }
+
+    u32 len = units * sizeof(T);
+    for (u32 addr = CurDstAddr; addr < CurDstAddr + len; addr = (addr & ~0xF) + 0x10)
+        NDS.JIT.CheckAndInvalidate(num, dstregion, addr);
+    memcpy(dst, src, len);
+    if (vram)
+        NDS.GPU.SetVRAMDirty(dst, len);
+    PROFILE_COUNT(NDS.Profiler, DMAUnits, units);
+
+    CurSrcAddr += len;
+    CurDstAddr += len;
+    IterCount -= units;
+    RemCount -= units;
+
+    return true;
+}
+
 void DMA::Run9()
 {
     if (NDS.ARM9Timestamp >= NDS.ARM9Target) return;
@@ -563,10 +642,17 @@ void DMA::Run9()
     {
         while (IterCount > 0 && !Stall)
         {
+            if (CopyBulk<0, u16>(burststart))
+            {
+                if (NDS.ARM9Timestamp >= NDS.ARM9Target) break;
+                continue;
+            }
+
             NDS.ARM9Timestamp += (UnitTimings9_16(burststart) << NDS.ARM9ClockShift);
             burststart = false;
 
-            NDS.ARM9Write16(CurDstAddr, NDS.ARM9Read16(CurSrcAddr));
+            NDS.ARM9Write<u16>(CurDstAddr, NDS.ARM9Read<u16>(CurSrcAddr));
+            PROFILE_COUNT(NDS.Profiler, DMAUnits, 1);
 
             CurSrcAddr += SrcAddrInc<<1;
             CurDstAddr += DstAddrInc<<1;
@@ -580,10 +666,17 @@ void DMA::Run9()
     {
         while (IterCount > 0 && !Stall)
         {
+            if (CopyBulk<0, u32>(burststart))
+            {
+                if (NDS.ARM9Timestamp >= NDS.ARM9Target) break;
+                continue;
+            }
+
             NDS.ARM9Timestamp += (UnitTimings9_32(burststart) << NDS.ARM9ClockShift);
             burststart = false;
 
-            NDS.ARM9Write32(CurDstAddr, NDS.ARM9Read32(CurSrcAddr));
+            NDS.ARM9Write<u32>(CurDstAddr, NDS.ARM9Read<u32>(CurSrcAddr));
+            PROFILE_COUNT(NDS.Profiler, DMAUnits, 1);
 
             CurSrcAddr += SrcAddrInc<<2;
             CurDstAddr += DstAddrInc<<2;
@@ -636,10 +729,17 @@ void DMA::Run7()
     {
         while (IterCount > 0 && !Stall)
         {
+            if (CopyBulk<1, u16>(burststart))
+            {
+                if (NDS.ARM7Timestamp >= NDS.ARM7Target) break;
+                continue;
+            }
+
             NDS.ARM7Timestamp += UnitTimings7_16(burststart);
             burststart = false;
 
-            NDS.ARM7Write16(CurDstAddr, NDS.ARM7Read16(CurSrcAddr));
+            NDS.ARM7Write<u16>(CurDstAddr, NDS.ARM7Read<u16>(CurSrcAddr));
+            PROFILE_COUNT(NDS.Profiler, DMAUnits, 1);
 
             CurSrcAddr += SrcAddrInc<<1;
             CurDstAddr += DstAddrInc<<1;
@@ -653,10 +753,17 @@ void DMA::Run7()
     {
         while (IterCount > 0 && !Stall)
         {
+            if (CopyBulk<1, u32>(burststart))
+            {
+                if (NDS.ARM7Timestamp >= NDS.ARM7Target) break;
+                continue;
+            }
+
             NDS.ARM7Timestamp += UnitTimings7_32(burststart);
             burststart = false;
 
-            NDS.ARM7Write32(CurDstAddr, NDS.ARM7Read32(CurSrcAddr));
+            NDS.ARM7Write<u32>(CurDstAddr, NDS.ARM7Read<u32>(CurSrcAddr));
+            PROFILE_COUNT(NDS.Profiler, DMAUnits, 1);
 
             CurSrcAddr += SrcAddrInc<<2;
             CurDstAddr += DstAddrInc<<2;
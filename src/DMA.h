@@ -78,6 +78,8 @@ public:
     u32 Cnt {};
 
 private:
+    template <u32 num, typename T> bool CopyBulk(bool& burststart);
+
     melonDS::NDS& NDS;
     u32 CPU {};
     u32 Num {};
@@ -1249,6 +1249,9 @@ void DSi::ApplyNewRAMSize(u32 size)
         Log(LogLevel::Debug, "RAM: 16MB\n");
         break;
     }
+
+    // main RAM is mirrored differently now
+    JIT.UnlinkAllBlocks();
 }
 
 
@@ -2836,11 +2839,13 @@ void DSi::ARM7IOWrite8(u32 addr, u8 val)
     case 0x04004000:
         if (!(SCFG_EXT[1] & (1 << 31))) /* no access to SCFG Registers if disabled*/
             return;
+        JIT.MemoryStateChanging();
         SCFG_BIOS |= (val & 0x03);
         return;
     case 0x04004001:
         if (!(SCFG_EXT[1] & (1 << 31))) /* no access to SCFG Registers if disabled*/
             return;
+        JIT.MemoryStateChanging();
         SCFG_BIOS |= ((val & 0x07) << 8);
         return;
     case 0x04004002:
@@ -2935,6 +2940,7 @@ void DSi::ARM7IOWrite16(u32 addr, u16 val)
         case 0x04004000:
             if (!(SCFG_EXT[1] & (1 << 31))) /* no access to SCFG Registers if disabled*/
                 return;
+            JIT.MemoryStateChanging();
             SCFG_BIOS |= (val & 0x0703);
             return;
         case 0x04004002:
@@ -3042,6 +3048,7 @@ void DSi::ARM7IOWrite32(u32 addr, u32 val)
     case 0x04004000:
         if (!(SCFG_EXT[1] & (1 << 31))) /* no access to SCFG Registers if disabled*/
             return;
+        JIT.MemoryStateChanging();
         SCFG_BIOS |= (val & 0x0703);
         return;
     case 0x04004008:
@@ -0,0 +1,123 @@
+/*
+    Copyright 2016-2023 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef EVENTQUEUE_H
+#define EVENTQUEUE_H
+
+#include "types.h"
+
+namespace melonDS
+{
+
+/// Pending scheduler events and the timestamp they're due at.
+///
+/// The timestamp of the event that's due next is cached, so looking
+/// it up is free and checking whether anything is due is one compare.
+/// The cache only has to be rebuilt when an event actually fires or
+/// the next one is cancelled.
+///
+/// There are few enough events for this to beat a binary heap:
+/// the heap would have to be reordered every time an event fires
+/// and rearms itself, which happens a lot more often than a lookup
+/// finds nothing to do.
+template <u32 NumEvents>
+class EventQueue
+{
+    static_assert(NumEvents <= 32, "pending events are kept as a 32-bit mask");
+
+public:
+    void Clear() noexcept
+    {
+        Mask = 0;
+        Next = UINT64_MAX;
+    }
+
+    [[nodiscard]] bool Contains(u32 id) const noexcept { return Mask & (1 << id); }
+    [[nodiscard]] bool IsEmpty() const noexcept { return Mask == 0; }
+
+    /// @return The timestamp of the event that's due next,
+    /// or UINT64_MAX if no event is pending.
+    [[nodiscard]] u64 NextTimestamp() const noexcept { return Next; }
+
+    /// Adds event \c id, which must not be queued already.
+    void Push(u32 id, u64 timestamp) noexcept
+    {
+        Timestamps[id] = timestamp;
+        Mask |= (1 << id);
+        if (timestamp < Next)
+            Next = timestamp;
+    }
+
+    /// Removes event \c id, does nothing if it isn't queued.
+    void Remove(u32 id) noexcept
+    {
+        if (!(Mask & (1 << id)))
+            return;
+
+        Mask &= ~(1 << id);
+        if (Timestamps[id] == Next)
+            Next = FindNext();
+    }
+
+    /// Removes every event that is due at \c timestamp or earlier.
+    /// @return The IDs of the removed events as a bitmask.
+    u32 PopDue(u64 timestamp) noexcept
+    {
+        if (Next > timestamp)
+            return 0;
+
+        u32 due = 0;
+        u32 mask = Mask;
+        while (mask)
+        {
+            u32 id = __builtin_ctz(mask);
+            mask &= mask - 1;
+
+            if (Timestamps[id] <= timestamp)
+                due |= (1 << id);
+        }
+
+        Mask &= ~due;
+        Next = FindNext();
+        return due;
+    }
+
+private:
+    u64 FindNext() const noexcept
+    {
+        u64 next = UINT64_MAX;
+        u32 mask = Mask;
+        while (mask)
+        {
+            u32 id = __builtin_ctz(mask);
+            mask &= mask - 1;
+
+            if (Timestamps[id] < next)
+                next = Timestamps[id];
+        }
+        return next;
+    }
+
+    u64 Timestamps[NumEvents] {};
+    u32 Mask = 0;
+    u64 Next = UINT64_MAX;
+};
+
+}
+
+#endif // EVENTQUEUE_H
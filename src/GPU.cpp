@@ -118,6 +118,8 @@ void GPU::ResetVRAMCache() noexcept
 
 void GPU::Reset() noexcept
 {
+    GPU2D_Renderer->Sync();
+
     VCount = 0;
     NextVCount = -1;
     TotalScanlines = 0;
@@ -198,6 +200,8 @@ void GPU::Reset() noexcept
 
 void GPU::Stop() noexcept
 {
+    GPU2D_Renderer->Sync();
+
     int fbsize;
     if (GPU3D.IsRendererAccelerated())
         fbsize = (256*3 + 1) * 192;
@@ -214,6 +218,8 @@ void GPU::Stop() noexcept
 
 void GPU::DoSavestate(Savestate* file) noexcept
 {
+    GPU2D_Renderer->Sync();
+
     file->Section("GPUG");
 
     file->Var16(&VCount);
@@ -228,15 +234,15 @@ void GPU::DoSavestate(Savestate* file) noexcept
     file->VarArray(Palette, 2*1024);
     file->VarArray(OAM, 2*1024);
 
-    file->VarArray(VRAM_A, 128*1024);
-    file->VarArray(VRAM_B, 128*1024);
-    file->VarArray(VRAM_C, 128*1024);
-    file->VarArray(VRAM_D, 128*1024);
-    file->VarArray(VRAM_E,  64*1024);
-    file->VarArray(VRAM_F,  16*1024);
-    file->VarArray(VRAM_G,  16*1024);
-    file->VarArray(VRAM_H,  32*1024);
-    file->VarArray(VRAM_I,  16*1024);
+    file->VarPages(VRAM_A, 128*1024);
+    file->VarPages(VRAM_B, 128*1024);
+    file->VarPages(VRAM_C, 128*1024);
+    file->VarPages(VRAM_D, 128*1024);
+    file->VarPages(VRAM_E,  64*1024);
+    file->VarPages(VRAM_F,  16*1024);
+    file->VarPages(VRAM_G,  16*1024);
+    file->VarPages(VRAM_H,  32*1024);
+    file->VarPages(VRAM_I,  16*1024);
 
     file->VarArray(VRAMCNT, 9);
     file->Var8(&VRAMSTAT);
@@ -304,6 +310,8 @@ void GPU::SetRenderer3D(std::unique_ptr<Renderer3D>&& renderer) noexcept
 
 void GPU::InitFramebuffers() noexcept
 {
+    GPU2D_Renderer->Sync();
+
     int fbsize;
     if (GPU3D.IsRendererAccelerated())
         fbsize = (256*3 + 1) * 192;
@@ -881,19 +889,23 @@ void GPU::StartHBlank(u32 line) noexcept
 
     if (VCount < 192)
     {
-        // draw
-        // note: this should start 48 cycles after the scanline start
-        if (line < 192)
         {
-            GPU2D_Renderer->DrawScanline(line, &GPU2D_A);
-            GPU2D_Renderer->DrawScanline(line, &GPU2D_B);
-        }
+            PROFILE_SCOPE(NDS.Profiler, ProfileZone_Render2D);
 
-        // sprites are pre-rendered one scanline in advance
-        if (line < 191)
-        {
-            GPU2D_Renderer->DrawSprites(line+1, &GPU2D_A);
-            GPU2D_Renderer->DrawSprites(line+1, &GPU2D_B);
+            // draw
+            // note: this should start 48 cycles after the scanline start
+            if (line < 192)
+            {
+                GPU2D_Renderer->DrawScanline(line, &GPU2D_A);
+                GPU2D_Renderer->DrawScanline(line, &GPU2D_B);
+            }
+
+            // sprites are pre-rendered one scanline in advance
+            if (line < 191)
+            {
+                GPU2D_Renderer->DrawSprites(line+1, &GPU2D_A);
+                GPU2D_Renderer->DrawSprites(line+1, &GPU2D_B);
+            }
         }
 
         NDS.CheckDMAs(0, 0x02);
@@ -904,6 +916,7 @@ void GPU::StartHBlank(u32 line) noexcept
     }
     else if (VCount == 262)
     {
+        PROFILE_SCOPE(NDS.Profiler, ProfileZone_Render2D);
         GPU2D_Renderer->DrawSprites(0, &GPU2D_A);
         GPU2D_Renderer->DrawSprites(0, &GPU2D_B);
     }
@@ -919,6 +932,8 @@ void GPU::StartHBlank(u32 line) noexcept
 
 void GPU::FinishFrame(u32 lines) noexcept
 {
+    GPU2D_Renderer->Sync();
+
     FrontBuffer = FrontBuffer ? 0 : 1;
     AssignFramebuffers();
 
@@ -933,6 +948,8 @@ void GPU::FinishFrame(u32 lines) noexcept
 
 void GPU::BlankFrame() noexcept
 {
+    GPU2D_Renderer->Sync();
+
     int backbuf = FrontBuffer ? 0 : 1;
     int fbsize;
     if (GPU3D.IsRendererAccelerated())
@@ -422,6 +422,23 @@ public:
         if (mask & (1<<3)) *(T*)&VRAM_D[addr & 0x1FFFF] = val;
     }
 
+    /// Marks len bytes of VRAM starting at ptr as modified,
+    /// for when they were written to without going through WriteVRAM_ABG etc.
+    /// (ptr has to point into one of the banks, as VRAMPtr_ABG etc. do)
+    void SetVRAMDirty(const u8* ptr, u32 len) noexcept
+    {
+        for (int bank = 0; bank < 9; bank++)
+        {
+            if (ptr < VRAM[bank] || ptr > &VRAM[bank][VRAMMask[bank]])
+                continue;
+
+            u32 offset = ptr - VRAM[bank];
+            for (u32 i = offset / VRAMDirtyGranularity; i <= (offset + len - 1) / VRAMDirtyGranularity; i++)
+                VRAMDirty[bank][i] = true;
+            return;
+        }
+    }
+
 
     template<typename T>
     T ReadVRAM_BG(u32 addr) const noexcept
@@ -422,21 +422,21 @@ void Unit::Write16(u32 addr, u16 val)
     case 0x026: BGRotD[0] = val; return;
     case 0x028:
         BGXRef[0] = (BGXRef[0] & 0xFFFF0000) | val;
-        if (GPU.VCount < 192) BGXRefInternal[0] = BGXRef[0];
+        if (GPU.VCount < 192) ReloadBGXRef(0);
         return;
     case 0x02A:
         if (val & 0x0800) val |= 0xF000;
         BGXRef[0] = (BGXRef[0] & 0xFFFF) | (val << 16);
-        if (GPU.VCount < 192) BGXRefInternal[0] = BGXRef[0];
+        if (GPU.VCount < 192) ReloadBGXRef(0);
         return;
     case 0x02C:
         BGYRef[0] = (BGYRef[0] & 0xFFFF0000) | val;
-        if (GPU.VCount < 192) BGYRefInternal[0] = BGYRef[0];
+        if (GPU.VCount < 192) ReloadBGYRef(0);
         return;
     case 0x02E:
         if (val & 0x0800) val |= 0xF000;
         BGYRef[0] = (BGYRef[0] & 0xFFFF) | (val << 16);
-        if (GPU.VCount < 192) BGYRefInternal[0] = BGYRef[0];
+        if (GPU.VCount < 192) ReloadBGYRef(0);
         return;
 
     case 0x030: BGRotA[1] = val; return;
@@ -445,21 +445,21 @@ void Unit::Write16(u32 addr, u16 val)
     case 0x036: BGRotD[1] = val; return;
     case 0x038:
         BGXRef[1] = (BGXRef[1] & 0xFFFF0000) | val;
-        if (GPU.VCount < 192) BGXRefInternal[1] = BGXRef[1];
+        if (GPU.VCount < 192) ReloadBGXRef(1);
         return;
     case 0x03A:
         if (val & 0x0800) val |= 0xF000;
         BGXRef[1] = (BGXRef[1] & 0xFFFF) | (val << 16);
-        if (GPU.VCount < 192) BGXRefInternal[1] = BGXRef[1];
+        if (GPU.VCount < 192) ReloadBGXRef(1);
         return;
     case 0x03C:
         BGYRef[1] = (BGYRef[1] & 0xFFFF0000) | val;
-        if (GPU.VCount < 192) BGYRefInternal[1] = BGYRef[1];
+        if (GPU.VCount < 192) ReloadBGYRef(1);
         return;
     case 0x03E:
         if (val & 0x0800) val |= 0xF000;
         BGYRef[1] = (BGYRef[1] & 0xFFFF) | (val << 16);
-        if (GPU.VCount < 192) BGYRefInternal[1] = BGYRef[1];
+        if (GPU.VCount < 192) ReloadBGYRef(1);
         return;
 
     case 0x040:
@@ -541,23 +541,23 @@ void Unit::Write32(u32 addr, u32 val)
         case 0x028:
             if (val & 0x08000000) val |= 0xF0000000;
             BGXRef[0] = val;
-            if (GPU.VCount < 192) BGXRefInternal[0] = BGXRef[0];
+            if (GPU.VCount < 192) ReloadBGXRef(0);
             return;
         case 0x02C:
             if (val & 0x08000000) val |= 0xF0000000;
             BGYRef[0] = val;
-            if (GPU.VCount < 192) BGYRefInternal[0] = BGYRef[0];
+            if (GPU.VCount < 192) ReloadBGYRef(0);
             return;
 
         case 0x038:
             if (val & 0x08000000) val |= 0xF0000000;
             BGXRef[1] = val;
-            if (GPU.VCount < 192) BGXRefInternal[1] = BGXRef[1];
+            if (GPU.VCount < 192) ReloadBGXRef(1);
             return;
         case 0x03C:
             if (val & 0x08000000) val |= 0xF0000000;
             BGYRef[1] = val;
-            if (GPU.VCount < 192) BGYRefInternal[1] = BGYRef[1];
+            if (GPU.VCount < 192) ReloadBGYRef(1);
             return;
         }
     }
@@ -566,6 +566,18 @@ void Unit::Write32(u32 addr, u32 val)
     Write16(addr+2, val>>16);
 }
 
+void Unit::ReloadBGXRef(u32 num)
+{
+    GPU.GetRenderer2D().SyncUnit(*this);
+    BGXRefInternal[num] = BGXRef[num];
+}
+
+void Unit::ReloadBGYRef(u32 num)
+{
+    GPU.GetRenderer2D().SyncUnit(*this);
+    BGYRefInternal[num] = BGYRef[num];
+}
+
 void Unit::UpdateMosaicCounters(u32 line)
 {
     // Y mosaic uses incrementing 4-bit counters
@@ -694,6 +706,59 @@ void Unit::CalculateWindowMask(u32 line, u8* windowMask, const u8* objWindow)
     }
 }
 
+void Unit::CopyRegisters(const Unit& other)
+{
+    Enabled = other.Enabled;
+
+    DispCnt = other.DispCnt;
+    memcpy(BGCnt, other.BGCnt, 4*2);
+    memcpy(BGXPos, other.BGXPos, 4*2);
+    memcpy(BGYPos, other.BGYPos, 4*2);
+    memcpy(BGXRef, other.BGXRef, 2*4);
+    memcpy(BGYRef, other.BGYRef, 2*4);
+    memcpy(BGRotA, other.BGRotA, 2*2);
+    memcpy(BGRotB, other.BGRotB, 2*2);
+    memcpy(BGRotC, other.BGRotC, 2*2);
+    memcpy(BGRotD, other.BGRotD, 2*2);
+
+    memcpy(Win0Coords, other.Win0Coords, 4);
+    memcpy(Win1Coords, other.Win1Coords, 4);
+    memcpy(WinCnt, other.WinCnt, 4);
+
+    // bit 0 is set by CheckWindows(), bit 1 by CalculateWindowMask()
+    Win0Active = (Win0Active & ~0x1) | (other.Win0Active & 0x1);
+    Win1Active = (Win1Active & ~0x1) | (other.Win1Active & 0x1);
+
+    memcpy(BGMosaicSize, other.BGMosaicSize, 2);
+    memcpy(OBJMosaicSize, other.OBJMosaicSize, 2);
+
+    BlendCnt = other.BlendCnt;
+    BlendAlpha = other.BlendAlpha;
+    EVA = other.EVA;
+    EVB = other.EVB;
+    EVY = other.EVY;
+
+    CaptureCnt = other.CaptureCnt;
+    CaptureLatch = other.CaptureLatch;
+
+    MasterBrightness = other.MasterBrightness;
+}
+
+void Unit::CopyLineState(const Unit& other)
+{
+    memcpy(BGXRefInternal, other.BGXRefInternal, 2*4);
+    memcpy(BGYRefInternal, other.BGYRefInternal, 2*4);
+
+    Win0Active = (Win0Active & ~0x2) | (other.Win0Active & 0x2);
+    Win1Active = (Win1Active & ~0x2) | (other.Win1Active & 0x2);
+
+    BGMosaicY = other.BGMosaicY;
+    BGMosaicYMax = other.BGMosaicYMax;
+    OBJMosaicYCount = other.OBJMosaicYCount;
+    OBJMosaicY = other.OBJMosaicY;
+    OBJMosaicYMax = other.OBJMosaicYMax;
+}
+
 void Unit::GetBGVRAM(u8*& data, u32& mask) const
 {
     if (Num == 0)
@@ -78,6 +78,13 @@ public:
     void UpdateMosaicCounters(u32 line);
     void CalculateWindowMask(u32 line, u8* windowMask, const u8* objWindow);
 
+    // a renderer drawing on another thread works on its own copy of a unit.
+    // The state it updates from one scanline to the next (internal reference
+    // points, mosaic counters, horizontal window state) is kept apart from
+    // the registers and the state updated at the start of each scanline.
+    void CopyRegisters(const Unit& other);
+    void CopyLineState(const Unit& other);
+
     u32 Num;
     bool Enabled;
 
@@ -123,6 +130,9 @@ public:
 
     u16 MasterBrightness;
 private:
+    void ReloadBGXRef(u32 num);
+    void ReloadBGYRef(u32 num);
+
     melonDS::GPU& GPU;
 };
 
@@ -136,6 +146,15 @@ public:
 
     virtual void VBlankEnd(Unit* unitA, Unit* unitB) = 0;
 
+    /// Waits for the scanlines that are being drawn on other threads, if any.
+    /// Must be called before the framebuffers or VRAM caches are touched
+    /// outside of the renderer.
+    virtual void Sync() {}
+
+    /// Same as Sync(), but only if \c unit is drawn on another thread.
+    /// Called before the unit's internal reference points are reloaded.
+    virtual void SyncUnit(const Unit& unit) {}
+
     void SetFramebuffer(u32* unitA, u32* unitB)
     {
         Framebuffer[0] = unitA;
@@ -24,10 +24,184 @@ namespace melonDS
 {
 namespace GPU2D
 {
-SoftRenderer::SoftRenderer(melonDS::GPU& gpu)
-    : Renderer2D(), GPU(gpu)
+SoftRenderer::SoftRenderer(melonDS::GPU& gpu, bool threaded)
+    : Renderer2D(), GPU(gpu), Palette(gpu.Palette), OAM(gpu.OAM)
 {
     // mosaic table is initialized at compile-time
+
+    CompositeLine = GetCompositeLineFunc();
+    ApplyMasterBrightness = GetMasterBrightnessFunc();
+
+    SetThreaded(threaded);
+}
+
+SoftRenderer::~SoftRenderer()
+{
+    SetThreaded(false);
+}
+
+void SoftRenderer::SetThreaded(bool threaded) noexcept
+{
+    if (threaded == IsThreaded())
+        return;
+
+    if (threaded)
+    {
+        ThreadRenderer = std::make_unique<SoftRenderer>(GPU);
+        ThreadUnit = std::make_unique<Unit>(1, GPU);
+        ThreadUnit->Reset();
+        ReseedThreadUnit = true;
+
+        // the sprites for the next scanline may already have been drawn
+        memcpy(ThreadRenderer->OBJLine[1], OBJLine[1], 256*4);
+        memcpy(ThreadRenderer->OBJWindow[1], OBJWindow[1], 256);
+        ThreadRenderer->NumSprites[1] = NumSprites[1];
+
+        LineJobs.clear();
+        for (u32 i = 0; i < NumLineJobs; i++)
+            LineJobs.push_back(std::make_unique<LineJob>(GPU));
+        JobsQueued = 0;
+        JobsPosted = 0;
+        JobsDone = 0;
+
+        Sema_JobsPosted = Platform::Semaphore_Create();
+        Sema_JobsDone = Platform::Semaphore_Create();
+        RenderThreadRunning = true;
+        RenderThread = Platform::Thread_Create([this]() { RenderThreadFunc(); });
+    }
+    else
+    {
+        Sync();
+
+        memcpy(OBJLine[1], ThreadRenderer->OBJLine[1], 256*4);
+        memcpy(OBJWindow[1], ThreadRenderer->OBJWindow[1], 256);
+        NumSprites[1] = ThreadRenderer->NumSprites[1];
+
+        StopRenderThread();
+    }
+}
+
+void SoftRenderer::StopRenderThread()
+{
+    if (!RenderThread)
+        return;
+
+    WaitForJobs(JobsQueued);
+
+    RenderThreadRunning = false;
+    Platform::Semaphore_Post(Sema_JobsPosted);
+    Platform::Thread_Wait(RenderThread);
+    Platform::Thread_Free(RenderThread);
+    RenderThread = nullptr;
+
+    Platform::Semaphore_Free(Sema_JobsPosted);
+    Platform::Semaphore_Free(Sema_JobsDone);
+    Sema_JobsPosted = nullptr;
+    Sema_JobsDone = nullptr;
+
+    LineJobs.clear();
+    ThreadUnit = nullptr;
+    ThreadRenderer = nullptr;
+}
+
+void SoftRenderer::RenderThreadFunc()
+{
+    for (;;)
+    {
+        Platform::Semaphore_Wait(Sema_JobsPosted);
+        if (!RenderThreadRunning)
+            return;
+
+        u32 jobnum = JobsDone.load(std::memory_order_relaxed);
+        LineJob& job = *LineJobs[jobnum % NumLineJobs];
+
+        ThreadUnit->CopyRegisters(job.Regs);
+        if (job.Reseed)
+            ThreadUnit->CopyLineState(job.Regs);
+
+        SoftRenderer& renderer = *ThreadRenderer;
+        renderer.Palette = job.Palette;
+        renderer.OAM = job.OAM;
+        renderer.Framebuffer[1] = job.Framebuffer;
+        renderer.CurUnit = ThreadUnit.get();
+
+        if (job.Line >= 0)
+            renderer.RenderScanline(job.Line, job.VCount, job.ForceBlank);
+        if (job.SpriteLine >= 0)
+            renderer.RenderSprites(job.SpriteLine);
+
+        JobsDone.store(jobnum + 1, std::memory_order_release);
+        Platform::Semaphore_Post(Sema_JobsDone);
+    }
+}
+
+SoftRenderer::LineJob& SoftRenderer::QueueJob()
+{
+    if (JobsQueued - JobsDone.load(std::memory_order_acquire) >= NumLineJobs)
+        WaitForJobs(JobsQueued - NumLineJobs + 1);
+    if (JobsQueued - JobsPosted >= LineJobBatch)
+        PostJobs();
+
+    LineJob& job = *LineJobs[JobsQueued % NumLineJobs];
+    job.Line = -1;
+    job.SpriteLine = -1;
+    job.Framebuffer = Framebuffer[1];
+
+    job.Regs.CopyRegisters(*CurUnit);
+    job.Reseed = ReseedThreadUnit;
+    if (ReseedThreadUnit)
+    {
+        job.Regs.CopyLineState(*CurUnit);
+        ReseedThreadUnit = false;
+    }
+
+    memcpy(&job.Palette[0x400], &GPU.Palette[0x400], 0x400);
+    memcpy(&job.OAM[0x400], &GPU.OAM[0x400], 0x400);
+
+    JobsQueued++;
+    return job;
+}
+
+void SoftRenderer::PostJobs()
+{
+    if (JobsPosted == JobsQueued)
+        return;
+
+    Platform::Semaphore_Post(Sema_JobsPosted, JobsQueued - JobsPosted);
+    JobsPosted = JobsQueued;
+}
+
+void SoftRenderer::WaitForJobs(u32 target)
+{
+    PostJobs();
+
+    // the thread posts once per job, so anything left
+    // from before is stale, and the count is checked again anyway
+    Platform::Semaphore_Reset(Sema_JobsDone);
+    while ((s32)(JobsDone.load(std::memory_order_acquire) - target) < 0)
+        Platform::Semaphore_Wait(Sema_JobsDone);
+}
+
+void SoftRenderer::Sync()
+{
+    if (!RenderThread)
+        return;
+
+    WaitForJobs(JobsQueued);
+
+    // until the next scanline is queued, engine B's own
+    // state is the one to go by, and may be changed
+    if (!ReseedThreadUnit)
+    {
+        GPU.GPU2D_B.CopyLineState(*ThreadUnit);
+        ReseedThreadUnit = true;
+    }
+}
+
+void SoftRenderer::SyncUnit(const Unit& unit)
+{
+    if (unit.Num == 1)
+        Sync();
 }
 
 u32 SoftRenderer::ColorComposite(int i, u32 val1, u32 val2) const
@@ -106,12 +280,6 @@ void SoftRenderer::DrawScanline(u32 line, Unit* unit)
 {
     CurUnit = unit;
 
-    int stride = GPU.GPU3D.IsRendererAccelerated() ? (256*3 + 1) : 256;
-    u32* dst = &Framebuffer[CurUnit->Num][stride * line];
-
-    int n3dline = line;
-    line = GPU.VCount;
-
     if (CurUnit->Num == 0)
     {
         auto bgDirty = GPU.VRAMDirty_ABG.DeriveState(GPU.VRAMMap_ABG, GPU);
@@ -124,26 +292,49 @@ void SoftRenderer::DrawScanline(u32 line, Unit* unit)
     else
     {
         auto bgDirty = GPU.VRAMDirty_BBG.DeriveState(GPU.VRAMMap_BBG, GPU);
-        GPU.MakeVRAMFlat_BBGCoherent(bgDirty);
         auto bgExtPalDirty = GPU.VRAMDirty_BBGExtPal.DeriveState(GPU.VRAMMap_BBGExtPal, GPU);
-        GPU.MakeVRAMFlat_BBGExtPalCoherent(bgExtPalDirty);
         auto objExtPalDirty = GPU.VRAMDirty_BOBJExtPal.DeriveState(&GPU.VRAMMap_BOBJExtPal, GPU);
+
+        // queued scanlines still need the old contents
+        if (bgDirty.Any() || bgExtPalDirty.Any() || objExtPalDirty.Any())
+            Sync();
+
+        GPU.MakeVRAMFlat_BBGCoherent(bgDirty);
+        GPU.MakeVRAMFlat_BBGExtPalCoherent(bgExtPalDirty);
         GPU.MakeVRAMFlat_BOBJExtPalCoherent(objExtPalDirty);
     }
 
+    u32 vcount = GPU.VCount;
     bool forceblank = false;
 
     // scanlines that end up outside of the GPU drawing range
     // (as a result of writing to VCount) are filled white
-    if (line > 192) forceblank = true;
+    if (vcount > 192) forceblank = true;
 
     // GPU B can be completely disabled by POWCNT1
     // oddly that's not the case for GPU A
     if (CurUnit->Num && !CurUnit->Enabled) forceblank = true;
 
-    if (line == 0 && CurUnit->CaptureCnt & (1 << 31) && !forceblank)
+    if (vcount == 0 && CurUnit->CaptureCnt & (1 << 31) && !forceblank)
         CurUnit->CaptureLatch = true;
 
+    if (CurUnit->Num && RenderThread)
+    {
+        LineJob& job = QueueJob();
+        job.Line = line;
+        job.VCount = vcount;
+        job.ForceBlank = forceblank;
+        return;
+    }
+
+    RenderScanline(line, vcount, forceblank);
+}
+
+void SoftRenderer::RenderScanline(u32 n3dline, u32 line, bool forceblank)
+{
+    int stride = GPU.GPU3D.IsRendererAccelerated() ? (256*3 + 1) : 256;
+    u32* dst = &Framebuffer[CurUnit->Num][stride * n3dline];
+
     if (CurUnit->Num == 0)
     {
         if (!GPU.GPU3D.IsRendererAccelerated())
@@ -259,7 +450,14 @@ void SoftRenderer::DrawScanline(u32 line, Unit* unit)
     }
 
     // master brightness
-    if (dispmode != 0)
+    if (dispmode != 0 && ApplyMasterBrightness)
+    {
+        u32 factor = masterBrightness & 0x1F;
+        if (factor > 16) factor = 16;
+
+        ApplyMasterBrightness(dst, masterBrightness >> 14, factor);
+    }
+    else if (dispmode != 0)
     {
         if ((masterBrightness >> 14) == 1)
         {
@@ -303,6 +501,9 @@ void SoftRenderer::DrawScanline(u32 line, Unit* unit)
 
 void SoftRenderer::VBlankEnd(Unit* unitA, Unit* unitB)
 {
+    // the units' internal state is about to be reset
+    Sync();
+
 #ifdef OGLRENDERER_ENABLED
     if (Renderer3D& renderer3d = GPU.GPU3D.GetCurrentRenderer(); renderer3d.Accelerated)
     {
@@ -697,8 +898,8 @@ void SoftRenderer::DrawScanline_BGOBJ(u32 line)
     }
 
     u64 backdrop;
-    if (CurUnit->Num) backdrop = *(u16*)&GPU.Palette[0x400];
-    else     backdrop = *(u16*)&GPU.Palette[0];
+    if (CurUnit->Num) backdrop = *(u16*)&Palette[0x400];
+    else     backdrop = *(u16*)&Palette[0];
 
     {
         u8 r = (backdrop & 0x001F) << 1;
@@ -737,12 +938,20 @@ void SoftRenderer::DrawScanline_BGOBJ(u32 line)
 
     if (!GPU.GPU3D.IsRendererAccelerated())
     {
-        for (int i = 0; i < 256; i++)
+        if (CompositeLine)
+        {
+            CompositeParams params {CurUnit->BlendCnt, CurUnit->EVA, CurUnit->EVB, CurUnit->EVY};
+            CompositeLine(BGOBJLine, WindowMask, params);
+        }
+        else
         {
-            u32 val1 = BGOBJLine[i];
-            u32 val2 = BGOBJLine[256+i];
+            for (int i = 0; i < 256; i++)
+            {
+                u32 val1 = BGOBJLine[i];
+                u32 val2 = BGOBJLine[256+i];
 
-            BGOBJLine[i] = ColorComposite(i, val1, val2);
+                BGOBJLine[i] = ColorComposite(i, val1, val2);
+            }
         }
     }
     else
@@ -938,14 +1147,14 @@ void SoftRenderer::DrawBG_Text(u32 line, u32 bgnum)
         tilesetaddr = ((bgcnt & 0x003C) << 12);
         tilemapaddr = ((bgcnt & 0x1F00) << 3);
 
-        pal = (u16*)&GPU.Palette[0x400];
+        pal = (u16*)&Palette[0x400];
     }
     else
     {
         tilesetaddr = ((CurUnit->DispCnt & 0x07000000) >> 8) + ((bgcnt & 0x003C) << 12);
         tilemapaddr = ((CurUnit->DispCnt & 0x38000000) >> 11) + ((bgcnt & 0x1F00) << 3);
 
-        pal = (u16*)&GPU.Palette[0];
+        pal = (u16*)&Palette[0];
     }
 
     // adjust Y position in tilemap
@@ -1117,14 +1326,14 @@ void SoftRenderer::DrawBG_Affine(u32 line, u32 bgnum)
         tilesetaddr = ((bgcnt & 0x003C) << 12);
         tilemapaddr = ((bgcnt & 0x1F00) << 3);
 
-        pal = (u16*)&GPU.Palette[0x400];
+        pal = (u16*)&Palette[0x400];
     }
     else
     {
         tilesetaddr = ((CurUnit->DispCnt & 0x07000000) >> 8) + ((bgcnt & 0x003C) << 12);
         tilemapaddr = ((CurUnit->DispCnt & 0x38000000) >> 11) + ((bgcnt & 0x1F00) << 3);
 
-        pal = (u16*)&GPU.Palette[0];
+        pal = (u16*)&Palette[0];
     }
 
     u16 curtile;
@@ -1271,8 +1480,8 @@ void SoftRenderer::DrawBG_Extended(u32 line, u32 bgnum)
         {
             // 256-color bitmap
 
-            if (CurUnit->Num) pal = (u16*)&GPU.Palette[0x400];
-            else              pal = (u16*)&GPU.Palette[0];
+            if (CurUnit->Num) pal = (u16*)&Palette[0x400];
+            else              pal = (u16*)&Palette[0];
 
             u8 color;
 
@@ -1330,14 +1539,14 @@ void SoftRenderer::DrawBG_Extended(u32 line, u32 bgnum)
             tilesetaddr = ((bgcnt & 0x003C) << 12);
             tilemapaddr = ((bgcnt & 0x1F00) << 3);
 
-            pal = (u16*)&GPU.Palette[0x400];
+            pal = (u16*)&Palette[0x400];
         }
         else
         {
             tilesetaddr = ((CurUnit->DispCnt & 0x07000000) >> 8) + ((bgcnt & 0x003C) << 12);
             tilemapaddr = ((CurUnit->DispCnt & 0x38000000) >> 11) + ((bgcnt & 0x1F00) << 3);
 
-            pal = (u16*)&GPU.Palette[0];
+            pal = (u16*)&Palette[0];
         }
 
         u16 curtile;
@@ -1448,8 +1657,8 @@ void SoftRenderer::DrawBG_Large(u32 line) // BG is always BG2
 
     // 256-color bitmap
 
-    if (CurUnit->Num) pal = (u16*)&GPU.Palette[0x400];
-    else     pal = (u16*)&GPU.Palette[0];
+    if (CurUnit->Num) pal = (u16*)&Palette[0x400];
+    else     pal = (u16*)&Palette[0];
 
     u8 color;
 
@@ -1522,7 +1731,7 @@ template <SoftRenderer::DrawPixel drawPixel>
 void SoftRenderer::InterleaveSprites(u32 prio)
 {
     u32* objLine = OBJLine[CurUnit->Num];
-    u16* pal = (u16*)&GPU.Palette[CurUnit->Num ? 0x600 : 0x200];
+    u16* pal = (u16*)&Palette[CurUnit->Num ? 0x600 : 0x200];
 
     if (CurUnit->DispCnt & 0x80000000)
     {
@@ -1582,6 +1791,43 @@ void SoftRenderer::DrawSprites(u32 line, Unit* unit)
 {
     CurUnit = unit;
 
+    if (CurUnit->Num == 0)
+    {
+        auto objDirty = GPU.VRAMDirty_AOBJ.DeriveState(GPU.VRAMMap_AOBJ, GPU);
+        GPU.MakeVRAMFlat_AOBJCoherent(objDirty);
+    }
+    else
+    {
+        auto objDirty = GPU.VRAMDirty_BOBJ.DeriveState(GPU.VRAMMap_BOBJ, GPU);
+        if (objDirty.Any())
+            Sync();
+
+        GPU.MakeVRAMFlat_BOBJCoherent(objDirty);
+    }
+
+    if (CurUnit->Num && RenderThread)
+    {
+        // the sprites for the next scanline are drawn right after it,
+        // nothing can have changed in between
+        if (JobsPosted != JobsQueued)
+        {
+            LineJob& last = *LineJobs[(JobsQueued - 1) % NumLineJobs];
+            if (last.SpriteLine < 0 && last.Line >= 0 && (u32)last.Line + 1 == line)
+            {
+                last.SpriteLine = line;
+                return;
+            }
+        }
+
+        QueueJob().SpriteLine = line;
+        return;
+    }
+
+    RenderSprites(line);
+}
+
+void SoftRenderer::RenderSprites(u32 line)
+{
     if (line == 0)
     {
         // reset those counters here
@@ -1594,23 +1840,12 @@ void SoftRenderer::DrawSprites(u32 line, Unit* unit)
         CurUnit->OBJMosaicYCount = 0;
     }
 
-    if (CurUnit->Num == 0)
-    {
-        auto objDirty = GPU.VRAMDirty_AOBJ.DeriveState(GPU.VRAMMap_AOBJ, GPU);
-        GPU.MakeVRAMFlat_AOBJCoherent(objDirty);
-    }
-    else
-    {
-        auto objDirty = GPU.VRAMDirty_BOBJ.DeriveState(GPU.VRAMMap_BOBJ, GPU);
-        GPU.MakeVRAMFlat_BOBJCoherent(objDirty);
-    }
-
     NumSprites[CurUnit->Num] = 0;
     memset(OBJLine[CurUnit->Num], 0, 256*4);
     memset(OBJWindow[CurUnit->Num], 0, 256);
     if (!(CurUnit->DispCnt & 0x1000)) return;
 
-    u16* oam = (u16*)&GPU.OAM[CurUnit->Num ? 0x400 : 0];
+    u16* oam = (u16*)&OAM[CurUnit->Num ? 0x400 : 0];
 
     const s32 spritewidth[16] =
     {
@@ -1705,7 +1940,7 @@ void SoftRenderer::DrawSprites(u32 line, Unit* unit)
 template<bool window>
 void SoftRenderer::DrawSprite_Rotscale(u32 num, u32 boundwidth, u32 boundheight, u32 width, u32 height, s32 xpos, s32 ypos)
 {
-    u16* oam = (u16*)&GPU.OAM[CurUnit->Num ? 0x400 : 0];
+    u16* oam = (u16*)&OAM[CurUnit->Num ? 0x400 : 0];
     u16* attrib = &oam[num * 4];
     u16* rotparams = &oam[(((attrib[1] >> 9) & 0x1F) * 16) + 3];
 
@@ -1917,7 +2152,7 @@ void SoftRenderer::DrawSprite_Rotscale(u32 num, u32 boundwidth, u32 boundheight,
 template<bool window>
 void SoftRenderer::DrawSprite_Normal(u32 num, u32 width, u32 height, s32 xpos, s32 ypos)
 {
-    u16* oam = (u16*)&GPU.OAM[CurUnit->Num ? 0x400 : 0];
+    u16* oam = (u16*)&OAM[CurUnit->Num ? 0x400 : 0];
     u16* attrib = &oam[num * 4];
 
     u32 pixelattr = ((attrib[2] & 0x0C00) << 6) | 0xC0000;
@@ -19,6 +19,12 @@
 #pragma once
 
 #include "GPU2D.h"
+#include "GPU2D_SoftComposite.h"
+#include "Platform.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
 
 namespace melonDS
 {
@@ -30,14 +36,73 @@ namespace GPU2D
 class SoftRenderer : public Renderer2D
 {
 public:
-    SoftRenderer(melonDS::GPU& gpu);
-    ~SoftRenderer() override {}
+    SoftRenderer(melonDS::GPU& gpu, bool threaded = false);
+    ~SoftRenderer() override;
+
+    /// Draws engine B on a separate thread, so that it runs alongside
+    /// the emulation. Scanlines are queued along with a copy of the
+    /// registers, palette and OAM they use, and the emulation only waits
+    /// for them when engine B's VRAM or internal state is about to change,
+    /// and at the end of the frame at the latest. The output is the same
+    /// either way.
+    void SetThreaded(bool threaded) noexcept;
+    [[nodiscard]] bool IsThreaded() const noexcept { return RenderThread != nullptr; }
 
     void DrawScanline(u32 line, Unit* unit) override;
     void DrawSprites(u32 line, Unit* unit) override;
     void VBlankEnd(Unit* unitA, Unit* unitB) override;
+
+    void Sync() override;
+    void SyncUnit(const Unit& unit) override;
 private:
     melonDS::GPU& GPU;
+
+    // palette and OAM, either the GPU's or a copy made for the render thread
+    u8* Palette;
+    u8* OAM;
+
+    struct LineJob
+    {
+        LineJob(melonDS::GPU& gpu) : Regs(1, gpu) {}
+
+        s32 Line;       // scanline to draw, -1 if none
+        s32 SpriteLine; // scanline to draw the sprites of, -1 if none
+        u32 VCount;
+        bool ForceBlank;
+        bool Reseed;    // whether to take the line state from Regs
+        u32* Framebuffer;
+
+        Unit Regs;
+        alignas(u64) u8 Palette[2*1024];
+        alignas(u64) u8 OAM[2*1024];
+    };
+
+    static constexpr u32 NumLineJobs = 64;
+    // queued jobs are handed over to the thread in batches,
+    // waking it up for every scanline would cost more than drawing it
+    static constexpr u32 LineJobBatch = 8;
+
+    // engine B's renderer and state on the render thread
+    std::unique_ptr<SoftRenderer> ThreadRenderer;
+    std::unique_ptr<Unit> ThreadUnit;
+    bool ReseedThreadUnit = true;
+
+    std::vector<std::unique_ptr<LineJob>> LineJobs;
+    u32 JobsQueued = 0;
+    u32 JobsPosted = 0;
+    std::atomic<u32> JobsDone = 0;
+
+    Platform::Thread* RenderThread = nullptr;
+    std::atomic_bool RenderThreadRunning;
+    Platform::Semaphore* Sema_JobsPosted = nullptr;
+    Platform::Semaphore* Sema_JobsDone = nullptr;
+
+    void RenderThreadFunc();
+    void StopRenderThread();
+    LineJob& QueueJob();
+    void PostJobs();
+    void WaitForJobs(u32 target);
+
     alignas(8) u32 BGOBJLine[256*3];
     u32* _3DLine;
 
@@ -48,6 +113,10 @@ private:
 
     u32 NumSprites[2];
 
+    // null if this CPU has no SIMD kernels, the scalar code is used then
+    CompositeLineFunc CompositeLine;
+    MasterBrightnessFunc ApplyMasterBrightness;
+
     u8* CurBGXMosaicTable;
     array2d<u8, 16, 256> MosaicTable = []() constexpr
     {
@@ -119,6 +188,9 @@ private:
     }
     u32 ColorComposite(int i, u32 val1, u32 val2) const;
 
+    void RenderScanline(u32 n3dline, u32 line, bool forceblank);
+    void RenderSprites(u32 line);
+
     template<u32 bgmode> void DrawScanlineBGMode(u32 line);
     void DrawScanlineBGMode6(u32 line);
     void DrawScanlineBGMode7(u32 line);
@@ -0,0 +1,319 @@
+/*
+    Copyright 2016-2023 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "GPU2D_SoftComposite.h"
+
+// built the same way as the 3D span kernels, see GPU3D_SoftSpan.cpp
+#if defined(__x86_64__) || defined(__i386__)
+#define COMPOSITE_X86
+#elif defined(__aarch64__)
+#define COMPOSITE_NEON
+#endif
+
+// the helpers take and return vectors wider than what the generic build
+// supports, which doesn't matter since they are always inlined into
+// a function built for the right instruction set
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+namespace melonDS
+{
+namespace GPU2D
+{
+
+#if defined(COMPOSITE_X86) || defined(COMPOSITE_NEON)
+
+template <int N>
+struct CompositeVec
+{
+    typedef u32 U __attribute__((vector_size(N*4)));
+    typedef s32 I __attribute__((vector_size(N*4)));
+};
+
+#define COMPOSITE_INLINE static inline __attribute__((always_inline))
+
+template <typename U>
+COMPOSITE_INLINE U Splat(u32 val)
+{
+    U v = {};
+    return v + val;
+}
+
+template <typename U>
+COMPOSITE_INLINE U Load(const u32* src)
+{
+    U v;
+    __builtin_memcpy(&v, src, sizeof(v));
+    return v;
+}
+
+template <typename U>
+COMPOSITE_INLINE void Store(u32* dst, U v)
+{
+    __builtin_memcpy(dst, &v, sizeof(v));
+}
+
+template <typename U>
+COMPOSITE_INLINE U LoadBytes(const u8* src)
+{
+    U v;
+    for (u32 i = 0; i < sizeof(U)/4; i++)
+        v[i] = src[i];
+    return v;
+}
+
+// whether any lane of a comparison result is set
+template <typename I>
+COMPOSITE_INLINE bool Any(I mask)
+{
+    u64 words[sizeof(I)/8];
+    __builtin_memcpy(words, &mask, sizeof(mask));
+
+    u64 ret = 0;
+    for (u32 i = 0; i < sizeof(I)/8; i++)
+        ret |= words[i];
+    return ret != 0;
+}
+
+template <typename U>
+COMPOSITE_INLINE U Clamp(U val, u32 max)
+{
+    return (val > max) ? Splat<U>(max) : val;
+}
+
+template <typename U>
+COMPOSITE_INLINE U ColorBlend4(U val1, U val2, U eva, U evb)
+{
+    U r =  (((val1 & 0x00003F) * eva) + ((val2 & 0x00003F) * evb) + 0x000008) >> 4;
+    U g = ((((val1 & 0x003F00) * eva) + ((val2 & 0x003F00) * evb) + 0x000800) >> 4) & 0x007F00;
+    U b = ((((val1 & 0x3F0000) * eva) + ((val2 & 0x3F0000) * evb) + 0x080000) >> 4) & 0x7F0000;
+
+    return Clamp(r, 0x00003F) | Clamp(g, 0x003F00) | Clamp(b, 0x3F0000) | 0xFF000000;
+}
+
+template <typename U>
+COMPOSITE_INLINE U ColorBlend5(U val1, U val2)
+{
+    U eva = ((val1 >> 24) & 0x1F) + 1;
+    U evb = 32 - eva;
+
+    U r =  (((val1 & 0x00003F) * eva) + ((val2 & 0x00003F) * evb) + 0x000010) >> 5;
+    U g = ((((val1 & 0x003F00) * eva) + ((val2 & 0x003F00) * evb) + 0x001000) >> 5) & 0x007F00;
+    U b = ((((val1 & 0x3F0000) * eva) + ((val2 & 0x3F0000) * evb) + 0x100000) >> 5) & 0x7F0000;
+
+    U ret = Clamp(r, 0x00003F) | Clamp(g, 0x003F00) | Clamp(b, 0x3F0000) | 0xFF000000;
+    return (eva == 32) ? val1 : ret;
+}
+
+template <typename U>
+COMPOSITE_INLINE U ColorBrightnessUp(U val, u32 factor, u32 bias)
+{
+    U rb = val & 0x3F003F;
+    U g = val & 0x003F00;
+
+    rb += (((((0x3F003F - rb) * factor) + (bias*0x010001)) >> 4) & 0x3F003F);
+    g +=  (((((0x003F00 - g ) * factor) + (bias*0x000100)) >> 4) & 0x003F00);
+
+    return rb | g | 0xFF000000;
+}
+
+template <typename U>
+COMPOSITE_INLINE U ColorBrightnessDown(U val, u32 factor, u32 bias)
+{
+    U rb = val & 0x3F003F;
+    U g = val & 0x003F00;
+
+    rb -= ((((rb * factor) + (bias*0x010001)) >> 4) & 0x3F003F);
+    g -=  ((((g  * factor) + (bias*0x000100)) >> 4) & 0x003F00);
+
+    return rb | g | 0xFF000000;
+}
+
+// the effect selected in BLDCNT is the same for the whole line, so each
+// of them gets its own loop
+template <int N, u32 effect>
+COMPOSITE_INLINE void CompositeLineImpl(u32* line, const u8* windowMask, const CompositeParams& params)
+{
+    typedef typename CompositeVec<N>::U U;
+    typedef typename CompositeVec<N>::I I;
+
+    const u32 blendCnt = params.BlendCnt;
+    const U evaReg = Splat<U>(params.EVA);
+    const U evbReg = Splat<U>(params.EVB);
+
+    for (int i = 0; i < 256; i += N)
+    {
+        U val1 = Load<U>(&line[i]);
+        U val2 = Load<U>(&line[256+i]);
+
+        U window = LoadBytes<U>(&windowMask[i]);
+
+        U flag1 = val1 >> 24;
+        U flag2 = val2 >> 24;
+
+        U target2 = (flag2 & 0x80) ? Splat<U>(0x1000) : ((flag2 & 0x40) ? Splat<U>(0x0100) : (flag2 << 8));
+        I blend2 = (target2 & blendCnt) != 0;
+
+        I obj = (flag1 & 0x80) != 0;
+        I is3d = (flag1 & 0x40) != 0;
+
+        // sprite blending, using the bitmap sprite's alpha if there is one
+        I objBlend = obj & blend2;
+        // 3D layer blending
+        I blend3D = is3d & blend2 & ~obj;
+
+        // the regular special effect, for everything else
+        U target1 = obj ? Splat<U>(0x10) : (is3d ? Splat<U>(0x01) : flag1);
+        I special = ((target1 & blendCnt) != 0) & ((window & 0x20) != 0) & ~(blend2 & (obj | is3d));
+
+        I blend = objBlend;
+        if (effect == 1)
+            blend |= special & blend2;
+
+        // most of the time only one of the effects is used, if any
+        I any = blend | blend3D;
+        if (effect >= 2)
+            any |= special;
+        if (!Any(any))
+            continue;
+
+        U ret = val1;
+
+        if (Any(blend))
+        {
+            I bitmapObj = objBlend & is3d;
+            U eva = bitmapObj ? (flag1 & 0x1F) : evaReg;
+            U evb = bitmapObj ? (16 - eva) : evbReg;
+
+            ret = blend ? ColorBlend4(val1, val2, eva, evb) : ret;
+        }
+
+        if (effect >= 2 && Any(special))
+        {
+            if (effect == 2)
+                ret = special ? ColorBrightnessUp(val1, params.EVY, 0x8) : ret;
+            else
+                ret = special ? ColorBrightnessDown(val1, params.EVY, 0x7) : ret;
+        }
+
+        if (Any(blend3D))
+            ret = blend3D ? ColorBlend5(val1, val2) : ret;
+
+        Store(&line[i], ret);
+    }
+}
+
+template <int N>
+COMPOSITE_INLINE void CompositeLineDispatch(u32* line, const u8* windowMask, const CompositeParams& params)
+{
+    switch ((params.BlendCnt >> 6) & 0x3)
+    {
+    case 0: CompositeLineImpl<N, 0>(line, windowMask, params); break;
+    case 1: CompositeLineImpl<N, 1>(line, windowMask, params); break;
+    case 2: CompositeLineImpl<N, 2>(line, windowMask, params); break;
+    case 3: CompositeLineImpl<N, 3>(line, windowMask, params); break;
+    }
+}
+
+template <int N>
+COMPOSITE_INLINE void MasterBrightnessImpl(u32* line, u32 mode, u32 factor)
+{
+    typedef typename CompositeVec<N>::U U;
+
+    if (mode == 1)
+    {
+        for (int i = 0; i < 256; i += N)
+            Store(&line[i], ColorBrightnessUp(Load<U>(&line[i]), factor, 0x0));
+    }
+    else if (mode == 2)
+    {
+        for (int i = 0; i < 256; i += N)
+            Store(&line[i], ColorBrightnessDown(Load<U>(&line[i]), factor, 0xF));
+    }
+}
+
+#endif
+
+#ifdef COMPOSITE_X86
+// SSE4.1 is the first to have 32-bit multiplies
+__attribute__((target("sse4.1")))
+static void CompositeLine_SSE41(u32* line, const u8* windowMask, const CompositeParams& params)
+{
+    CompositeLineDispatch<4>(line, windowMask, params);
+}
+
+__attribute__((target("avx2")))
+static void CompositeLine_AVX2(u32* line, const u8* windowMask, const CompositeParams& params)
+{
+    CompositeLineDispatch<8>(line, windowMask, params);
+}
+
+__attribute__((target("sse4.1")))
+static void MasterBrightness_SSE41(u32* line, u32 mode, u32 factor)
+{
+    MasterBrightnessImpl<4>(line, mode, factor);
+}
+
+__attribute__((target("avx2")))
+static void MasterBrightness_AVX2(u32* line, u32 mode, u32 factor)
+{
+    MasterBrightnessImpl<8>(line, mode, factor);
+}
+#endif
+
+#ifdef COMPOSITE_NEON
+static void CompositeLine_NEON(u32* line, const u8* windowMask, const CompositeParams& params)
+{
+    CompositeLineDispatch<4>(line, windowMask, params);
+}
+
+static void MasterBrightness_NEON(u32* line, u32 mode, u32 factor)
+{
+    MasterBrightnessImpl<4>(line, mode, factor);
+}
+#endif
+
+CompositeLineFunc GetCompositeLineFunc() noexcept
+{
+#ifdef COMPOSITE_X86
+    if (__builtin_cpu_supports("avx2"))
+        return CompositeLine_AVX2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return CompositeLine_SSE41;
+#endif
+#ifdef COMPOSITE_NEON
+    return CompositeLine_NEON;
+#endif
+    return nullptr;
+}
+
+MasterBrightnessFunc GetMasterBrightnessFunc() noexcept
+{
+#ifdef COMPOSITE_X86
+    if (__builtin_cpu_supports("avx2"))
+        return MasterBrightness_AVX2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return MasterBrightness_SSE41;
+#endif
+#ifdef COMPOSITE_NEON
+    return MasterBrightness_NEON;
+#endif
+    return nullptr;
+}
+
+}
+}
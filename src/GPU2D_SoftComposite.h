@@ -0,0 +1,66 @@
+/*
+    Copyright 2016-2023 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef GPU2D_SOFTCOMPOSITE_H
+#define GPU2D_SOFTCOMPOSITE_H
+
+#include "types.h"
+
+namespace melonDS
+{
+namespace GPU2D
+{
+
+// SIMD kernels for the last stages of the 2D renderer, which are done
+// over a whole scanline: color special effects and master brightness.
+//
+// Color special effects are a per-pixel choice between no effect,
+// alpha blending (with the BLDALPHA coefficients, a bitmap sprite's
+// alpha, or the 3D layer's alpha) and brightness up/down. The kernels
+// work out every candidate for several pixels at once and then pick
+// the right one, which avoids the unpredictable branches the scalar
+// code takes when layers with different effects are mixed on a line.
+//
+// The results are bit-exact with SoftRenderer::ColorComposite() and
+// friends, which remain the fallback when no kernel is available.
+
+struct CompositeParams
+{
+    u32 BlendCnt;
+    u32 EVA, EVB, EVY;
+};
+
+/// Applies color special effects to the scanline in \c line,
+/// whose first 256 entries are the topmost pixels and the next 256
+/// the pixels below them. The results replace the topmost pixels.
+using CompositeLineFunc = void (*)(u32* line, const u8* windowMask, const CompositeParams& params);
+
+/// Applies master brightness to 256 pixels,
+/// \c mode being 1 for brightness up and 2 for brightness down.
+using MasterBrightnessFunc = void (*)(u32* line, u32 mode, u32 factor);
+
+/// @return The fastest compositing kernel this CPU supports, or nullptr if there is none.
+[[nodiscard]] CompositeLineFunc GetCompositeLineFunc() noexcept;
+
+/// @return The fastest master brightness kernel this CPU supports, or nullptr if there is none.
+[[nodiscard]] MasterBrightnessFunc GetMasterBrightnessFunc() noexcept;
+
+}
+}
+
+#endif // GPU2D_SOFTCOMPOSITE_H
@@ -416,6 +416,8 @@ void GPU3D::DoSavestate(Savestate* file) noexcept
     file->Var32(&FlushRequest);
     file->Var32(&FlushAttributes);
 
+    file->BeginPages();
+
     for (Vertex& vtx : VertexRAM)
     {
         vtx.DoSavestate(file);
@@ -490,6 +492,8 @@ void GPU3D::DoSavestate(Savestate* file) noexcept
         }
     }
 
+    file->EndPages();
+
     CmdStallQueue.DoSavestate(file);
 
     file->Var32((u32*)&VertexPipeline);
@@ -949,6 +953,8 @@ bool ClipCoordsEqual(Vertex* a, Vertex* b)
 
 void GPU3D::SubmitPolygon() noexcept
 {
+    PROFILE_COUNT(NDS.Profiler, Polygons, 1);
+
     Vertex clippedvertices[10];
     Vertex* reusedvertices[2];
     int clipstart = 0;
@@ -1354,6 +1360,8 @@ void GPU3D::SubmitPolygon() noexcept
 
 void GPU3D::SubmitVertex() noexcept
 {
+    PROFILE_COUNT(NDS.Profiler, Vertices, 1);
+
     s64 vertex[4] = {(s64)CurVertex[0], (s64)CurVertex[1], (s64)CurVertex[2], 0x1000};
     Vertex* vertextrans = &TempVertexBuffer[VertexNumInPoly];
 
@@ -1741,6 +1749,7 @@ void GPU3D::ExecuteCommand() noexcept
     if (paramsRequiredCount <= 1)
     {
         // fast path for command which only have a single parameter
+        PROFILE_COUNT(NDS.Profiler, GXCommands, 1);
 
         /*printf("[GXS:%08X] 0x%02X,  0x%08X", GXStat, entry.Command, entry.Param);*/
 
@@ -2117,6 +2126,7 @@ void GPU3D::ExecuteCommand() noexcept
                 printf("\n");*/
 
                 ExecParamCount = 0;
+                PROFILE_COUNT(NDS.Profiler, GXCommands, 1);
 
                 switch (entry.Command)
                 {
@@ -2507,6 +2517,7 @@ void GPU3D::VBlank() noexcept
 
 void GPU3D::VCount215(GPU& gpu) noexcept
 {
+    PROFILE_SCOPE(NDS.Profiler, ProfileZone_Render3D);
     CurrentRenderer->RenderFrame(gpu);
 }
 
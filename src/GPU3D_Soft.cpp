@@ -95,7 +95,7 @@ void SoftRenderer::EnableRenderThread()
     }
 }
 
-SoftRenderer::SoftRenderer(bool threaded) noexcept
+SoftRenderer::SoftRenderer(bool threaded, int bandWorkers) noexcept
     : Renderer3D(false), Threaded(threaded)
 {
     Sema_RenderStart = Platform::Semaphore_Create();
@@ -105,11 +105,17 @@ SoftRenderer::SoftRenderer(bool threaded) noexcept
     RenderThreadRunning = false;
     RenderThreadRendering = false;
     RenderThread = nullptr;
+
+    BandWorkersRunning = false;
+    StartBandWorkers(bandWorkers);
+
+    SetSpanKernel(GetBestSpanKernel());
 }
 
 SoftRenderer::~SoftRenderer()
 {
     StopRenderThread();
+    StopBandWorkers();
 
     Platform::Semaphore_Free(Sema_RenderStart);
     Platform::Semaphore_Free(Sema_RenderDone);
@@ -122,9 +128,11 @@ void SoftRenderer::Reset(GPU& gpu)
     memset(DepthBuffer, 0, BufferSize * 2 * 4);
     memset(AttrBuffer, 0, BufferSize * 2 * 4);
 
-    PrevIsShadowMask = false;
+    memset(Raster.StencilBuffer, 0, sizeof(Raster.StencilBuffer));
+    Raster.PrevIsShadowMask = false;
 
     SetupRenderThread(gpu);
+    TexCache.Reset();
     EnableRenderThread();
 }
 
@@ -138,10 +146,32 @@ void SoftRenderer::SetThreaded(bool threaded, GPU& gpu) noexcept
     }
 }
 
-void SoftRenderer::TextureLookup(const GPU& gpu, u32 texparam, u32 texpal, s16 s, s16 t, u16* color, u8* alpha) const
+void SoftRenderer::SetBandWorkers(int count, GPU& gpu) noexcept
+{
+    count = std::clamp(count, 0, MaxBandWorkers);
+    if (count != GetBandWorkers())
+    {
+        // this also waits for the render thread to be done with the workers
+        SetupRenderThread(gpu);
+
+        StopBandWorkers();
+        StartBandWorkers(count);
+
+        EnableRenderThread();
+    }
+}
+
+void SoftRenderer::SetSpanKernel(SpanKernel kernel) noexcept
 {
-    u32 vramaddr = (texparam & 0xFFFF) << 3;
+    if (!IsSpanKernelSupported(kernel))
+        kernel = SpanKernel::Scalar;
 
+    SpanKernelType = kernel;
+    SpanFunc = GetSpanKernelFunc(kernel);
+}
+
+u32 SoftRenderer::TextureLookup(u32 texparam, const u32* texels, s16 s, s16 t) const
+{
     s32 width = 8 << ((texparam >> 20) & 0x7);
     s32 height = 8 << ((texparam >> 23) & 0x7);
 
@@ -184,184 +214,7 @@ void SoftRenderer::TextureLookup(const GPU& gpu, u32 texparam, u32 texpal, s16 s
         else if (t >= height) t = height-1;
     }
 
-    u8 alpha0;
-    if (texparam & (1<<29)) alpha0 = 0;
-    else                    alpha0 = 31;
-
-    switch ((texparam >> 26) & 0x7)
-    {
-    case 1: // A3I5
-        {
-            vramaddr += ((t * width) + s);
-            u8 pixel = ReadVRAM_Texture<u8>(vramaddr, gpu);
-
-            texpal <<= 4;
-            *color = ReadVRAM_TexPal<u16>(texpal + ((pixel&0x1F)<<1), gpu);
-            *alpha = ((pixel >> 3) & 0x1C) + (pixel >> 6);
-        }
-        break;
-
-    case 2: // 4-color
-        {
-            vramaddr += (((t * width) + s) >> 2);
-            u8 pixel = ReadVRAM_Texture<u8>(vramaddr, gpu);
-            pixel >>= ((s & 0x3) << 1);
-            pixel &= 0x3;
-
-            texpal <<= 3;
-            *color = ReadVRAM_TexPal<u16>(texpal + (pixel<<1), gpu);
-            *alpha = (pixel==0) ? alpha0 : 31;
-        }
-        break;
-
-    case 3: // 16-color
-        {
-            vramaddr += (((t * width) + s) >> 1);
-            u8 pixel = ReadVRAM_Texture<u8>(vramaddr, gpu);
-            if (s & 0x1) pixel >>= 4;
-            else         pixel &= 0xF;
-
-            texpal <<= 4;
-            *color = ReadVRAM_TexPal<u16>(texpal + (pixel<<1), gpu);
-            *alpha = (pixel==0) ? alpha0 : 31;
-        }
-        break;
-
-    case 4: // 256-color
-        {
-            vramaddr += ((t * width) + s);
-            u8 pixel = ReadVRAM_Texture<u8>(vramaddr, gpu);
-
-            texpal <<= 4;
-            *color = ReadVRAM_TexPal<u16>(texpal + (pixel<<1), gpu);
-            *alpha = (pixel==0) ? alpha0 : 31;
-        }
-        break;
-
-    case 5: // compressed
-        {
-            vramaddr += ((t & 0x3FC) * (width>>2)) + (s & 0x3FC);
-            vramaddr += (t & 0x3);
-
-            u32 slot1addr = 0x20000 + ((vramaddr & 0x1FFFC) >> 1);
-            if (vramaddr >= 0x40000)
-                slot1addr += 0x10000;
-
-            u8 val = ReadVRAM_Texture<u8>(vramaddr, gpu);
-            val >>= (2 * (s & 0x3));
-
-            u16 palinfo = ReadVRAM_Texture<u16>(slot1addr, gpu);
-            u32 paloffset = (palinfo & 0x3FFF) << 2;
-            texpal <<= 4;
-
-            switch (val & 0x3)
-            {
-            case 0:
-                *color = ReadVRAM_TexPal<u16>(texpal + paloffset, gpu);
-                *alpha = 31;
-                break;
-
-            case 1:
-                *color = ReadVRAM_TexPal<u16>(texpal + paloffset + 2, gpu);
-                *alpha = 31;
-                break;
-
-            case 2:
-                if ((palinfo >> 14) == 1)
-                {
-                    u16 color0 = ReadVRAM_TexPal<u16>(texpal + paloffset, gpu);
-                    u16 color1 = ReadVRAM_TexPal<u16>(texpal + paloffset + 2, gpu);
-
-                    u32 r0 = color0 & 0x001F;
-                    u32 g0 = color0 & 0x03E0;
-                    u32 b0 = color0 & 0x7C00;
-                    u32 r1 = color1 & 0x001F;
-                    u32 g1 = color1 & 0x03E0;
-                    u32 b1 = color1 & 0x7C00;
-
-                    u32 r = (r0 + r1) >> 1;
-                    u32 g = ((g0 + g1) >> 1) & 0x03E0;
-                    u32 b = ((b0 + b1) >> 1) & 0x7C00;
-
-                    *color = r | g | b;
-                }
-                else if ((palinfo >> 14) == 3)
-                {
-                    u16 color0 = ReadVRAM_TexPal<u16>(texpal + paloffset, gpu);
-                    u16 color1 = ReadVRAM_TexPal<u16>(texpal + paloffset + 2, gpu);
-
-                    u32 r0 = color0 & 0x001F;
-                    u32 g0 = color0 & 0x03E0;
-                    u32 b0 = color0 & 0x7C00;
-                    u32 r1 = color1 & 0x001F;
-                    u32 g1 = color1 & 0x03E0;
-                    u32 b1 = color1 & 0x7C00;
-
-                    u32 r = (r0*5 + r1*3) >> 3;
-                    u32 g = ((g0*5 + g1*3) >> 3) & 0x03E0;
-                    u32 b = ((b0*5 + b1*3) >> 3) & 0x7C00;
-
-                    *color = r | g | b;
-                }
-                else
-                    *color = ReadVRAM_TexPal<u16>(texpal + paloffset + 4, gpu);
-                *alpha = 31;
-                break;
-
-            case 3:
-                if ((palinfo >> 14) == 2)
-                {
-                    *color = ReadVRAM_TexPal<u16>(texpal + paloffset + 6, gpu);
-                    *alpha = 31;
-                }
-                else if ((palinfo >> 14) == 3)
-                {
-                    u16 color0 = ReadVRAM_TexPal<u16>(texpal + paloffset, gpu);
-                    u16 color1 = ReadVRAM_TexPal<u16>(texpal + paloffset + 2, gpu);
-
-                    u32 r0 = color0 & 0x001F;
-                    u32 g0 = color0 & 0x03E0;
-                    u32 b0 = color0 & 0x7C00;
-                    u32 r1 = color1 & 0x001F;
-                    u32 g1 = color1 & 0x03E0;
-                    u32 b1 = color1 & 0x7C00;
-
-                    u32 r = (r0*3 + r1*5) >> 3;
-                    u32 g = ((g0*3 + g1*5) >> 3) & 0x03E0;
-                    u32 b = ((b0*3 + b1*5) >> 3) & 0x7C00;
-
-                    *color = r | g | b;
-                    *alpha = 31;
-                }
-                else
-                {
-                    *color = 0;
-                    *alpha = 0;
-                }
-                break;
-            }
-        }
-        break;
-
-    case 6: // A5I3
-        {
-            vramaddr += ((t * width) + s);
-            u8 pixel = ReadVRAM_Texture<u8>(vramaddr, gpu);
-
-            texpal <<= 4;
-            *color = ReadVRAM_TexPal<u16>(texpal + ((pixel&0x7)<<1), gpu);
-            *alpha = (pixel >> 3);
-        }
-        break;
-
-    case 7: // direct color
-        {
-            vramaddr += (((t * width) + s) << 1);
-            *color = ReadVRAM_Texture<u16>(vramaddr, gpu);
-            *alpha = (*color & 0x8000) ? 31 : 0;
-        }
-        break;
-    }
+    return texels[(t * width) + s];
 }
 
 // depth test is 'less or equal' instead of 'less than' under the following conditions:
@@ -444,8 +297,9 @@ u32 SoftRenderer::AlphaBlend(const GPU3D& gpu3d, u32 srccolor, u32 dstcolor, u32
     return srcR | (srcG << 8) | (srcB << 16) | (dstalpha << 24);
 }
 
-u32 SoftRenderer::RenderPixel(const GPU& gpu, const Polygon* polygon, u8 vr, u8 vg, u8 vb, s16 s, s16 t) const
+u32 SoftRenderer::RenderPixel(const GPU& gpu, const RendererPolygon* rp, u8 vr, u8 vg, u8 vb, s16 s, s16 t) const
 {
+    const Polygon* polygon = rp->PolyData;
     u8 r, g, b, a;
 
     u32 blendmode = (polygon->Attr >> 4) & 0x3;
@@ -478,14 +332,12 @@ u32 SoftRenderer::RenderPixel(const GPU& gpu, const Polygon* polygon, u8 vr, u8
 
     if ((gpu.GPU3D.RenderDispCnt & (1<<0)) && (((polygon->TexParam >> 26) & 0x7) != 0))
     {
-        u8 tr, tg, tb;
+        u32 texel = TextureLookup(polygon->TexParam, rp->Texels, s, t);
 
-        u16 tcolor; u8 talpha;
-        TextureLookup(gpu, polygon->TexParam, polygon->TexPalette, s, t, &tcolor, &talpha);
-
-        tr = (tcolor << 1) & 0x3E; if (tr) tr++;
-        tg = (tcolor >> 4) & 0x3E; if (tg) tg++;
-        tb = (tcolor >> 9) & 0x3E; if (tb) tb++;
+        u8 tr = texel & 0x3F;
+        u8 tg = (texel >> 8) & 0x3F;
+        u8 tb = (texel >> 16) & 0x3F;
+        u8 talpha = texel >> 24;
 
         if (blendmode & 0x1)
         {
@@ -653,6 +505,7 @@ void SoftRenderer::SetupPolygon(SoftRenderer::RendererPolygon* rp, Polygon* poly
     s32 ytop = polygon->YTop, ybot = polygon->YBottom;
 
     rp->PolyData = polygon;
+    rp->Texels = TexCache.Find(polygon->TexParam, polygon->TexPalette);
 
     rp->CurVL = vtop;
     rp->CurVR = vtop;
@@ -698,7 +551,7 @@ void SoftRenderer::SetupPolygon(SoftRenderer::RendererPolygon* rp, Polygon* poly
     }
 }
 
-void SoftRenderer::RenderShadowMaskScanline(const GPU3D& gpu3d, RendererPolygon* rp, s32 y)
+void SoftRenderer::RenderShadowMaskScanline(const GPU3D& gpu3d, RasterState& state, RendererPolygon* rp, s32 y)
 {
     Polygon* polygon = rp->PolyData;
 
@@ -716,10 +569,10 @@ void SoftRenderer::RenderShadowMaskScanline(const GPU3D& gpu3d, RendererPolygon*
     else
         fnDepthTest = DepthTest_LessThan;
 
-    if (!PrevIsShadowMask)
-        memset(&StencilBuffer[256 * (y&0x1)], 0, 256);
+    if (!state.PrevIsShadowMask)
+        memset(&state.StencilBuffer[256 * (y&0x1)], 0, 256);
 
-    PrevIsShadowMask = true;
+    state.PrevIsShadowMask = true;
 
     if (polygon->YTop != polygon->YBottom)
     {
@@ -860,13 +713,13 @@ void SoftRenderer::RenderShadowMaskScanline(const GPU3D& gpu3d, RendererPolygon*
         u32 dstattr = AttrBuffer[pixeladdr];
 
         if (!fnDepthTest(DepthBuffer[pixeladdr], z, dstattr))
-            StencilBuffer[256*(y&0x1) + x] = 1;
+            state.StencilBuffer[256*(y&0x1) + x] = 1;
 
         if (dstattr & 0xF)
         {
             pixeladdr += BufferSize;
             if (!fnDepthTest(DepthBuffer[pixeladdr], z, AttrBuffer[pixeladdr]))
-                StencilBuffer[256*(y&0x1) + x] |= 0x2;
+                state.StencilBuffer[256*(y&0x1) + x] |= 0x2;
         }
     }
 
@@ -886,13 +739,13 @@ void SoftRenderer::RenderShadowMaskScanline(const GPU3D& gpu3d, RendererPolygon*
         u32 dstattr = AttrBuffer[pixeladdr];
 
         if (!fnDepthTest(DepthBuffer[pixeladdr], z, dstattr))
-            StencilBuffer[256*(y&0x1) + x] = 1;
+            state.StencilBuffer[256*(y&0x1) + x] = 1;
 
         if (dstattr & 0xF)
         {
             pixeladdr += BufferSize;
             if (!fnDepthTest(DepthBuffer[pixeladdr], z, AttrBuffer[pixeladdr]))
-                StencilBuffer[256*(y&0x1) + x] |= 0x2;
+                state.StencilBuffer[256*(y&0x1) + x] |= 0x2;
         }
     }
 
@@ -912,13 +765,13 @@ void SoftRenderer::RenderShadowMaskScanline(const GPU3D& gpu3d, RendererPolygon*
         u32 dstattr = AttrBuffer[pixeladdr];
 
         if (!fnDepthTest(DepthBuffer[pixeladdr], z, dstattr))
-            StencilBuffer[256*(y&0x1) + x] = 1;
+            state.StencilBuffer[256*(y&0x1) + x] = 1;
 
         if (dstattr & 0xF)
         {
             pixeladdr += BufferSize;
             if (!fnDepthTest(DepthBuffer[pixeladdr], z, AttrBuffer[pixeladdr]))
-                StencilBuffer[256*(y&0x1) + x] |= 0x2;
+                state.StencilBuffer[256*(y&0x1) + x] |= 0x2;
         }
     }
 
@@ -926,7 +779,7 @@ void SoftRenderer::RenderShadowMaskScanline(const GPU3D& gpu3d, RendererPolygon*
     rp->XR = rp->SlopeR.Step();
 }
 
-void SoftRenderer::RenderPolygonScanline(const GPU& gpu, RendererPolygon* rp, s32 y)
+void SoftRenderer::RenderPolygonScanline(const GPU& gpu, RasterState& state, RendererPolygon* rp, s32 y)
 {
     Polygon* polygon = rp->PolyData;
 
@@ -944,7 +797,7 @@ void SoftRenderer::RenderPolygonScanline(const GPU& gpu, RendererPolygon* rp, s3
     else
         fnDepthTest = DepthTest_LessThan;
 
-    PrevIsShadowMask = false;
+    state.PrevIsShadowMask = false;
 
     if (polygon->YTop != polygon->YBottom)
     {
@@ -1089,6 +942,32 @@ void SoftRenderer::RenderPolygonScanline(const GPU& gpu, RendererPolygon* rp, s3
     if (x < 0) x = 0;
     s32 xlimit;
 
+    // with a SIMD kernel, depth and interpolation factors
+    // are calculated for the whole span at once
+    if (SpanFunc)
+    {
+        SpanParams spanparams;
+        interpX.GetSpanParams(spanparams);
+        spanparams.WBuffer = polygon->WBuffer;
+        spanparams.Z0 = zl;
+        spanparams.Z1 = zr;
+
+        SpanFunc(spanparams, x, std::min(xend+1, 256), state.Span);
+    }
+
+    // sets up interpX for pixel x, returns its depth
+    auto interpolatePixel = [&](s32 x) -> s32
+    {
+        if (SpanFunc)
+        {
+            interpX.SetX(x, state.Span.Factor[x]);
+            return state.Span.Z[x];
+        }
+
+        interpX.SetX(x);
+        return interpX.InterpolateZ(zl, zr, polygon->WBuffer);
+    };
+
     s32 xcov = 0;
 
     // part 1: left edge
@@ -1112,7 +991,7 @@ void SoftRenderer::RenderPolygonScanline(const GPU& gpu, RendererPolygon* rp, s3
         // check stencil buffer for shadows
         if (polygon->IsShadow)
         {
-            u8 stencil = StencilBuffer[256*(y&0x1) + x];
+            u8 stencil = state.StencilBuffer[256*(y&0x1) + x];
             if (!stencil)
                 continue;
             if (!(stencil & 0x1))
@@ -1121,9 +1000,7 @@ void SoftRenderer::RenderPolygonScanline(const GPU& gpu, RendererPolygon* rp, s3
                 dstattr &= ~0xF; // quick way to prevent drawing the shadow under antialiased edges
         }
 
-        interpX.SetX(x);
-
-        s32 z = interpX.InterpolateZ(zl, zr, polygon->WBuffer);
+        s32 z = interpolatePixel(x);
 
         // if depth test against the topmost pixel fails, test
         // against the pixel underneath
@@ -1144,7 +1021,7 @@ void SoftRenderer::RenderPolygonScanline(const GPU& gpu, RendererPolygon* rp, s3
         s16 s = interpX.Interpolate(sl, sr);
         s16 t = interpX.Interpolate(tl, tr);
 
-        u32 color = RenderPixel(gpu, polygon, vr>>3, vg>>3, vb>>3, s, t);
+        u32 color = RenderPixel(gpu, rp, vr>>3, vg>>3, vb>>3, s, t);
         u8 alpha = color >> 24;
 
         // alpha test
@@ -1208,7 +1085,7 @@ void SoftRenderer::RenderPolygonScanline(const GPU& gpu, RendererPolygon* rp, s3
         // check stencil buffer for shadows
         if (polygon->IsShadow)
         {
-            u8 stencil = StencilBuffer[256*(y&0x1) + x];
+            u8 stencil = state.StencilBuffer[256*(y&0x1) + x];
             if (!stencil)
                 continue;
             if (!(stencil & 0x1))
@@ -1217,9 +1094,7 @@ void SoftRenderer::RenderPolygonScanline(const GPU& gpu, RendererPolygon* rp, s3
                 dstattr &= ~0xF; // quick way to prevent drawing the shadow under antialiased edges
         }
 
-        interpX.SetX(x);
-
-        s32 z = interpX.InterpolateZ(zl, zr, polygon->WBuffer);
+        s32 z = interpolatePixel(x);
 
         // if depth test against the topmost pixel fails, test
         // against the pixel underneath
@@ -1240,7 +1115,7 @@ void SoftRenderer::RenderPolygonScanline(const GPU& gpu, RendererPolygon* rp, s3
         s16 s = interpX.Interpolate(sl, sr);
         s16 t = interpX.Interpolate(tl, tr);
 
-        u32 color = RenderPixel(gpu, polygon, vr>>3, vg>>3, vb>>3, s, t);
+        u32 color = RenderPixel(gpu, rp, vr>>3, vg>>3, vb>>3, s, t);
         u8 alpha = color >> 24;
 
         // alpha test
@@ -1300,7 +1175,7 @@ void SoftRenderer::RenderPolygonScanline(const GPU& gpu, RendererPolygon* rp, s3
         // check stencil buffer for shadows
         if (polygon->IsShadow)
         {
-            u8 stencil = StencilBuffer[256*(y&0x1) + x];
+            u8 stencil = state.StencilBuffer[256*(y&0x1) + x];
             if (!stencil)
                 continue;
             if (!(stencil & 0x1))
@@ -1309,9 +1184,7 @@ void SoftRenderer::RenderPolygonScanline(const GPU& gpu, RendererPolygon* rp, s3
                 dstattr &= ~0xF; // quick way to prevent drawing the shadow under antialiased edges
         }
 
-        interpX.SetX(x);
-
-        s32 z = interpX.InterpolateZ(zl, zr, polygon->WBuffer);
+        s32 z = interpolatePixel(x);
 
         // if depth test against the topmost pixel fails, test
         // against the pixel underneath
@@ -1332,7 +1205,7 @@ void SoftRenderer::RenderPolygonScanline(const GPU& gpu, RendererPolygon* rp, s3
         s16 s = interpX.Interpolate(sl, sr);
         s16 t = interpX.Interpolate(tl, tr);
 
-        u32 color = RenderPixel(gpu, polygon, vr>>3, vg>>3, vb>>3, s, t);
+        u32 color = RenderPixel(gpu, rp, vr>>3, vg>>3, vb>>3, s, t);
         u8 alpha = color >> 24;
 
         // alpha test
@@ -1384,19 +1257,24 @@ void SoftRenderer::RenderPolygonScanline(const GPU& gpu, RendererPolygon* rp, s3
     rp->XR = rp->SlopeR.Step();
 }
 
-void SoftRenderer::RenderScanline(const GPU& gpu, s32 y, int npolys)
+static bool PolygonCoversScanline(const Polygon* polygon, s32 y)
 {
-    for (int i = 0; i < npolys; i++)
+    return y >= polygon->YTop && (y < polygon->YBottom || (y == polygon->YTop && polygon->YBottom == polygon->YTop));
+}
+
+void SoftRenderer::RenderScanline(const GPU& gpu, RasterState& state, s32 y)
+{
+    for (int i = 0; i < state.NumPolygons; i++)
     {
-        RendererPolygon* rp = &PolygonList[i];
+        RendererPolygon* rp = &state.PolygonList[i];
         Polygon* polygon = rp->PolyData;
 
-        if (y >= polygon->YTop && (y < polygon->YBottom || (y == polygon->YTop && polygon->YBottom == polygon->YTop)))
+        if (PolygonCoversScanline(polygon, y))
         {
             if (polygon->IsShadowMask)
-                RenderShadowMaskScanline(gpu.GPU3D, rp, y);
+                RenderShadowMaskScanline(gpu.GPU3D, state, rp, y);
             else
-                RenderPolygonScanline(gpu, rp, y);
+                RenderPolygonScanline(gpu, state, rp, y);
         }
     }
 }
@@ -1699,20 +1577,48 @@ void SoftRenderer::ClearBuffers(const GPU& gpu)
     }
 }
 
+void SoftRenderer::DecodeTextures(const GPU& gpu, Polygon** polygons, int npolys)
+{
+    // everything is decoded before rasterization starts, so that
+    // the band workers only ever have to look textures up
+    TexCache.Trim();
+
+    if (!(gpu.GPU3D.RenderDispCnt & (1<<0)))
+        return;
+
+    for (int i = 0; i < npolys; i++)
+    {
+        Polygon* polygon = polygons[i];
+        if (polygon->Degenerate || ((polygon->TexParam >> 26) & 0x7) == 0)
+            continue;
+
+        TexCache.Get(gpu, polygon->TexParam, polygon->TexPalette);
+    }
+}
+
 void SoftRenderer::RenderPolygons(const GPU& gpu, bool threaded, Polygon** polygons, int npolys)
 {
+    DecodeTextures(gpu, polygons, npolys);
+
+    if (Bands.size() > 1)
+    {
+        RenderPolygonsBanded(gpu, threaded, polygons, npolys);
+        return;
+    }
+
     int j = 0;
     for (int i = 0; i < npolys; i++)
     {
         if (polygons[i]->Degenerate) continue;
-        SetupPolygon(&PolygonList[j++], polygons[i]);
+        SetupPolygon(&Raster.PolygonList[j++], polygons[i]);
     }
+    Raster.NumPolygons = j;
 
-    RenderScanline(gpu, 0, j);
+    RenderScanline(gpu, Raster, 0);
 
     for (s32 y = 1; y < 192; y++)
     {
-        RenderScanline(gpu, y, j);
+        RenderScanline(gpu, Raster, y);
         ScanlineFinalPass(gpu.GPU3D, y-1);
 
         if (threaded)
@@ -1727,6 +1633,293 @@ void SoftRenderer::RenderPolygons(const GPU& gpu, bool threaded, Polygon** polyg
         Platform::Semaphore_Post(Sema_ScanlineCount);
 }
 
+int SoftRenderer::SplitBands(Polygon** polygons, int npolys, bool& lastShadowMask)
+{
+    // Scanlines depend on each other in two ways:
+    // * the final pass looks at the scanlines above and below
+    // * the stencil buffer only holds two scanlines, and is only cleared
+    //   by a shadow mask that doesn't directly follow another one.
+    //   When it isn't cleared, the scanline sees what was left two
+    //   scanlines above (or even further up).
+    //
+    // The first one is taken care of while rendering, the bands wait for
+    // each other before doing the final pass on their edges. For the second
+    // one, the bands are placed so that no scanline needs stencil bits that
+    // were left by another band. Each band also needs to know whether the
+    // last polygon before it was a shadow mask.
+
+    // how much work each scanline roughly is
+    s32 weight[192+1] {};
+    bool noSplit[192] {};
+    bool prevShadowMaskAt[192] {};
+    bool anyShadows = false;
+
+    int n = 0;
+    for (int i = 0; i < npolys; i++)
+    {
+        Polygon* polygon = polygons[i];
+        if (polygon->Degenerate) continue;
+        BandPolygons[n++] = polygon;
+
+        s32 ytop = std::clamp(polygon->YTop, 0, 192);
+        s32 ybot = std::clamp(std::max(polygon->YBottom, polygon->YTop+1), 0, 192);
+        weight[ytop]++;
+        weight[ybot]--;
+
+        if (polygon->IsShadowMask || polygon->IsShadow)
+            anyShadows = true;
+    }
+    NumBandPolygons = n;
+
+    bool prevShadowMask = Raster.PrevIsShadowMask;
+    LastStencilLine[0] = -1;
+    LastStencilLine[1] = -1;
+    if (anyShadows)
+    {
+        for (s32 y = 0; y < 192; y++)
+        {
+            prevShadowMaskAt[y] = prevShadowMask;
+
+            bool cleared = false, inherited = false, touched = false;
+            for (int i = 0; i < n; i++)
+            {
+                Polygon* polygon = BandPolygons[i];
+                if (!PolygonCoversScanline(polygon, y)) continue;
+
+                if (polygon->IsShadowMask)
+                {
+                    if (!prevShadowMask) cleared = true;
+                    else if (!cleared) inherited = true;
+                    touched = true;
+                    prevShadowMask = true;
+                }
+                else
+                {
+                    if (polygon->IsShadow && !cleared) inherited = true;
+                    prevShadowMask = false;
+                }
+            }
+
+            // no band may start between this line and the one it takes stencil bits from
+            if (inherited)
+            {
+                for (s32 s = LastStencilLine[y&0x1]+1; s <= y; s++)
+                    noSplit[s] = true;
+            }
+
+            if (touched)
+                LastStencilLine[y&0x1] = y;
+        }
+    }
+    else
+    {
+        // without shadow masks, only a frame without any polygon keeps the
+        // state of the previous one, and the stencil buffer isn't used at all
+        if (n > 0) prevShadowMask = false;
+    }
+
+    s32 totalweight = 0;
+    for (s32 y = 0; y < 192; y++)
+    {
+        // every scanline has a final pass, no matter how many polygons it has
+        weight[y+1] += weight[y];
+        totalweight += weight[y] + 1;
+    }
+
+    // not worth waking up the workers for an empty frame
+    int numbands = n ? (int)Bands.size() : 1;
+    int band = 0;
+    int target = 1;
+    s32 cumweight = 0;
+    Bands[0].YStart = 0;
+    for (s32 y = 0; y < 192 && target < numbands; y++)
+    {
+        if (cumweight >= (s64)totalweight * target / numbands && !noSplit[y] && y > Bands[band].YStart)
+        {
+            Bands[band].YEnd = y;
+            band++;
+            Bands[band].YStart = y;
+
+            // a scanline with lots of polygons can be worth more than one band,
+            // don't follow it with bands that are only a scanline high
+            while (target < numbands && cumweight >= (s64)totalweight * target / numbands)
+                target++;
+        }
+        cumweight += weight[y] + 1;
+    }
+    Bands[band].YEnd = 192;
+
+    for (int i = 1; i <= band; i++)
+        Bands[i].State->PrevIsShadowMask = prevShadowMaskAt[Bands[i].YStart];
+
+    lastShadowMask = prevShadowMask;
+
+    return band + 1;
+}
+
+void SoftRenderer::RenderBandScanlines(const GPU& gpu, int band, bool threaded)
+{
+    RenderBand& b = Bands[band];
+    RasterState& state = band ? *b.State : Raster;
+    bool first = band == 0;
+    bool last = band == NumActiveBands-1;
+    s32 ystart = b.YStart, yend = b.YEnd;
+
+    int j = 0;
+    for (int i = 0; i < NumBandPolygons; i++)
+    {
+        Polygon* polygon = BandPolygons[i];
+        if (polygon->YTop >= yend || std::max(polygon->YBottom, polygon->YTop+1) <= ystart)
+            continue;
+
+        RendererPolygon* rp = &state.PolygonList[j++];
+        SetupPolygon(rp, polygon);
+
+        // skip ahead to where the band starts, this lands
+        // on the same values stepping down to it would
+        if (ystart > polygon->YTop && polygon->YTop != polygon->YBottom)
+        {
+            SetupPolygonLeftEdge(rp, ystart);
+            SetupPolygonRightEdge(rp, ystart);
+        }
+    }
+    state.NumPolygons = j;
+
+    RenderScanline(gpu, state, ystart);
+    if (!first) Platform::Semaphore_Post(b.Sema_FirstLine);
+    if (!last && yend-1 == ystart) Platform::Semaphore_Post(b.Sema_LastLine);
+
+    for (s32 y = ystart+1; y < yend; y++)
+    {
+        RenderScanline(gpu, state, y);
+        if (!last && y == yend-1) Platform::Semaphore_Post(b.Sema_LastLine);
+
+        if (first || y-1 > ystart)
+        {
+            ScanlineFinalPass(gpu.GPU3D, y-1);
+
+            if (first && threaded)
+                Platform::Semaphore_Post(Sema_ScanlineCount);
+        }
+    }
+
+    // the final pass for the edges of the band has to wait for the bands next to it
+    if (!first) Platform::Semaphore_Wait(Bands[band-1].Sema_LastLine);
+    if (!last) Platform::Semaphore_Wait(Bands[band+1].Sema_FirstLine);
+
+    if (!first)
+        ScanlineFinalPass(gpu.GPU3D, ystart);
+
+    if (first || yend-1 > ystart)
+    {
+        ScanlineFinalPass(gpu.GPU3D, yend-1);
+
+        if (first && threaded)
+            Platform::Semaphore_Post(Sema_ScanlineCount);
+    }
+}
+
+void SoftRenderer::RenderPolygonsBanded(const GPU& gpu, bool threaded, Polygon** polygons, int npolys)
+{
+    bool lastShadowMask;
+    NumActiveBands = SplitBands(polygons, npolys, lastShadowMask);
+
+    BandGPU = &gpu;
+    for (int i = 1; i < NumActiveBands; i++)
+        Platform::Semaphore_Post(Bands[i].Sema_Start);
+
+    RenderBandScanlines(gpu, 0, threaded);
+
+    // the other bands are handed out in order, so the main thread can keep reading scanlines
+    for (int i = 1; i < NumActiveBands; i++)
+    {
+        Platform::Semaphore_Wait(Bands[i].Sema_Done);
+
+        if (threaded)
+            Platform::Semaphore_Post(Sema_ScanlineCount, Bands[i].YEnd - Bands[i].YStart);
+    }
+
+    // leave things as if the frame was rendered in one go, for the next frame
+    Raster.PrevIsShadowMask = lastShadowMask;
+    for (int row = 0; row < 2; row++)
+    {
+        for (int i = NumActiveBands-1; i > 0; i--)
+        {
+            if (LastStencilLine[row] < Bands[i].YStart) continue;
+
+            memcpy(&Raster.StencilBuffer[256*row], &Bands[i].State->StencilBuffer[256*row], 256);
+            break;
+        }
+    }
+}
+
+void SoftRenderer::BandWorkerFunc(int band)
+{
+    for (;;)
+    {
+        Platform::Semaphore_Wait(Bands[band].Sema_Start);
+        if (!BandWorkersRunning) return;
+
+        RenderBandScanlines(*BandGPU, band, false);
+
+        Platform::Semaphore_Post(Bands[band].Sema_Done);
+    }
+}
+
+void SoftRenderer::StartBandWorkers(int count)
+{
+    count = std::clamp(count, 0, MaxBandWorkers);
+
+    Bands.resize(count + 1);
+    for (int i = 0; i <= count; i++)
+    {
+        RenderBand& band = Bands[i];
+        band.Sema_FirstLine = Platform::Semaphore_Create();
+        band.Sema_LastLine = Platform::Semaphore_Create();
+        if (i == 0) continue;
+
+        band.State = std::make_unique<RasterState>();
+        band.Sema_Start = Platform::Semaphore_Create();
+        band.Sema_Done = Platform::Semaphore_Create();
+    }
+
+    if (count == 0) return;
+
+    BandWorkersRunning = true;
+    for (int i = 1; i <= count; i++)
+    {
+        Bands[i].Thread = Platform::Thread_Create([this, i]() {
+            BandWorkerFunc(i);
+        });
+    }
+}
+
+void SoftRenderer::StopBandWorkers()
+{
+    if (BandWorkersRunning.load(std::memory_order_relaxed))
+    {
+        BandWorkersRunning = false;
+
+        for (size_t i = 1; i < Bands.size(); i++)
+            Platform::Semaphore_Post(Bands[i].Sema_Start);
+
+        for (size_t i = 1; i < Bands.size(); i++)
+        {
+            Platform::Thread_Wait(Bands[i].Thread);
+            Platform::Thread_Free(Bands[i].Thread);
+        }
+    }
+
+    for (RenderBand& band : Bands)
+    {
+        Platform::Semaphore_Free(band.Sema_FirstLine);
+        Platform::Semaphore_Free(band.Sema_LastLine);
+        if (band.Sema_Start) Platform::Semaphore_Free(band.Sema_Start);
+        if (band.Sema_Done) Platform::Semaphore_Free(band.Sema_Done);
+    }
+    Bands.clear();
+}
+
 void SoftRenderer::VCount144(GPU& gpu)
 {
     if (RenderThreadRunning.load(std::memory_order_relaxed) && !gpu.GPU3D.AbortFrame)
@@ -1741,6 +1934,10 @@ void SoftRenderer::RenderFrame(GPU& gpu)
     bool textureChanged = gpu.MakeVRAMFlat_TextureCoherent(textureDirty);
     bool texPalChanged = gpu.MakeVRAMFlat_TexPalCoherent(texPalDirty);
 
+    // the render thread is idle at this point, so cached textures can be dropped
+    if (textureChanged || texPalChanged)
+        TexCache.Invalidate(textureDirty, texPalDirty);
+
     FrameIdentical = !(textureChanged || texPalChanged) && gpu.GPU3D.RenderFrameIdentical;
 
     if (RenderThreadRunning.load(std::memory_order_relaxed))
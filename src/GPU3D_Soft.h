@@ -20,22 +20,42 @@
 
 #include "GPU.h"
 #include "GPU3D.h"
+#include "GPU3D_SoftSpan.h"
+#include "GPU3D_SoftTexcache.h"
 #include "Platform.h"
 #include <thread>
 #include <atomic>
+#include <memory>
+#include <vector>
 
 namespace melonDS
 {
 class SoftRenderer : public Renderer3D
 {
 public:
-    SoftRenderer(bool threaded = false) noexcept;
+    SoftRenderer(bool threaded = false, int bandWorkers = 0) noexcept;
     ~SoftRenderer() override;
     void Reset(GPU& gpu) override;
 
     void SetThreaded(bool threaded, GPU& gpu) noexcept;
     [[nodiscard]] bool IsThreaded() const noexcept { return Threaded; }
 
+    /// Sets how many extra threads help rasterizing each frame.
+    /// With N workers, the frame is split into N+1 bands of scanlines
+    /// that are rendered in parallel, the thread rendering the frame
+    /// takes care of the topmost one. 0 renders the whole frame
+    /// on one thread. The output is the same either way.
+    void SetBandWorkers(int count, GPU& gpu) noexcept;
+    [[nodiscard]] int GetBandWorkers() const noexcept { return (int)Bands.size() - 1; }
+    static constexpr int MaxBandWorkers = 15;
+
+    /// Selects the SIMD kernel used to interpolate depth along
+    /// scanlines, falling back to the scalar one if the CPU doesn't
+    /// support it. The fastest supported one is used by default.
+    /// Must not be called while a frame is being rendered.
+    void SetSpanKernel(SpanKernel kernel) noexcept;
+    [[nodiscard]] SpanKernel GetSpanKernel() const noexcept { return SpanKernelType; }
+
     void VCount144(GPU& gpu) override;
     void RenderFrame(GPU& gpu) override;
     void RestartFrame(GPU& gpu) override;
@@ -79,6 +99,7 @@ private:
             this->x0 = x0;
             this->x1 = x1;
             this->xdiff = x1 - x0;
+            this->yfactor = 0;
 
             // calculate reciprocal for Z interpolation
             // TODO eventually: use a faster reciprocal function?
@@ -214,6 +235,27 @@ private:
             }
         }
 
+        // same as SetX(), with the factor calculated by a span kernel
+        constexpr void SetX(s32 x, u32 yfactor)
+        {
+            this->x = x - x0;
+            this->yfactor = yfactor;
+        }
+
+        // the span kernels do the same math as SetX() and InterpolateZ(),
+        // several pixels at once
+        constexpr void GetSpanParams(SpanParams& params) const
+        {
+            static_assert(dir == 0, "span kernels only interpolate along X");
+
+            params.X0 = x0;
+            params.XDiff = xdiff;
+            params.W0 = w0n;
+            params.W1 = w1d;
+            params.XRecipZ = xrecip_z;
+            params.Linear = linear;
+        }
+
     private:
         s32 x0, x1, xdiff, x;
 
@@ -445,6 +487,7 @@ private:
     struct RendererPolygon
     {
         Polygon* PolyData;
+        const u32* Texels; // decoded texture, null if the polygon isn't textured
 
         Slope<0> SlopeL;
         Slope<1> SlopeR;
@@ -454,22 +497,57 @@ private:
 
     };
 
-    RendererPolygon PolygonList[2048];
-    void TextureLookup(const GPU& gpu, u32 texparam, u32 texpal, s16 s, s16 t, u16* color, u8* alpha) const;
-    u32 RenderPixel(const GPU& gpu, const Polygon* polygon, u8 vr, u8 vg, u8 vb, s16 s, s16 t) const;
+    // rasterizer state that is carried over from one scanline to the next
+    // each band of scanlines that's rendered in parallel has its own copy
+    struct RasterState
+    {
+        RendererPolygon PolygonList[2048];
+        int NumPolygons;
+
+        u8 StencilBuffer[256*2];
+        bool PrevIsShadowMask;
+
+        // depth and interpolation factors of the scanline span being rendered
+        SpanValues Span;
+    };
+
+    struct RenderBand
+    {
+        s32 YStart, YEnd;
+        std::unique_ptr<RasterState> State; // null for band 0, which uses Raster
+
+        Platform::Thread* Thread = nullptr;
+        Platform::Semaphore* Sema_Start = nullptr;
+        Platform::Semaphore* Sema_Done = nullptr;
+
+        // the final pass for the first and last scanline of a band needs the
+        // polygons of the scanline next to it, which belongs to the next band
+        Platform::Semaphore* Sema_FirstLine = nullptr;
+        Platform::Semaphore* Sema_LastLine = nullptr;
+    };
+
+    u32 TextureLookup(u32 texparam, const u32* texels, s16 s, s16 t) const;
+    u32 RenderPixel(const GPU& gpu, const RendererPolygon* rp, u8 vr, u8 vg, u8 vb, s16 s, s16 t) const;
     void PlotTranslucentPixel(const GPU3D& gpu3d, u32 pixeladdr, u32 color, u32 z, u32 polyattr, u32 shadow);
     void SetupPolygonLeftEdge(RendererPolygon* rp, s32 y) const;
     void SetupPolygonRightEdge(RendererPolygon* rp, s32 y) const;
     void SetupPolygon(RendererPolygon* rp, Polygon* polygon) const;
-    void RenderShadowMaskScanline(const GPU3D& gpu3d, RendererPolygon* rp, s32 y);
-    void RenderPolygonScanline(const GPU& gpu, RendererPolygon* rp, s32 y);
-    void RenderScanline(const GPU& gpu, s32 y, int npolys);
+    void RenderShadowMaskScanline(const GPU3D& gpu3d, RasterState& state, RendererPolygon* rp, s32 y);
+    void RenderPolygonScanline(const GPU& gpu, RasterState& state, RendererPolygon* rp, s32 y);
+    void RenderScanline(const GPU& gpu, RasterState& state, s32 y);
     u32 CalculateFogDensity(const GPU3D& gpu3d, u32 pixeladdr) const;
     void ScanlineFinalPass(const GPU3D& gpu3d, s32 y);
     void ClearBuffers(const GPU& gpu);
+    void DecodeTextures(const GPU& gpu, Polygon** polygons, int npolys);
     void RenderPolygons(const GPU& gpu, bool threaded, Polygon** polygons, int npolys);
+    void RenderPolygonsBanded(const GPU& gpu, bool threaded, Polygon** polygons, int npolys);
+    int SplitBands(Polygon** polygons, int npolys, bool& lastShadowMask);
+    void RenderBandScanlines(const GPU& gpu, int band, bool threaded);
 
     void RenderThreadFunc(GPU& gpu);
+    void BandWorkerFunc(int band);
+    void StartBandWorkers(int count);
+    void StopBandWorkers();
 
     // buffer dimensions are 258x194 to add a offscreen 1px border
     // which simplifies edge marking tests
@@ -495,8 +573,7 @@ private:
     // bit22: translucent flag
     // bit24-29: polygon ID for opaque pixels
 
-    u8 StencilBuffer[256*2];
-    bool PrevIsShadowMask;
+    RasterState Raster;
 
     bool Enabled;
 
@@ -518,5 +595,25 @@ private:
     // Used to allow the main thread to read some scanlines
     // before (the 3D portion of) the entire frame is rasterized.
     Platform::Semaphore* Sema_ScanlineCount;
+
+    // band rendering
+
+    // band 0 is rendered by whichever thread renders the frame,
+    // the others each have a worker thread
+    std::vector<RenderBand> Bands;
+    int NumActiveBands;
+    std::atomic_bool BandWorkersRunning;
+    const GPU* BandGPU;
+
+    // the non-degenerate polygons of the frame being rendered
+    Polygon* BandPolygons[2048];
+    int NumBandPolygons;
+    // scanline that last touched each row of the stencil buffer, -1 if none did
+    s32 LastStencilLine[2];
+
+    SpanKernel SpanKernelType;
+    SpanKernelFunc SpanFunc; // null for the scalar kernel
+
+    SoftTexCache TexCache;
 };
 }
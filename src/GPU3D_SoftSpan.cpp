@@ -0,0 +1,236 @@
+/*
+    Copyright 2016-2023 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "GPU3D_SoftSpan.h"
+
+// The kernels are written once with GCC vector extensions and compiled
+// for each instruction set with target attributes, so that the generic
+// build still runs on any CPU of the architecture.
+#if defined(__x86_64__) || defined(__i386__)
+#define SPAN_X86
+#elif defined(__aarch64__)
+#define SPAN_NEON
+#endif
+
+namespace melonDS
+{
+
+template <int N>
+struct SpanVec
+{
+    typedef s32 I __attribute__((vector_size(N*4)));
+    typedef u32 U __attribute__((vector_size(N*4)));
+    typedef float F __attribute__((vector_size(N*4)));
+    typedef s64 L __attribute__((vector_size(N*8)));
+};
+
+template <int N>
+static inline __attribute__((always_inline)) void FillSpan(s32* out, s32 count, s32 val)
+{
+    typedef typename SpanVec<N>::I I;
+    I v = {};
+    v += val;
+
+    for (s32 i = 0; i < count; i += N)
+        __builtin_memcpy(&out[i], &v, sizeof(v));
+}
+
+template <int N>
+static inline __attribute__((always_inline)) void InterpolateSpanImpl(const SpanParams& params, s32 xstart, s32 xend, SpanValues& out)
+{
+    typedef typename SpanVec<N>::I I;
+    typedef typename SpanVec<N>::U U;
+    typedef typename SpanVec<N>::F F;
+    typedef typename SpanVec<N>::L L;
+
+    const s32 count = xend - xstart;
+    if (count <= 0) return;
+
+    const s32 xdiff = params.XDiff;
+    const u32 w0 = params.W0;
+    const u32 w1 = params.W1;
+    const s32 z0 = params.Z0;
+    const s32 z1 = params.Z1;
+    s32* zout = &out.Z[xstart];
+    s32* factorout = (s32*)&out.Factor[xstart];
+
+    // the factor is only calculated in perspective mode, otherwise it stays 0
+    const bool perspective = xdiff != 0 && !params.Linear;
+    if (!perspective)
+        FillSpan<N>(factorout, count, 0);
+
+    // X relative to the interpolator's start, for the first N pixels
+    I xfirst;
+    for (int i = 0; i < N; i++)
+        xfirst[i] = xstart - params.X0 + i;
+
+    if (perspective)
+    {
+        const I izero = {};
+        const F fzero = {};
+
+        for (s32 i = 0; i < count; i += N)
+        {
+            const I x = xfirst + i;
+            const U xw0 = (U)x * w0;
+            const U den = xw0 + (U)(xdiff - x) * w1;
+
+            // the quotient is at most 256, so a single precision division
+            // gets within 1 of it, and the remainder is small enough to be
+            // checked in 32 bits, even though the dividend is 33 bits wide
+            F fden = __builtin_convertvector((I)den, F);
+            fden = (den == 0) ? fzero + 1 : fden;
+            F fq = (__builtin_convertvector((I)xw0, F) * 256) / fden;
+            // keep the conversion defined for lanes past the end of the span
+            fq = ((fq >= 0) & (fq < 65536)) ? fq : fzero;
+
+            I yfactor = __builtin_convertvector(fq, I);
+            I rem = (I)((xw0 << 8) - (U)yfactor * den);
+            yfactor = (rem < 0) ? yfactor - 1 : yfactor;
+            rem = (rem < 0) ? rem + (I)den : rem;
+            yfactor = (rem >= (I)den) ? yfactor + 1 : yfactor;
+            yfactor = (den == 0) ? izero : yfactor;
+
+            __builtin_memcpy(&factorout[i], &yfactor, sizeof(yfactor));
+        }
+    }
+
+    if (xdiff == 0 || z0 == z1 || (params.WBuffer && !perspective))
+    {
+        FillSpan<N>(zout, count, z0);
+    }
+    else if (params.WBuffer)
+    {
+        // Z is at most 24 bits wide, so the product fits in 32 bits
+        const bool up = z0 < z1;
+        const u32 base = up ? z0 : z1;
+        const u32 disp = up ? (z1 - z0) : (z0 - z1);
+
+        for (s32 i = 0; i < count; i += N)
+        {
+            U yfactor;
+            __builtin_memcpy(&yfactor, &factorout[i], sizeof(yfactor));
+            if (!up) yfactor = 256 - yfactor;
+
+            const U z = base + ((disp * yfactor) >> 8);
+            __builtin_memcpy(&zout[i], &z, sizeof(z));
+        }
+    }
+    else
+    {
+        const bool up = z0 < z1;
+        const s32 base = up ? z0 : z1;
+        const s32 disp = (up ? (z1 - z0) : (z0 - z1)) >> 9;
+        const s64 scale = (s64)disp * params.XRecipZ;
+
+        for (s32 i = 0; i < count; i += N)
+        {
+            const I x = xfirst + i;
+            const I factor = up ? x : (xdiff - x);
+
+            const L prod = __builtin_convertvector(factor, L) * scale;
+            const I z = base + __builtin_convertvector(prod >> 13, I);
+            __builtin_memcpy(&zout[i], &z, sizeof(z));
+        }
+    }
+}
+
+#ifdef SPAN_X86
+__attribute__((target("sse4.1")))
+static void InterpolateSpan_SSE41(const SpanParams& params, s32 xstart, s32 xend, SpanValues& out)
+{
+    InterpolateSpanImpl<4>(params, xstart, xend, out);
+}
+
+__attribute__((target("avx2")))
+static void InterpolateSpan_AVX2(const SpanParams& params, s32 xstart, s32 xend, SpanValues& out)
+{
+    InterpolateSpanImpl<8>(params, xstart, xend, out);
+}
+#endif
+
+#ifdef SPAN_NEON
+static void InterpolateSpan_NEON(const SpanParams& params, s32 xstart, s32 xend, SpanValues& out)
+{
+    InterpolateSpanImpl<4>(params, xstart, xend, out);
+}
+#endif
+
+bool IsSpanKernelSupported(SpanKernel kernel) noexcept
+{
+    switch (kernel)
+    {
+    case SpanKernel::Scalar:
+        return true;
+#ifdef SPAN_X86
+    case SpanKernel::SSE41:
+        return __builtin_cpu_supports("sse4.1");
+    case SpanKernel::AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+#ifdef SPAN_NEON
+    case SpanKernel::NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+SpanKernel GetBestSpanKernel() noexcept
+{
+    for (SpanKernel kernel : {SpanKernel::AVX2, SpanKernel::SSE41, SpanKernel::NEON})
+    {
+        if (IsSpanKernelSupported(kernel))
+            return kernel;
+    }
+
+    return SpanKernel::Scalar;
+}
+
+SpanKernelFunc GetSpanKernelFunc(SpanKernel kernel) noexcept
+{
+    if (!IsSpanKernelSupported(kernel))
+        return nullptr;
+
+    switch (kernel)
+    {
+#ifdef SPAN_X86
+    case SpanKernel::SSE41: return InterpolateSpan_SSE41;
+    case SpanKernel::AVX2: return InterpolateSpan_AVX2;
+#endif
+#ifdef SPAN_NEON
+    case SpanKernel::NEON: return InterpolateSpan_NEON;
+#endif
+    default: return nullptr;
+    }
+}
+
+const char* GetSpanKernelName(SpanKernel kernel) noexcept
+{
+    switch (kernel)
+    {
+    case SpanKernel::Scalar: return "scalar";
+    case SpanKernel::SSE41: return "sse4.1";
+    case SpanKernel::AVX2: return "avx2";
+    case SpanKernel::NEON: return "neon";
+    default: return "unknown";
+    }
+}
+
+}
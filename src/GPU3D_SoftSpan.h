@@ -0,0 +1,88 @@
+/*
+    Copyright 2016-2023 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef GPU3D_SOFTSPAN_H
+#define GPU3D_SOFTSPAN_H
+
+#include "types.h"
+
+namespace melonDS
+{
+
+// SIMD kernels for the software renderer's per-pixel interpolation.
+//
+// Along X, the interpolator needs a 64-bit division per pixel to get
+// the perspective-correct interpolation factor, and the depth of every
+// pixel has to be known before anything else can be done with it.
+// These kernels calculate both for several pixels at once, the other
+// attributes are then interpolated from the factor only for the pixels
+// that pass the depth test.
+//
+// The results are bit-exact with SoftRenderer's X interpolator, which
+// remains the scalar fallback. The divisions are done in single
+// precision and then corrected with the exact remainder. This relies
+// on W values fitting in 16 bits and Z values in 24 bits, neither
+// being negative, which GPU3D guarantees.
+
+/// The state of an X interpolator, and the depth at both ends of the span.
+struct SpanParams
+{
+    s32 X0, XDiff;
+    s32 W0, W1;
+    s32 XRecipZ;
+    bool Linear;
+    bool WBuffer;
+    s32 Z0, Z1;
+};
+
+struct SpanValues
+{
+    // kernels may write a few values past the end of the span
+    alignas(32) s32 Z[256 + 8];
+    alignas(32) u32 Factor[256 + 8];
+};
+
+enum class SpanKernel
+{
+    Scalar = 0,
+    SSE41,
+    AVX2,
+    NEON,
+};
+
+/// Fills \c out with the depth and interpolation factor
+/// of the pixels \c xstart to \c xend-1.
+using SpanKernelFunc = void (*)(const SpanParams& params, s32 xstart, s32 xend, SpanValues& out);
+
+/// @return Whether \c kernel can run on this CPU.
+/// The scalar one always can.
+[[nodiscard]] bool IsSpanKernelSupported(SpanKernel kernel) noexcept;
+
+/// @return The fastest kernel this CPU supports.
+[[nodiscard]] SpanKernel GetBestSpanKernel() noexcept;
+
+/// @return The function implementing \c kernel, or nullptr if it's
+/// the scalar one (the renderer uses its own interpolator for that)
+/// or isn't supported by this CPU.
+[[nodiscard]] SpanKernelFunc GetSpanKernelFunc(SpanKernel kernel) noexcept;
+
+[[nodiscard]] const char* GetSpanKernelName(SpanKernel kernel) noexcept;
+
+}
+
+#endif // GPU3D_SOFTSPAN_H
@@ -0,0 +1,338 @@
+/*
+    Copyright 2016-2023 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "GPU3D_SoftTexcache.h"
+
+namespace melonDS
+{
+
+// 16MB of decoded texels is a lot more than a game can use at once,
+// but could be reached by a game that keeps using the same texture
+// with many different palettes
+static constexpr u32 MaxCachedTexels = 4*1024*1024;
+
+static inline u32 MakeTexel(u16 color, u8 alpha)
+{
+    u32 r = (color << 1) & 0x3E; if (r) r++;
+    u32 g = (color >> 4) & 0x3E; if (g) g++;
+    u32 b = (color >> 9) & 0x3E; if (b) b++;
+
+    return r | (g << 8) | (b << 16) | (alpha << 24);
+}
+
+// marks the memory from start to start+length, wrapping around the end
+template <u32 Size>
+static void MarkRange(NonStupidBitField<Size>& mask, u32 start, u32 length)
+{
+    constexpr u32 memSize = Size * VRAMDirtyGranularity;
+    if (length >= memSize)
+    {
+        mask.SetRange(0, Size);
+        return;
+    }
+
+    start &= (memSize - 1);
+    u32 startBit = start / VRAMDirtyGranularity;
+    u32 endBit = (start + length - 1) / VRAMDirtyGranularity;
+
+    if (endBit < Size)
+        mask.SetRange(startBit, endBit - startBit + 1);
+    else
+    {
+        mask.SetRange(startBit, Size - startBit);
+        mask.SetRange(0, endBit - Size + 1);
+    }
+}
+
+void SoftTexCache::Reset() noexcept
+{
+    Entries.clear();
+    NumTexels = 0;
+}
+
+void SoftTexCache::Invalidate(const TextureDirty& textureDirty, const TexPalDirty& texPalDirty) noexcept
+{
+    for (auto it = Entries.begin(); it != Entries.end();)
+    {
+        Entry& entry = it->second;
+        if (entry.TextureMask.Intersects(textureDirty) || entry.TexPalMask.Intersects(texPalDirty))
+        {
+            NumTexels -= entry.Texels.size();
+            it = Entries.erase(it);
+        }
+        else
+            it++;
+    }
+}
+
+void SoftTexCache::Trim() noexcept
+{
+    Frame++;
+    if (NumTexels <= MaxCachedTexels)
+        return;
+
+    for (auto it = Entries.begin(); it != Entries.end();)
+    {
+        Entry& entry = it->second;
+        if (entry.LastUsed != Frame-1)
+        {
+            NumTexels -= entry.Texels.size();
+            it = Entries.erase(it);
+        }
+        else
+            it++;
+    }
+}
+
+u64 SoftTexCache::MakeKey(u32 texparam, u32 texpal) noexcept
+{
+    // only the address, size, format and colour 0 transparency matter,
+    // not how the texture is repeated or how its coordinates are transformed
+    u32 fmt = (texparam >> 26) & 0x7;
+    texparam &= 0x3FF0FFFF;
+
+    if (fmt < 2 || fmt > 4)
+        texparam &= ~(1<<29);
+    if (fmt == 7)
+        texpal = 0;
+
+    return ((u64)(texpal & 0x1FFF) << 32) | texparam;
+}
+
+const u32* SoftTexCache::Find(u32 texparam, u32 texpal) const noexcept
+{
+    auto it = Entries.find(MakeKey(texparam, texpal));
+    if (it == Entries.end())
+        return nullptr;
+
+    return it->second.Texels.data();
+}
+
+const u32* SoftTexCache::Get(const GPU& gpu, u32 texparam, u32 texpal)
+{
+    u64 key = MakeKey(texparam, texpal);
+
+    auto it = Entries.find(key);
+    if (it != Entries.end())
+    {
+        it->second.LastUsed = Frame;
+        return it->second.Texels.data();
+    }
+
+    Entry& entry = Entries[key];
+    Decode(gpu, texparam, texpal, entry);
+    entry.LastUsed = Frame;
+    NumTexels += entry.Texels.size();
+
+    return entry.Texels.data();
+}
+
+void SoftTexCache::Decode(const GPU& gpu, u32 texparam, u32 texpal, Entry& entry) noexcept
+{
+    const u8* vram = gpu.VRAMFlat_Texture;
+    const u8* palvram = gpu.VRAMFlat_TexPal;
+    auto readPal = [=](u32 addr) { return *(const u16*)&palvram[addr & 0x1FFFF]; };
+
+    u32 vramaddr = (texparam & 0xFFFF) << 3;
+    u32 width = 8 << ((texparam >> 20) & 0x7);
+    u32 height = 8 << ((texparam >> 23) & 0x7);
+    u32 numtexels = width * height;
+
+    u8 alpha0;
+    if (texparam & (1<<29)) alpha0 = 0;
+    else                    alpha0 = 31;
+
+    entry.Texels.resize(numtexels);
+    u32* out = entry.Texels.data();
+
+    switch ((texparam >> 26) & 0x7)
+    {
+    case 1: // A3I5
+        {
+            texpal <<= 4;
+            MarkRange(entry.TextureMask, vramaddr, numtexels);
+            MarkRange(entry.TexPalMask, texpal, 32*2);
+
+            for (u32 i = 0; i < numtexels; i++)
+            {
+                u8 pixel = vram[(vramaddr + i) & 0x7FFFF];
+                u16 color = readPal(texpal + ((pixel&0x1F)<<1));
+                out[i] = MakeTexel(color, ((pixel >> 3) & 0x1C) + (pixel >> 6));
+            }
+        }
+        break;
+
+    case 2: // 4-color
+        {
+            texpal <<= 3;
+            MarkRange(entry.TextureMask, vramaddr, numtexels >> 2);
+            MarkRange(entry.TexPalMask, texpal, 4*2);
+
+            u32 pal[4];
+            for (u32 i = 0; i < 4; i++)
+                pal[i] = MakeTexel(readPal(texpal + (i<<1)), i ? 31 : alpha0);
+
+            for (u32 i = 0; i < numtexels; i++)
+            {
+                u8 pixel = vram[(vramaddr + (i >> 2)) & 0x7FFFF];
+                out[i] = pal[(pixel >> ((i & 0x3) << 1)) & 0x3];
+            }
+        }
+        break;
+
+    case 3: // 16-color
+        {
+            texpal <<= 4;
+            MarkRange(entry.TextureMask, vramaddr, numtexels >> 1);
+            MarkRange(entry.TexPalMask, texpal, 16*2);
+
+            u32 pal[16];
+            for (u32 i = 0; i < 16; i++)
+                pal[i] = MakeTexel(readPal(texpal + (i<<1)), i ? 31 : alpha0);
+
+            for (u32 i = 0; i < numtexels; i++)
+            {
+                u8 pixel = vram[(vramaddr + (i >> 1)) & 0x7FFFF];
+                out[i] = pal[(pixel >> ((i & 0x1) << 2)) & 0xF];
+            }
+        }
+        break;
+
+    case 4: // 256-color
+        {
+            texpal <<= 4;
+            MarkRange(entry.TextureMask, vramaddr, numtexels);
+            MarkRange(entry.TexPalMask, texpal, 256*2);
+
+            u32 pal[256];
+            for (u32 i = 0; i < 256; i++)
+                pal[i] = MakeTexel(readPal(texpal + (i<<1)), i ? 31 : alpha0);
+
+            for (u32 i = 0; i < numtexels; i++)
+                out[i] = pal[vram[(vramaddr + i) & 0x7FFFF]];
+        }
+        break;
+
+    case 5: // compressed
+        {
+            texpal <<= 4;
+            MarkRange(entry.TextureMask, vramaddr, numtexels >> 2);
+
+            // every 4x4 block is 4 bytes, and picks its palette in slot 1
+            for (u32 by = 0; by < height; by += 4)
+            {
+                for (u32 bx = 0; bx < width; bx += 4)
+                {
+                    u32 blockaddr = vramaddr + (by * width >> 2) + bx;
+
+                    u32 slot1addr = 0x20000 + ((blockaddr & 0x1FFFC) >> 1);
+                    if (blockaddr >= 0x40000)
+                        slot1addr += 0x10000;
+
+                    u16 palinfo = *(const u16*)&vram[slot1addr & 0x7FFFF];
+                    u32 paladdr = texpal + ((palinfo & 0x3FFF) << 2);
+                    u32 palmode = palinfo >> 14;
+                    MarkRange(entry.TextureMask, slot1addr, 2);
+                    MarkRange(entry.TexPalMask, paladdr, 4*2);
+
+                    u16 color0 = readPal(paladdr);
+                    u16 color1 = readPal(paladdr + 2);
+
+                    u32 r0 = color0 & 0x001F;
+                    u32 g0 = color0 & 0x03E0;
+                    u32 b0 = color0 & 0x7C00;
+                    u32 r1 = color1 & 0x001F;
+                    u32 g1 = color1 & 0x03E0;
+                    u32 b1 = color1 & 0x7C00;
+
+                    u32 pal[4];
+                    pal[0] = MakeTexel(color0, 31);
+                    pal[1] = MakeTexel(color1, 31);
+
+                    if (palmode == 1)
+                    {
+                        u32 r = (r0 + r1) >> 1;
+                        u32 g = ((g0 + g1) >> 1) & 0x03E0;
+                        u32 b = ((b0 + b1) >> 1) & 0x7C00;
+                        pal[2] = MakeTexel(r | g | b, 31);
+                    }
+                    else if (palmode == 3)
+                    {
+                        u32 r = (r0*5 + r1*3) >> 3;
+                        u32 g = ((g0*5 + g1*3) >> 3) & 0x03E0;
+                        u32 b = ((b0*5 + b1*3) >> 3) & 0x7C00;
+                        pal[2] = MakeTexel(r | g | b, 31);
+                    }
+                    else
+                        pal[2] = MakeTexel(readPal(paladdr + 4), 31);
+
+                    if (palmode == 2)
+                        pal[3] = MakeTexel(readPal(paladdr + 6), 31);
+                    else if (palmode == 3)
+                    {
+                        u32 r = (r0*3 + r1*5) >> 3;
+                        u32 g = ((g0*3 + g1*5) >> 3) & 0x03E0;
+                        u32 b = ((b0*3 + b1*5) >> 3) & 0x7C00;
+                        pal[3] = MakeTexel(r | g | b, 31);
+                    }
+                    else
+                        pal[3] = 0;
+
+                    for (u32 y = 0; y < 4; y++)
+                    {
+                        u8 val = vram[(blockaddr + y) & 0x7FFFF];
+                        u32* row = &out[(by + y) * width + bx];
+
+                        for (u32 x = 0; x < 4; x++)
+                            row[x] = pal[(val >> (x << 1)) & 0x3];
+                    }
+                }
+            }
+        }
+        break;
+
+    case 6: // A5I3
+        {
+            texpal <<= 4;
+            MarkRange(entry.TextureMask, vramaddr, numtexels);
+            MarkRange(entry.TexPalMask, texpal, 8*2);
+
+            for (u32 i = 0; i < numtexels; i++)
+            {
+                u8 pixel = vram[(vramaddr + i) & 0x7FFFF];
+                u16 color = readPal(texpal + ((pixel&0x7)<<1));
+                out[i] = MakeTexel(color, pixel >> 3);
+            }
+        }
+        break;
+
+    case 7: // direct color
+        {
+            MarkRange(entry.TextureMask, vramaddr, numtexels << 1);
+
+            for (u32 i = 0; i < numtexels; i++)
+            {
+                u16 color = *(const u16*)&vram[(vramaddr + (i << 1)) & 0x7FFFF];
+                out[i] = MakeTexel(color, (color & 0x8000) ? 31 : 0);
+            }
+        }
+        break;
+    }
+}
+
+}
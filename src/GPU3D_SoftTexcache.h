@@ -0,0 +1,85 @@
+/*
+    Copyright 2016-2023 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef GPU3D_SOFTTEXCACHE_H
+#define GPU3D_SOFTTEXCACHE_H
+
+#include <unordered_map>
+#include <vector>
+
+#include "types.h"
+#include "GPU.h"
+#include "NonStupidBitfield.h"
+
+namespace melonDS
+{
+
+// Textures decoded for the software renderer.
+//
+// Every texel is stored as the renderer wants it, that is the texture
+// colour expanded to 6 bits per component in bits 0-23 and the 5-bit
+// alpha in bits 24-28, so that sampling a texture is one load no matter
+// its format. Wrapping and clamping are left to the renderer.
+//
+// Each texture remembers which parts of texture and palette VRAM it was
+// decoded from, and is dropped once any of them is written to.
+class SoftTexCache
+{
+public:
+    using TextureDirty = NonStupidBitField<512*1024/VRAMDirtyGranularity>;
+    using TexPalDirty = NonStupidBitField<128*1024/VRAMDirtyGranularity>;
+
+    void Reset() noexcept;
+
+    /// Drops the textures decoded from VRAM that has changed.
+    void Invalidate(const TextureDirty& textureDirty, const TexPalDirty& texPalDirty) noexcept;
+
+    /// Starts a new frame. If the cache has grown too large, this frees
+    /// the textures that weren't used during the previous one.
+    /// Must not be called while pointers returned by Find() are in use.
+    void Trim() noexcept;
+
+    /// Decodes a texture from the flat VRAM copies, unless it is cached already.
+    /// @return The decoded texels, row after row.
+    const u32* Get(const GPU& gpu, u32 texparam, u32 texpal);
+
+    /// Looks up a texture without decoding it. Several threads may do this
+    /// at once, as long as none of them calls Get() at the same time.
+    /// @return The decoded texels, or nullptr if the texture isn't cached.
+    [[nodiscard]] const u32* Find(u32 texparam, u32 texpal) const noexcept;
+
+private:
+    struct Entry
+    {
+        std::vector<u32> Texels;
+        TextureDirty TextureMask;
+        TexPalDirty TexPalMask;
+        u32 LastUsed;
+    };
+
+    static u64 MakeKey(u32 texparam, u32 texpal) noexcept;
+    static void Decode(const GPU& gpu, u32 texparam, u32 texpal, Entry& entry) noexcept;
+
+    std::unordered_map<u64, Entry> Entries;
+    u32 NumTexels = 0;
+    u32 Frame = 0;
+};
+
+}
+
+#endif // GPU3D_SOFTTEXCACHE_H
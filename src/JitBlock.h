@@ -26,12 +26,24 @@ namespace melonDS
 {
 typedef void (*JitBlockEntry)();
 
+// an exit of a block whose target is known when it's compiled,
+// so that it can jump into the following block directly
+struct BlockExit
+{
+    // the address the block continues at
+    u32 Target;
+    // where the jumps which are patched to link the block are,
+    // relative to the start of the code memory
+    u32 ExitJumpOffset, LinkJumpOffset;
+};
+
 class JitBlock
 {
 public:
     JitBlock(u32 num, u32 literalHash, u32 numAddresses, u32 numLiterals)
     {
         Num = num;
+        Trace = false;
         NumAddresses = numAddresses;
         NumLiterals = numLiterals;
         Data.SetLength(numAddresses * 2 + numLiterals);
@@ -41,11 +53,15 @@ public:
     u32 StartAddrLocal;
     u32 InstrHash, LiteralHash;
     u8 Num;
+    // compiled as a hot trace, otherwise it counts how often it's entered
+    bool Trace;
     u16 NumAddresses;
     u16 NumLiterals;
 
     JitBlockEntry EntryPoint;
 
+    TinyVector<BlockExit> Exits;
+
     const u32* AddressRanges() const { return &Data[0]; }
     u32* AddressRanges() { return &Data[0]; }
     const u32* AddressMasks() const { return &Data[NumAddresses]; }
@@ -73,7 +73,16 @@ const s32 kIterationCycleMargin = 8;
 //
 // timings for GBA slot and wifi are set up at runtime
 
-NDS* NDS::Current = nullptr;
+// builds without the JIT recompiler only have its cached interpreter,
+// any other JIT settings leave the console to the interpreter there
+static bool UsesJIT(const std::optional<JITArgs>& args) noexcept
+{
+#ifdef JIT_ENABLED
+    return args.has_value();
+#else
+    return args.has_value() && args->CachedInterpreter;
+#endif
+}
 
 NDS::NDS() noexcept :
     NDS(
@@ -103,10 +112,10 @@ NDS::NDS(NDSArgs&& args, int type) noexcept :
     NDSCartSlot(*this, std::move(args.NDSROM)),
     GBACartSlot(type == 1 ? nullptr : std::move(args.GBAROM)),
     AREngine(*this),
-    ARM9(*this, args.GDB, args.JIT.has_value()),
-    ARM7(*this, args.GDB, args.JIT.has_value()),
-#ifdef JIT_ENABLED
-    EnableJIT(args.JIT.has_value()),
+    ARM9(*this, args.GDB, UsesJIT(args.JIT)),
+    ARM7(*this, args.GDB, UsesJIT(args.JIT)),
+#ifdef CACHED_INTERPRETER_ENABLED
+    EnableJIT(UsesJIT(args.JIT)),
 #endif
     DMAs {
         DMA(0, 0, *this),
@@ -179,6 +188,8 @@ void NDS::SetARM9RegionTimings(u32 addrstart, u32 addrend, u32 region, int buswi
 
 void NDS::SetARM7RegionTimings(u32 addrstart, u32 addrend, u32 region, int buswidth, int nonseq, int seq)
 {
+    JIT.MemoryStateChanging();
+
     addrstart >>= 3;
     addrend   >>= 3;
 
@@ -208,19 +219,20 @@ void NDS::SetARM7RegionTimings(u32 addrstart, u32 addrend, u32 region, int buswi
     }
 }
 
-#ifdef JIT_ENABLED
+#ifdef CACHED_INTERPRETER_ENABLED
 void NDS::SetJITArgs(std::optional<JITArgs> args) noexcept
 {
-    if (args)
+    bool enable = UsesJIT(args);
+    if (enable)
     { // If we want to turn the JIT on...
         JIT.SetJITArgs(*args);
     }
-    else if (args.has_value() != EnableJIT)
+    else if (EnableJIT)
     { // Else if we want to turn the JIT off, and it wasn't already off...
         JIT.ResetBlockCache();
     }
 
-    EnableJIT = args.has_value();
+    EnableJIT = enable;
 }
 #endif
 
@@ -516,6 +528,7 @@ void NDS::Reset()
         evt.Param = 0;
     }
     SchedListMask = 0;
+    SchedQueue.Clear();
 
     KeyInput = 0x007F03FF;
     KeyCnt[0] = 0;
@@ -529,6 +542,8 @@ void NDS::Reset()
     SPI.Reset();
     RTC.Reset();
     Wifi.Reset();
+
+    UpdateMemPages(0, MemPages::End);
 }
 
 void NDS::Start()
@@ -580,6 +595,9 @@ void NDS::Stop(Platform::StopReason reason)
 
 bool NDS::DoSavestate(Savestate* file)
 {
+    if (!file->Saving)
+        JIT.MemoryStateChanging();
+
     file->Section("NDSG");
 
     if (file->Saving)
@@ -598,9 +616,15 @@ bool NDS::DoSavestate(Savestate* file)
         }
     }
 
-    file->VarArray(MainRAM, MainRAMMaxSize);
-    file->VarArray(SharedWRAM, SharedWRAMSize);
-    file->VarArray(ARM7WRAM, ARM7WRAMSize);
+    // what's past the RAM actually mapped can't change, so delta savestates
+    // don't have to go through it. Only the DS's never changes size though,
+    // the DSi's is only known once SCFG is loaded, after this
+    u32 mainramlen = MainRAMMaxSize;
+    if (file->Delta && ConsoleType == 0)
+        mainramlen = MainRAMMask+1;
+    file->VarPages(MainRAM, mainramlen);
+    file->VarPages(SharedWRAM, SharedWRAMSize);
+    file->VarPages(ARM7WRAM, ARM7WRAMSize);
 
     //file->VarArray(ARM9BIOS, 0x1000);
     //file->VarArray(ARM7BIOS, 0x4000);
@@ -659,6 +683,15 @@ bool NDS::DoSavestate(Savestate* file)
         file->Var32(&evt.Param);
     }
     file->Var32(&SchedListMask);
+    if (!file->Saving)
+    {
+        SchedQueue.Clear();
+        for (int i = 0; i < Event_MAX; i++)
+        {
+            if (SchedListMask & (1<<i))
+                SchedQueue.Push(i, SchedList[i].Timestamp);
+        }
+    }
     file->Var64(&ARM9Timestamp);
     file->Var64(&ARM9Target);
     file->Var64(&ARM7Timestamp);
@@ -714,7 +747,9 @@ bool NDS::DoSavestate(Savestate* file)
         SPU.SetPowerCnt(PowerControl7 & 0x0001);
         Wifi.SetPowerCnt(PowerControl7 & 0x0002);
 
-#ifdef JIT_ENABLED
+        UpdateMemPages(0, MemPages::End);
+
+#ifdef CACHED_INTERPRETER_ENABLED
         JIT.Reset();
 #endif
     }
@@ -771,20 +806,7 @@ void NDS::SetARM9BIOS(const std::array<u8, ARM9BIOSSize>& bios) noexcept
 
 u64 NDS::NextTarget()
 {
-    u64 minEvent = UINT64_MAX;
-
-    u32 mask = SchedListMask;
-    for (int i = 0; i < Event_MAX; i++)
-    {
-        if (!mask) break;
-        if (mask & 0x1)
-        {
-            if (SchedList[i].Timestamp < minEvent)
-                minEvent = SchedList[i].Timestamp;
-        }
-
-        mask >>= 1;
-    }
+    u64 minEvent = SchedQueue.NextTimestamp();
 
     u64 max = SysTimestamp + kMaxIterationCycles;
 
@@ -798,24 +820,25 @@ void NDS::RunSystem(u64 timestamp)
 {
     SysTimestamp = timestamp;
 
-    u32 mask = SchedListMask;
-    for (int i = 0; i < Event_MAX; i++)
+    // events are run in ID order, like they always have been
+    u32 mask = SchedQueue.PopDue(SysTimestamp);
+    while (mask)
     {
-        if (!mask) break;
-        if (mask & 0x1)
-        {
-            SchedEvent& evt = SchedList[i];
+        int i = __builtin_ctz(mask);
+        mask &= mask - 1;
 
-            if (evt.Timestamp <= SysTimestamp)
-            {
-                SchedListMask &= ~(1<<i);
+        SchedEvent& evt = SchedList[i];
 
-                EventFunc func = evt.Funcs[evt.FuncID];
-                func(evt.Param);
-            }
-        }
+        // one of the events run before might have rescheduled this one
+        if (evt.Timestamp <= SysTimestamp)
+        {
+            SchedListMask &= ~(1<<i);
+            SchedQueue.Remove(i);
 
-        mask >>= 1;
+            EventFunc func = evt.Funcs[evt.FuncID];
+            func(evt.Param);
+            PROFILE_COUNT(Profiler, SchedulerEvents, 1);
+        }
     }
 }
 
@@ -860,6 +883,7 @@ void NDS::RunSystemSleep(u64 timestamp)
                 if (evt.Timestamp <= SysTimestamp)
                 {
                     SchedListMask &= ~(1<<i);
+                    SchedQueue.Remove(i);
 
                     u32 param;
                     if (i == Event_SPU)
@@ -869,6 +893,7 @@ void NDS::RunSystemSleep(u64 timestamp)
 
                     EventFunc func = evt.Funcs[evt.FuncID];
                     func(param);
+                    PROFILE_COUNT(Profiler, SchedulerEvents, 1);
                 }
             }
         }
@@ -877,6 +902,9 @@ void NDS::RunSystemSleep(u64 timestamp)
             if (SchedList[i].Timestamp <= SysTimestamp)
             {
                 SchedList[i].Timestamp += offset;
+
+                SchedQueue.Remove(i);
+                SchedQueue.Push(i, SchedList[i].Timestamp);
             }
         }
 
@@ -961,7 +989,8 @@ u32 NDS::RunFrame()
                 }
                 else
                 {
-#ifdef JIT_ENABLED
+                    PROFILE_SCOPE(Profiler, ProfileZone_ARM9);
+#ifdef CACHED_INTERPRETER_ENABLED
                     if (EnableJIT)
                         ARM9.ExecuteJIT();
                     else
@@ -970,7 +999,10 @@ u32 NDS::RunFrame()
                 }
 
                 RunTimers(0);
-                GPU.GPU3D.Run();
+                {
+                    PROFILE_SCOPE(Profiler, ProfileZone_GPU3D);
+                    GPU.GPU3D.Run();
+                }
 
                 target = ARM9Timestamp >> ARM9ClockShift;
                 CurCPU = 1;
@@ -993,7 +1025,8 @@ u32 NDS::RunFrame()
                     }
                     else
                     {
-#ifdef JIT_ENABLED
+                        PROFILE_SCOPE(Profiler, ProfileZone_ARM7);
+#ifdef CACHED_INTERPRETER_ENABLED
                         if (EnableJIT)
                             ARM7.ExecuteJIT();
                         else
@@ -1004,10 +1037,15 @@ u32 NDS::RunFrame()
                     RunTimers(1);
                 }
 
-                RunSystem(target);
+                {
+                    PROFILE_SCOPE(Profiler, ProfileZone_RunSystem);
+                    RunSystem(target);
+                }
 
                 if (CPUStop & CPUStop_Sleep)
                 {
+                    // whatever is mixed from now on is silence
+                    SPU.CatchUp(SysTimestamp);
                     break;
                 }
             }
@@ -1023,6 +1061,7 @@ u32 NDS::RunFrame()
             ARM7Timestamp-SysTimestamp,
             GPU.GPU3D.Timestamp-SysTimestamp);
 #endif
+        SPU.CatchUp(SysTimestamp);
         SPU.TransferOutput();
         break;
     }
@@ -1033,6 +1072,10 @@ u32 NDS::RunFrame()
     if (LagFrameFlag)
         NumLagFrames++;
 
+#ifdef PROFILING_ENABLED
+    Profiler.EndFrame();
+#endif
+
     if (Running)
         return GPU.TotalScanlines;
     else
@@ -1041,7 +1084,7 @@ u32 NDS::RunFrame()
 
 u32 NDS::RunFrame()
 {
-#ifdef JIT_ENABLED
+#ifdef CACHED_INTERPRETER_ENABLED
     if (EnableJIT)
         return RunFrame<true>();
     else
@@ -1101,6 +1144,7 @@ void NDS::ScheduleEvent(u32 id, bool periodic, s32 delay, u32 funcid, u32 param)
     evt.Param = param;
 
     SchedListMask |= (1<<id);
+    SchedQueue.Push(id, evt.Timestamp);
 
     Reschedule(evt.Timestamp);
 }
@@ -1108,6 +1152,7 @@ void NDS::ScheduleEvent(u32 id, bool periodic, s32 delay, u32 funcid, u32 param)
 void NDS::CancelEvent(u32 id)
 {
     SchedListMask &= ~(1<<id);
+    SchedQueue.Remove(id);
 }
 
 
@@ -1241,6 +1286,96 @@ void NDS::MapSharedWRAM(u8 val)
         SWRAM_ARM7.Mask = 0x7FFF;
         break;
     }
+
+    UpdateMemPages(0x03000000, 0x04000000);
+}
+
+void NDS::UpdateMemPages(u32 start, u32 end)
+{
+    for (u32 addr = start; addr < end; addr += MemPages::Size)
+    {
+        u32 page = addr >> MemPages::Shift;
+        u8* mem9 = nullptr;
+        u8* mem7 = nullptr;
+        bool write9 = true;
+
+        // the DSi's memory map isn't covered, it always takes the slow path
+        if (ConsoleType == 0)
+        {
+            switch (addr & 0xFF000000)
+            {
+            case 0x02000000:
+                mem9 = &MainRAM[addr & MainRAMMask];
+                ARM9Pages.WriteRegion[page] = ARMJIT_Memory::memregion_MainRAM;
+                break;
+
+            case 0x03000000:
+                if (SWRAM_ARM9.Mem)
+                    mem9 = &SWRAM_ARM9.Mem[addr & SWRAM_ARM9.Mask];
+                ARM9Pages.WriteRegion[page] = ARMJIT_Memory::memregion_SharedWRAM;
+                break;
+
+            case 0x06000000:
+                // VRAM is only read directly, writes have to mark it as dirty
+                write9 = false;
+                switch (addr & 0x00E00000)
+                {
+                case 0x00000000: mem9 = GPU.VRAMPtr_ABG[(addr >> 14) & 0x1F]; break;
+                case 0x00200000: mem9 = GPU.VRAMPtr_BBG[(addr >> 14) & 0x7]; break;
+                case 0x00400000: mem9 = GPU.VRAMPtr_AOBJ[(addr >> 14) & 0xF]; break;
+                case 0x00600000: mem9 = GPU.VRAMPtr_BOBJ[(addr >> 14) & 0x7]; break;
+                default:
+                    {
+                        // LCDC, the banks follow each other and are mirrored every 1 MB
+                        static constexpr u8 lcdcbanks[] =
+                        {
+                            0, 0, 0, 0, 0, 0, 0, 0,
+                            1, 1, 1, 1, 1, 1, 1, 1,
+                            2, 2, 2, 2, 2, 2, 2, 2,
+                            3, 3, 3, 3, 3, 3, 3, 3,
+                            4, 4, 4, 4, 5, 6, 7, 7,
+                            8,
+                        };
+                        u32 slot = (addr >> 14) & 0x3F;
+                        if (slot < sizeof(lcdcbanks) && (GPU.VRAMMap_LCDC & (1 << lcdcbanks[slot])))
+                        {
+                            u32 bank = lcdcbanks[slot];
+                            mem9 = &GPU.VRAM[bank][addr & GPU.VRAMMask[bank]];
+                        }
+                    }
+                    break;
+                }
+                break;
+            }
+
+            switch (addr & 0xFF800000)
+            {
+            case 0x02000000:
+            case 0x02800000:
+                mem7 = &MainRAM[addr & MainRAMMask];
+                ARM7Pages.WriteRegion[page] = ARMJIT_Memory::memregion_MainRAM;
+                break;
+
+            case 0x03000000:
+                if (SWRAM_ARM7.Mem)
+                {
+                    mem7 = &SWRAM_ARM7.Mem[addr & SWRAM_ARM7.Mask];
+                    ARM7Pages.WriteRegion[page] = ARMJIT_Memory::memregion_SharedWRAM;
+                    break;
+                }
+                [[fallthrough]];
+            case 0x03800000:
+                mem7 = &ARM7WRAM[addr & (ARM7WRAMSize - 1)];
+                ARM7Pages.WriteRegion[page] = ARMJIT_Memory::memregion_WRAM7;
+                break;
+            }
+        }
+
+        ARM9Pages.Read[page] = mem9;
+        ARM9Pages.Write[page] = write9 ? mem9 : nullptr;
+        ARM7Pages.Read[page] = mem7;
+        ARM7Pages.Write[page] = mem7;
+    }
 }
 
 
@@ -1885,6 +2020,8 @@ void NDS::debug(u32 param)
 
 u8 NDS::ARM9Read8(u32 addr)
 {
+    PROFILE_COUNT(Profiler, SlowMemAccesses9, 1);
+
     if ((addr & 0xFFFFF000) == 0xFFFF0000)
     {
         return *(u8*)&ARM9BIOS[addr & 0xFFF];
@@ -1944,6 +2081,8 @@ u8 NDS::ARM9Read8(u32 addr)
 
 u16 NDS::ARM9Read16(u32 addr)
 {
+    PROFILE_COUNT(Profiler, SlowMemAccesses9, 1);
+
     addr &= ~0x1;
 
     if ((addr & 0xFFFFF000) == 0xFFFF0000)
@@ -2004,6 +2143,8 @@ u16 NDS::ARM9Read16(u32 addr)
 
 u32 NDS::ARM9Read32(u32 addr)
 {
+    PROFILE_COUNT(Profiler, SlowMemAccesses9, 1);
+
     addr &= ~0x3;
 
     if ((addr & 0xFFFFF000) == 0xFFFF0000)
@@ -2067,6 +2208,8 @@ u32 NDS::ARM9Read32(u32 addr)
 
 void NDS::ARM9Write8(u32 addr, u8 val)
 {
+    PROFILE_COUNT(Profiler, SlowMemAccesses9, 1);
+
     switch (addr & 0xFF000000)
     {
     case 0x02000000:
@@ -2106,6 +2249,8 @@ void NDS::ARM9Write8(u32 addr, u8 val)
 
 void NDS::ARM9Write16(u32 addr, u16 val)
 {
+    PROFILE_COUNT(Profiler, SlowMemAccesses9, 1);
+
     addr &= ~0x1;
 
     switch (addr & 0xFF000000)
@@ -2166,6 +2311,8 @@ void NDS::ARM9Write16(u32 addr, u16 val)
 
 void NDS::ARM9Write32(u32 addr, u32 val)
 {
+    PROFILE_COUNT(Profiler, SlowMemAccesses9, 1);
+
     addr &= ~0x3;
 
     switch (addr & 0xFF000000)
@@ -2261,6 +2408,8 @@ bool NDS::ARM9GetMemRegion(u32 addr, bool write, MemRegion* region)
 
 u8 NDS::ARM7Read8(u32 addr)
 {
+    PROFILE_COUNT(Profiler, SlowMemAccesses7, 1);
+
     if (addr < 0x00004000)
     {
         // TODO: check the boundary? is it 4000 or higher on regular DS?
@@ -2327,6 +2476,8 @@ u8 NDS::ARM7Read8(u32 addr)
 
 u16 NDS::ARM7Read16(u32 addr)
 {
+    PROFILE_COUNT(Profiler, SlowMemAccesses7, 1);
+
     addr &= ~0x1;
 
     if (addr < 0x00004000)
@@ -2393,6 +2544,8 @@ u16 NDS::ARM7Read16(u32 addr)
 
 u32 NDS::ARM7Read32(u32 addr)
 {
+    PROFILE_COUNT(Profiler, SlowMemAccesses7, 1);
+
     addr &= ~0x3;
 
     if (addr < 0x00004000)
@@ -2462,6 +2615,8 @@ u32 NDS::ARM7Read32(u32 addr)
 
 void NDS::ARM7Write8(u32 addr, u8 val)
 {
+    PROFILE_COUNT(Profiler, SlowMemAccesses7, 1);
+
     switch (addr & 0xFF800000)
     {
     case 0x02000000:
@@ -2519,6 +2674,8 @@ void NDS::ARM7Write8(u32 addr, u8 val)
 
 void NDS::ARM7Write16(u32 addr, u16 val)
 {
+    PROFILE_COUNT(Profiler, SlowMemAccesses7, 1);
+
     addr &= ~0x1;
 
     switch (addr & 0xFF800000)
@@ -2589,6 +2746,8 @@ void NDS::ARM7Write16(u32 addr, u16 val)
 
 void NDS::ARM7Write32(u32 addr, u32 val)
 {
+    PROFILE_COUNT(Profiler, SlowMemAccesses7, 1);
+
     addr &= ~0x3;
 
     switch (addr & 0xFF800000)
@@ -3210,16 +3369,16 @@ void NDS::ARM9IOWrite8(u32 addr, u8 val)
 
     case 0x04000208: IME[0] = val & 0x1; UpdateIRQ(0); return;
 
-    case 0x04000240: GPU.MapVRAM_AB(0, val); return;
-    case 0x04000241: GPU.MapVRAM_AB(1, val); return;
-    case 0x04000242: GPU.MapVRAM_CD(2, val); return;
-    case 0x04000243: GPU.MapVRAM_CD(3, val); return;
-    case 0x04000244: GPU.MapVRAM_E(4, val); return;
-    case 0x04000245: GPU.MapVRAM_FG(5, val); return;
-    case 0x04000246: GPU.MapVRAM_FG(6, val); return;
+    case 0x04000240: GPU.MapVRAM_AB(0, val); UpdateMemPages(0x06000000, 0x06800000); return;
+    case 0x04000241: GPU.MapVRAM_AB(1, val); UpdateMemPages(0x06000000, 0x06800000); return;
+    case 0x04000242: GPU.MapVRAM_CD(2, val); UpdateMemPages(0x06000000, 0x06800000); return;
+    case 0x04000243: GPU.MapVRAM_CD(3, val); UpdateMemPages(0x06000000, 0x06800000); return;
+    case 0x04000244: GPU.MapVRAM_E(4, val); UpdateMemPages(0x06000000, 0x06800000); return;
+    case 0x04000245: GPU.MapVRAM_FG(5, val); UpdateMemPages(0x06000000, 0x06800000); return;
+    case 0x04000246: GPU.MapVRAM_FG(6, val); UpdateMemPages(0x06000000, 0x06800000); return;
     case 0x04000247: MapSharedWRAM(val); return;
-    case 0x04000248: GPU.MapVRAM_H(7, val); return;
-    case 0x04000249: GPU.MapVRAM_I(8, val); return;
+    case 0x04000248: GPU.MapVRAM_H(7, val); UpdateMemPages(0x06000000, 0x06800000); return;
+    case 0x04000249: GPU.MapVRAM_I(8, val); UpdateMemPages(0x06000000, 0x06800000); return;
 
     case 0x04000300:
         if (PostFlag9 & 0x01) val |= 0x01;
@@ -3372,6 +3531,8 @@ void NDS::ARM9IOWrite16(u32 addr, u16 val)
     case 0x04000204:
         {
             u16 oldVal = ExMemCnt[0];
+            if (val != oldVal)
+                JIT.MemoryStateChanging();
             ExMemCnt[0] = val;
             ExMemCnt[1] = (ExMemCnt[1] & 0x007F) | (val & 0xFF80);
             if ((oldVal ^ ExMemCnt[0]) & 0xFF)
@@ -3387,22 +3548,27 @@ void NDS::ARM9IOWrite16(u32 addr, u16 val)
     case 0x04000240:
         GPU.MapVRAM_AB(0, val & 0xFF);
         GPU.MapVRAM_AB(1, val >> 8);
+        UpdateMemPages(0x06000000, 0x06800000);
         return;
     case 0x04000242:
         GPU.MapVRAM_CD(2, val & 0xFF);
         GPU.MapVRAM_CD(3, val >> 8);
+        UpdateMemPages(0x06000000, 0x06800000);
         return;
     case 0x04000244:
         GPU.MapVRAM_E(4, val & 0xFF);
         GPU.MapVRAM_FG(5, val >> 8);
+        UpdateMemPages(0x06000000, 0x06800000);
         return;
     case 0x04000246:
         GPU.MapVRAM_FG(6, val & 0xFF);
         MapSharedWRAM(val >> 8);
+        UpdateMemPages(0x06000000, 0x06800000);
         return;
     case 0x04000248:
         GPU.MapVRAM_H(7, val & 0xFF);
         GPU.MapVRAM_I(8, val >> 8);
+        UpdateMemPages(0x06000000, 0x06800000);
         return;
 
     case 0x04000280: DivCnt = val; StartDiv(); return;
@@ -3556,16 +3722,19 @@ void NDS::ARM9IOWrite32(u32 addr, u32 val)
         GPU.MapVRAM_AB(1, (val >> 8) & 0xFF);
         GPU.MapVRAM_CD(2, (val >> 16) & 0xFF);
         GPU.MapVRAM_CD(3, val >> 24);
+        UpdateMemPages(0x06000000, 0x06800000);
         return;
     case 0x04000244:
         GPU.MapVRAM_E(4, val & 0xFF);
         GPU.MapVRAM_FG(5, (val >> 8) & 0xFF);
         GPU.MapVRAM_FG(6, (val >> 16) & 0xFF);
         MapSharedWRAM(val >> 24);
+        UpdateMemPages(0x06000000, 0x06800000);
         return;
     case 0x04000248:
         GPU.MapVRAM_H(7, val & 0xFF);
         GPU.MapVRAM_I(8, (val >> 8) & 0xFF);
+        UpdateMemPages(0x06000000, 0x06800000);
         return;
 
     case 0x04000280: DivCnt = val; StartDiv(); return;
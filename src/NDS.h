@@ -41,7 +41,9 @@
 #include "ARM.h"
 #include "CRC32.h"
 #include "DMA.h"
+#include "EventQueue.h"
 #include "FreeBIOS.h"
+#include "Profiler.h"
 
 // when touching the main loop/timing code, pls test a lot of shit
 // with this enabled, to make sure it doesn't desync
@@ -179,6 +181,22 @@ struct Timer
     u32 CycleShift;
 };
 
+// host memory behind each 16 KB page of a CPU's address space below 0x10000000,
+// so that accesses to plain memory don't have to go through ARM9Read8 etc.
+// pages which are null need the slow path (I/O, BIOS, unmapped memory, ...)
+struct MemPages
+{
+    static constexpr u32 Shift = 14;
+    static constexpr u32 Size = 1 << Shift;
+    static constexpr u32 End = 0x10000000;
+    static constexpr u32 Count = End >> Shift;
+
+    u8* Read[Count];
+    u8* Write[Count];
+    // the JIT memory region code written to a page has to be invalidated in
+    u8 WriteRegion[Count];
+};
+
 enum
 {
     Mem9_ITCM       = 0x00000001,
@@ -224,7 +242,7 @@ class ARMJIT;
 class NDS
 {
 private:
-#ifdef JIT_ENABLED
+#ifdef CACHED_INTERPRETER_ENABLED
     bool EnableJIT;
 #endif
 
@@ -283,6 +301,9 @@ public: // TODO: Encapsulate the rest of these members
     MemRegion SWRAM_ARM9;
     MemRegion SWRAM_ARM7;
 
+    MemPages ARM9Pages {};
+    MemPages ARM7Pages {};
+
     u32 KeyInput;
     u16 RCnt;
 
@@ -302,6 +323,9 @@ public: // TODO: Encapsulate the rest of these members
     melonDS::GPU GPU;
     melonDS::AREngine AREngine;
 
+    // only counts anything in builds with PROFILING_ENABLED
+    melonDS::Profiler Profiler;
+
     const u32 ARM7WRAMSize = 0x10000;
     u8* ARM7WRAM;
 
@@ -383,6 +407,10 @@ public: // TODO: Encapsulate the rest of these members
 
     u32 RunFrame();
 
+    /// @return What happened during the last frame that was run.
+    /// Only counted in builds with PROFILING_ENABLED, otherwise all zeroes.
+    const FrameStats& GetFrameStats() const noexcept { return Profiler.GetLastFrame(); }
+
     bool IsRunning() const noexcept { return Running; }
 
     void TouchScreen(u16 x, u16 y);
@@ -420,6 +448,8 @@ public: // TODO: Encapsulate the rest of these members
 
     u32 GetPC(u32 cpu) const;
     u64 GetSysClockCycles(int num);
+    // the time up to which events have been run
+    [[nodiscard]] u64 GetSysTimestamp() const noexcept { return SysTimestamp; }
     void NocashPrint(u32 cpu, u32 addr);
 
     void MonitorARM9Jump(u32 addr);
@@ -449,6 +479,79 @@ public: // TODO: Encapsulate the rest of these members
 
     virtual bool ARM7GetMemRegion(u32 addr, bool write, MemRegion* region);
 
+    /// Accesses memory like ARM9Read8/16/32 etc., but directly
+    /// if the page tables point to host memory for the address.
+    template <typename T>
+    T ARM9Read(u32 addr)
+    {
+        addr &= ~(sizeof(T) - 1);
+        if (addr < MemPages::End)
+        {
+            if (u8* mem = ARM9Pages.Read[addr >> MemPages::Shift])
+                return *(T*)&mem[addr & (MemPages::Size - 1)];
+        }
+
+        if constexpr (sizeof(T) == 4) return ARM9Read32(addr);
+        else if constexpr (sizeof(T) == 2) return ARM9Read16(addr);
+        else return ARM9Read8(addr);
+    }
+    template <typename T>
+    void ARM9Write(u32 addr, T val)
+    {
+        addr &= ~(sizeof(T) - 1);
+        if (addr < MemPages::End)
+        {
+            u32 page = addr >> MemPages::Shift;
+            if (u8* mem = ARM9Pages.Write[page])
+            {
+                JIT.CheckAndInvalidate(0, ARM9Pages.WriteRegion[page], addr);
+                *(T*)&mem[addr & (MemPages::Size - 1)] = val;
+                return;
+            }
+        }
+
+        if constexpr (sizeof(T) == 4) ARM9Write32(addr, val);
+        else if constexpr (sizeof(T) == 2) ARM9Write16(addr, val);
+        else ARM9Write8(addr, val);
+    }
+    template <typename T>
+    T ARM7Read(u32 addr)
+    {
+        addr &= ~(sizeof(T) - 1);
+        if (addr < MemPages::End)
+        {
+            if (u8* mem = ARM7Pages.Read[addr >> MemPages::Shift])
+                return *(T*)&mem[addr & (MemPages::Size - 1)];
+        }
+
+        if constexpr (sizeof(T) == 4) return ARM7Read32(addr);
+        else if constexpr (sizeof(T) == 2) return ARM7Read16(addr);
+        else return ARM7Read8(addr);
+    }
+    template <typename T>
+    void ARM7Write(u32 addr, T val)
+    {
+        addr &= ~(sizeof(T) - 1);
+        if (addr < MemPages::End)
+        {
+            u32 page = addr >> MemPages::Shift;
+            if (u8* mem = ARM7Pages.Write[page])
+            {
+                JIT.CheckAndInvalidate(1, ARM7Pages.WriteRegion[page], addr);
+                *(T*)&mem[addr & (MemPages::Size - 1)] = val;
+                return;
+            }
+        }
+
+        if constexpr (sizeof(T) == 4) ARM7Write32(addr, val);
+        else if constexpr (sizeof(T) == 2) ARM7Write16(addr, val);
+        else ARM7Write8(addr, val);
+    }
+
+    /// Rebuilds the page tables for [start, end), to be called
+    /// whenever the memory mapped there might have changed.
+    void UpdateMemPages(u32 start, u32 end);
+
     virtual u8 ARM9IORead8(u32 addr);
     virtual u16 ARM9IORead16(u32 addr);
     virtual u32 ARM9IORead32(u32 addr);
@@ -463,7 +566,7 @@ public: // TODO: Encapsulate the rest of these members
     virtual void ARM7IOWrite16(u32 addr, u16 val);
     virtual void ARM7IOWrite32(u32 addr, u32 val);
 
-#ifdef JIT_ENABLED
+#ifdef CACHED_INTERPRETER_ENABLED
     [[nodiscard]] bool IsJITEnabled() const noexcept { return EnableJIT; }
     void SetJITArgs(std::optional<JITArgs> args) noexcept;
 #else
@@ -474,6 +577,8 @@ public: // TODO: Encapsulate the rest of these members
 private:
     void InitTimings();
     u32 SchedListMask;
+    // same events as SchedListMask, ordered by when they're due
+    EventQueue<Event_MAX> SchedQueue;
     u64 SysTimestamp;
     u8 WRAMCnt;
     u8 PostFlag9;
@@ -529,8 +634,6 @@ public:
     NDS& operator=(const NDS&) = delete;
     NDS(NDS&&) = delete;
     NDS& operator=(NDS&&) = delete;
-    // The frontend should set and unset this manually after creating and destroying the NDS object.
-    [[deprecated("Temporary workaround until JIT code generation is revised to accommodate multiple NDS objects.")]] static NDS* Current;
 protected:
     explicit NDS(NDSArgs&& args, int type) noexcept;
     virtual void DoSavestateExtra(Savestate* file) {}
@@ -459,7 +459,7 @@ void CartRetail::DoSavestate(Savestate* file)
     }
     if (SRAMLength)
     {
-        file->VarArray(SRAM.get(), SRAMLength);
+        file->VarPages(SRAM.get(), SRAMLength);
     }
 
     // SPI status shito
@@ -183,7 +183,8 @@ struct NonStupidBitField
         }
         else
         {
-            Data[startEntry] |= ((1ULL << bitsCount) - 1) << (startBit & 0x3F);
+            u64 bits = (bitsCount == 64) ? 0xFFFFFFFFFFFFFFFF : ((1ULL << bitsCount) - 1);
+            Data[startEntry] |= bits << (startBit & 0x3F);
         }
     }
 
@@ -203,6 +204,26 @@ struct NonStupidBitField
         }
         return *this;
     }
+
+    bool Any() const
+    {
+        for (u32 i = 0; i < DataLength; i++)
+        {
+            if (Data[i])
+                return true;
+        }
+        return false;
+    }
+
+    bool Intersects(const NonStupidBitField<Size>& other) const
+    {
+        for (u32 i = 0; i < DataLength; i++)
+        {
+            if (Data[i] & other.Data[i])
+                return true;
+        }
+        return false;
+    }
 };
 
 }
@@ -0,0 +1,69 @@
+/*
+    Copyright 2016-2023 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <chrono>
+#include <thread>
+
+#include "Profiler.h"
+
+namespace melonDS
+{
+
+const char* Profiler::GetZoneName(ProfileZone zone) noexcept
+{
+    switch (zone)
+    {
+    case ProfileZone_ARM9: return "ARM9 execute";
+    case ProfileZone_ARM7: return "ARM7 execute";
+    case ProfileZone_GPU3D: return "GPU3D::Run";
+    case ProfileZone_Render2D: return "2D rendering";
+    case ProfileZone_Render3D: return "3D rendering";
+    case ProfileZone_SPUMix: return "SPU::Mix";
+    case ProfileZone_RunSystem: return "RunSystem";
+    default: return "?";
+    }
+}
+
+#if !defined(__x86_64__) && !defined(__i386__)
+u64 Profiler::Now() noexcept
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+#endif
+
+double Profiler::TicksPerSecond() noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+    static const double rate = []
+    {
+        auto start = std::chrono::steady_clock::now();
+        u64 startTicks = Now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        auto end = std::chrono::steady_clock::now();
+        u64 endTicks = Now();
+
+        return (endTicks - startTicks) / std::chrono::duration<double>(end - start).count();
+    }();
+    return rate;
+#else
+    return 1e9;
+#endif
+}
+
+}
@@ -0,0 +1,171 @@
+/*
+    Copyright 2016-2023 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "types.h"
+
+namespace melonDS
+{
+
+enum ProfileZone
+{
+    ProfileZone_ARM9,
+    ProfileZone_ARM7,
+    ProfileZone_GPU3D,
+    ProfileZone_Render2D,
+    ProfileZone_Render3D,
+    ProfileZone_SPUMix,
+    ProfileZone_RunSystem,
+
+    ProfileZone_MAX
+};
+
+/// Number of times some of the expensive things in the core happened
+/// during one frame.
+struct FrameStats
+{
+    u32 JITBlocksCompiled;
+    /// Includes the blocks dropped when the whole block cache is reset.
+    u32 JITBlocksInvalidated;
+    u32 FastmemFaults;
+    /// Accesses that went through NDS::ARM9Read8() and friends.
+    /// Accesses to memory only the DSi has are handled by DSi and not counted.
+    u32 SlowMemAccesses9;
+    u32 SlowMemAccesses7;
+    u32 DMAUnits;
+    u32 GXCommands;
+    u32 Polygons;
+    u32 Vertices;
+    u32 SchedulerEvents;
+};
+
+/// Time spent by the emulation thread in each subsystem,
+/// and the counters in FrameStats.
+///
+/// Zones nest: time spent in a zone entered from another one is only
+/// counted towards the inner zone, so the totals of all zones never
+/// add up to more than the time the console actually ran for.
+/// Work done by other threads (such as the 3D renderer's) isn't counted,
+/// only the time the emulation thread spends waiting for it is.
+///
+/// The zones and counters are only instrumented in builds with
+/// PROFILING_ENABLED, since reading the clock a few times per scheduler
+/// iteration isn't free. Otherwise everything stays at 0.
+class Profiler
+{
+public:
+#ifdef PROFILING_ENABLED
+    static constexpr bool Enabled = true;
+#else
+    static constexpr bool Enabled = false;
+#endif
+
+    class Scope
+    {
+    public:
+        Scope(Profiler& profiler, ProfileZone zone) noexcept
+            : Owner(profiler), Zone(zone), OuterChildTicks(profiler.ChildTicks), Start(Now())
+        {
+            profiler.ChildTicks = 0;
+        }
+
+        ~Scope() noexcept
+        {
+            u64 elapsed = Now() - Start;
+            Owner.Ticks[Zone] += elapsed - Owner.ChildTicks;
+            Owner.ChildTicks = OuterChildTicks + elapsed;
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Profiler& Owner;
+        ProfileZone Zone;
+        u64 OuterChildTicks;
+        u64 Start;
+    };
+
+    void Reset() noexcept
+    {
+        for (u64& ticks : Ticks)
+            ticks = 0;
+        ChildTicks = 0;
+        CurrentFrame = {};
+        LastFrame = {};
+    }
+
+    /// Keeps the counters of the frame that just ended and starts over.
+    void EndFrame() noexcept
+    {
+        LastFrame = CurrentFrame;
+        CurrentFrame = {};
+    }
+
+    /// @return The counters of the last frame that was run.
+    [[nodiscard]] const FrameStats& GetLastFrame() const noexcept { return LastFrame; }
+
+    /// @return The time spent in \c zone since the last Reset(), in ticks.
+    [[nodiscard]] u64 GetTicks(ProfileZone zone) const noexcept { return Ticks[zone]; }
+
+    /// @return The time spent in \c zone since the last Reset(), in seconds.
+    [[nodiscard]] double GetSeconds(ProfileZone zone) const noexcept { return Ticks[zone] / TicksPerSecond(); }
+
+    [[nodiscard]] static const char* GetZoneName(ProfileZone zone) noexcept;
+
+    /// @return A timestamp in ticks of an unspecified clock.
+    /// Uses the TSC on x86, which is a lot cheaper to read than the system clock.
+    [[nodiscard]] static u64 Now() noexcept;
+
+    /// @return The rate of Now(). This is measured the first time it's called,
+    /// which takes a few milliseconds.
+    [[nodiscard]] static double TicksPerSecond() noexcept;
+
+    /// Counters of the frame being run, updated through PROFILE_COUNT().
+    FrameStats CurrentFrame {};
+
+private:
+    u64 Ticks[ProfileZone_MAX] {};
+    u64 ChildTicks = 0;
+    FrameStats LastFrame {};
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+inline u64 Profiler::Now() noexcept
+{
+    return __builtin_ia32_rdtsc();
+}
+#endif
+
+#ifdef PROFILING_ENABLED
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+/// Counts the rest of the enclosing block towards \c zone.
+#define PROFILE_SCOPE(profiler, zone) melonDS::Profiler::Scope PROFILE_CONCAT(profileScope, __LINE__)(profiler, zone)
+/// Adds \c n to the FrameStats member \c counter.
+#define PROFILE_COUNT(profiler, counter, n) ((profiler).CurrentFrame.counter += (n))
+#else
+#define PROFILE_SCOPE(profiler, zone) do {} while (0)
+#define PROFILE_COUNT(profiler, counter, n) do {} while (0)
+#endif
+
+}
+
+#endif // PROFILER_H
@@ -0,0 +1,266 @@
+/*
+    Copyright 2016-2023 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <string.h>
+#include <algorithm>
+
+#include "RewindBuffer.h"
+#include "NDS.h"
+#include "Platform.h"
+#include "Profiler.h"
+
+namespace melonDS
+{
+using Platform::Log;
+using Platform::LogLevel;
+
+// The XOR of a page's old and new contents is zero wherever it didn't
+// change, which usually is most of it. It's stored as runs of zero words
+// and literal words: its length in bytes, then pairs of run lengths, each
+// followed by its literal words.
+
+static void CompressUndo(const std::vector<u8>& log, std::vector<u8>& out)
+{
+    u32 len = log.size();
+    u32 numwords = (len + 3) / 4;
+    auto word = [&](u32 i) -> u32
+    {
+        u32 val = 0;
+        memcpy(&val, &log[i*4], std::min(4u, len - i*4));
+        return val;
+    };
+    auto put = [&](u32 val)
+    {
+        u32 pos = out.size();
+        out.resize(pos + 4);
+        memcpy(&out[pos], &val, 4);
+    };
+
+    out.clear();
+    put(len);
+
+    u32 i = 0;
+    while (i < numwords)
+    {
+        u32 zeros = 0;
+        while (i < numwords && word(i) == 0)
+        {
+            zeros++;
+            i++;
+        }
+
+        u32 start = i;
+        while (i < numwords && word(i) != 0)
+            i++;
+
+        put(zeros);
+        put(i - start);
+        for (u32 j = start; j < i; j++)
+            put(word(j));
+    }
+
+    out.shrink_to_fit();
+}
+
+static bool DecompressUndo(const std::vector<u8>& in, std::vector<u8>& log)
+{
+    u32 pos = 0;
+    auto get = [&](u32& val)
+    {
+        if (in.size() - pos < 4)
+            return false;
+        memcpy(&val, &in[pos], 4);
+        pos += 4;
+        return true;
+    };
+
+    u32 len;
+    if (!get(len))
+        return false;
+
+    u32 numwords = (len + 3) / 4;
+    log.assign(numwords * 4, 0);
+
+    u32 i = 0;
+    while (pos < in.size())
+    {
+        u32 zeros, literals;
+        if (!get(zeros) || !get(literals))
+            return false;
+        if (zeros > numwords - i || literals > numwords - i - zeros)
+            return false;
+        i += zeros;
+
+        if (in.size() - pos < literals * 4)
+            return false;
+        memcpy(&log[i*4], &in[pos], literals * 4);
+        pos += literals * 4;
+        i += literals;
+    }
+
+    log.resize(len);
+    return true;
+}
+
+RewindBuffer::RewindBuffer(u32 interval, u64 budget) noexcept :
+    Interval(std::max(interval, 1u)),
+    Budget(budget)
+{
+    Delta.RecordUndo = true;
+}
+
+void RewindBuffer::Clear() noexcept
+{
+    Snapshots.clear();
+    Delta.Reset();
+    MemoryUsed = 0;
+    FramesSinceSnapshot = 0;
+}
+
+void RewindBuffer::SetInterval(u32 interval) noexcept
+{
+    Interval = std::max(interval, 1u);
+}
+
+void RewindBuffer::SetBudget(u64 bytes) noexcept
+{
+    Budget = bytes;
+    Trim();
+}
+
+double RewindBuffer::GetCaptureSeconds() const noexcept
+{
+    return CaptureTicks / Profiler::TicksPerSecond();
+}
+
+void RewindBuffer::ResetStats() noexcept
+{
+    CaptureTicks = 0;
+    NumCaptures = 0;
+    NumFrames = 0;
+}
+
+void RewindBuffer::DropOldest() noexcept
+{
+    const Snapshot& oldest = Snapshots.front();
+    MemoryUsed -= oldest.State.size() + oldest.Undo.size();
+    Snapshots.pop_front();
+
+    // there's nothing left to go back to from the new oldest one
+    Snapshot& next = Snapshots.front();
+    MemoryUsed -= next.Undo.size();
+    next.Undo.clear();
+    next.Undo.shrink_to_fit();
+}
+
+void RewindBuffer::Trim() noexcept
+{
+    while (MemoryUsed > Budget && Snapshots.size() > 1)
+        DropOldest();
+}
+
+bool RewindBuffer::FrameDone(NDS& nds)
+{
+    NumFrames++;
+    if (++FramesSinceSnapshot < Interval)
+        return true;
+
+    return Capture(nds);
+}
+
+bool RewindBuffer::Capture(NDS& nds)
+{
+    u64 start = Profiler::Now();
+
+    if (StateBuffer.empty())
+        StateBuffer.resize(Savestate::DEFAULT_SIZE);
+
+    Savestate state(StateBuffer.data(), StateBuffer.size(), true);
+    state.Delta = &Delta;
+    nds.DoSavestate(&state);
+    state.Finish();
+
+    if (state.Error)
+    {
+        Log(LogLevel::Error, "rewind: failed to take a snapshot\n");
+        Clear();
+        return false;
+    }
+
+    // a snapshot with every page in it can't be gone back from,
+    // this happens with the first one
+    if (!Delta.CanUndo)
+    {
+        Snapshots.clear();
+        MemoryUsed = 0;
+    }
+
+    Snapshot& snap = Snapshots.emplace_back();
+    snap.State.assign(StateBuffer.data(), StateBuffer.data() + state.Length());
+    if (Snapshots.size() > 1)
+        CompressUndo(Delta.UndoLog, snap.Undo);
+
+    MemoryUsed += snap.State.size() + snap.Undo.size();
+    Trim();
+
+    FramesSinceSnapshot = 0;
+    CaptureTicks += Profiler::Now() - start;
+    NumCaptures++;
+    return true;
+}
+
+bool RewindBuffer::StepBack(NDS& nds)
+{
+    if (Snapshots.empty())
+        return false;
+
+    if (FramesSinceSnapshot == 0)
+    {
+        if (Snapshots.size() < 2)
+            return false;
+
+        // the copy of memory goes back to the snapshot before, the newest
+        // one can then be dropped and the one before loaded on top of it
+        Snapshot& newest = Snapshots.back();
+        if (!DecompressUndo(newest.Undo, UndoBuffer) ||
+            !Delta.Undo(UndoBuffer.data(), UndoBuffer.size()))
+        {
+            Log(LogLevel::Error, "rewind: bad snapshot\n");
+            Clear();
+            return false;
+        }
+
+        MemoryUsed -= newest.State.size() + newest.Undo.size();
+        Snapshots.pop_back();
+    }
+
+    Snapshot& snap = Snapshots.back();
+    Savestate state(snap.State.data(), snap.State.size(), false);
+    state.Delta = &Delta;
+    if (state.Error || !nds.DoSavestate(&state) || state.Error)
+    {
+        Log(LogLevel::Error, "rewind: failed to load a snapshot\n");
+        Clear();
+        return false;
+    }
+
+    FramesSinceSnapshot = 0;
+    return true;
+}
+
+}
@@ -0,0 +1,117 @@
+/*
+    Copyright 2016-2023 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef REWINDBUFFER_H
+#define REWINDBUFFER_H
+
+#include <deque>
+#include <vector>
+
+#include "types.h"
+#include "Savestate.h"
+
+namespace melonDS
+{
+class NDS;
+
+/// Keeps snapshots of a console taken every few frames, as many as fit
+/// in a memory budget, so that the console can be taken back through
+/// them one after another.
+///
+/// Snapshots are delta savestates, with only the pages of memory which
+/// changed since the previous snapshot. Each one also keeps the XOR of
+/// those pages' old and new contents, run-length encoded, which is what
+/// going back to the snapshot before it takes. Once the oldest snapshots
+/// are dropped to stay within the budget, the rest don't need them.
+///
+/// The buffer has to be told about every frame the console runs. It has
+/// to be cleared whenever the console's state changes some other way,
+/// such as when a savestate is loaded or the console is reset.
+class RewindBuffer
+{
+public:
+    static constexpr u64 DefaultBudget = 256 * 1024 * 1024;
+
+    explicit RewindBuffer(u32 interval = 1, u64 budget = DefaultBudget) noexcept;
+
+    /// Forgets every snapshot.
+    void Clear() noexcept;
+
+    /// Sets the number of frames between snapshots.
+    void SetInterval(u32 interval) noexcept;
+    [[nodiscard]] u32 GetInterval() const noexcept { return Interval; }
+
+    /// Sets how much memory the snapshots can take, dropping the oldest
+    /// ones if they no longer fit. The newest snapshot is always kept.
+    void SetBudget(u64 bytes) noexcept;
+    [[nodiscard]] u64 GetBudget() const noexcept { return Budget; }
+
+    /// Has to be called after every frame the console runs,
+    /// takes a snapshot once every interval.
+    /// @return false if taking a snapshot failed, the buffer is then cleared.
+    bool FrameDone(NDS& nds);
+
+    /// Takes the console back to the newest snapshot if it ran any frames
+    /// since, otherwise to the one before it, which becomes the newest.
+    /// @return false if there's no snapshot to go back to, or if loading
+    /// it failed. The buffer is cleared in the latter case.
+    bool StepBack(NDS& nds);
+
+    [[nodiscard]] u32 GetNumSnapshots() const noexcept { return (u32)Snapshots.size(); }
+
+    /// @return The memory taken by the snapshots. The copy of the console's
+    /// memory they're made against and a savestate buffer come on top of this.
+    [[nodiscard]] u64 GetMemoryUsed() const noexcept { return MemoryUsed; }
+
+    /// Time spent taking snapshots, and the number of snapshots taken
+    /// and of frames run, since the stats were last reset.
+    [[nodiscard]] double GetCaptureSeconds() const noexcept;
+    [[nodiscard]] u32 GetNumCaptures() const noexcept { return NumCaptures; }
+    [[nodiscard]] u32 GetNumFrames() const noexcept { return NumFrames; }
+    void ResetStats() noexcept;
+
+private:
+    struct Snapshot
+    {
+        std::vector<u8> State;
+        // compressed SavestateDelta::UndoLog, back to the previous snapshot
+        std::vector<u8> Undo;
+    };
+
+    bool Capture(NDS& nds);
+    void DropOldest() noexcept;
+    void Trim() noexcept;
+
+    std::deque<Snapshot> Snapshots;
+    SavestateDelta Delta;
+    std::vector<u8> StateBuffer;
+    std::vector<u8> UndoBuffer;
+
+    u32 Interval;
+    u64 Budget;
+    u64 MemoryUsed = 0;
+    u32 FramesSinceSnapshot = 0;
+
+    u64 CaptureTicks = 0;
+    u32 NumCaptures = 0;
+    u32 NumFrames = 0;
+};
+
+}
+
+#endif // REWINDBUFFER_H
@@ -200,7 +200,8 @@ SPU::SPU(melonDS::NDS& nds, AudioBitDepth bitdepth, AudioInterpolation interpola
         SPUCaptureUnit(1, nds),
     },
     AudioLock(Platform::Mutex_Create()),
-    Degrade10Bit(bitdepth == AudioBitDepth::_10Bit || (nds.ConsoleType == 1 && bitdepth == AudioBitDepth::Auto))
+    Degrade10Bit(bitdepth == AudioBitDepth::_10Bit || (nds.ConsoleType == 1 && bitdepth == AudioBitDepth::Auto)),
+    MixChannel(GetSPUMixChannelFunc())
 {
     NDS.RegisterEventFunc(Event_SPU, 0, MemberEventFunc(SPU, Mix));
 
@@ -237,6 +238,7 @@ void SPU::Reset()
     Capture[1].Reset();
 
     NDS.ScheduleEvent(Event_SPU, false, 1024, 0, 0);
+    NextSampleTimestamp = NDS.SchedList[Event_SPU].Timestamp;
 }
 
 void SPU::Stop()
@@ -258,6 +260,12 @@ void SPU::DoSavestate(Savestate* file)
     file->Var8(&MasterVolume);
     file->Var16(&Bias);
 
+    // older states didn't mix lazily, the event was always due with the next sample
+    if (file->IsAtLeastVersion(12, 2))
+        file->Var64(&NextSampleTimestamp);
+    else
+        NextSampleTimestamp = NDS.SchedList[Event_SPU].Timestamp;
+
     for (SPUChannel& channel : Channels)
         channel.DoSavestate(file);
 
@@ -288,6 +296,11 @@ void SPU::SetApplyBias(bool enable)
     ApplyBias = enable;
 }
 
+void SPU::SetOutputEnabled(bool enable)
+{
+    OutputEnabled = enable;
+}
+
 void SPU::SetDegrade10Bit(bool enable)
 {
     Degrade10Bit = enable;
@@ -592,12 +605,8 @@ void SPUChannel::NextSample_Noise()
 }
 
 template<u32 type>
-s32 SPUChannel::Run()
+void SPUChannel::RunTimer()
 {
-    if (!(Cnt & (1<<31))) return 0;
-
-    if ((type < 3) && ((Length+LoopPos) < 16)) return 0;
-
     if (KeyOn)
     {
         Start();
@@ -629,6 +638,16 @@ s32 SPUChannel::Run()
         case 4: NextSample_Noise(); break;
         }
     }
+}
+
+template<u32 type>
+s32 SPUChannel::Run()
+{
+    if (!(Cnt & (1<<31))) return 0;
+
+    if ((type < 3) && ((Length+LoopPos) < 16)) return 0;
+
+    RunTimer<type>();
 
     s32 val = (s32)CurSample;
 
@@ -679,6 +698,105 @@ s32 SPUChannel::Run()
     return val;
 }
 
+template<u32 type>
+void SPUChannel::Run(s32* buf, u32 samples)
+{
+    for (u32 i = 0; i < samples; i++)
+        buf[i] = Run<type>();
+}
+
+template<u32 type>
+u32 SPUChannel::Decode(SPUSampleBlock& block, u32 samples)
+{
+    const bool interp = (type < 3) && (InterpType != AudioInterpolation::None);
+
+    u32 i = 0;
+    for (; i < samples; i++)
+    {
+        // like Run(), the channel doesn't output anything once it's stopped
+        if (!(Cnt & (1<<31))) break;
+        if ((type < 3) && ((Length+LoopPos) < 16)) break;
+
+        RunTimer<type>();
+
+        block.Cur[i] = CurSample;
+        if (interp)
+        {
+            block.Prev[0][i] = PrevSample[0];
+            block.Prev[1][i] = PrevSample[1];
+            block.Prev[2][i] = PrevSample[2];
+
+            s32 samplepos = ((Timer - TimerReload) * 0x100) / (0x10000 - TimerReload);
+            if (samplepos > 0xFF) samplepos = 0xFF;
+            block.SamplePos[i] = samplepos;
+        }
+    }
+
+    // which comes out as silence whatever the kernel does with it
+    for (u32 j = i; j < samples; j++)
+    {
+        block.Cur[j] = 0;
+        block.Prev[0][j] = 0;
+        block.Prev[1][j] = 0;
+        block.Prev[2][j] = 0;
+        block.SamplePos[j] = 0;
+    }
+
+    return i;
+}
+
+template<u32 type>
+void SPUChannel::Skip(u32 samples)
+{
+    if (type < 3)
+    {
+        // the FIFO and ADPCM state have to be exact for when the output
+        // is used again, which means reading the sample data like usual
+        for (u32 i = 0; i < samples; i++)
+        {
+            if (!(Cnt & (1<<31))) return;
+            if ((Length+LoopPos) < 16) return;
+
+            RunTimer<type>();
+        }
+        return;
+    }
+
+    // PSG and noise don't read anything, so the timer
+    // can be advanced over all of the samples at once
+    if (!(Cnt & (1<<31))) return;
+
+    if (KeyOn)
+    {
+        Start();
+        KeyOn = false;
+    }
+
+    u32 timer = Timer + (samples * 512);
+    u32 period = 0x10000 - TimerReload;
+    u32 steps = 0;
+    if (timer >> 16)
+    {
+        steps = ((timer - 0x10000) / period) + 1;
+        timer -= steps * period;
+    }
+    Timer = timer;
+
+    if (type == 3)
+    {
+        if (steps)
+        {
+            Pos += steps;
+            CurSample = PSGTable[(Cnt >> 24) & 0x7][Pos & 0x7];
+        }
+    }
+    else
+    {
+        for (u32 i = 0; i < steps; i++)
+            NextSample_Noise();
+    }
+}
+
 void SPUChannel::PanOutput(s32 in, s32& left, s32& right)
 {
     left += ((s64)in * (128-Pan)) >> 10;
@@ -809,150 +927,251 @@ void SPUCaptureUnit::Run(s32 sample)
 }
 
 
-void SPU::Mix(u32 dummy)
+void SPU::MixSamples(u32 count, bool dummy)
 {
-    s32 left = 0, right = 0;
-    s32 leftoutput = 0, rightoutput = 0;
+    PROFILE_SCOPE(NDS.Profiler, ProfileZone_SPUMix);
+
+    s32 left[MixBatchSize] {}, right[MixBatchSize] {};
+    s32 ch1[MixBatchSize] {}, ch3[MixBatchSize] {};
+    s32 buf[MixBatchSize];
+    SPUSampleBlock block {};
 
-    if ((Cnt & (1<<15)) && (!dummy))
+    bool enabled = (Cnt & (1<<15)) && (!dummy);
+    if (enabled && MixChannel)
     {
-        s32 ch0 = Channels[0].DoRun();
-        s32 ch1 = Channels[1].DoRun();
-        s32 ch2 = Channels[2].DoRun();
-        s32 ch3 = Channels[3].DoRun();
+        for (int i = 0; i < 16; i++)
+        {
+            SPUChannel& chan = Channels[i];
+            if (!(chan.Cnt & (1<<31)))
+                continue;
+
+            // nothing was decoded if the channel was set up to not play
+            if (chan.DoDecode(block, count) == 0)
+                continue;
 
-        // TODO: addition from capture registers
-        Channels[0].PanOutput(ch0, left, right);
-        Channels[2].PanOutput(ch2, left, right);
+            u32 type = (chan.Cnt >> 29) & 0x3;
 
-        if (!(Cnt & (1<<12))) Channels[1].PanOutput(ch1, left, right);
-        if (!(Cnt & (1<<13))) Channels[3].PanOutput(ch3, left, right);
+            SPUChannelMixParams params;
+            params.Interpolation = (type < 3) ? chan.InterpType : AudioInterpolation::None;
+            params.VolumeShift = chan.VolumeShift;
+            params.Volume = chan.Volume;
+            params.Pan = chan.Pan;
+            params.Mix = !(((i == 1) && (Cnt & (1<<12))) || ((i == 3) && (Cnt & (1<<13))));
 
-        for (int i = 4; i < 16; i++)
+            s32* out = (i == 1) ? ch1 : (i == 3) ? ch3 : buf;
+            MixChannel(out, left, right, block, count, params);
+        }
+    }
+    else if (enabled)
+    {
+        // the channels don't depend on each other, so each of them
+        // can be run for the entire batch before moving onto the next one
+        for (int i = 0; i < 16; i++)
         {
-            SPUChannel* chan = &Channels[i];
+            SPUChannel& chan = Channels[i];
+            if (!(chan.Cnt & (1<<31)))
+                continue;
 
-            s32 channel = chan->DoRun();
-            chan->PanOutput(channel, left, right);
+            s32* out = (i == 1) ? ch1 : (i == 3) ? ch3 : buf;
+            chan.DoRun(out, count);
+
+            // TODO: addition from capture registers
+            if ((i == 1) && (Cnt & (1<<12))) continue;
+            if ((i == 3) && (Cnt & (1<<13))) continue;
+
+            for (u32 j = 0; j < count; j++)
+                chan.PanOutput(out[j], left[j], right[j]);
         }
+    }
 
-        // sound capture
-        // TODO: other sound capture sources, along with their bugs
+    for (u32 j = 0; j < count; j++)
+    {
+        s32 leftoutput = 0, rightoutput = 0;
 
-        if (Capture[0].Cnt & (1<<7))
+        if (enabled)
         {
-            s32 val = left;
+            // sound capture
+            // TODO: other sound capture sources, along with their bugs
+            // (only ever done with one sample at a time, see RunMixer)
 
-            val >>= 8;
-            if      (val < -0x8000) val = -0x8000;
-            else if (val > 0x7FFF)  val = 0x7FFF;
+            if (Capture[0].Cnt & (1<<7))
+            {
+                s32 val = left[j];
 
-            Capture[0].Run(val);
-        }
+                val >>= 8;
+                if      (val < -0x8000) val = -0x8000;
+                else if (val > 0x7FFF)  val = 0x7FFF;
 
-        if (Capture[1].Cnt & (1<<7))
-        {
-            s32 val = right;
+                Capture[0].Run(val);
+            }
+
+            if (Capture[1].Cnt & (1<<7))
+            {
+                s32 val = right[j];
 
-            val >>= 8;
-            if      (val < -0x8000) val = -0x8000;
-            else if (val > 0x7FFF)  val = 0x7FFF;
+                val >>= 8;
+                if      (val < -0x8000) val = -0x8000;
+                else if (val > 0x7FFF)  val = 0x7FFF;
 
-            Capture[1].Run(val);
+                Capture[1].Run(val);
+            }
         }
 
-        // final output
+        if (!OutputEnabled)
+            continue;
 
-        switch (Cnt & 0x0300)
+        if (enabled)
         {
-        case 0x0000: // left mixer
-            leftoutput = left;
-            break;
-        case 0x0100: // channel 1
-            {
-                s32 pan = 128 - Channels[1].Pan;
-                leftoutput = ((s64)ch1 * pan) >> 10;
-            }
-            break;
-        case 0x0200: // channel 3
+            // final output
+
+            switch (Cnt & 0x0300)
             {
-                s32 pan = 128 - Channels[3].Pan;
-                leftoutput = ((s64)ch3 * pan) >> 10;
+            case 0x0000: // left mixer
+                leftoutput = left[j];
+                break;
+            case 0x0100: // channel 1
+                {
+                    s32 pan = 128 - Channels[1].Pan;
+                    leftoutput = ((s64)ch1[j] * pan) >> 10;
+                }
+                break;
+            case 0x0200: // channel 3
+                {
+                    s32 pan = 128 - Channels[3].Pan;
+                    leftoutput = ((s64)ch3[j] * pan) >> 10;
+                }
+                break;
+            case 0x0300: // channel 1+3
+                {
+                    s32 pan1 = 128 - Channels[1].Pan;
+                    s32 pan3 = 128 - Channels[3].Pan;
+                    leftoutput = (((s64)ch1[j] * pan1) >> 10) + (((s64)ch3[j] * pan3) >> 10);
+                }
+                break;
             }
-            break;
-        case 0x0300: // channel 1+3
+
+            switch (Cnt & 0x0C00)
             {
-                s32 pan1 = 128 - Channels[1].Pan;
-                s32 pan3 = 128 - Channels[3].Pan;
-                leftoutput = (((s64)ch1 * pan1) >> 10) + (((s64)ch3 * pan3) >> 10);
+            case 0x0000: // right mixer
+                rightoutput = right[j];
+                break;
+            case 0x0400: // channel 1
+                {
+                    s32 pan = Channels[1].Pan;
+                    rightoutput = ((s64)ch1[j] * pan) >> 10;
+                }
+                break;
+            case 0x0800: // channel 3
+                {
+                    s32 pan = Channels[3].Pan;
+                    rightoutput = ((s64)ch3[j] * pan) >> 10;
+                }
+                break;
+            case 0x0C00: // channel 1+3
+                {
+                    s32 pan1 = Channels[1].Pan;
+                    s32 pan3 = Channels[3].Pan;
+                    rightoutput = (((s64)ch1[j] * pan1) >> 10) + (((s64)ch3[j] * pan3) >> 10);
+                }
+                break;
             }
-            break;
         }
 
-        switch (Cnt & 0x0C00)
+        leftoutput = ((s64)leftoutput * MasterVolume) >> 7;
+        rightoutput = ((s64)rightoutput * MasterVolume) >> 7;
+
+        leftoutput >>= 8;
+        rightoutput >>= 8;
+
+        // Add SOUNDBIAS value
+        // The value used by all commercial games is 0x200, so we subtract that so it won't offset the final sound output.
+        if (ApplyBias)
         {
-        case 0x0000: // right mixer
-            rightoutput = right;
-            break;
-        case 0x0400: // channel 1
-            {
-                s32 pan = Channels[1].Pan;
-                rightoutput = ((s64)ch1 * pan) >> 10;
-            }
-            break;
-        case 0x0800: // channel 3
-            {
-                s32 pan = Channels[3].Pan;
-                rightoutput = ((s64)ch3 * pan) >> 10;
-            }
-            break;
-        case 0x0C00: // channel 1+3
-            {
-                s32 pan1 = Channels[1].Pan;
-                s32 pan3 = Channels[3].Pan;
-                rightoutput = (((s64)ch1 * pan1) >> 10) + (((s64)ch3 * pan3) >> 10);
-            }
-            break;
+            leftoutput += (Bias << 6) - 0x8000;
+            rightoutput += (Bias << 6) - 0x8000;
         }
-    }
 
-    leftoutput = ((s64)leftoutput * MasterVolume) >> 7;
-    rightoutput = ((s64)rightoutput * MasterVolume) >> 7;
+        if      (leftoutput < -0x8000) leftoutput = -0x8000;
+        else if (leftoutput > 0x7FFF)  leftoutput = 0x7FFF;
+        if      (rightoutput < -0x8000) rightoutput = -0x8000;
+        else if (rightoutput > 0x7FFF)  rightoutput = 0x7FFF;
 
-    leftoutput >>= 8;
-    rightoutput >>= 8;
+        // The original DS and DS lite degrade the output from 16 to 10 bit before output
+        if (Degrade10Bit)
+        {
+            leftoutput &= 0xFFFFFFC0;
+            rightoutput &= 0xFFFFFFC0;
+        }
 
-    // Add SOUNDBIAS value
-    // The value used by all commercial games is 0x200, so we subtract that so it won't offset the final sound output.
-    if (ApplyBias)
-    {
-        leftoutput += (Bias << 6) - 0x8000;
-        rightoutput += (Bias << 6) - 0x8000;
+        // OutputBufferFrame can never get full because it's
+        // transfered to OutputBuffer at the end of the frame
+        // FIXME: apparently this does happen!!!
+        if (OutputBackbufferWritePosition * 2 < OutputBufferSize - 1)
+        {
+            OutputBackbuffer[OutputBackbufferWritePosition    ] = leftoutput >> 1;
+            OutputBackbuffer[OutputBackbufferWritePosition + 1] = rightoutput >> 1;
+            OutputBackbufferWritePosition += 2;
+        }
     }
+}
 
-    if      (leftoutput < -0x8000) leftoutput = -0x8000;
-    else if (leftoutput > 0x7FFF)  leftoutput = 0x7FFF;
-    if      (rightoutput < -0x8000) rightoutput = -0x8000;
-    else if (rightoutput > 0x7FFF)  rightoutput = 0x7FFF;
+void SPU::SkipSamples(u32 count, bool dummy)
+{
+    if (!(Cnt & (1<<15)) || dummy)
+        return;
 
-    // The original DS and DS lite degrade the output from 16 to 10 bit before output
-    if (Degrade10Bit)
+    for (SPUChannel& chan : Channels)
     {
-        leftoutput &= 0xFFFFFFC0;
-        rightoutput &= 0xFFFFFFC0;
+        if (chan.Cnt & (1<<31))
+            chan.DoSkip(count);
     }
+}
 
-    // OutputBufferFrame can never get full because it's
-    // transfered to OutputBuffer at the end of the frame
-    // FIXME: apparently this does happen!!!
-    if (OutputBackbufferWritePosition * 2 < OutputBufferSize - 1)
+void SPU::RunMixer(u64 timestamp, bool dummy)
+{
+    while (NextSampleTimestamp <= timestamp)
     {
-        OutputBackbuffer[OutputBackbufferWritePosition    ] = leftoutput >> 1;
-        OutputBackbuffer[OutputBackbufferWritePosition + 1] = rightoutput >> 1;
-        OutputBackbufferWritePosition += 2;
+        u32 count = ((timestamp - NextSampleTimestamp) >> 10) + 1;
+        if (count > MixBatchSize) count = MixBatchSize;
+
+        // the capture units feed the channels back through memory,
+        // so with them everything has to happen in order
+        if (CaptureEnabled()) count = 1;
+
+        // the capture units record what's mixed, so that has to be done
+        if (OutputEnabled || CaptureEnabled())
+            MixSamples(count, dummy);
+        else
+            SkipSamples(count, dummy);
+        NextSampleTimestamp += count << 10;
     }
+}
+
+void SPU::CatchUp(u64 timestamp)
+{
+    RunMixer(timestamp, false);
+}
+
+void SPU::RescheduleMix()
+{
+    // while capturing, the event is due with every sample
+    // so that the captured data lands in memory in time
+    if (!CaptureEnabled()) return;
+    if (NDS.SchedList[Event_SPU].Timestamp <= NextSampleTimestamp) return;
 
-    NDS.ScheduleEvent(Event_SPU, true, 1024, 0, 0);
+    NDS.CancelEvent(Event_SPU);
+    NDS.ScheduleEvent(Event_SPU, false, NextSampleTimestamp - NDS.ARM7Timestamp, 0, 0);
+}
+
+void SPU::Mix(u32 dummy)
+{
+    // samples are otherwise only mixed once something needs them,
+    // this is mostly so that the channels don't lag behind too far
+    // when reading sample data the CPU is still streaming in
+    RunMixer(NDS.SchedList[Event_SPU].Timestamp, dummy);
+
+    u32 batch = (dummy || CaptureEnabled()) ? 1 : MixBatchSize;
+    NDS.ScheduleEvent(Event_SPU, true, batch << 10, 0, 0);
 }
 
 void SPU::TransferOutput()
@@ -1083,6 +1302,8 @@ int SPU::ReadOutput(s16* data, int samples)
 
 u8 SPU::Read8(u32 addr)
 {
+    CatchUp(NDS.GetSysTimestamp());
+
     if (addr < 0x04000500)
     {
         SPUChannel* chan = &Channels[(addr >> 4) & 0xF];
@@ -1113,6 +1334,8 @@ u8 SPU::Read8(u32 addr)
 
 u16 SPU::Read16(u32 addr)
 {
+    CatchUp(NDS.GetSysTimestamp());
+
     if (addr < 0x04000500)
     {
         SPUChannel* chan = &Channels[(addr >> 4) & 0xF];
@@ -1140,6 +1363,8 @@ u16 SPU::Read16(u32 addr)
 
 u32 SPU::Read32(u32 addr)
 {
+    CatchUp(NDS.GetSysTimestamp());
+
     if (addr < 0x04000500)
     {
         SPUChannel* chan = &Channels[(addr >> 4) & 0xF];
@@ -1169,6 +1394,8 @@ u32 SPU::Read32(u32 addr)
 
 void SPU::Write8(u32 addr, u8 val)
 {
+    CatchUp(NDS.GetSysTimestamp());
+
     if (addr < 0x04000500)
     {
         SPUChannel* chan = &Channels[(addr >> 4) & 0xF];
@@ -1196,10 +1423,12 @@ void SPU::Write8(u32 addr, u8 val)
 
         case 0x04000508:
             Capture[0].SetCnt(val);
+            RescheduleMix();
             if (val & 0x03) Log(LogLevel::Warn, "!! UNSUPPORTED SPU CAPTURE MODE %02X\n", val);
             return;
         case 0x04000509:
             Capture[1].SetCnt(val);
+            RescheduleMix();
             if (val & 0x03) Log(LogLevel::Warn, "!! UNSUPPORTED SPU CAPTURE MODE %02X\n", val);
             return;
         }
@@ -1210,6 +1439,8 @@ void SPU::Write8(u32 addr, u8 val)
 
 void SPU::Write16(u32 addr, u16 val)
 {
+    CatchUp(NDS.GetSysTimestamp());
+
     if (addr < 0x04000500)
     {
         SPUChannel* chan = &Channels[(addr >> 4) & 0xF];
@@ -1246,6 +1477,7 @@ void SPU::Write16(u32 addr, u16 val)
         case 0x04000508:
             Capture[0].SetCnt(val & 0xFF);
             Capture[1].SetCnt(val >> 8);
+            RescheduleMix();
             if (val & 0x0303) Log(LogLevel::Warn, "!! UNSUPPORTED SPU CAPTURE MODE %04X\n", val);
             return;
 
@@ -1259,6 +1491,8 @@ void SPU::Write16(u32 addr, u16 val)
 
 void SPU::Write32(u32 addr, u32 val)
 {
+    CatchUp(NDS.GetSysTimestamp());
+
     if (addr < 0x04000500)
     {
         SPUChannel* chan = &Channels[(addr >> 4) & 0xF];
@@ -1294,6 +1528,7 @@ void SPU::Write32(u32 addr, u32 val)
         case 0x04000508:
             Capture[0].SetCnt(val & 0xFF);
             Capture[1].SetCnt(val >> 8);
+            RescheduleMix();
             if (val & 0x0303) Log(LogLevel::Warn, "!! UNSUPPORTED SPU CAPTURE MODE %04X\n", val);
             return;
 
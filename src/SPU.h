@@ -21,6 +21,7 @@
 
 #include "Savestate.h"
 #include "Platform.h"
+#include "SPU_Mix.h"
 
 namespace melonDS
 {
@@ -125,32 +126,74 @@ public:
     void NextSample_PSG();
     void NextSample_Noise();
 
+    template<u32 type> void RunTimer();
     template<u32 type> s32 Run();
+    template<u32 type> void Run(s32* buf, u32 samples);
+    template<u32 type> u32 Decode(SPUSampleBlock& block, u32 samples);
+    template<u32 type> void Skip(u32 samples);
 
-    s32 DoRun()
+    void DoRun(s32* buf, u32 samples)
     {
         switch ((Cnt >> 29) & 0x3)
         {
-        case 0: return Run<0>(); break;
-        case 1: return Run<1>(); break;
-        case 2: return Run<2>(); break;
+        case 0: Run<0>(buf, samples); return;
+        case 1: Run<1>(buf, samples); return;
+        case 2: Run<2>(buf, samples); return;
         case 3:
             if (Num >= 14)
             {
-                return Run<4>();
-                break;
+                Run<4>(buf, samples);
+                return;
             }
             else if (Num >= 8)
             {
-                return Run<3>();
-                break;
+                Run<3>(buf, samples);
+                return;
             }
             [[fallthrough]];
+        default:
+            memset(buf, 0, samples*sizeof(s32));
+            return;
+        }
+    }
+
+    // decodes the samples for the block kernels, returns
+    // for how many of them the channel was playing
+    u32 DoDecode(SPUSampleBlock& block, u32 samples)
+    {
+        switch ((Cnt >> 29) & 0x3)
+        {
+        case 0: return Decode<0>(block, samples);
+        case 1: return Decode<1>(block, samples);
+        case 2: return Decode<2>(block, samples);
+        case 3:
+            if (Num >= 14)
+                return Decode<4>(block, samples);
+            else if (Num >= 8)
+                return Decode<3>(block, samples);
+            [[fallthrough]];
         default:
             return 0;
         }
     }
 
+    // advances the channel like DoRun() without producing any output
+    void DoSkip(u32 samples)
+    {
+        switch ((Cnt >> 29) & 0x3)
+        {
+        case 0: Skip<0>(samples); break;
+        case 1: Skip<1>(samples); break;
+        case 2: Skip<2>(samples); break;
+        case 3:
+            if (Num >= 14)
+                Skip<4>(samples);
+            else if (Num >= 8)
+                Skip<3>(samples);
+            break;
+        }
+    }
+
     void PanOutput(s32 in, s32& left, s32& right);
 
 private:
@@ -233,7 +276,22 @@ public:
     void SetDegrade10Bit(AudioBitDepth depth);
     void SetApplyBias(bool enable);
 
+    // with the output disabled, no audio is generated at all, only what
+    // the console can observe of the channels is kept up to date,
+    // for frontends which throw the audio away anyway
+    void SetOutputEnabled(bool enable);
+    [[nodiscard]] bool GetOutputEnabled() const noexcept { return OutputEnabled; }
+
     void Mix(u32 dummy);
+    // mixes all samples which are due until the given timestamp,
+    // has to be done before anything observes the state of the SPU.
+    // Register accesses catch up to the system timestamp, as far as the
+    // per-sample event would have gotten by then, so they see and change
+    // the same samples. What's different is when sample data is read:
+    // outside of register accesses, a sample can be mixed up to a batch
+    // later, so if the CPU or a DMA rewrites sample data in between,
+    // the channel plays the new data where it used to play the old.
+    void CatchUp(u64 timestamp);
 
     void TrimOutput();
     void DrainOutput();
@@ -252,6 +310,8 @@ public:
 
 private:
     static const u32 OutputBufferSize = 2*2048;
+    // samples mixed in one go when nothing needs them earlier
+    static const u32 MixBatchSize = SPUMaxBlockSamples;
     melonDS::NDS& NDS;
     s16 OutputBackbuffer[2 * OutputBufferSize] {};
     u32 OutputBackbufferWritePosition = 0;
@@ -267,9 +327,21 @@ private:
     u16 Bias = 0;
     bool ApplyBias = true;
     bool Degrade10Bit = false;
+    bool OutputEnabled = true;
 
     std::array<SPUChannel, 16> Channels;
     std::array<SPUCaptureUnit, 2> Capture;
+
+    // when the oldest sample which isn't mixed yet is due
+    u64 NextSampleTimestamp = 0;
+
+    SPUMixChannelFunc MixChannel = nullptr;
+
+    bool CaptureEnabled() const { return (Capture[0].Cnt | Capture[1].Cnt) & 0x80; }
+    void RescheduleMix();
+    void RunMixer(u64 timestamp, bool dummy);
+    void MixSamples(u32 count, bool dummy);
+    void SkipSamples(u32 count, bool dummy);
 };
 
 }
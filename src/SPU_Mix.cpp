@@ -0,0 +1,233 @@
+/*
+    Copyright 2016-2023 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "SPU_Mix.h"
+#include "SPU.h"
+
+// built the same way as the 3D span kernels, see GPU3D_SoftSpan.cpp
+#if defined(__x86_64__) || defined(__i386__)
+#define SPUMIX_X86
+#elif defined(__aarch64__)
+#define SPUMIX_NEON
+#endif
+
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+namespace melonDS
+{
+
+#if defined(SPUMIX_X86) || defined(SPUMIX_NEON)
+
+template <int N>
+struct SPUMixVec
+{
+    typedef s32 I __attribute__((vector_size(N*4)));
+};
+
+#define SPUMIX_INLINE static inline __attribute__((always_inline))
+
+template <typename I>
+SPUMIX_INLINE I Splat(s32 val)
+{
+    I v = {};
+    return v + val;
+}
+
+template <typename I>
+SPUMIX_INLINE I Load(const s32* src)
+{
+    I v;
+    __builtin_memcpy(&v, src, sizeof(v));
+    return v;
+}
+
+template <typename I>
+SPUMIX_INLINE void Store(s32* dst, I v)
+{
+    __builtin_memcpy(dst, &v, sizeof(v));
+}
+
+// there's nothing to gather 16-bit table entries with,
+// but the rest of the interpolation vectorises fine
+template <typename I>
+SPUMIX_INLINE I Gather(const s16* table, I index, u32 stride = 1)
+{
+    I v;
+    for (u32 i = 0; i < sizeof(I)/4; i++)
+        v[i] = table[index[i] * stride];
+    return v;
+}
+
+template <typename I>
+SPUMIX_INLINE I Clamp(I val, s32 min, s32 max)
+{
+    val = (val < min) ? Splat<I>(min) : val;
+    return (val > max) ? Splat<I>(max) : val;
+}
+
+// ((s64)in * pan) >> 10 without 64-bit multiplies, the low bits of
+// the input can't carry over into the high ones once they're shifted out
+template <typename I>
+SPUMIX_INLINE I Pan(I in, s32 pan)
+{
+    return ((in >> 10) * pan) + (((in & 0x3FF) * pan) >> 10);
+}
+
+template <int N, AudioInterpolation interp>
+SPUMIX_INLINE void MixChannelImpl(s32* out, s32* left, s32* right,
+                                  const SPUSampleBlock& block, u32 count,
+                                  const SPUChannelMixParams& params)
+{
+    typedef typename SPUMixVec<N>::I I;
+
+    for (u32 i = 0; i < count; i += N)
+    {
+        I val = Load<I>(&block.Cur[i]);
+
+        if (interp != AudioInterpolation::None)
+        {
+            I samplepos = Load<I>(&block.SamplePos[i]);
+            I prev0 = Load<I>(&block.Prev[0][i]);
+
+            switch (interp)
+            {
+            case AudioInterpolation::Linear:
+                val = ((val   * samplepos) +
+                       (prev0 * (0xFF-samplepos))) >> 8;
+                break;
+
+            case AudioInterpolation::Cosine:
+                val = ((val   * Gather(InterpCos.data(), samplepos)) +
+                       (prev0 * Gather(InterpCos.data(), 0xFF-samplepos))) >> 14;
+                break;
+
+            case AudioInterpolation::Cubic:
+                {
+                    const s16* cubic = InterpCubic[0].data();
+                    I prev1 = Load<I>(&block.Prev[1][i]);
+                    I prev2 = Load<I>(&block.Prev[2][i]);
+
+                    val = ((prev2 * Gather(cubic+0, samplepos, 4)) +
+                           (prev1 * Gather(cubic+1, samplepos, 4)) +
+                           (prev0 * Gather(cubic+2, samplepos, 4)) +
+                           (val   * Gather(cubic+3, samplepos, 4))) >> 14;
+                }
+                break;
+
+            case AudioInterpolation::SNESGaussian:
+                {
+                    const s16* gauss = InterpSNESGauss.data();
+                    I prev1 = Load<I>(&block.Prev[1][i]);
+                    I prev2 = Load<I>(&block.Prev[2][i]);
+
+                    // Avoid clipping (from fullsnes)
+                    I res =    ((Gather(gauss, 0x0FF - samplepos) * Clamp(prev2 >> 1, -0x3FFA, 0x3FF8)) >> 10);
+                    res = res + ((Gather(gauss, 0x1FF - samplepos) * Clamp(prev1 >> 1, -0x3FFA, 0x3FF8)) >> 10);
+                    res = res + ((Gather(gauss, 0x100 + samplepos) * Clamp(prev0 >> 1, -0x3FFA, 0x3FF8)) >> 10);
+                    res = res + ((Gather(gauss, 0x000 + samplepos) * Clamp(val   >> 1, -0x3FFA, 0x3FF8)) >> 10);
+                    val = Clamp(res, -0x8000, 0x7FFF);
+                }
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        val <<= params.VolumeShift;
+        val *= (s32)params.Volume;
+        Store(&out[i], val);
+
+        if (params.Mix)
+        {
+            Store(&left[i], Load<I>(&left[i]) + Pan(val, 128 - params.Pan));
+            Store(&right[i], Load<I>(&right[i]) + Pan(val, params.Pan));
+        }
+    }
+}
+
+template <int N>
+SPUMIX_INLINE void MixChannelDispatch(s32* out, s32* left, s32* right,
+                                      const SPUSampleBlock& block, u32 count,
+                                      const SPUChannelMixParams& params)
+{
+    switch (params.Interpolation)
+    {
+    case AudioInterpolation::Linear:
+        MixChannelImpl<N, AudioInterpolation::Linear>(out, left, right, block, count, params);
+        break;
+    case AudioInterpolation::Cosine:
+        MixChannelImpl<N, AudioInterpolation::Cosine>(out, left, right, block, count, params);
+        break;
+    case AudioInterpolation::Cubic:
+        MixChannelImpl<N, AudioInterpolation::Cubic>(out, left, right, block, count, params);
+        break;
+    case AudioInterpolation::SNESGaussian:
+        MixChannelImpl<N, AudioInterpolation::SNESGaussian>(out, left, right, block, count, params);
+        break;
+    default:
+        MixChannelImpl<N, AudioInterpolation::None>(out, left, right, block, count, params);
+        break;
+    }
+}
+
+#endif
+
+#ifdef SPUMIX_X86
+// SSE4.1 is the first to have 32-bit multiplies
+__attribute__((target("sse4.1")))
+static void MixChannel_SSE41(s32* out, s32* left, s32* right,
+                             const SPUSampleBlock& block, u32 count,
+                             const SPUChannelMixParams& params)
+{
+    MixChannelDispatch<4>(out, left, right, block, count, params);
+}
+
+__attribute__((target("avx2")))
+static void MixChannel_AVX2(s32* out, s32* left, s32* right,
+                            const SPUSampleBlock& block, u32 count,
+                            const SPUChannelMixParams& params)
+{
+    MixChannelDispatch<8>(out, left, right, block, count, params);
+}
+#endif
+
+#ifdef SPUMIX_NEON
+static void MixChannel_NEON(s32* out, s32* left, s32* right,
+                            const SPUSampleBlock& block, u32 count,
+                            const SPUChannelMixParams& params)
+{
+    MixChannelDispatch<4>(out, left, right, block, count, params);
+}
+#endif
+
+SPUMixChannelFunc GetSPUMixChannelFunc() noexcept
+{
+#ifdef SPUMIX_X86
+    if (__builtin_cpu_supports("avx2"))
+        return MixChannel_AVX2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return MixChannel_SSE41;
+#endif
+#ifdef SPUMIX_NEON
+    return MixChannel_NEON;
+#endif
+    return nullptr;
+}
+
+}
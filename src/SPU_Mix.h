@@ -0,0 +1,80 @@
+/*
+    Copyright 2016-2023 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef SPU_MIX_H
+#define SPU_MIX_H
+
+#include <array>
+#include "types.h"
+
+namespace melonDS
+{
+enum class AudioInterpolation;
+
+// SIMD kernels for the SPU's per-channel output.
+//
+// Decoding a channel's samples is a sequential state machine, but
+// what's done with them afterwards isn't: the optional interpolation,
+// the volume and the panning only depend on the sample and the ones
+// before it. A channel is first decoded over a whole batch of output
+// samples into an SPUSampleBlock, which the kernel then turns into the
+// channel's output and adds onto the mixer several samples at a time.
+//
+// The results are bit-exact with SPUChannel::Run() and PanOutput(),
+// which remain the scalar fallback.
+
+static constexpr u32 SPUMaxBlockSamples = 16;
+
+// the interpolation tables, defined in SPU.cpp
+extern const std::array<s16, 0x100> InterpCos;
+extern const array2d<s16, 0x100, 4> InterpCubic;
+extern const std::array<s16, 0x200> InterpSNESGauss;
+
+/// A channel's decoded samples over a batch, entries past the number
+/// of samples decoded have to be zero.
+struct SPUSampleBlock
+{
+    alignas(32) s32 Cur[SPUMaxBlockSamples];
+    // only needed with interpolation, PrevSample[] from the channel
+    alignas(32) s32 Prev[3][SPUMaxBlockSamples];
+    alignas(32) s32 SamplePos[SPUMaxBlockSamples];
+};
+
+struct SPUChannelMixParams
+{
+    AudioInterpolation Interpolation;
+    u32 VolumeShift;
+    u32 Volume;
+    u32 Pan;
+    // whether the channel goes to the mixer, channel 1 and 3 might not
+    bool Mix;
+};
+
+/// Writes the output of a channel for \c count samples to \c out,
+/// and adds it to \c left and \c right if it goes to the mixer.
+/// Kernels may process up to SPUMaxBlockSamples entries of all buffers.
+using SPUMixChannelFunc = void (*)(s32* out, s32* left, s32* right,
+                                   const SPUSampleBlock& block, u32 count,
+                                   const SPUChannelMixParams& params);
+
+/// @return The fastest channel kernel this CPU supports, or nullptr if there is none.
+[[nodiscard]] SPUMixChannelFunc GetSPUMixChannelFunc() noexcept;
+
+}
+
+#endif // SPU_MIX_H
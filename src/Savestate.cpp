@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <cassert>
 #include <cstring>
+#include <algorithm>
 #include "Savestate.h"
 #include "Platform.h"
 
@@ -250,6 +251,215 @@ void Savestate::VarArray(void* data, u32 len)
     buffer_offset += len;
 }
 
+bool SavestateDelta::Undo(const u8* log, u32 len) noexcept
+{
+    u32 pos = 0;
+    while (pos < len)
+    {
+        u32 region, page;
+        if (len - pos < 8) return false;
+        memcpy(&region, &log[pos], 4);
+        memcpy(&page, &log[pos+4], 4);
+        pos += 8;
+
+        if (region >= Regions.size()) return false;
+        std::vector<u8>& shadow = Regions[region];
+        u32 offset = page * PageSize;
+        if (offset >= shadow.size()) return false;
+        u32 size = std::min(PageSize, (u32)shadow.size() - offset);
+        if (len - pos < size) return false;
+
+        for (u32 i = 0; i < size; i++)
+            shadow[offset + i] ^= log[pos + i];
+        pos += size;
+    }
+
+    return true;
+}
+
+std::vector<u8>& Savestate::NextDeltaRegion()
+{
+    if (DeltaRegion == 0 && Saving)
+    {
+        Delta->UndoLog.clear();
+        Delta->CanUndo = true;
+    }
+
+    if (DeltaRegion >= Delta->Regions.size())
+        Delta->Regions.resize(DeltaRegion + 1);
+    return Delta->Regions[DeltaRegion++];
+}
+
+void Savestate::SavePages(const u8* mem, u32 len, std::vector<u8>& shadow)
+{
+    const u32 pagesize = SavestateDelta::PageSize;
+    const u32 numpages = (len + pagesize - 1) / pagesize;
+    bool full = shadow.size() != len;
+    shadow.resize(len);
+    if (full)
+        Delta->CanUndo = false;
+    std::vector<u8>& undo = Delta->UndoLog;
+    bool recordundo = Delta->RecordUndo && !full;
+
+    // the shadow is brought up to date first and the pages are written
+    // from it, mem can then be where they're written to
+    DeltaPages.clear();
+    for (u32 i = 0; i < numpages; i++)
+    {
+        u32 offset = i * pagesize;
+        u32 size = std::min(pagesize, len - offset);
+        if (full || memcmp(&mem[offset], &shadow[offset], size))
+        {
+            if (recordundo)
+            {
+                u32 header[2] = {DeltaRegion-1, i};
+                u32 pos = undo.size();
+                undo.resize(pos + sizeof(header) + size);
+                memcpy(&undo[pos], header, sizeof(header));
+                pos += sizeof(header);
+                for (u32 j = 0; j < size; j++)
+                    undo[pos + j] = mem[offset + j] ^ shadow[offset + j];
+            }
+
+            memcpy(&shadow[offset], &mem[offset], size);
+            DeltaPages.push_back(i);
+        }
+    }
+
+    u32 length = len;
+    u32 count = DeltaPages.size();
+    Var32(&length);
+    Var32(&count);
+    for (u32 i : DeltaPages)
+    {
+        u32 offset = i * pagesize;
+        Var32(&i);
+        VarArray(&shadow[offset], std::min(pagesize, len - offset));
+    }
+}
+
+u32 Savestate::LoadPages(std::vector<u8>& shadow)
+{
+    const u32 pagesize = SavestateDelta::PageSize;
+
+    u32 len = 0, count = 0;
+    Var32(&len);
+    Var32(&count);
+    if (Error) return 0;
+
+    const u32 numpages = (len + pagesize - 1) / pagesize;
+    if (shadow.size() != len)
+    {
+        // only the first state of a chain can be loaded on its own
+        if (count != numpages)
+        {
+            Log(LogLevel::Error, "savestate: delta region %u doesn't go with the previous state\n", DeltaRegion-1);
+            Error = true;
+            return 0;
+        }
+
+        shadow.resize(len);
+    }
+
+    for (u32 j = 0; j < count && !Error; j++)
+    {
+        u32 i = 0;
+        Var32(&i);
+        if (i >= numpages)
+        {
+            Log(LogLevel::Error, "savestate: delta page %u is out of range\n", i);
+            Error = true;
+            return 0;
+        }
+
+        u32 offset = i * pagesize;
+        VarArray(&shadow[offset], std::min(pagesize, len - offset));
+    }
+
+    return len;
+}
+
+void Savestate::VarPages(void* data, u32 len)
+{
+    if (!Delta)
+    {
+        VarArray(data, len);
+        return;
+    }
+
+    if (Error || finished) return;
+
+    std::vector<u8>& shadow = NextDeltaRegion();
+    if (Saving)
+    {
+        SavePages(static_cast<const u8*>(data), len, shadow);
+        return;
+    }
+
+    // the pages which aren't in this state are the same as in the
+    // previous one, which isn't necessarily what's in the memory now
+    u32 loadlen = LoadPages(shadow);
+    if (Error) return;
+    if (loadlen != len)
+    {
+        Log(LogLevel::Error, "savestate: delta region %u is %u bytes long, expected %u\n", DeltaRegion-1, loadlen, len);
+        Error = true;
+        return;
+    }
+
+    memcpy(data, shadow.data(), len);
+}
+
+void Savestate::BeginPages()
+{
+    if (!Delta || Error || finished) return;
+
+    if (Saving)
+    {
+        PagesStart = buffer_offset;
+        return;
+    }
+
+    std::vector<u8>& shadow = NextDeltaRegion();
+    u32 len = LoadPages(shadow);
+    if (Error) return;
+
+    // what's saved until EndPages() is read from the shadow instead
+    PagesBuffer = buffer;
+    PagesStart = buffer_offset;
+    PagesLength = buffer_length;
+    buffer = shadow.data();
+    buffer_offset = 0;
+    buffer_length = len;
+}
+
+void Savestate::EndPages()
+{
+    if (!Delta || finished) return;
+
+    if (Saving)
+    {
+        if (Error) return;
+
+        u32 len = buffer_offset - PagesStart;
+        buffer_offset = PagesStart;
+        SavePages(buffer + PagesStart, len, NextDeltaRegion());
+    }
+    else if (PagesBuffer)
+    {
+        if (!Error && buffer_offset != buffer_length)
+        {
+            Log(LogLevel::Error, "savestate: read %u bytes of %u-byte delta region\n", buffer_offset, buffer_length);
+            Error = true;
+        }
+
+        buffer = PagesBuffer;
+        buffer_offset = PagesStart;
+        buffer_length = PagesLength;
+        PagesBuffer = nullptr;
+    }
+}
+
 void Savestate::Finish()
 {
     if (Error || finished) return;
@@ -21,14 +21,61 @@
 
 #include <cstring>
 #include <string>
+#include <vector>
 #include <stdio.h>
 #include "types.h"
 
 #define SAVESTATE_MAJOR 12
-#define SAVESTATE_MINOR 1
+#define SAVESTATE_MINOR 2
 
 namespace melonDS
 {
+/// What delta savestates are made against: a copy of the memories
+/// stored with Savestate::VarPages(), as of the previous savestate
+/// made or loaded with it.
+///
+/// A delta savestate only stores the pages of those memories which
+/// changed since then, so it can only be loaded onto a console whose
+/// memory is in the state of the previous one. The first savestate
+/// made with a delta, or the first one after Reset(), stores every
+/// page and can be loaded onto any console.
+///
+/// Changes are found by comparing the memories against the copy,
+/// rather than by tracking writes. The JIT's fast memory stores
+/// don't go through anything which could track them.
+///
+/// If making or loading a delta savestate fails, the delta has to
+/// be Reset() before it can be used again.
+class SavestateDelta
+{
+public:
+    static constexpr u32 PageSize = 0x1000;
+
+    /// Forgets the previous savestate, the next one stores every page.
+    void Reset() noexcept { Regions.clear(); }
+
+    /// Makes delta savestates also record how to take the copy back to
+    /// what it was before them, in UndoLog. This isn't possible for a
+    /// savestate which has to store every page, CanUndo is then cleared.
+    bool RecordUndo = false;
+    bool CanUndo = false;
+
+    /// For every page stored by the last delta savestate made, its region
+    /// and index followed by the XOR of its old and new contents.
+    std::vector<u8> UndoLog;
+
+    /// Takes the copy back to what it was before the delta savestate
+    /// \c log was recorded with. The savestate before that one can then
+    /// be loaded with this delta, as it would have been right after it.
+    /// @return false if the log doesn't go with this delta.
+    bool Undo(const u8* log, u32 len) noexcept;
+
+private:
+    friend class Savestate;
+    // one for every VarPages() call or BeginPages() block, in order
+    std::vector<std::vector<u8>> Regions;
+};
+
 class Savestate
 {
 public:
@@ -70,6 +117,21 @@ public:
 
     void VarArray(void* data, u32 len);
 
+    /// Like VarArray(), for large memories. Is the same as VarArray()
+    /// unless Delta is set, in which case only the pages which changed
+    /// since the previous savestate made with that delta are stored.
+    void VarPages(void* data, u32 len);
+
+    /// Everything saved between these two is stored like with VarPages(),
+    /// for large structures which aren't saved with a single VarArray().
+    /// There can't be any sections in between.
+    void BeginPages();
+    void EndPages();
+
+    /// Makes this a delta savestate, has to be set before anything is
+    /// saved or loaded. See SavestateDelta.
+    SavestateDelta* Delta = nullptr;
+
     void Finish();
 
     // TODO rewinds the stream
@@ -94,7 +156,7 @@ public:
     {
         // major version is stored at offset 0x04
         u16 major = 0;
-        memcpy(&major, buffer + 0x04, sizeof(major));
+        memcpy(&major, Header() + 0x04, sizeof(major));
         return major;
     }
 
@@ -102,7 +164,7 @@ public:
     {
         // minor version is stored at offset 0x06
         u16 minor = 0;
-        memcpy(&minor, buffer + 0x06, sizeof(minor));
+        memcpy(&minor, Header() + 0x06, sizeof(minor));
         return minor;
     }
 
@@ -113,6 +175,17 @@ private:
     void WriteSavestateHeader();
     void WriteStateLength();
     u32 FindSection(const char* magic) const;
+    // a BeginPages() block is read from elsewhere
+    [[nodiscard]] const u8* Header() const { return PagesBuffer ? PagesBuffer : buffer; }
+    std::vector<u8>& NextDeltaRegion();
+    void SavePages(const u8* mem, u32 len, std::vector<u8>& shadow);
+    u32 LoadPages(std::vector<u8>& shadow);
+    u32 DeltaRegion = 0;
+    std::vector<u32> DeltaPages;
+    // where reading continues after EndPages()
+    u8* PagesBuffer = nullptr;
+    u32 PagesStart = 0;
+    u32 PagesLength = 0;
     u8* buffer;
     u32 buffer_offset;
     u32 buffer_length;
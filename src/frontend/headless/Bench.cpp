@@ -0,0 +1,661 @@
+/*
+    Copyright 2016-2023 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+// Performance benchmark for the emulator core.
+//
+// Boots the firmware with the built-in FreeBIOS, then every ROM given on
+// the command line, and runs each of them for a fixed number of frames
+// with every combination of CPU backend and renderer. Nothing about a run
+// depends on the host, so its framebuffer CRC has to be the same every
+// time and for every configuration, and frames/s can be compared between
+// builds.
+//
+// In builds with ENABLE_PROFILING, the time spent in each subsystem is
+// also reported, as milliseconds per emulated frame, along with the
+// counters of the last frame.
+//
+// With --savestates, the cost of making a savestate after every frame is
+// measured too, for full savestates and for delta ones. With --rewind,
+// so is the cost of keeping a rewind buffer, and of going back through it.
+//
+// With --check-span-kernels, nothing is timed. Instead, the 3D scenes of
+// every frame of every ROM, and a number of random ones, are rendered with
+// each SIMD span kernel the CPU supports and have to come out the same as
+// with the scalar interpolator.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "HeadlessRunner.h"
+#include "Args.h"
+#include "CRC32.h"
+#include "GPU2D_Soft.h"
+#include "GPU3D_Soft.h"
+#include "NDS.h"
+#include "NDSCart.h"
+#include "Platform.h"
+#include "Profiler.h"
+#include "RewindBuffer.h"
+#include "Savestate.h"
+
+using namespace melonDS;
+
+struct BenchConfig
+{
+    const char* Name;
+    bool JIT;
+    bool CachedInterpreter;
+    int BandWorkers;
+    bool Threaded2D;
+    bool IdleLoopSkip = true;
+    bool AudioOutput = true;
+};
+
+struct BenchROM
+{
+    std::string Path;
+    std::unique_ptr<u8[]> Data;
+    u32 Length = 0;
+};
+
+static void PrintUsage(const char* argv0)
+{
+    printf("usage: %s [options] [rom.nds...]\n", argv0);
+    printf("  -f, --frames N      number of frames to time per run (default 600)\n");
+    printf("  -w, --warmup N      number of frames to run before timing (default 60)\n");
+    printf("  -i, --interpreter   only run with the (cached) interpreter\n");
+    printf("  -j, --jit           only run with the JIT recompiler\n");
+    printf("  -s, --savestates    also time making a full and a delta savestate every frame\n");
+    printf("  -r, --rewind N      also time a rewind buffer with a snapshot every N frames\n");
+    printf("  -k, --check-span-kernels N\n");
+    printf("                      don't time anything, check that each SIMD span kernel\n");
+    printf("                      renders the 3D scenes of every frame and N random ones\n");
+    printf("                      like the scalar interpolator\n");
+    printf("\n");
+    printf("The firmware is always booted first, then every ROM given.\n");
+}
+
+static std::unique_ptr<u8[]> LoadFile(const std::string& path, u32& len)
+{
+    Platform::FileHandle* f = Platform::OpenFile(path, Platform::FileMode::Read);
+    if (!f)
+        return nullptr;
+
+    len = (u32)Platform::FileLength(f);
+    auto data = std::make_unique<u8[]>(len);
+    Platform::FileRewind(f);
+    u64 got = Platform::FileRead(data.get(), len, 1, f);
+    Platform::CloseFile(f);
+
+    if (got != 1)
+        return nullptr;
+    return data;
+}
+
+static bool RunBench(const BenchROM& rom, const BenchConfig& config, u32 warmup, u32 frames)
+{
+    // one worker, so that the console runs on the same thread all along
+    HeadlessRunner runner(1);
+
+    NDSArgs args {};
+    if (!config.JIT)
+        args.JIT = std::nullopt;
+    else
+        args.JIT->CachedInterpreter = config.CachedInterpreter;
+    args.Renderer3D = std::make_unique<SoftRenderer>(false, config.BandWorkers);
+
+    if (rom.Data)
+    {
+        args.NDSROM = NDSCart::ParseROM(rom.Data.get(), rom.Length);
+        if (!args.NDSROM)
+        {
+            fprintf(stderr, "failed to parse ROM %s\n", rom.Path.c_str());
+            return false;
+        }
+    }
+
+    int inst = runner.AddInstance(std::move(args), rom.Path);
+    NDS& nds = runner.GetNDS(inst);
+    if (config.Threaded2D)
+        static_cast<GPU2D::SoftRenderer&>(nds.GPU.GetRenderer2D()).SetThreaded(true);
+    nds.ARM7.SetIdleLoopSkip(config.IdleLoopSkip);
+    nds.SPU.SetOutputEnabled(config.AudioOutput);
+
+    runner.RunFrames(warmup);
+    nds.Profiler.Reset();
+
+    u64 start = Profiler::Now();
+    runner.RunFrames(frames);
+    u64 end = Profiler::Now();
+
+    u32 ran = runner.GetInstance(inst).NumFrames - warmup;
+    double secs = (end - start) / Profiler::TicksPerSecond();
+
+    u32 crc = CRC32((const u8*)runner.GetFramebuffer(inst, 0), HeadlessRunner::ScreenWidth * HeadlessRunner::ScreenHeight * 4);
+    crc = CRC32((const u8*)runner.GetFramebuffer(inst, 1), HeadlessRunner::ScreenWidth * HeadlessRunner::ScreenHeight * 4, crc);
+
+    printf("  %-28s %8.1f frames/s  CRC %08X%s\n",
+        config.Name, ran / secs, crc, nds.IsRunning() ? "" : " (stopped)");
+
+    if (Profiler::Enabled && ran > 0)
+    {
+        double total = 0;
+        for (int i = 0; i < ProfileZone_MAX; i++)
+        {
+            auto zone = (ProfileZone)i;
+            double zonesecs = nds.Profiler.GetSeconds(zone);
+            total += zonesecs;
+
+            printf("    %-16s %8.3f ms/frame %6.1f%%\n",
+                Profiler::GetZoneName(zone), zonesecs * 1000 / ran, zonesecs * 100 / secs);
+        }
+
+        printf("    %-16s %8.3f ms/frame %6.1f%%\n",
+            "other", (secs - total) * 1000 / ran, (secs - total) * 100 / secs);
+
+        const FrameStats& stats = nds.GetFrameStats();
+        printf("    last frame: %u/%u JIT blocks compiled/invalidated, %u fastmem faults,\n"
+               "      %u/%u slow ARM9/ARM7 accesses, %u DMA units, %u GX commands,\n"
+               "      %u polygons, %u vertices, %u scheduler events\n",
+            stats.JITBlocksCompiled, stats.JITBlocksInvalidated, stats.FastmemFaults,
+            stats.SlowMemAccesses9, stats.SlowMemAccesses7, stats.DMAUnits, stats.GXCommands,
+            stats.Polygons, stats.Vertices, stats.SchedulerEvents);
+    }
+
+    return true;
+}
+
+static bool RunSavestateBench(const BenchROM& rom, u32 warmup, u32 frames)
+{
+    HeadlessRunner runner(1);
+
+    NDSArgs args {};
+    if (rom.Data)
+    {
+        args.NDSROM = NDSCart::ParseROM(rom.Data.get(), rom.Length);
+        if (!args.NDSROM)
+        {
+            fprintf(stderr, "failed to parse ROM %s\n", rom.Path.c_str());
+            return false;
+        }
+    }
+
+    int inst = runner.AddInstance(std::move(args), rom.Path);
+    NDS& nds = runner.GetNDS(inst);
+    runner.RunFrames(warmup);
+
+    // the same buffer is used for every savestate, as a rewind buffer would
+    std::vector<u8> buffer(32 * 1024 * 1024);
+    SavestateDelta delta;
+    u64 fullticks = 0, deltaticks = 0;
+    u64 fullbytes = 0, deltabytes = 0;
+    u32 maxdelta = 0;
+
+    for (u32 i = 0; i < frames; i++)
+    {
+        runner.RunFrames(1);
+
+        Savestate fullstate(buffer.data(), buffer.size(), true);
+        u64 start = Profiler::Now();
+        nds.DoSavestate(&fullstate);
+        fullstate.Finish();
+        u64 mid = Profiler::Now();
+
+        Savestate deltastate(buffer.data(), buffer.size(), true);
+        deltastate.Delta = &delta;
+        nds.DoSavestate(&deltastate);
+        deltastate.Finish();
+        u64 end = Profiler::Now();
+
+        if (fullstate.Error || deltastate.Error)
+        {
+            fprintf(stderr, "failed to make a savestate\n");
+            return false;
+        }
+
+        fullticks += mid - start;
+        fullbytes += fullstate.Length();
+
+        // the first delta has every page, it's what the others are made against
+        if (i > 0)
+        {
+            deltaticks += end - mid;
+            deltabytes += deltastate.Length();
+            maxdelta = std::max(maxdelta, deltastate.Length());
+        }
+    }
+
+    double ms = 1000 / Profiler::TicksPerSecond();
+    u32 deltas = std::max(frames, 2u) - 1;
+    printf("  %-28s %8.3f ms %8.1f KB\n", "full savestate",
+        fullticks * ms / frames, fullbytes / 1024.0 / frames);
+    printf("  %-28s %8.3f ms %8.1f KB (at most %.1f KB)\n", "delta savestate",
+        deltaticks * ms / deltas, deltabytes / 1024.0 / deltas, maxdelta / 1024.0);
+
+    return true;
+}
+
+static bool RunRewindBench(const BenchROM& rom, u32 warmup, u32 frames, u32 interval)
+{
+    HeadlessRunner runner(1);
+
+    NDSArgs args {};
+    if (rom.Data)
+    {
+        args.NDSROM = NDSCart::ParseROM(rom.Data.get(), rom.Length);
+        if (!args.NDSROM)
+        {
+            fprintf(stderr, "failed to parse ROM %s\n", rom.Path.c_str());
+            return false;
+        }
+    }
+
+    int inst = runner.AddInstance(std::move(args), rom.Path);
+    NDS& nds = runner.GetNDS(inst);
+    runner.RunFrames(warmup);
+
+    // no budget, so that every snapshot can be gone back to
+    RewindBuffer rewind(interval, UINT64_MAX);
+    for (u32 i = 0; i < frames; i++)
+    {
+        runner.RunFrames(1);
+        if (!rewind.FrameDone(nds))
+            return false;
+    }
+
+    double capturems = rewind.GetCaptureSeconds() * 1000;
+    u32 snapshots = rewind.GetNumSnapshots();
+    u64 memory = rewind.GetMemoryUsed();
+
+    u32 steps = 0;
+    u64 start = Profiler::Now();
+    while (rewind.StepBack(nds))
+        steps++;
+    u64 end = Profiler::Now();
+
+    printf("  %-28s %8.3f ms/frame, %u snapshots in %.1f MB\n",
+        "rewind capture", capturems / frames, snapshots, memory / 1048576.0);
+    printf("  %-28s %8.3f ms/step, %u steps\n", "rewind step back",
+        steps ? (end - start) * 1000 / Profiler::TicksPerSecond() / steps : 0.0, steps);
+
+    return true;
+}
+
+static const SpanKernel SIMDSpanKernels[] = {SpanKernel::SSE41, SpanKernel::AVX2, SpanKernel::NEON};
+
+// Renders the scene in the 3D engine's render state with each SIMD kernel
+// and compares it to the scalar one. Shadow polygons depend on the stencil
+// buffer left by the frame before, so the renderer is reset before each
+// one. It's left with the kernel it had.
+static bool CompareSpanKernels(NDS& nds, const char* scene)
+{
+    const int size = HeadlessRunner::ScreenWidth * HeadlessRunner::ScreenHeight;
+    auto& renderer = static_cast<SoftRenderer&>(nds.GPU.GetRenderer3D());
+    SpanKernel prevkernel = renderer.GetSpanKernel();
+
+    auto render = [&](SpanKernel kernel, std::vector<u32>& out)
+    {
+        renderer.Reset(nds.GPU);
+        renderer.SetSpanKernel(kernel);
+        renderer.RenderFrame(nds.GPU);
+        out.resize(size);
+        for (int y = 0; y < HeadlessRunner::ScreenHeight; y++)
+            memcpy(&out[y * HeadlessRunner::ScreenWidth], renderer.GetLine(y), HeadlessRunner::ScreenWidth * 4);
+    };
+
+    std::vector<u32> reference, output;
+    render(SpanKernel::Scalar, reference);
+
+    bool ok = true;
+    for (SpanKernel kernel : SIMDSpanKernels)
+    {
+        if (!IsSpanKernelSupported(kernel))
+            continue;
+
+        render(kernel, output);
+        for (int i = 0; i < size; i++)
+        {
+            if (output[i] != reference[i])
+            {
+                printf("  %s: %s kernel renders pixel %d,%d as %08X instead of %08X\n",
+                    scene, GetSpanKernelName(kernel),
+                    i % HeadlessRunner::ScreenWidth, i / HeadlessRunner::ScreenWidth,
+                    output[i], reference[i]);
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    renderer.SetSpanKernel(prevkernel);
+    return ok;
+}
+
+static bool CheckSpanKernels(const BenchROM& rom, u32 frames)
+{
+    HeadlessRunner runner(1);
+
+    NDSArgs args {};
+    args.JIT = std::nullopt;
+    args.Renderer3D = std::make_unique<SoftRenderer>();
+    if (rom.Data)
+    {
+        args.NDSROM = NDSCart::ParseROM(rom.Data.get(), rom.Length);
+        if (!args.NDSROM)
+        {
+            fprintf(stderr, "failed to parse ROM %s\n", rom.Path.c_str());
+            return false;
+        }
+    }
+
+    int inst = runner.AddInstance(std::move(args), rom.Path);
+    NDS& nds = runner.GetNDS(inst);
+
+    u32 scenes = 0;
+    bool ok = true;
+    for (u32 i = 0; i < frames; i++)
+    {
+        runner.RunFrames(1);
+
+        // the scene which was swapped in at the start of vblank,
+        // unless it's the same as the one before
+        GPU3D& gpu3d = nds.GPU.GPU3D;
+        if (gpu3d.RenderFrameIdentical || gpu3d.RenderNumPolygons == 0)
+            continue;
+
+        std::string scene = "frame " + std::to_string(i);
+        ok &= CompareSpanKernels(nds, scene.c_str());
+        scenes++;
+    }
+
+    printf("  %-28s %u scenes%s\n", "span kernels, frames", scenes, ok ? "" : ", MISMATCH");
+    return ok;
+}
+
+// The random scenes go through the geometry engine like any other,
+// with random render settings, polygon attributes, textures and vertices.
+static bool CheckSpanKernelsRandom(u32 count)
+{
+    NDSArgs args {};
+    args.JIT = std::nullopt;
+    args.Renderer3D = std::make_unique<SoftRenderer>();
+    auto nds = std::make_unique<NDS>(std::move(args));
+    nds->Reset();
+
+    GPU& gpu = nds->GPU;
+    GPU3D& gpu3d = gpu.GPU3D;
+    gpu.SetPowerCnt(0x820F);
+
+    // fixed seed, so that a mismatch can be found again
+    std::mt19937 rng(0x3D);
+    auto word = [&]() { return (u32)rng(); };
+    auto random = [&](u32 max) { return word() % max; };
+
+    // random textures in banks A and B, and random palettes in E
+    for (u32 bank = 0; bank < 2; bank++)
+        gpu.MapVRAM_AB(bank, 0x80);
+    gpu.MapVRAM_E(4, 0x80);
+    for (u32 addr = 0x06800000; addr < 0x06840000; addr += 4)
+        nds->ARM9Write32(addr, word());
+    for (u32 addr = 0x06880000; addr < 0x06890000; addr += 4)
+        nds->ARM9Write32(addr, word());
+    gpu.MapVRAM_AB(0, 0x83);
+    gpu.MapVRAM_AB(1, 0x8B);
+    gpu.MapVRAM_E(4, 0x83);
+
+    auto command = [&](u32 cmd, std::initializer_list<u32> params)
+    {
+        if (params.size() == 0)
+            gpu3d.Write32(0x04000400 + (cmd << 2), 0);
+        for (u32 param : params)
+            gpu3d.Write32(0x04000400 + (cmd << 2), param);
+
+        // the geometry engine only gets as far as the ARM9 is
+        for (int i = 0; i < 1000 && !gpu3d.FlushRequest && (gpu3d.Read32(0x04000600) & (1<<27)); i++)
+            nds->ARM9Timestamp += 64 << nds->ARM9ClockShift;
+    };
+
+    u32 polygons = 0;
+    bool ok = true;
+    for (u32 n = 0; n < count; n++)
+    {
+        gpu3d.Write32(0x04000060, random(0x1000));
+        gpu3d.Write32(0x04000340, random(0x20));
+        gpu3d.Write32(0x04000350, word() & 0x3F1FFFFF);
+        gpu3d.Write32(0x04000354, random(0x8000));
+        gpu3d.Write32(0x04000358, word());
+        gpu3d.Write32(0x0400035C, word());
+        for (u32 addr = 0x04000330; addr < 0x040003C0; addr += 4)
+        {
+            if (addr < 0x04000340 || addr >= 0x04000360)
+                gpu3d.Write32(addr, word());
+        }
+
+        // a perspective projection most of the time,
+        // otherwise every W is the same and the spans are linear
+        command(0x10, {0});
+        if (random(4))
+        {
+            s32 scale = 0x1000 + random(0x2000);
+            command(0x16, {(u32)scale, 0, 0, 0,  0, (u32)scale, 0, 0,
+                           0, 0, (u32)-0x1080, (u32)-0x1000,  0, 0, (u32)-0x1000, 0});
+        }
+        else
+            command(0x15, {});
+        command(0x10, {2});
+        command(0x15, {});
+        command(0x10, {3});
+        command(0x15, {});
+        command(0x60, {0xBFFF0000});
+
+        u32 numpolys = 1 + random(64);
+        for (u32 p = 0; p < numpolys; p++)
+        {
+            // no lights, both sides, and anything else
+            command(0x29, {(word() & 0x3F1FFFF0) | 0xC0});
+            command(0x2A, {word() & 0x3FFFFFFF});
+            command(0x2B, {random(0x2000)});
+
+            u32 type = random(4);
+            u32 numverts = (type & 1) ? 4 : 3;
+            if (type >= 2)
+                numverts += random(4);
+            command(0x40, {type});
+            for (u32 v = 0; v < numverts; v++)
+            {
+                command(0x20, {random(0x8000)});
+                command(0x22, {word()});
+                s16 x = (s16)(random(0x6000) - 0x3000);
+                s16 y = (s16)(random(0x6000) - 0x3000);
+                s16 z = (s16)-(0x400 + random(0x7000));
+                command(0x23, {(u16)x | ((u32)(u16)y << 16), (u16)z});
+            }
+            command(0x41, {});
+        }
+        polygons += numpolys;
+
+        // random manual sorting and W-buffering
+        command(0x50, {random(4)});
+        gpu3d.VBlank();
+
+        std::string scene = "random scene " + std::to_string(n);
+        ok &= CompareSpanKernels(*nds, scene.c_str());
+    }
+
+    printf("  %-28s %u scenes, %u polygons%s\n", "span kernels, random", count, polygons, ok ? "" : ", MISMATCH");
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    u32 numframes = 600;
+    u32 warmup = 60;
+    bool interp = true;
+    bool jit = true;
+    bool savestates = false;
+    u32 rewindinterval = 0;
+    bool checkspankernels = false;
+    u32 randomscenes = 0;
+    std::vector<BenchROM> roms;
+
+    // the firmware boot comes first
+    roms.emplace_back();
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        bool hasnext = (i+1) < argc;
+
+        if ((!strcmp(arg, "-f") || !strcmp(arg, "--frames")) && hasnext)
+            numframes = atoi(argv[++i]);
+        else if ((!strcmp(arg, "-w") || !strcmp(arg, "--warmup")) && hasnext)
+            warmup = atoi(argv[++i]);
+        else if (!strcmp(arg, "-i") || !strcmp(arg, "--interpreter"))
+            jit = false;
+        else if (!strcmp(arg, "-j") || !strcmp(arg, "--jit"))
+            interp = false;
+        else if (!strcmp(arg, "-s") || !strcmp(arg, "--savestates"))
+            savestates = true;
+        else if ((!strcmp(arg, "-r") || !strcmp(arg, "--rewind")) && hasnext)
+            rewindinterval = std::max(atoi(argv[++i]), 1);
+        else if ((!strcmp(arg, "-k") || !strcmp(arg, "--check-span-kernels")) && hasnext)
+        {
+            checkspankernels = true;
+            randomscenes = std::max(atoi(argv[++i]), 0);
+        }
+        else if (arg[0] == '-')
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            roms.emplace_back();
+            roms.back().Path = arg;
+        }
+    }
+
+#ifndef JIT_ENABLED
+    if (!interp)
+    {
+        fprintf(stderr, "this build has no JIT recompiler\n");
+        return 1;
+    }
+    jit = false;
+#endif
+
+    if (numframes < 1 || (!interp && !jit))
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    Platform::Init(argc, argv);
+
+    for (BenchROM& rom : roms)
+    {
+        if (rom.Path.empty())
+            continue;
+
+        rom.Data = LoadFile(rom.Path, rom.Length);
+        if (!rom.Data)
+        {
+            fprintf(stderr, "failed to load ROM %s\n", rom.Path.c_str());
+            Platform::DeInit();
+            return 1;
+        }
+    }
+
+    if (checkspankernels)
+    {
+        printf("checking span kernels against the scalar interpolator:");
+        for (SpanKernel kernel : SIMDSpanKernels)
+        {
+            if (IsSpanKernelSupported(kernel))
+                printf(" %s", GetSpanKernelName(kernel));
+        }
+        printf("\n");
+
+        int ret = 0;
+        if (!CheckSpanKernelsRandom(randomscenes))
+            ret = 1;
+        for (const BenchROM& rom : roms)
+        {
+            printf("\n%s\n", rom.Path.empty() ? "firmware" : rom.Path.c_str());
+            if (!CheckSpanKernels(rom, warmup + numframes))
+                ret = 1;
+        }
+
+        Platform::DeInit();
+        return ret;
+    }
+
+    int bandworkers = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+
+    std::vector<BenchConfig> configs;
+    if (interp)
+    {
+        configs.push_back({"interpreter, software", false, false, 0, false});
+        configs.push_back({"interpreter, software bands", false, false, bandworkers, false});
+        configs.push_back({"interpreter, threaded 2D", false, false, 0, true});
+        configs.push_back({"interpreter, no idle skip", false, false, 0, false, false});
+#ifdef CACHED_INTERPRETER_ENABLED
+        configs.push_back({"cached interpreter, software", true, true, 0, false});
+#endif
+    }
+    if (jit)
+    {
+        configs.push_back({"JIT, software", true, false, 0, false});
+        configs.push_back({"JIT, software bands", true, false, bandworkers, false});
+        configs.push_back({"JIT, threaded 2D", true, false, 0, true});
+        configs.push_back({"JIT, no audio output", true, false, 0, false, true, false});
+    }
+
+    printf("%u frames per run after %u frames of warmup, %d 3D band worker(s)%s\n",
+        numframes, warmup, bandworkers,
+        Profiler::Enabled ? "" : "\n(build with ENABLE_PROFILING for a per-subsystem breakdown)");
+
+    int ret = 0;
+    for (const BenchROM& rom : roms)
+    {
+        printf("\n%s\n", rom.Path.empty() ? "firmware" : rom.Path.c_str());
+
+        for (const BenchConfig& config : configs)
+        {
+            if (!RunBench(rom, config, warmup, numframes))
+            {
+                ret = 1;
+                break;
+            }
+        }
+
+        if (savestates && !RunSavestateBench(rom, warmup, numframes))
+            ret = 1;
+        if (rewindinterval && !RunRewindBench(rom, warmup, numframes, rewindinterval))
+            ret = 1;
+    }
+
+    Platform::DeInit();
+    return ret;
+}
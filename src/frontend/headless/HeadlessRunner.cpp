@@ -0,0 +1,168 @@
+/*
+    Copyright 2016-2023 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <string.h>
+
+#include "HeadlessRunner.h"
+#include "Args.h"
+#include "NDS.h"
+
+namespace melonDS
+{
+
+HeadlessRunner::HeadlessRunner(unsigned numthreads)
+{
+    if (numthreads == 0)
+        numthreads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned i = 0; i < numthreads; i++)
+        Workers.emplace_back(&HeadlessRunner::WorkerFunc, this);
+}
+
+HeadlessRunner::~HeadlessRunner()
+{
+    {
+        std::lock_guard<std::mutex> lock(Lock);
+        Exiting = true;
+    }
+    WorkReady.notify_all();
+
+    for (std::thread& worker : Workers)
+        worker.join();
+
+    Instances.clear();
+}
+
+int HeadlessRunner::AddInstance(NDSArgs&& args, const std::string& romname)
+{
+    auto nds = std::make_unique<melonDS::NDS>(std::move(args));
+
+    nds->Reset();
+    if (nds->CartInserted() && nds->NeedsDirectBoot())
+        nds->SetupDirectBoot(romname);
+    nds->Start();
+
+    return AddInstance(std::move(nds));
+}
+
+int HeadlessRunner::AddInstance(std::unique_ptr<melonDS::NDS>&& nds)
+{
+    auto inst = std::make_unique<Instance>();
+    inst->NDS = std::move(nds);
+    for (int i = 0; i < 2; i++)
+    {
+        inst->Framebuffer[i] = std::make_unique<u32[]>(ScreenWidth * ScreenHeight);
+        memset(inst->Framebuffer[i].get(), 0, ScreenWidth * ScreenHeight * sizeof(u32));
+    }
+
+    std::lock_guard<std::mutex> lock(Lock);
+    Instances.push_back(std::move(inst));
+    return (int)Instances.size() - 1;
+}
+
+void HeadlessRunner::RunFrames(u32 frames)
+{
+    std::unique_lock<std::mutex> lock(Lock);
+
+    // the workers go through their own list, so that consoles can be
+    // added while they're running without moving any under them
+    Batch.clear();
+    for (auto& inst : Instances)
+        Batch.push_back(inst.get());
+
+    FramesToRun = frames;
+    Remaining = (int)Batch.size();
+    NextInstance = 0;
+    Generation++;
+    WorkReady.notify_all();
+
+    // also wait for every worker to go back to sleep, so that none of them
+    // can pick up an instance of the next batch with a stale frame count
+    WorkDone.wait(lock, [this] { return Remaining == 0 && Busy == 0; });
+}
+
+void HeadlessRunner::RunInstance(Instance& inst, u32 frames)
+{
+    melonDS::NDS& nds = *inst.NDS;
+    inst.Audio.clear();
+
+    for (u32 i = 0; i < frames && nds.IsRunning(); i++)
+    {
+        nds.RunFrame();
+        inst.NumFrames++;
+
+        int pending = nds.SPU.GetOutputSize();
+        if (pending > 0)
+        {
+            size_t pos = inst.Audio.size();
+            inst.Audio.resize(pos + pending*2);
+            int got = nds.SPU.ReadOutput(&inst.Audio[pos], pending);
+            inst.Audio.resize(pos + got*2);
+        }
+    }
+
+    int front = nds.GPU.FrontBuffer;
+    for (int i = 0; i < 2; i++)
+    {
+        if (nds.GPU.Framebuffer[front][i])
+            memcpy(inst.Framebuffer[i].get(), nds.GPU.Framebuffer[front][i].get(), ScreenWidth * ScreenHeight * sizeof(u32));
+    }
+}
+
+void HeadlessRunner::WorkerFunc()
+{
+    u32 lastgen = 0;
+
+    for (;;)
+    {
+        u32 frames;
+        int count;
+        {
+            std::unique_lock<std::mutex> lock(Lock);
+            WorkReady.wait(lock, [&] { return Exiting || Generation != lastgen; });
+            if (Exiting)
+                return;
+
+            lastgen = Generation;
+            frames = FramesToRun;
+            count = (int)Batch.size();
+            Busy++;
+        }
+
+        int done = 0;
+        for (;;)
+        {
+            int idx = NextInstance.fetch_add(1);
+            if (idx >= count)
+                break;
+
+            RunInstance(*Batch[idx], frames);
+            done++;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(Lock);
+            Remaining -= done;
+            Busy--;
+            if (Remaining == 0 && Busy == 0)
+                WorkDone.notify_all();
+        }
+    }
+}
+
+}
@@ -0,0 +1,122 @@
+/*
+    Copyright 2016-2023 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef HEADLESSRUNNER_H
+#define HEADLESSRUNNER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "types.h"
+
+namespace melonDS
+{
+class NDS;
+struct NDSArgs;
+
+/// Steps any number of emulated consoles on a pool of worker threads,
+/// with no frame limiter and no frontend attached.
+///
+/// Each console is only ever touched by one worker at a time,
+/// so consoles don't need to know about each other.
+/// Output of the last emulated frame of each console is kept
+/// as plain buffers that can be read between calls to \c RunFrames.
+class HeadlessRunner
+{
+public:
+    static constexpr int ScreenWidth = 256;
+    static constexpr int ScreenHeight = 192;
+
+    struct Instance
+    {
+        std::unique_ptr<melonDS::NDS> NDS;
+
+        /// Top and bottom screen of the last emulated frame, 256x192 each.
+        std::unique_ptr<u32[]> Framebuffer[2];
+
+        /// Interleaved stereo samples output during the last \c RunFrames call.
+        std::vector<s16> Audio;
+
+        u32 NumFrames = 0;
+    };
+
+    /// @param numthreads Number of worker threads to use.
+    /// 0 means one worker per hardware thread.
+    explicit HeadlessRunner(unsigned numthreads = 0);
+    ~HeadlessRunner();
+    HeadlessRunner(const HeadlessRunner&) = delete;
+    HeadlessRunner& operator=(const HeadlessRunner&) = delete;
+
+    /// Creates a new console from \c args, resets it and starts it.
+    /// If a cart is inserted and the console can't boot it from firmware,
+    /// it is booted directly, with \c romname passed as its argv.
+    /// @return The index of the new console.
+    int AddInstance(NDSArgs&& args, const std::string& romname = "");
+
+    /// Takes over an already configured console.
+    /// The console is expected to be reset and started by the caller.
+    /// Consoles added while \c RunFrames is running are first run by
+    /// the next call.
+    /// @return The index of the new console.
+    int AddInstance(std::unique_ptr<melonDS::NDS>&& nds);
+
+    /// Runs \c frames frames on every console that is still running,
+    /// and returns once all of them are done.
+    void RunFrames(u32 frames);
+
+    [[nodiscard]] int GetNumInstances() const noexcept { return (int)Instances.size(); }
+    [[nodiscard]] unsigned GetNumThreads() const noexcept { return (unsigned)Workers.size(); }
+
+    [[nodiscard]] melonDS::NDS& GetNDS(int inst) noexcept { return *Instances[inst]->NDS; }
+    [[nodiscard]] const Instance& GetInstance(int inst) const noexcept { return *Instances[inst]; }
+
+    [[nodiscard]] const u32* GetFramebuffer(int inst, int screen) const noexcept
+    {
+        return Instances[inst]->Framebuffer[screen].get();
+    }
+
+    [[nodiscard]] const std::vector<s16>& GetAudio(int inst) const noexcept { return Instances[inst]->Audio; }
+
+private:
+    void WorkerFunc();
+    void RunInstance(Instance& inst, u32 frames);
+
+    std::vector<std::unique_ptr<Instance>> Instances;
+    // the consoles being run by the current RunFrames call
+    std::vector<Instance*> Batch;
+    std::vector<std::thread> Workers;
+
+    std::mutex Lock;
+    std::condition_variable WorkReady;
+    std::condition_variable WorkDone;
+    u32 Generation = 0;
+    u32 FramesToRun = 0;
+    int Remaining = 0;
+    int Busy = 0;
+    bool Exiting = false;
+    std::atomic<int> NextInstance = 0;
+};
+
+}
+
+#endif // HEADLESSRUNNER_H
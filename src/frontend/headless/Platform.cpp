@@ -0,0 +1,501 @@
+/*
+    Copyright 2016-2023 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+// Platform implementation for the headless runner.
+// There is no UI, no config file, no network and no camera here:
+// everything the core asks for is either served from plain stdio
+// or stubbed out, so that many consoles can share one process.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#include "Platform.h"
+#include "SPI_Firmware.h"
+
+#ifdef __WIN32__
+#define fseek _fseeki64
+#define ftell _ftelli64
+#endif // __WIN32__
+
+namespace melonDS::Platform
+{
+
+static std::atomic<int> LogThreshold = LogLevel::Info;
+
+void Init(int argc, char** argv)
+{
+    if (getenv("MELONDS_HEADLESS_DEBUG"))
+        LogThreshold = LogLevel::Debug;
+}
+
+void DeInit()
+{
+}
+
+void SignalStop(StopReason reason)
+{
+    // the runner polls NDS::IsRunning() after every frame, nothing to do here
+    if (reason == StopReason::GBAModeNotSupported)
+        Log(LogLevel::Error, "!! GBA MODE NOT SUPPORTED\n");
+}
+
+
+int InstanceID()
+{
+    return 0;
+}
+
+std::string InstanceFileSuffix()
+{
+    return "";
+}
+
+constexpr char AccessMode(FileMode mode, bool file_exists)
+{
+    if (mode & FileMode::Append)
+        return  'a';
+
+    if (!(mode & FileMode::Write))
+        return 'r';
+
+    if (mode & (FileMode::NoCreate))
+        return 'r';
+
+    if ((mode & FileMode::Preserve) && file_exists)
+        return 'r';
+
+    return 'w';
+}
+
+constexpr bool IsExtended(FileMode mode)
+{
+    return (mode & FileMode::ReadWrite) == FileMode::ReadWrite;
+}
+
+static std::string GetModeString(FileMode mode, bool file_exists)
+{
+    std::string modeString;
+
+    modeString += AccessMode(mode, file_exists);
+
+    if (IsExtended(mode))
+        modeString += '+';
+
+    if (!(mode & FileMode::Text))
+        modeString += 'b';
+
+    return modeString;
+}
+
+static bool RawFileExists(const std::string& path)
+{
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    fclose(f);
+    return true;
+}
+
+FileHandle* OpenFile(const std::string& path, FileMode mode)
+{
+    if ((mode & (FileMode::ReadWrite | FileMode::Append)) == FileMode::None)
+    {
+        Log(LogLevel::Error, "Attempted to open \"%s\" in neither read nor write mode (FileMode 0x%x)\n", path.c_str(), mode);
+        return nullptr;
+    }
+
+    bool exists = RawFileExists(path);
+    if ((mode & FileMode::NoCreate) && !exists)
+        return nullptr;
+
+    std::string modeString = GetModeString(mode, exists);
+    FILE* file = fopen(path.c_str(), modeString.c_str());
+    if (file)
+    {
+        Log(LogLevel::Debug, "Opened \"%s\" with FileMode 0x%x (effective mode \"%s\")\n", path.c_str(), mode, modeString.c_str());
+        return reinterpret_cast<FileHandle *>(file);
+    }
+    else
+    {
+        Log(LogLevel::Debug, "Failed to open \"%s\" with FileMode 0x%x (effective mode \"%s\")\n", path.c_str(), mode, modeString.c_str());
+        return nullptr;
+    }
+}
+
+FileHandle* OpenLocalFile(const std::string& path, FileMode mode)
+{
+    // local files are looked up relative to the working directory
+    return OpenFile(path, mode);
+}
+
+bool CloseFile(FileHandle* file)
+{
+    return fclose(reinterpret_cast<FILE *>(file)) == 0;
+}
+
+bool IsEndOfFile(FileHandle* file)
+{
+    return feof(reinterpret_cast<FILE *>(file)) != 0;
+}
+
+bool FileReadLine(char* str, int count, FileHandle* file)
+{
+    return fgets(str, count, reinterpret_cast<FILE *>(file)) != nullptr;
+}
+
+bool FileExists(const std::string& name)
+{
+    return RawFileExists(name);
+}
+
+bool LocalFileExists(const std::string& name)
+{
+    return RawFileExists(name);
+}
+
+bool CheckFileWritable(const std::string& filepath)
+{
+    FileHandle* file = OpenFile(filepath, FileMode::Append);
+    if (!file) return false;
+    CloseFile(file);
+    return true;
+}
+
+bool CheckLocalFileWritable(const std::string& name)
+{
+    return CheckFileWritable(name);
+}
+
+bool FileSeek(FileHandle* file, s64 offset, FileSeekOrigin origin)
+{
+    int stdorigin = SEEK_SET;
+    switch (origin)
+    {
+        case FileSeekOrigin::Start: stdorigin = SEEK_SET; break;
+        case FileSeekOrigin::Current: stdorigin = SEEK_CUR; break;
+        case FileSeekOrigin::End: stdorigin = SEEK_END; break;
+    }
+
+    return fseek(reinterpret_cast<FILE *>(file), offset, stdorigin) == 0;
+}
+
+void FileRewind(FileHandle* file)
+{
+    rewind(reinterpret_cast<FILE *>(file));
+}
+
+u64 FileRead(void* data, u64 size, u64 count, FileHandle* file)
+{
+    return fread(data, size, count, reinterpret_cast<FILE *>(file));
+}
+
+bool FileFlush(FileHandle* file)
+{
+    return fflush(reinterpret_cast<FILE *>(file)) == 0;
+}
+
+u64 FileWrite(const void* data, u64 size, u64 count, FileHandle* file)
+{
+    return fwrite(data, size, count, reinterpret_cast<FILE *>(file));
+}
+
+u64 FileWriteFormatted(FileHandle* file, const char* fmt, ...)
+{
+    if (fmt == nullptr)
+        return 0;
+
+    va_list args;
+    va_start(args, fmt);
+    u64 ret = vfprintf(reinterpret_cast<FILE *>(file), fmt, args);
+    va_end(args);
+    return ret;
+}
+
+u64 FileLength(FileHandle* file)
+{
+    FILE* stdfile = reinterpret_cast<FILE *>(file);
+    long pos = ftell(stdfile);
+    fseek(stdfile, 0, SEEK_END);
+    long len = ftell(stdfile);
+    fseek(stdfile, pos, SEEK_SET);
+    return len;
+}
+
+void Log(LogLevel level, const char* fmt, ...)
+{
+    if (fmt == nullptr || level < LogThreshold)
+        return;
+
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+}
+
+struct Thread
+{
+    std::thread Handle;
+};
+
+Thread* Thread_Create(std::function<void()> func)
+{
+    return new Thread {std::thread(std::move(func))};
+}
+
+void Thread_Free(Thread* thread)
+{
+    // std::thread can't be killed, the core always waits before freeing
+    if (thread->Handle.joinable())
+        thread->Handle.detach();
+    delete thread;
+}
+
+void Thread_Wait(Thread* thread)
+{
+    if (thread->Handle.joinable())
+        thread->Handle.join();
+}
+
+struct Semaphore
+{
+    std::mutex Lock;
+    std::condition_variable Cond;
+    int Count = 0;
+};
+
+Semaphore* Semaphore_Create()
+{
+    return new Semaphore;
+}
+
+void Semaphore_Free(Semaphore* sema)
+{
+    delete sema;
+}
+
+void Semaphore_Reset(Semaphore* sema)
+{
+    std::lock_guard<std::mutex> lock(sema->Lock);
+    sema->Count = 0;
+}
+
+void Semaphore_Wait(Semaphore* sema)
+{
+    std::unique_lock<std::mutex> lock(sema->Lock);
+    sema->Cond.wait(lock, [sema] { return sema->Count > 0; });
+    sema->Count--;
+}
+
+void Semaphore_Post(Semaphore* sema, int count)
+{
+    {
+        std::lock_guard<std::mutex> lock(sema->Lock);
+        sema->Count += count;
+    }
+    sema->Cond.notify_all();
+}
+
+struct Mutex
+{
+    std::mutex Handle;
+};
+
+Mutex* Mutex_Create()
+{
+    return new Mutex;
+}
+
+void Mutex_Free(Mutex* mutex)
+{
+    delete mutex;
+}
+
+void Mutex_Lock(Mutex* mutex)
+{
+    mutex->Handle.lock();
+}
+
+void Mutex_Unlock(Mutex* mutex)
+{
+    mutex->Handle.unlock();
+}
+
+bool Mutex_TryLock(Mutex* mutex)
+{
+    return mutex->Handle.try_lock();
+}
+
+void Sleep(u64 usecs)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(usecs));
+}
+
+
+// save data lives in memory only; batch runs start from the supplied save every time
+
+void WriteNDSSave(const u8* savedata, u32 savelen, u32 writeoffset, u32 writelen)
+{
+}
+
+void WriteGBASave(const u8* savedata, u32 savelen, u32 writeoffset, u32 writelen)
+{
+}
+
+void WriteFirmware(const Firmware& firmware, u32 writeoffset, u32 writelen)
+{
+}
+
+void WriteDateTime(int year, int month, int day, int hour, int minute, int second)
+{
+}
+
+bool MP_Init()
+{
+    return false;
+}
+
+void MP_DeInit()
+{
+}
+
+void MP_Begin()
+{
+}
+
+void MP_End()
+{
+}
+
+int MP_SendPacket(u8* data, int len, u64 timestamp)
+{
+    return 0;
+}
+
+int MP_RecvPacket(u8* data, u64* timestamp)
+{
+    return 0;
+}
+
+int MP_SendCmd(u8* data, int len, u64 timestamp)
+{
+    return 0;
+}
+
+int MP_SendReply(u8* data, int len, u64 timestamp, u16 aid)
+{
+    return 0;
+}
+
+int MP_SendAck(u8* data, int len, u64 timestamp)
+{
+    return 0;
+}
+
+int MP_RecvHostPacket(u8* data, u64* timestamp)
+{
+    return 0;
+}
+
+u16 MP_RecvReplies(u8* data, u64 timestamp, u16 aidmask)
+{
+    return 0;
+}
+
+bool LAN_Init()
+{
+    return false;
+}
+
+void LAN_DeInit()
+{
+}
+
+int LAN_SendPacket(u8* data, int len)
+{
+    return 0;
+}
+
+int LAN_RecvPacket(u8* data)
+{
+    return 0;
+}
+
+
+void Camera_Start(int num)
+{
+}
+
+void Camera_Stop(int num)
+{
+}
+
+void Camera_CaptureFrame(int num, u32* frame, int width, int height, bool yuv)
+{
+    // feed a black frame
+    if (yuv)
+    {
+        // YUYV, two pixels per word
+        for (int i = 0; i < (width * height) / 2; i++)
+            frame[i] = 0x80008000;
+    }
+    else
+        memset(frame, 0, width * height * sizeof(u32));
+}
+
+DynamicLibrary* DynamicLibrary_Load(const char* lib)
+{
+#ifdef _WIN32
+    return (DynamicLibrary*) LoadLibraryA(lib);
+#else
+    return (DynamicLibrary*) dlopen(lib, RTLD_NOW | RTLD_LOCAL);
+#endif
+}
+
+void DynamicLibrary_Unload(DynamicLibrary* lib)
+{
+#ifdef _WIN32
+    FreeLibrary((HMODULE) lib);
+#else
+    dlclose(lib);
+#endif
+}
+
+void* DynamicLibrary_LoadFunction(DynamicLibrary* lib, const char* name)
+{
+#ifdef _WIN32
+    return (void*) GetProcAddress((HMODULE) lib, name);
+#else
+    return dlsym(lib, name);
+#endif
+}
+
+}
@@ -0,0 +1,246 @@
+/*
+    Copyright 2016-2023 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+// Microbenchmark for the event scheduler.
+//
+// Replays the pattern of NDS::RunFrame's inner loop (look up the next
+// deadline, advance to it or by at most kMaxIterationCycles, run what's due)
+// once with the linear SchedList scan the scheduler used to do, and once
+// with EventQueue, and reports how many loop iterations and events per
+// second each manages. Event handlers only rearm themselves, so only the
+// bookkeeping of the scheduler is measured.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "EventQueue.h"
+#include "NDS.h"
+
+using namespace melonDS;
+
+// same as in NDS.cpp
+const s32 kMaxIterationCycles = 64;
+const s32 kIterationCycleMargin = 8;
+
+struct BenchEvent
+{
+    u64 Timestamp;
+    u32 Period;
+};
+
+// the scheduler as it was before EventQueue
+struct LinearScheduler
+{
+    BenchEvent Events[Event_MAX] {};
+    u32 Mask = 0;
+
+    void Schedule(u32 id, u64 timestamp)
+    {
+        Events[id].Timestamp = timestamp;
+        Mask |= (1<<id);
+    }
+
+    u64 NextTarget(u64 now)
+    {
+        u64 minEvent = UINT64_MAX;
+
+        u32 mask = Mask;
+        for (int i = 0; i < Event_MAX; i++)
+        {
+            if (!mask) break;
+            if (mask & 0x1)
+            {
+                if (Events[i].Timestamp < minEvent)
+                    minEvent = Events[i].Timestamp;
+            }
+
+            mask >>= 1;
+        }
+
+        u64 max = now + kMaxIterationCycles;
+        if (minEvent < max + kIterationCycleMargin)
+            return minEvent;
+        return max;
+    }
+
+    u32 RunSystem(u64 now)
+    {
+        u32 ran = 0;
+        u32 mask = Mask;
+        for (int i = 0; i < Event_MAX; i++)
+        {
+            if (!mask) break;
+            if (mask & 0x1)
+            {
+                if (Events[i].Timestamp <= now)
+                {
+                    Mask &= ~(1<<i);
+                    Schedule(i, Events[i].Timestamp + Events[i].Period);
+                    ran++;
+                }
+            }
+
+            mask >>= 1;
+        }
+        return ran;
+    }
+};
+
+// the scheduler as it is now
+struct QueueScheduler
+{
+    BenchEvent Events[Event_MAX] {};
+    u32 Mask = 0;
+    EventQueue<Event_MAX> Queue;
+
+    void Schedule(u32 id, u64 timestamp)
+    {
+        Events[id].Timestamp = timestamp;
+        Mask |= (1<<id);
+        Queue.Push(id, timestamp);
+    }
+
+    u64 NextTarget(u64 now)
+    {
+        u64 minEvent = Queue.NextTimestamp();
+
+        u64 max = now + kMaxIterationCycles;
+        if (minEvent < max + kIterationCycleMargin)
+            return minEvent;
+        return max;
+    }
+
+    u32 RunSystem(u64 now)
+    {
+        u32 ran = 0;
+        u32 mask = Queue.PopDue(now);
+        while (mask)
+        {
+            int i = __builtin_ctz(mask);
+            mask &= mask - 1;
+
+            if (Events[i].Timestamp <= now)
+            {
+                Mask &= ~(1<<i);
+                Queue.Remove(i);
+                Schedule(i, Events[i].Timestamp + Events[i].Period);
+                ran++;
+            }
+        }
+        return ran;
+    }
+};
+
+struct Scenario
+{
+    const char* Name;
+    u32 NumEvents;
+};
+
+// periods in system cycles, roughly what the corresponding events use
+static const u32 EventPeriods[Event_MAX] =
+{
+    1606, // LCD, half a scanline
+    1024, // SPU
+    2048, // Wifi
+    32768, // RTC
+    384, // display FIFO
+    1200, // ROM transfer
+    600, // ROM SPI transfer
+    512, // SPI transfer
+    34, // div
+    13, // sqrt
+    800, // SDMMC
+    900, // SDIO
+    1500, // NWifi
+    4000, // camera IRQ
+    700, // camera transfer
+    250, // DSP
+};
+
+template <typename Scheduler>
+static double RunBench(u32 numevents, u64 cycles, u64& iterations, u64& events)
+{
+    Scheduler sched;
+    for (u32 i = 0; i < numevents; i++)
+    {
+        sched.Events[i].Period = EventPeriods[i];
+        sched.Schedule(i, EventPeriods[i] + i);
+    }
+
+    iterations = 0;
+    events = 0;
+    u64 now = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    while (now < cycles)
+    {
+        u64 target = sched.NextTarget(now);
+        // the CPUs usually overshoot the target by a few cycles
+        now = target + (iterations & 0x3);
+        events += sched.RunSystem(now);
+        iterations++;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    // one emulated second by default
+    u64 cycles = 33513982;
+    if (argc > 1)
+        cycles = strtoull(argv[1], nullptr, 0);
+
+    const Scenario scenarios[] =
+    {
+        {"DS (LCD, SPU, Wifi, RTC)", 4},
+        {"DS, busy (+FIFO, cart, SPI, div, sqrt)", Event_DSi_SDMMCTransfer},
+        {"DSi, all events", Event_MAX},
+    };
+
+    printf("%llu emulated cycles per run\n", (unsigned long long)cycles);
+    printf("%-42s %-8s %14s %14s %10s\n", "scenario", "sched", "iterations/s", "events/s", "speedup");
+
+    for (const Scenario& scenario : scenarios)
+    {
+        u64 iterLinear, evtLinear, iterQueue, evtQueue;
+        double timeLinear = RunBench<LinearScheduler>(scenario.NumEvents, cycles, iterLinear, evtLinear);
+        double timeQueue = RunBench<QueueScheduler>(scenario.NumEvents, cycles, iterQueue, evtQueue);
+
+        if (iterLinear != iterQueue || evtLinear != evtQueue)
+        {
+            fprintf(stderr, "%s: schedulers disagree (%llu/%llu iterations, %llu/%llu events)\n",
+                scenario.Name,
+                (unsigned long long)iterLinear, (unsigned long long)iterQueue,
+                (unsigned long long)evtLinear, (unsigned long long)evtQueue);
+            return 1;
+        }
+
+        printf("%-42s %-8s %14.0f %14.0f\n", scenario.Name, "linear",
+            iterLinear / timeLinear, evtLinear / timeLinear);
+        printf("%-42s %-8s %14.0f %14.0f %9.2fx\n", "", "queue",
+            iterQueue / timeQueue, evtQueue / timeQueue, timeLinear / timeQueue);
+    }
+
+    return 0;
+}
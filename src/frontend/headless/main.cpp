@@ -0,0 +1,283 @@
+/*
+    Copyright 2016-2023 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+
+#include "HeadlessRunner.h"
+#include "Args.h"
+#include "CRC32.h"
+#include "GPU2D_Soft.h"
+#include "GPU3D_Soft.h"
+#include "NDS.h"
+#include "NDSCart.h"
+#include "Platform.h"
+#include "Savestate.h"
+
+using namespace melonDS;
+
+static void PrintUsage(const char* argv0)
+{
+    printf("usage: %s [options] [rom.nds]\n", argv0);
+    printf("  -n, --instances N   number of consoles to run (default 1)\n");
+    printf("  -t, --threads N     number of worker threads (default: one per hardware thread)\n");
+    printf("  -f, --frames N      number of frames to run (default 600)\n");
+    printf("  -i, --interpreter   disable the JIT recompiler\n");
+    printf("  -a, --async-jit     compile JIT blocks on a separate thread (not deterministic)\n");
+    printf("  -C, --cached-interp decode blocks like the JIT, but interpret them instead\n");
+    printf("                      of generating code\n");
+    printf("  -I, --no-idle-skip  run through ARM7 idle loops in the interpreter\n");
+    printf("  -m, --no-audio      don't generate any audio, only keep the sound hardware's\n");
+    printf("                      state the console can observe\n");
+    printf("  -b, --3d-workers N  extra threads rasterizing each 3D frame (default 0)\n");
+    printf("  -k, --span-kernel K SIMD kernel for the 3D renderer: scalar, sse4.1, avx2, neon\n");
+    printf("                      (default: the fastest one supported)\n");
+    printf("  -2, --threaded-2d   draw the sub screen's 2D engine on its own thread\n");
+    printf("  -c, --jit-cache D   load the first console's JIT blocks from a file in D\n");
+    printf("                      named after the ROM if it exists, and save them there\n");
+    printf("                      afterwards\n");
+}
+
+static std::unique_ptr<u8[]> LoadFile(const std::string& path, u32& len)
+{
+    Platform::FileHandle* f = Platform::OpenFile(path, Platform::FileMode::Read);
+    if (!f)
+        return nullptr;
+
+    len = (u32)Platform::FileLength(f);
+    auto data = std::make_unique<u8[]>(len);
+    Platform::FileRewind(f);
+    u64 got = Platform::FileRead(data.get(), len, 1, f);
+    Platform::CloseFile(f);
+
+    if (got != 1)
+        return nullptr;
+    return data;
+}
+
+// each ROM gets its own code cache, told apart by its game code
+// and header CRC, so that a directory can hold the caches of many
+static std::string GetJITCachePath(const std::string& dir, NDS& nds)
+{
+    char name[32];
+    if (NDSCart::CartCommon* cart = nds.NDSCartSlot.GetCart())
+    {
+        const NDSHeader& header = cart->GetHeader();
+        char gamecode[5];
+        for (int i = 0; i < 4; i++)
+            gamecode[i] = isalnum((u8)header.GameCode[i]) ? header.GameCode[i] : '_';
+        gamecode[4] = '\0';
+        snprintf(name, sizeof(name), "%s-%04X.jitcache", gamecode, header.HeaderCRC16);
+    }
+    else
+        snprintf(name, sizeof(name), "firmware.jitcache");
+
+    return dir + "/" + name;
+}
+
+int main(int argc, char** argv)
+{
+    int numinstances = 1;
+    unsigned numthreads = 0;
+    u32 numframes = 600;
+    bool usejit = true;
+    bool asyncjit = false;
+    bool cachedinterp = false;
+    bool idleskip = true;
+    bool audio = true;
+    int bandworkers = 0;
+    bool threaded2d = false;
+    SpanKernel spankernel = GetBestSpanKernel();
+    std::string rompath;
+    std::string jitcachedir;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        bool hasnext = (i+1) < argc;
+
+        if ((!strcmp(arg, "-n") || !strcmp(arg, "--instances")) && hasnext)
+            numinstances = atoi(argv[++i]);
+        else if ((!strcmp(arg, "-t") || !strcmp(arg, "--threads")) && hasnext)
+            numthreads = atoi(argv[++i]);
+        else if ((!strcmp(arg, "-f") || !strcmp(arg, "--frames")) && hasnext)
+            numframes = atoi(argv[++i]);
+        else if (!strcmp(arg, "-i") || !strcmp(arg, "--interpreter"))
+            usejit = false;
+        else if (!strcmp(arg, "-a") || !strcmp(arg, "--async-jit"))
+            asyncjit = true;
+        else if (!strcmp(arg, "-C") || !strcmp(arg, "--cached-interp"))
+            cachedinterp = true;
+        else if (!strcmp(arg, "-I") || !strcmp(arg, "--no-idle-skip"))
+            idleskip = false;
+        else if (!strcmp(arg, "-m") || !strcmp(arg, "--no-audio"))
+            audio = false;
+        else if ((!strcmp(arg, "-b") || !strcmp(arg, "--3d-workers")) && hasnext)
+            bandworkers = atoi(argv[++i]);
+        else if (!strcmp(arg, "-2") || !strcmp(arg, "--threaded-2d"))
+            threaded2d = true;
+        else if ((!strcmp(arg, "-c") || !strcmp(arg, "--jit-cache")) && hasnext)
+            jitcachedir = argv[++i];
+        else if ((!strcmp(arg, "-k") || !strcmp(arg, "--span-kernel")) && hasnext)
+        {
+            const char* name = argv[++i];
+            bool found = false;
+            for (SpanKernel kernel : {SpanKernel::Scalar, SpanKernel::SSE41, SpanKernel::AVX2, SpanKernel::NEON})
+            {
+                if (!strcmp(name, GetSpanKernelName(kernel)))
+                {
+                    spankernel = kernel;
+                    found = true;
+                }
+            }
+
+            if (!found || !IsSpanKernelSupported(spankernel))
+            {
+                fprintf(stderr, "span kernel %s is not supported\n", name);
+                return 1;
+            }
+        }
+        else if (arg[0] == '-')
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+        else
+            rompath = arg;
+    }
+
+    if (numinstances < 1)
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    Platform::Init(argc, argv);
+
+    std::unique_ptr<u8[]> romdata;
+    u32 romlen = 0;
+    if (!rompath.empty())
+    {
+        romdata = LoadFile(rompath, romlen);
+        if (!romdata)
+        {
+            fprintf(stderr, "failed to load ROM %s\n", rompath.c_str());
+            Platform::DeInit();
+            return 1;
+        }
+    }
+
+    {
+        HeadlessRunner runner(numthreads);
+
+        for (int i = 0; i < numinstances; i++)
+        {
+            NDSArgs args {};
+            if (!usejit)
+                args.JIT = std::nullopt;
+            else
+            {
+                args.JIT->AsyncCompile = asyncjit;
+                args.JIT->CachedInterpreter = cachedinterp;
+            }
+            auto renderer = std::make_unique<SoftRenderer>(false, bandworkers);
+            renderer->SetSpanKernel(spankernel);
+            args.Renderer3D = std::move(renderer);
+
+            if (romdata)
+            {
+                args.NDSROM = NDSCart::ParseROM(romdata.get(), romlen);
+                if (!args.NDSROM)
+                {
+                    fprintf(stderr, "failed to parse ROM %s\n", rompath.c_str());
+                    Platform::DeInit();
+                    return 1;
+                }
+            }
+
+            int inst = runner.AddInstance(std::move(args), rompath);
+            runner.GetNDS(inst).ARM7.SetIdleLoopSkip(idleskip);
+            runner.GetNDS(inst).SPU.SetOutputEnabled(audio);
+            if (threaded2d)
+            {
+                auto& renderer2d = static_cast<GPU2D::SoftRenderer&>(runner.GetNDS(inst).GPU.GetRenderer2D());
+                renderer2d.SetThreaded(true);
+            }
+        }
+
+        // only the first console gets the code memory the code cache can be used with
+        NDS& firstnds = runner.GetNDS(0);
+        std::string jitcachepath;
+        if (!jitcachedir.empty())
+            jitcachepath = GetJITCachePath(jitcachedir, firstnds);
+        if (usejit && !jitcachepath.empty() && Platform::FileExists(jitcachepath))
+        {
+            u32 len = 0;
+            std::unique_ptr<u8[]> data = LoadFile(jitcachepath, len);
+            Savestate cache(data.get(), len, false);
+            if (!data || cache.Error || !firstnds.JIT.DoCodeCache(&cache))
+                printf("couldn't use JIT code cache %s\n", jitcachepath.c_str());
+        }
+
+        printf("running %d console(s) for %u frames on %u thread(s)\n",
+            runner.GetNumInstances(), numframes, runner.GetNumThreads());
+
+        auto start = std::chrono::steady_clock::now();
+        runner.RunFrames(numframes);
+        auto end = std::chrono::steady_clock::now();
+
+        double secs = std::chrono::duration<double>(end - start).count();
+        u64 totalframes = 0;
+        for (int i = 0; i < runner.GetNumInstances(); i++)
+        {
+            const HeadlessRunner::Instance& inst = runner.GetInstance(i);
+            totalframes += inst.NumFrames;
+
+            u32 crc = CRC32((const u8*)runner.GetFramebuffer(i, 0), HeadlessRunner::ScreenWidth * HeadlessRunner::ScreenHeight * 4);
+            crc = CRC32((const u8*)runner.GetFramebuffer(i, 1), HeadlessRunner::ScreenWidth * HeadlessRunner::ScreenHeight * 4, crc);
+
+            printf("console %d: %u frames, %zu audio samples, framebuffer CRC %08X%s\n",
+                i, inst.NumFrames, inst.Audio.size() / 2, crc,
+                inst.NDS->IsRunning() ? "" : " (stopped)");
+        }
+
+        printf("%.3f s, %.1f frames/s total, %.1f frames/s per console\n",
+            secs, totalframes / secs, totalframes / secs / runner.GetNumInstances());
+
+        if (usejit && !jitcachepath.empty())
+        {
+            Savestate cache(1024 * 1024);
+            bool saved = firstnds.JIT.DoCodeCache(&cache);
+            cache.Finish();
+
+            Platform::FileHandle* f = saved && !cache.Error ? Platform::OpenFile(jitcachepath, Platform::FileMode::Write) : nullptr;
+            if (!f || Platform::FileWrite(cache.Buffer(), cache.Length(), 1, f) != 1)
+                printf("couldn't save JIT code cache %s\n", jitcachepath.c_str());
+            if (f)
+                Platform::CloseFile(f);
+        }
+    }
+
+    Platform::DeInit();
+    return 0;
+}
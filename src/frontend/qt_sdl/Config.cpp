@@ -56,6 +56,7 @@ int ScreenVSyncInterval;
 
 int _3DRenderer;
 bool Threaded3D;
+int Threaded3DWorkers;
 
 int GL_ScaleFactor;
 bool GL_BetterPolygons;
@@ -248,6 +249,7 @@ ConfigEntry ConfigFile[] =
 
     {"3DRenderer", 0, &_3DRenderer, 0, false},
     {"Threaded3D", 1, &Threaded3D, true, false},
+    {"Threaded3DWorkers", 0, &Threaded3DWorkers, 0, false},
 
     {"GL_ScaleFactor", 0, &GL_ScaleFactor, 1, false},
     {"GL_BetterPolygons", 1, &GL_BetterPolygons, false, false},
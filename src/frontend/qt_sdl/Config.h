@@ -100,6 +100,7 @@ extern int ScreenVSyncInterval;
 
 extern int _3DRenderer;
 extern bool Threaded3D;
+extern int Threaded3DWorkers;
 
 extern int GL_ScaleFactor;
 extern bool GL_BetterPolygons;
@@ -216,10 +216,8 @@ bool EmuThread::UpdateConsole(UpdateConsoleNDSArgs&& ndsargs, UpdateConsoleGBAAr
 
     if (!NDS || NDS->ConsoleType != Config::ConsoleType)
     { // If we're switching between DS and DSi mode, or there's no console...
-        // To ensure the destructor is called before a new one is created,
-        // as the presence of global signal handlers still complicates things a bit
+        // To ensure the destructor is called before a new one is created
         NDS = nullptr;
-        NDS::Current = nullptr;
 
         NDS = CreateConsole(std::move(nextndscart), std::move(nextgbacart));
 
@@ -227,7 +225,6 @@ bool EmuThread::UpdateConsole(UpdateConsoleNDSArgs&& ndsargs, UpdateConsoleGBAAr
             return false;
 
         NDS->Reset();
-        NDS::Current = NDS.get();
 
         return true;
     }
@@ -294,8 +291,6 @@ bool EmuThread::UpdateConsole(UpdateConsoleNDSArgs&& ndsargs, UpdateConsoleGBAAr
     NDS->SPU.SetInterpolation(static_cast<AudioInterpolation>(Config::AudioInterp));
     NDS->SPU.SetDegrade10Bit(static_cast<AudioBitDepth>(Config::AudioBitDepth));
 
-    NDS::Current = NDS.get();
-
     return true;
 }
 
@@ -328,7 +323,7 @@ void EmuThread::run()
 
     if (videoRenderer == 0)
     { // If we're using the software renderer...
-        NDS->GPU.SetRenderer3D(std::make_unique<SoftRenderer>(Config::Threaded3D != 0));
+        NDS->GPU.SetRenderer3D(std::make_unique<SoftRenderer>(Config::Threaded3D != 0, Config::Threaded3DWorkers));
     }
     else
     {
@@ -457,7 +452,7 @@ void EmuThread::run()
 
                 if (videoRenderer == 0)
                 { // If we're using the software renderer...
-                    NDS->GPU.SetRenderer3D(std::make_unique<SoftRenderer>(Config::Threaded3D != 0));
+                    NDS->GPU.SetRenderer3D(std::make_unique<SoftRenderer>(Config::Threaded3D != 0, Config::Threaded3DWorkers));
                 }
                 else
                 {
@@ -671,7 +666,6 @@ void EmuThread::run()
 
     EmuStatus = emuStatus_Exit;
 
-    NDS::Current = nullptr;
     // nds is out of scope, so unique_ptr cleans it up for us
 }
 